@@ -313,6 +313,81 @@ gegl_buffer_flush (GeglBuffer *buffer)
                             GEGL_TILE_FLUSH, 0,0,0,NULL);
 }
 
+void
+gegl_buffer_prefetch (GeglBuffer          *buffer,
+                      const GeglRectangle *rect)
+{
+  GeglRectangle roi;
+  gint          tile_width;
+  gint          tile_height;
+  gint          x0, y0, x1, y1;
+  gint          x, y;
+
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (rect != NULL);
+
+  if (! gegl_rectangle_intersect (&roi, rect, &buffer->extent))
+    return;
+
+  tile_width  = buffer->tile_width;
+  tile_height = buffer->tile_height;
+
+  x0 = gegl_tile_indice (roi.x + buffer->shift_x, tile_width);
+  y0 = gegl_tile_indice (roi.y + buffer->shift_y, tile_height);
+  x1 = gegl_tile_indice (roi.x + roi.width  - 1 + buffer->shift_x, tile_width);
+  y1 = gegl_tile_indice (roi.y + roi.height - 1 + buffer->shift_y, tile_height);
+
+  /* the cache and the compressed store answer for the tiles they hold, the
+   * remaining ones are queued for reading by backends that support it. the
+   * handlers look at the backend's index, which is only stable under the
+   * storage lock
+   */
+  g_rec_mutex_lock (&buffer->tile_storage->mutex);
+
+  for (y = y0; y <= y1; y++)
+    for (x = x0; x <= x1; x++)
+      gegl_tile_source_command (GEGL_TILE_SOURCE (buffer),
+                                GEGL_TILE_PREFETCH, x, y, 0, NULL);
+
+  g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+}
+
+void
+gegl_buffer_build_pyramid (GeglBuffer          *buffer,
+                           const GeglRectangle *rect,
+                           gint                 levels)
+{
+  GeglRectangle roi;
+
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+
+  if (! rect)
+    rect = &buffer->extent;
+
+  if (! gegl_rectangle_intersect (&roi, rect, &buffer->extent))
+    return;
+
+  /* all the levels up to the one where roi fits in a single tile */
+  if (levels <= 0)
+    {
+      gint width  = roi.width;
+      gint height = roi.height;
+
+      for (levels = 0;
+           width > buffer->tile_width || height > buffer->tile_height;
+           levels++)
+        {
+          width  = (width  + 1) / 2;
+          height = (height + 1) / 2;
+        }
+    }
+
+  roi.x += buffer->shift_x;
+  roi.y += buffer->shift_y;
+
+  gegl_tile_handler_zoom_build (buffer->tile_storage->zoom, &roi, levels);
+}
+
 static inline void
 gegl_buffer_iterate_write (GeglBuffer          *buffer,
                            const GeglRectangle *roi,
@@ -612,6 +687,30 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
           tp        = ((guchar *) tile_base) + (offsety * tile_width + offsetx) * px_size;
 
           y = bufy;
+
+          /* all pixels of a uniform tile are the same, convert only one */
+          if (gegl_tile_is_uniform (tile) && bpx_size <= 128)
+            {
+              guchar pixel[128];
+
+              if (fish)
+                babl_process (fish, tile_base, pixel, 1);
+              else
+                memcpy (pixel, tile_base, px_size);
+
+              for (row = offsety;
+                   row < tile_height && y < height;
+                   row++, y++)
+                {
+                  gegl_memset_pattern (bp, pixel, bpx_size, pixels);
+                  bp += buf_stride;
+                }
+
+              gegl_tile_unref (tile);
+              bufx += (tile_width - offsetx);
+              continue;
+            }
+
           for (row = offsety;
                row < tile_height && y < height;
                row++, y++)
@@ -1993,12 +2092,27 @@ gegl_buffer_set_pattern (GeglBuffer          *buffer,
   gegl_free (pattern_data);
 }
 
+static void
+gegl_buffer_set_color_rect (GeglBuffer          *dst,
+                            const GeglRectangle *dst_rect,
+                            const gchar         *pixel,
+                            gint                 bpp)
+{
+  GeglBufferIterator *i;
+
+  i = gegl_buffer_iterator_new (dst, dst_rect, 0, dst->soft_format,
+                                GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  while (gegl_buffer_iterator_next (i))
+    {
+      gegl_memset_pattern (i->data[0], pixel, bpp, i->length);
+    }
+}
+
 void
 gegl_buffer_set_color (GeglBuffer          *dst,
                        const GeglRectangle *dst_rect,
                        GeglColor           *color)
 {
-  GeglBufferIterator *i;
   gchar               pixel[128];
   gint                bpp;
 
@@ -2017,15 +2131,96 @@ gegl_buffer_set_color (GeglBuffer          *dst,
 
   bpp = babl_format_get_bytes_per_pixel (dst->soft_format);
 
-  /* FIXME: this can be even further optimized by special casing it so
-   * that fully filled tiles are shared.
-   */
-  i = gegl_buffer_iterator_new (dst, dst_rect, 0, dst->soft_format,
-                                GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-  while (gegl_buffer_iterator_next (i))
+  if (bpp == babl_format_get_bytes_per_pixel (dst->format) &&
+      !g_object_get_data (G_OBJECT (dst), "is-linear"))
     {
-      gegl_memset_pattern (i->data[0], pixel, bpp, i->length);
+      gint          tile_width  = dst->tile_width;
+      gint          tile_height = dst->tile_height;
+      GeglRectangle tile_rect;
+      GeglRectangle clipped;
+      gint          x0, y0, x1, y1;
+
+      /* tiles outside the abyss may be shared with a parent buffer */
+      if (!gegl_rectangle_intersect (&clipped, dst_rect, &dst->abyss))
+        return;
+      dst_rect = &clipped;
+
+      /* the tiles completely covered by the rectangle */
+      x0 = gegl_tile_indice (dst_rect->x + dst->shift_x + tile_width - 1,
+                             tile_width);
+      y0 = gegl_tile_indice (dst_rect->y + dst->shift_y + tile_height - 1,
+                             tile_height);
+      x1 = gegl_tile_indice (dst_rect->x + dst_rect->width + dst->shift_x,
+                             tile_width);
+      y1 = gegl_tile_indice (dst_rect->y + dst_rect->height + dst->shift_y,
+                             tile_height);
+
+      if (x1 > x0 && y1 > y0)
+        {
+          GeglTileHandlerCache *cache = dst->tile_storage->cache;
+          GeglRectangle         rest;
+          gint                  x, y;
+
+          tile_rect.x      = x0 * tile_width  - dst->shift_x;
+          tile_rect.y      = y0 * tile_height - dst->shift_y;
+          tile_rect.width  = (x1 - x0) * tile_width;
+          tile_rect.height = (y1 - y0) * tile_height;
+
+          if (gegl_cl_is_accelerated ())
+            gegl_buffer_cl_cache_invalidate (dst, &tile_rect);
+
+          g_rec_mutex_lock (&dst->tile_storage->mutex);
+
+          _gegl_buffer_drop_hot_tile (dst);
+
+          /* fully covered tiles are replaced by uniform tiles, which share
+           * their data until written to
+           */
+          for (y = y0; y < y1; y++)
+            for (x = x0; x < x1; x++)
+              {
+                GeglTile *tile = gegl_tile_new_uniform (dst->tile_storage->tile_size,
+                                                        bpp, pixel);
+
+                tile->rev++;
+
+                gegl_tile_handler_cache_insert (cache, tile, x, y, 0);
+                gegl_tile_void_pyramid (tile);
+
+                gegl_tile_unref (tile);
+              }
+
+          g_rec_mutex_unlock (&dst->tile_storage->mutex);
+
+          gegl_buffer_emit_changed_signal (dst, &tile_rect);
+
+          /* fill the partially covered tiles around them */
+          rest = *dst_rect;
+          rest.height = tile_rect.y - dst_rect->y;
+          if (rest.height > 0)
+            gegl_buffer_set_color_rect (dst, &rest, pixel, bpp);
+
+          rest.y      = tile_rect.y + tile_rect.height;
+          rest.height = dst_rect->y + dst_rect->height - rest.y;
+          if (rest.height > 0)
+            gegl_buffer_set_color_rect (dst, &rest, pixel, bpp);
+
+          rest.y      = tile_rect.y;
+          rest.height = tile_rect.height;
+          rest.width  = tile_rect.x - dst_rect->x;
+          if (rest.width > 0)
+            gegl_buffer_set_color_rect (dst, &rest, pixel, bpp);
+
+          rest.x      = tile_rect.x + tile_rect.width;
+          rest.width  = dst_rect->x + dst_rect->width - rest.x;
+          if (rest.width > 0)
+            gegl_buffer_set_color_rect (dst, &rest, pixel, bpp);
+
+          return;
+        }
     }
+
+  gegl_buffer_set_color_rect (dst, dst_rect, pixel, bpp);
 }
 
 GeglBuffer *
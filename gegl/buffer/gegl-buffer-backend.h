@@ -46,6 +46,7 @@ typedef enum
   GEGL_TILE_FLUSH,
   GEGL_TILE_REFETCH,
   GEGL_TILE_REINIT,
+  GEGL_TILE_PREFETCH,
   GEGL_TILE_LAST_COMMAND
 } GeglTileCommand;
 
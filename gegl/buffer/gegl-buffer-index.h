@@ -9,7 +9,7 @@ GeglBuffer on disk representation
 
 
 /* Increase this number when the structures change.*/
-#define GEGL_FILE_SPEC_REV     0
+#define GEGL_FILE_SPEC_REV     2
 #define GEGL_MAGIC             {'G','E','G','L'}
 
 #define GEGL_FLAG_TILE         1
@@ -18,6 +18,9 @@ GeglBuffer on disk representation
 /* a VOID message, indicating that the specified tile has been rewritten */
 #define GEGL_FLAG_INVALIDATED  2
 
+/* a table of all the tile entries, see GeglBufferIndex */
+#define GEGL_FLAG_INDEX        4
+
 /* these flags are used for the header, the lower bits of the
  * header store the revision
  */
@@ -67,10 +70,13 @@ typedef struct {
  */
 #define gegl_buffer_header_get_rev(header)  (((GeglBufferHeader*)(header))->flags&0xff)
 
-/* The GeglBuffer index is written to the file as a linked list of
- * GeglBufferBlock's, each block encodes it's own length and the offset
- * of the file which the next block can be found. The last block in the
- * list has the next offset set to 0.
+/* In revision 0 the GeglBuffer index is written to the file as a linked
+ * list of GeglBufferBlock's, each block encodes it's own length and the
+ * offset of the file which the next block can be found. The last block in
+ * the list has the next offset set to 0.
+ *
+ * From revision 1 on the header points to a single GeglBufferIndex block
+ * instead, see below.
  */
 
 typedef struct {
@@ -97,14 +103,40 @@ typedef struct {
                             revision changes, the existing loaded index
                             can be compare the revision of tiles and update
                             own state when revision differs. */
+
+  guint32 codec;         /* how the tile data is stored, one of the
+                            GEGL_TILE_CODEC values, since revision 2 */
+  guint32 length;        /* length of the stored data of compressed tiles */
 } GeglBufferTile;
 
+/* The codecs tile data can be stored with, all but GEGL_TILE_CODEC_NONE
+ * and GEGL_TILE_CODEC_ZERO correspond to a GeglCompression.
+ */
+#define GEGL_TILE_CODEC_NONE   0 /* raw pixel data of the tile size */
+#define GEGL_TILE_CODEC_ZERO   1 /* all bytes are 0, nothing is stored */
+#define GEGL_TILE_CODEC_RLE    2
+#define GEGL_TILE_CODEC_DELTA  3
+#define GEGL_TILE_CODEC_LZ     4
+
+/* The index table is a block immediately followed by n_tiles
+ * GeglBufferTile entries sorted by z, y and x, with the next offsets of
+ * the entries set to 0. The whole index can thus be read at once and
+ * searched in place. The length of the block includes the entries.
+ */
+typedef struct {
+  GeglBufferBlock block;      /* flags are GEGL_FLAG_INDEX, next is 0    */
+  guint32         n_tiles;    /* number of entries following the block   */
+  guint32         entry_size; /* size of each entry, which differs
+                                 between revisions                       */
+} GeglBufferIndex;
+
 /* A convenience union to allow quick and simple casting */
 typedef union {
   guint32          length;
   GeglBufferBlock  block;
   GeglBufferHeader header;
   GeglBufferTile   tile;
+  GeglBufferIndex  index;
 } GeglBufferItem;
 
 /* functions to initialize data structures */
@@ -124,8 +156,35 @@ void gegl_buffer_header_init (GeglBufferHeader *header,
 
 void gegl_tile_entry_destroy (GeglBufferTile *entry);
 
+/* orders entries the way they are stored in the index table */
+gint gegl_tile_entry_compare (gconstpointer a,
+                              gconstpointer b);
+
+/* creates the index table of n_tiles entries, ready to be written to the
+ * file, its size in bytes is stored in the length of the block.
+ */
+GeglBufferIndex *gegl_buffer_index_new (GeglBufferTile **tiles,
+                                        gint             n_tiles);
+
+/* the codec id of a GeglCompression name, GEGL_TILE_CODEC_NONE if it has
+ * none
+ */
+guint32  gegl_tile_codec_from_name (const gchar          *name);
+
+/* expands the stored data of the tile of entry into data, returning FALSE
+ * if it is corrupt
+ */
+gboolean gegl_tile_entry_decode    (const GeglBufferTile *entry,
+                                    const Babl           *format,
+                                    gconstpointer         stored,
+                                    gpointer              data,
+                                    gint                  tile_size);
+
 GeglBufferItem *gegl_buffer_read_header(int      i,
                                         goffset *offset);
+/* reads any revision of the index, returning a list of newly allocated
+ * GeglBufferTile entries
+ */
 GList          *gegl_buffer_read_index (int      i,
                                         goffset *offset);
 
@@ -141,7 +200,9 @@ GList          *gegl_buffer_read_index (int      i,
     }
 #define GEGL_BUFFER_STRUCT_CHECK_PADDING \
   {struct_check_padding (GeglBufferBlock, 16);\
-  struct_check_padding (GeglBufferHeader, 256);}
+  struct_check_padding (GeglBufferHeader, 256);\
+  struct_check_padding (GeglBufferTile, 48);\
+  struct_check_padding (GeglBufferIndex, 24);}
 #define GEGL_BUFFER_SANITY {static gboolean done=FALSE;if(!done){GEGL_BUFFER_STRUCT_CHECK_PADDING;done=TRUE;}}
 
 #endif
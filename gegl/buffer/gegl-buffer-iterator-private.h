@@ -19,4 +19,13 @@
 #ifndef __GEGL_BUFFER_ITERATOR_PRIVATE_H__
 #define __GEGL_BUFFER_ITERATOR_PRIVATE_H__
 
+/* the number of tiles prefetched by iterators, of those the ones that were
+ * ready by the time they were needed, and the ones that were not
+ */
+void gegl_buffer_iterator_get_prefetch_stats (gint *issued,
+                                              gint *hidden,
+                                              gint *late);
+
+void gegl_buffer_iterator_stats              (void);
+
 #endif
@@ -33,6 +33,7 @@
 #include "gegl-buffer-private.h"
 #include "gegl-buffer-cl-cache.h"
 #include "gegl-config.h"
+#include "gegl-scheduler.h"
 
 #define GEGL_ITERATOR_INCOMPATIBLE (1 << 2)
 
@@ -72,17 +73,33 @@ typedef struct _SubIterState {
   gpointer             linear;
 } SubIterState;
 
+typedef struct _PrefetchTile {
+  gint index; /* the sub iterator */
+  gint x;
+  gint y;
+} PrefetchTile;
+
 struct _GeglBufferIteratorPriv
 {
   gint              num_buffers;
+  gboolean          quiet; /* the changed signal is emitted by the caller */
   GeglIteratorState state;
   GeglRectangle     origin_tile;
   gint              remaining_rows;
+  gint              prefetch;       /* the number of work units to prefetch */
+  gint              prefetch_ahead; /* the units prefetched ahead of roi[0] */
+  GeglRectangle     prefetch_roi;   /* the last unit prefetched */
+  GArray           *prefetched;     /* the tiles prefetched and not yet used */
   SubIterState      sub_iter[GEGL_BUFFER_MAX_ITERATORS];
 };
 
 static gboolean threaded = TRUE;
 
+/* prefetch statistics */
+static gint prefetch_issued = 0; /* tiles being read or computed ahead */
+static gint prefetch_hidden = 0; /* of those, ready by the time they were used */
+static gint prefetch_late   = 0; /* of those, still being fetched when used */
+
 GeglBufferIterator *
 gegl_buffer_iterator_empty_new (void)
 {
@@ -90,7 +107,10 @@ gegl_buffer_iterator_empty_new (void)
   iter->priv               = g_slice_new (GeglBufferIteratorPriv);
 
   iter->priv->num_buffers = 0;
+  iter->priv->quiet       = FALSE;
   iter->priv->state       = GeglIteratorState_Start;
+  iter->priv->prefetch    = 0;
+  iter->priv->prefetched  = NULL;
 
   threaded = gegl_config_threads () > 1;
 
@@ -223,14 +243,14 @@ release_tile (GeglBufferIterator *iter,
     }
 }
 
+/* the work unit of the first buffer starting at x, y */
 static void
-retile_subs (GeglBufferIterator *iter,
-             int                 x,
-             int                 y)
+unit_rect (GeglBufferIteratorPriv *priv,
+           GeglRectangle          *unit,
+           int                     x,
+           int                     y)
 {
-  GeglBufferIteratorPriv *priv = iter->priv;
   GeglRectangle real_roi;
-  int index;
 
   int shift_x = priv->origin_tile.x;
   int shift_y = priv->origin_tile.y;
@@ -245,7 +265,47 @@ retile_subs (GeglBufferIterator *iter,
   real_roi.height = priv->origin_tile.height;
 
   /* Trim tile down to the iteration roi */
-  gegl_rectangle_intersect (&iter->roi[0], &real_roi, &priv->sub_iter[0].full_rect);
+  gegl_rectangle_intersect (unit, &real_roi, &priv->sub_iter[0].full_rect);
+}
+
+/* the work unit following unit, returns FALSE past the last one */
+static gboolean
+next_unit_rect (GeglBufferIteratorPriv *priv,
+                GeglRectangle          *unit)
+{
+  SubIterState *sub = &priv->sub_iter[0];
+
+  /* Next tile in row */
+  int x = unit->x + unit->width;
+  int y = unit->y;
+
+  if (x >= sub->full_rect.x + sub->full_rect.width)
+    {
+      /* Next row */
+      x  = sub->full_rect.x;
+      y += unit->height;
+
+      if (y >= sub->full_rect.y + sub->full_rect.height)
+        {
+          /* All done */
+          return FALSE;
+        }
+    }
+
+  unit_rect (priv, unit, x, y);
+
+  return TRUE;
+}
+
+static void
+retile_subs (GeglBufferIterator *iter,
+             int                 x,
+             int                 y)
+{
+  GeglBufferIteratorPriv *priv = iter->priv;
+  int index;
+
+  unit_rect (priv, &iter->roi[0], x, y);
   priv->sub_iter[0].real_roi = iter->roi[0];
 
   for (index = 1; index < priv->num_buffers; index++)
@@ -279,28 +339,156 @@ static gboolean
 increment_rects (GeglBufferIterator *iter)
 {
   GeglBufferIteratorPriv *priv = iter->priv;
-  SubIterState           *sub  = &priv->sub_iter[0];
+  GeglRectangle           unit = iter->roi[0];
 
-  /* Next tile in row */
-  int x = iter->roi[0].x + iter->roi[0].width;
-  int y = iter->roi[0].y;
+  if (! next_unit_rect (priv, &unit))
+    return FALSE;
 
-  if (x >= sub->full_rect.x + sub->full_rect.width)
+  retile_subs (iter, unit.x, unit.y);
+
+  return TRUE;
+}
+
+/* the tiles of sub index covering the work unit, returns FALSE if there
+ * are none to fetch
+ */
+static gboolean
+unit_tiles (GeglBufferIteratorPriv *priv,
+            int                     index,
+            const GeglRectangle    *unit,
+            gint                   *x0,
+            gint                   *y0,
+            gint                   *x1,
+            gint                   *y1)
+{
+  SubIterState  *sub = &priv->sub_iter[index];
+  GeglBuffer    *buf = sub->buffer;
+  GeglRectangle  roi = *unit;
+
+  if (sub->linear_tile)
+    return FALSE;
+
+  roi.x += sub->full_rect.x - priv->sub_iter[0].full_rect.x;
+  roi.y += sub->full_rect.y - priv->sub_iter[0].full_rect.y;
+
+  /* the abyss is not read from tiles */
+  if (sub->level == 0 && ! gegl_rectangle_intersect (&roi, &roi, &buf->abyss))
+    return FALSE;
+
+  *x0 = gegl_tile_indice (roi.x + buf->shift_x, buf->tile_width);
+  *y0 = gegl_tile_indice (roi.y + buf->shift_y, buf->tile_height);
+  *x1 = gegl_tile_indice (roi.x + roi.width  - 1 + buf->shift_x, buf->tile_width);
+  *y1 = gegl_tile_indice (roi.y + roi.height - 1 + buf->shift_y, buf->tile_height);
+
+  return TRUE;
+}
+
+/* asks the tile handlers of every buffer to fetch the tiles of a work unit
+ * in the background; the swap reads them ahead, and the zoom handler
+ * computes the tiles of levels not built yet. the requests that were
+ * taken up are remembered, to tell in load_rects () whether they came in
+ * time.
+ */
+static void
+prefetch_unit (GeglBufferIteratorPriv *priv,
+               const GeglRectangle    *unit)
+{
+  int index;
+
+  for (index = 0; index < priv->num_buffers; index++)
     {
-      /* Next row */
-      x  = sub->full_rect.x;
-      y += iter->roi[0].height;
+      SubIterState *sub = &priv->sub_iter[index];
+      GeglBuffer   *buf = sub->buffer;
+      gint          x0, y0, x1, y1;
+      gint          x, y;
 
-      if (y >= sub->full_rect.y + sub->full_rect.height)
+      if (! unit_tiles (priv, index, unit, &x0, &y0, &x1, &y1))
+        continue;
+
+      /* always locked, the prefetch handlers read the backend's index */
+      g_rec_mutex_lock (&buf->tile_storage->mutex);
+
+      for (y = y0; y <= y1; y++)
+        for (x = x0; x <= x1; x++)
+          {
+            if (gegl_tile_source_command (GEGL_TILE_SOURCE (buf),
+                                          GEGL_TILE_PREFETCH,
+                                          x, y, sub->level, NULL))
+              {
+                PrefetchTile tile = {index, x, y};
+
+                g_array_append_val (priv->prefetched, tile);
+                g_atomic_int_inc (&prefetch_issued);
+              }
+          }
+
+      g_rec_mutex_unlock (&buf->tile_storage->mutex);
+    }
+}
+
+/* keeps priv->prefetch work units following roi[0] prefetched */
+static void
+prefetch_units (GeglBufferIterator *iter)
+{
+  GeglBufferIteratorPriv *priv = iter->priv;
+
+  if (! priv->prefetch)
+    return;
+
+  if (priv->prefetch_ahead > 0)
+    priv->prefetch_ahead--;
+  else
+    priv->prefetch_roi = iter->roi[0];
+
+  while (priv->prefetch_ahead < priv->prefetch &&
+         next_unit_rect (priv, &priv->prefetch_roi))
+    {
+      prefetch_unit (priv, &priv->prefetch_roi);
+      priv->prefetch_ahead++;
+    }
+}
+
+/* settles the prefetched tiles of sub index that are about to be used */
+static void
+prefetch_resolve (GeglBufferIterator *iter,
+                  int                 index)
+{
+  GeglBufferIteratorPriv *priv = iter->priv;
+  SubIterState           *sub  = &priv->sub_iter[index];
+  GeglBuffer             *buf  = sub->buffer;
+  gint                    x0, y0, x1, y1;
+  guint                   i;
+
+  if (! priv->prefetched || ! priv->prefetched->len ||
+      ! unit_tiles (priv, index, &iter->roi[0], &x0, &y0, &x1, &y1))
+    return;
+
+  for (i = 0; i < priv->prefetched->len;)
+    {
+      PrefetchTile *tile = &g_array_index (priv->prefetched, PrefetchTile, i);
+      gboolean      cached;
+
+      if (tile->index != index ||
+          tile->x < x0 || tile->x > x1 || tile->y < y0 || tile->y > y1)
         {
-          /* All done */
-          return FALSE;
+          i++;
+          continue;
         }
-    }
 
-  retile_subs (iter, x, y);
+      g_rec_mutex_lock (&buf->tile_storage->mutex);
 
-  return TRUE;
+      cached = gegl_tile_source_is_cached (GEGL_TILE_SOURCE (buf),
+                                           tile->x, tile->y, sub->level);
+
+      g_rec_mutex_unlock (&buf->tile_storage->mutex);
+
+      if (cached)
+        g_atomic_int_inc (&prefetch_hidden);
+      else
+        g_atomic_int_inc (&prefetch_late);
+
+      g_array_remove_index_fast (priv->prefetched, i);
+    }
 }
 
 static void
@@ -461,6 +649,17 @@ prepare_iteration (GeglBufferIterator *iter)
 
       gegl_buffer_lock (sub->buffer);
     }
+
+  /* the tiles of a single work unit are fetched as they are needed */
+  priv->prefetch       = gegl_config ()->iterator_prefetch;
+  priv->prefetch_ahead = 0;
+
+  if (priv->prefetch &&
+      (priv->sub_iter[0].full_rect.width  > priv->origin_tile.width ||
+       priv->sub_iter[0].full_rect.height > priv->origin_tile.height))
+    priv->prefetched = g_array_new (FALSE, FALSE, sizeof (PrefetchTile));
+  else
+    priv->prefetch = 0;
 }
 
 static void
@@ -472,6 +671,8 @@ load_rects (GeglBufferIterator *iter)
 
   for (index = 0; index < priv->num_buffers; index++)
     {
+      prefetch_resolve (iter, index);
+
       if (needs_indirect_read (iter, index))
         get_indirect (iter, index);
       else
@@ -529,10 +730,14 @@ gegl_buffer_iterator_stop (GeglBufferIterator *iter)
 
       gegl_buffer_unlock (sub->buffer);
 
-      if (sub->access_mode & GEGL_ACCESS_WRITE)
+      if ((sub->access_mode & GEGL_ACCESS_WRITE) && !priv->quiet)
         gegl_buffer_emit_changed_signal (sub->buffer, &sub->full_rect);
     }
 
+  /* tiles prefetched for units never reached are left to the cache */
+  if (priv->prefetched)
+    g_array_free (priv->prefetched, TRUE);
+
   g_slice_free (GeglBufferIteratorPriv, iter->priv);
   g_slice_free (GeglBufferIterator, iter);
 }
@@ -630,6 +835,8 @@ gegl_buffer_iterator_next (GeglBufferIterator *iter)
 
       initialize_rects (iter);
 
+      prefetch_units (iter);
+
       load_rects (iter);
 
       return TRUE;
@@ -666,6 +873,8 @@ gegl_buffer_iterator_next (GeglBufferIterator *iter)
           return FALSE;
         }
 
+      prefetch_units (iter);
+
       load_rects (iter);
 
       return TRUE;
@@ -676,3 +885,288 @@ gegl_buffer_iterator_next (GeglBufferIterator *iter)
       return FALSE;
     }
 }
+
+void
+gegl_buffer_iterator_get_prefetch_stats (gint *issued,
+                                         gint *hidden,
+                                         gint *late)
+{
+  if (issued)
+    *issued = g_atomic_int_get (&prefetch_issued);
+  if (hidden)
+    *hidden = g_atomic_int_get (&prefetch_hidden);
+  if (late)
+    *late = g_atomic_int_get (&prefetch_late);
+}
+
+void
+gegl_buffer_iterator_stats (void)
+{
+  g_warning ("Iterator prefetch: issued:%i hidden:%i late:%i",
+             g_atomic_int_get (&prefetch_issued),
+             g_atomic_int_get (&prefetch_hidden),
+             g_atomic_int_get (&prefetch_late));
+}
+
+
+/* Parallel iteration
+ *
+ * The area of the first buffer is cut into work units along its tile grid,
+ * one tile each. A work unit is iterated with an iterator of its own,
+ * copying the buffers, formats and access modes of the template iterator,
+ * by whichever participating thread claims it next. Since every buffer
+ * that is written to shares the tile grid of the first one, no two units
+ * write to the same tile.
+ */
+
+typedef struct ParallelJob
+{
+  GeglBufferIterator          *iter;  /* the template */
+  GeglRectangle                grid;  /* the tiles covering the area */
+  gint                         n_units;
+  volatile gint                next_unit;
+
+  GeglBufferIteratorFunc       func;
+  gconstpointer                scratch_init;
+  gsize                        scratch_size;
+  gpointer                     user_data;
+
+  GMutex                       mutex;
+  GSList                      *scratches;
+} ParallelJob;
+
+static gpointer
+parallel_scratch_new (ParallelJob *job)
+{
+  if (!job->scratch_size)
+    return NULL;
+
+  if (job->scratch_init)
+    return g_memdup (job->scratch_init, job->scratch_size);
+
+  return g_malloc0 (job->scratch_size);
+}
+
+static void
+parallel_iterate_unit (ParallelJob *job,
+                       gint         unit,
+                       gpointer     scratch)
+{
+  GeglBufferIteratorPriv *tpriv = job->iter->priv;
+  SubIterState           *lead  = &tpriv->sub_iter[0];
+  const GeglRectangle    *origin = &tpriv->origin_tile;
+  GeglBufferIterator     *iter;
+  GeglRectangle           tile;
+  GeglRectangle           roi;
+  gint                    columns = job->grid.width;
+  gint                    index;
+
+  tile.x      = (job->grid.x + unit % columns) * origin->width  - origin->x;
+  tile.y      = (job->grid.y + unit / columns) * origin->height - origin->y;
+  tile.width  = origin->width;
+  tile.height = origin->height;
+
+  gegl_rectangle_intersect (&roi, &tile, &lead->full_rect);
+
+  iter = gegl_buffer_iterator_empty_new ();
+  iter->priv->quiet = TRUE;
+
+  for (index = 0; index < tpriv->num_buffers; index++)
+    {
+      SubIterState *tsub = &tpriv->sub_iter[index];
+      SubIterState *sub  = &iter->priv->sub_iter[index];
+
+      /* the rectangles of the template are already scaled to the level,
+       * so the sub iterators are filled in directly
+       */
+      *sub = *tsub;
+      sub->full_rect.x      = roi.x + tsub->full_rect.x - lead->full_rect.x;
+      sub->full_rect.y      = roi.y + tsub->full_rect.y - lead->full_rect.y;
+      sub->full_rect.width  = roi.width;
+      sub->full_rect.height = roi.height;
+      sub->access_mode      = tsub->access_mode & ~GEGL_ITERATOR_INCOMPATIBLE;
+      sub->current_tile     = NULL;
+      sub->real_data        = NULL;
+      sub->linear_tile      = NULL;
+    }
+
+  iter->priv->num_buffers = tpriv->num_buffers;
+
+  while (gegl_buffer_iterator_next (iter))
+    job->func (iter, scratch, job->user_data);
+}
+
+static void
+parallel_run (gpointer data)
+{
+  ParallelJob *job     = data;
+  gpointer     scratch = NULL;
+  gboolean     started = FALSE;
+  gint         unit;
+
+  while ((unit = g_atomic_int_add (&job->next_unit, 1)) < job->n_units)
+    {
+      if (!started)
+        {
+          scratch = parallel_scratch_new (job);
+          started = TRUE;
+        }
+
+      parallel_iterate_unit (job, unit, scratch);
+    }
+
+  if (started)
+    {
+      g_mutex_lock (&job->mutex);
+      job->scratches = g_slist_prepend (job->scratches, scratch);
+      g_mutex_unlock (&job->mutex);
+    }
+}
+
+/* whether the buffers written to can be cut along the tile grid of the
+ * first buffer without two units sharing a tile
+ */
+static gboolean
+parallel_tiles_aligned (GeglBufferIterator *iter)
+{
+  GeglBufferIteratorPriv *priv = iter->priv;
+  SubIterState           *lead = &priv->sub_iter[0];
+  gint                    lead_x;
+  gint                    lead_y;
+  gint                    index;
+
+  lead_x = lead->buffer->shift_x + lead->full_rect.x;
+  lead_y = lead->buffer->shift_y + lead->full_rect.y;
+
+  for (index = 0; index < priv->num_buffers; index++)
+    {
+      SubIterState *sub = &priv->sub_iter[index];
+      GeglBuffer   *buf = sub->buffer;
+
+      if (!(sub->access_mode & GEGL_ACCESS_WRITE))
+        continue;
+
+      if (sub->level != lead->level ||
+          buf->tile_width  != lead->buffer->tile_width ||
+          buf->tile_height != lead->buffer->tile_height ||
+          abs (lead_x - (buf->shift_x + sub->full_rect.x)) % buf->tile_width ||
+          abs (lead_y - (buf->shift_y + sub->full_rect.y)) % buf->tile_height)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+void
+gegl_buffer_iterator_foreach_parallel (GeglBufferIterator          *iter,
+                                       GeglBufferIteratorFunc       func,
+                                       gconstpointer                scratch_init,
+                                       gsize                        scratch_size,
+                                       GeglBufferIteratorMergeFunc  merge,
+                                       gpointer                     user_data)
+{
+  GeglBufferIteratorPriv *priv;
+  SubIterState           *lead;
+  ParallelJob             job = {NULL, };
+  GeglTaskGroup           group;
+  GeglRectangle           grid;
+  gint                    threads;
+  gint                    n_units;
+  gint                    index;
+
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (func != NULL);
+
+  priv = iter->priv;
+  lead = &priv->sub_iter[0];
+
+  g_return_if_fail (priv->state == GeglIteratorState_Start);
+  g_return_if_fail (priv->num_buffers > 0);
+
+  threads = gegl_config_threads ();
+
+  priv->origin_tile.x      = lead->buffer->shift_x;
+  priv->origin_tile.y      = lead->buffer->shift_y;
+  priv->origin_tile.width  = lead->buffer->tile_width;
+  priv->origin_tile.height = lead->buffer->tile_height;
+
+  n_units = 0;
+  if (lead->full_rect.width > 0 && lead->full_rect.height > 0)
+    {
+      const GeglRectangle *origin = &priv->origin_tile;
+      const GeglRectangle *rect   = &lead->full_rect;
+
+      grid.x = gegl_tile_indice (rect->x + origin->x, origin->width);
+      grid.y = gegl_tile_indice (rect->y + origin->y, origin->height);
+      grid.width  = gegl_tile_indice (rect->x + rect->width - 1 + origin->x,
+                                      origin->width) - grid.x + 1;
+      grid.height = gegl_tile_indice (rect->y + rect->height - 1 + origin->y,
+                                      origin->height) - grid.y + 1;
+
+      n_units = grid.width * grid.height;
+    }
+
+  if (threads < 2 || n_units < 2 || !parallel_tiles_aligned (iter))
+    {
+      gpointer scratch = NULL;
+
+      if (scratch_size)
+        scratch = scratch_init ? g_memdup (scratch_init, scratch_size)
+                               : g_malloc0 (scratch_size);
+
+      while (gegl_buffer_iterator_next (iter))
+        func (iter, scratch, user_data);
+
+      if (merge)
+        merge (scratch, user_data);
+
+      g_free (scratch);
+      return;
+    }
+
+  job.iter         = iter;
+  job.grid         = grid;
+  job.n_units      = n_units;
+  job.func         = func;
+  job.scratch_init = scratch_init;
+  job.scratch_size = scratch_size;
+  job.user_data    = user_data;
+  g_mutex_init (&job.mutex);
+
+  if (gegl_cl_is_accelerated ())
+    for (index = 0; index < priv->num_buffers; index++)
+      gegl_buffer_cl_cache_flush (priv->sub_iter[index].buffer,
+                                  &priv->sub_iter[index].full_rect);
+
+  gegl_task_group_init (&group);
+  for (index = 1; index < MIN (threads, n_units); index++)
+    gegl_task_group_push (&group, parallel_run, &job);
+
+  /* the calling thread takes part as well; a task that only gets to run
+   * once all the units are claimed returns at once
+   */
+  parallel_run (&job);
+  gegl_task_group_wait (&group);
+
+  g_mutex_clear (&job.mutex);
+
+  for (; job.scratches;
+       job.scratches = g_slist_delete_link (job.scratches, job.scratches))
+    {
+      if (merge)
+        merge (job.scratches->data, user_data);
+      g_free (job.scratches->data);
+    }
+
+  for (index = 0; index < priv->num_buffers; index++)
+    {
+      SubIterState *sub = &priv->sub_iter[index];
+
+      if (sub->access_mode & GEGL_ACCESS_WRITE)
+        gegl_buffer_emit_changed_signal (sub->buffer, &sub->full_rect);
+    }
+
+  /* the template was never started, there is nothing to release */
+  g_slice_free (GeglBufferIteratorPriv, iter->priv);
+  g_slice_free (GeglBufferIterator, iter);
+}
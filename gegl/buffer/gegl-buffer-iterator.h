@@ -131,6 +131,62 @@ void                 gegl_buffer_iterator_stop  (GeglBufferIterator *iterator);
  */
 gboolean             gegl_buffer_iterator_next (GeglBufferIterator *iterator);
 
+/**
+ * GeglBufferIteratorFunc:
+ * @iterator: an iterator positioned at a chunk of data, as after a
+ * successful gegl_buffer_iterator_next()
+ * @scratch: the scratch memory of the calling thread
+ * @user_data: the data passed to gegl_buffer_iterator_foreach_parallel()
+ *
+ * Processes one chunk of the buffers of a parallel iteration.
+ */
+typedef void (*GeglBufferIteratorFunc)      (GeglBufferIterator *iterator,
+                                             gpointer            scratch,
+                                             gpointer            user_data);
+
+/**
+ * GeglBufferIteratorMergeFunc:
+ * @scratch: the scratch memory of one of the threads that took part
+ * @user_data: the data passed to gegl_buffer_iterator_foreach_parallel()
+ *
+ * Folds the partial result a thread left in its scratch memory into the
+ * final result, called on the thread that started the iteration.
+ */
+typedef void (*GeglBufferIteratorMergeFunc) (gpointer            scratch,
+                                             gpointer            user_data);
+
+/**
+ * gegl_buffer_iterator_foreach_parallel: (skip)
+ * @iterator: a #GeglBufferIterator that has not been iterated yet
+ * @func: called for each chunk of data
+ * @scratch_init: (allow-none): the initial contents of the scratch memory,
+ * or NULL to zero it
+ * @scratch_size: the size of the scratch memory of each thread, or 0
+ * @merge: (allow-none): called for the scratch memory of each thread once
+ * all chunks are processed
+ * @user_data: passed to @func and @merge
+ *
+ * Iterates like a loop over gegl_buffer_iterator_next() calling @func,
+ * but with the chunks spread over the threads of GEGL. The area is cut
+ * into work units along the tile grid of the first buffer, so no two
+ * threads write to the same tile; when a buffer written to does not
+ * share that grid the iteration runs on the calling thread only.
+ *
+ * The chunks are processed in no particular order, @func can not rely on
+ * state carried from one chunk to the next other than through @scratch,
+ * which belongs to a single thread. Reductions accumulate into @scratch
+ * and combine the partial results in @merge.
+ *
+ * The iterator is no longer valid after this function returns.
+ */
+void                 gegl_buffer_iterator_foreach_parallel
+                                       (GeglBufferIterator          *iterator,
+                                        GeglBufferIteratorFunc       func,
+                                        gconstpointer                scratch_init,
+                                        gsize                        scratch_size,
+                                        GeglBufferIteratorMergeFunc  merge,
+                                        gpointer                     user_data);
+
 
 
 #endif
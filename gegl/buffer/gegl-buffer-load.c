@@ -30,6 +30,8 @@
 #include "gegl-types-internal.h"
 #include "gegl-buffer-private.h"
 #include "gegl-buffer-index.h"
+#include "gegl-buffer-backend.h"
+#include "gegl-tile-backend-file.h"
 #include "gegl-debug.h"
 
 #include <glib/gprintf.h>
@@ -181,10 +183,11 @@ static GeglBufferItem *read_block (int           i,
     }
   else if (block.length < own_size)
     {
-      ret = g_malloc (own_size);
+      /* fields added in later versions are left as 0 */
+      ret = g_malloc0 (own_size);
       memcpy (ret, &block, sizeof (GeglBufferBlock));
       {
-        ssize_t sz_read = read (i, ret + sizeof(GeglBufferBlock),
+        ssize_t sz_read = read (i, ((gchar*)ret) + sizeof(GeglBufferBlock),
 								block.length - sizeof (GeglBufferBlock));
 		if(sz_read != -1)
 		  byte_read += sz_read;
@@ -201,14 +204,110 @@ static GeglBufferItem *read_block (int           i,
   return ret;
 }
 
+/* reads the index table of revision 1, whose block has already been read
+ * from offset
+ */
+static GList *
+read_index_table (int              i,
+                  goffset         *offset,
+                  GeglBufferBlock *block)
+{
+  GeglBufferIndex  index;
+  GList           *ret = NULL;
+  guchar          *entries;
+  struct stat      st;
+  gsize            size;
+  gint             n;
+
+  index.block = *block;
+
+  if (read (i, ((gchar *) &index) + sizeof (GeglBufferBlock),
+            sizeof (GeglBufferIndex) - sizeof (GeglBufferBlock)) !=
+      sizeof (GeglBufferIndex) - sizeof (GeglBufferBlock))
+    {
+      g_warning ("failed reading index table");
+      return NULL;
+    }
+
+  if (index.entry_size < G_STRUCT_OFFSET (GeglBufferTile, codec))
+    {
+      g_warning ("index table entries of %i bytes are too small",
+                 index.entry_size);
+      return NULL;
+    }
+
+  size = (gsize) index.n_tiles * index.entry_size;
+
+  /* the sizes come from the file, don't trust them beyond its end */
+  if (fstat (i, &st) != 0 ||
+      *offset + sizeof (GeglBufferIndex) + size > (guint64) st.st_size)
+    {
+      g_warning ("index table of %u entries of %u bytes exceeds the file",
+                 index.n_tiles, index.entry_size);
+      return NULL;
+    }
+
+  entries = g_try_malloc (size);
+  if (size && ! entries)
+    {
+      g_warning ("failed allocating index table");
+      return NULL;
+    }
+
+  /* the whole table in one go */
+  if (read (i, entries, size) != (gssize) size)
+    {
+      g_warning ("failed reading index table");
+      g_free (entries);
+      return NULL;
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "read index table of %i entries",
+             index.n_tiles);
+
+  for (n = index.n_tiles - 1; n >= 0; n--)
+    {
+      GeglBufferTile *entry = g_malloc0 (sizeof (GeglBufferTile));
+
+      /* we discard any excess information that might have been added in
+       * later versions, and leave fields missing in earlier ones as 0
+       */
+      memcpy (entry, entries + (gsize) n * index.entry_size,
+              MIN (index.entry_size, sizeof (GeglBufferTile)));
+      entry->block.length = sizeof (GeglBufferTile);
+
+      ret = g_list_prepend (ret, entry);
+    }
+
+  g_free (entries);
+
+  *offset += sizeof (GeglBufferIndex) + size;
+  return ret;
+}
+
 GList *
 gegl_buffer_read_index (int           i,
                         goffset      *offset)
 /* load the index */
 {
-  GList          *ret = NULL;
-  GeglBufferItem *item;
+  GList           *ret = NULL;
+  GeglBufferItem  *item;
+  GeglBufferBlock  block;
+
+  if (*offset == 0)
+    return NULL;
 
+  if (lseek (i, *offset, SEEK_SET) == -1 ||
+      read (i, &block, sizeof (GeglBufferBlock)) != sizeof (GeglBufferBlock))
+    {
+      g_warning ("failed reading index at %i", (gint)*offset);
+      return NULL;
+    }
+
+  if (block.flags == GEGL_FLAG_INDEX)
+    return read_index_table (i, offset, &block);
+
+  /* revision 0, a linked list of blocks */
   for (item = read_block (i, offset); item; item = read_block (i, offset))
     {
       g_assert (item);
@@ -242,6 +341,27 @@ gegl_buffer_open (const gchar *path)
                        NULL);
 }
 
+GeglBuffer *
+gegl_buffer_open_mapped (const gchar *path)
+{
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+
+  sanity();
+
+  /* the format is overridden by the one stored in the file */
+  backend = g_object_new (GEGL_TYPE_TILE_BACKEND_FILE,
+                          "format", babl_format ("RGBA float"),
+                          "path",   path,
+                          "mapped", TRUE,
+                          NULL);
+
+  buffer = gegl_buffer_new_for_backend (NULL, backend);
+  g_object_unref (backend);
+
+  return buffer;
+}
+
 GeglBuffer *
 gegl_buffer_load (const gchar *path)
 {
@@ -266,6 +386,11 @@ gegl_buffer_load (const gchar *path)
     g_free (header);
   }
 
+  if (gegl_buffer_header_get_rev (&info->header) > GEGL_FILE_SPEC_REV)
+    g_warning ("%s is of a newer revision (%i) than supported (%i)", path,
+               gegl_buffer_header_get_rev (&info->header),
+               GEGL_FILE_SPEC_REV);
+
 
 
   info->tile_size    = info->header.tile_width *
@@ -289,14 +414,19 @@ gegl_buffer_load (const gchar *path)
 
   /* load each tile */
   {
-    GList *iter;
-    gint   i = 0;
+    GList  *iter;
+    gint    i = 0;
+    guchar *stored = NULL;
+
     for (iter = info->tiles; iter; iter = iter->next)
       {
         GeglBufferTile *entry = iter->data;
         guchar         *data;
         GeglTile       *tile;
 
+        /* the tiles of a new buffer are empty already */
+        if (entry->codec == GEGL_TILE_CODEC_ZERO)
+          continue;
 
         tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (ret),
                                           entry->x,
@@ -316,17 +446,40 @@ gegl_buffer_load (const gchar *path)
         data = gegl_tile_get_data (tile);
         g_assert (data);
 
-        {
-          ssize_t sz_read = read (info->i, data, info->tile_size);
-          if(sz_read != -1)
-            info->offset += sz_read;
-        }
+        if (entry->codec == GEGL_TILE_CODEC_NONE)
+          {
+            ssize_t sz_read = read (info->i, data, info->tile_size);
+            if(sz_read != -1)
+              info->offset += sz_read;
+          }
+        else
+          {
+            ssize_t sz_read;
+
+            if (! stored)
+              stored = g_malloc (info->tile_size);
+
+            sz_read = entry->length <= (guint32) info->tile_size ?
+                      read (info->i, stored, entry->length) : -1;
+            if (sz_read != -1)
+              info->offset += sz_read;
+
+            if (sz_read != (ssize_t) entry->length ||
+                ! gegl_tile_entry_decode (entry, info->format, stored,
+                                          data, info->tile_size))
+              {
+                g_warning ("failed to decode tile %i,%i,%i",
+                           entry->x, entry->y, entry->z);
+              }
+          }
         /*g_assert (info->offset == entry->offset + info->tile_size);*/
 
         gegl_tile_unlock (tile);
         gegl_tile_unref (tile);
         i++;
       }
+
+    g_free (stored);
     GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded",i);
   }
   GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "buffer loaded %s", info->path);
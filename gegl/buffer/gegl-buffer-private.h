@@ -168,10 +168,20 @@ struct _GeglTile
                                  * should in theory just have the values 0/1
                                  */
   gint             is_zero_tile:1;
-
-  /* the shared list is a doubly linked circular list */
-  GeglTile        *next_shared;
-  GeglTile        *prev_shared;
+  gint             is_uniform:1;  /* all pixels are the same as the first
+                                   * one, cleared when the tile is locked
+                                   * for writing
+                                   */
+  gint             is_read_only:1; /* the data can't be written to, such
+                                    * as a file mapping, and is always
+                                    * copied when the tile is locked for
+                                    * writing
+                                    */
+
+  /* the number of tiles sharing the pixel data, shared by all of them and
+   * updated atomically, the data is freed when it drops to zero
+   */
+  gint            *n_clones;
 
   /* called when the tile is about to be destroyed */
   GDestroyNotify   destroy_notify;
@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <sys/types.h>
@@ -36,6 +37,9 @@
 #include "gegl-tile-storage.h"
 #include "gegl-tile.h"
 #include "gegl-buffer-index.h"
+#include "gegl-compression.h"
+#include "gegl-config.h"
+#include "gegl-scheduler.h"
 
 typedef struct
 {
@@ -45,14 +49,61 @@ typedef struct
   gint             o;
 
   gint             tile_size;
-  gint             offset;
+  goffset          offset;
   gint             entry_count;
-  GeglBufferBlock *in_holding; /* we need to write one block added behind
-                                * to be able to recompute the forward pointing
-                                * link from one entry to the next.
-                                */
+  gboolean         failed;
+
+  /* fetching and compression of the tiles, done by the threads of the
+   * scheduler one batch of tiles at a time, while the previous batch is
+   * written out
+   */
+  GeglBuffer            *buffer;
+  const Babl            *format;
+  const GeglCompression *compression;
+  guint32                codec;
 } SaveInfo;
 
+typedef struct
+{
+  SaveInfo       *info;
+  GeglBufferTile *entry;
+  GeglTile       *tile;
+  guchar         *compressed; /* the stored data, if not the tile data */
+} SaveTile;
+
+typedef struct
+{
+  SaveTile      *tiles;
+  gint           n_tiles;
+  GeglTaskGroup  group;
+  guchar        *data;    /* the stored data of the batch, written at once */
+} SaveBatch;
+
+typedef struct
+{
+  GeglBuffer    *snapshot;
+  gchar         *path;
+  GeglRectangle  roi;
+} SaveJob;
+
+/* the number of tiles fetched and compressed in parallel per thread before
+ * they are written out in order, and the most memory the data of a batch
+ * may take, two batches being in flight at a time
+ */
+#define SAVE_BATCH_PER_THREAD 16
+#define SAVE_BATCH_BYTES      (8 * 1024 * 1024)
+
+static const struct
+{
+  const gchar *name;
+  guint32      codec;
+} codecs[] =
+{
+  { "rle",   GEGL_TILE_CODEC_RLE   },
+  { "delta", GEGL_TILE_CODEC_DELTA },
+  { "lz",    GEGL_TILE_CODEC_LZ    }
+};
+
 
 GeglBufferTile *
 gegl_tile_entry_new (gint x,
@@ -75,30 +126,226 @@ gegl_tile_entry_destroy (GeglBufferTile *entry)
   g_free (entry);
 }
 
-static gsize write_block (SaveInfo        *info,
-                          GeglBufferBlock *block)
+guint32
+gegl_tile_codec_from_name (const gchar *name)
 {
-   gssize ret = 0;
-
-   if (info->in_holding)
-     {
-       glong allocated_pos = info->offset + info->in_holding->length;
-       info->in_holding->next = allocated_pos;
-
-       if (block == NULL)
-         info->in_holding->next = 0;
-
-       ret = write (info->o, info->in_holding, info->in_holding->length);
-	   if (ret == -1)
-         ret = 0;
-       info->offset += ret;
-       g_assert (allocated_pos == info->offset);
-     }
-  /* write block should also allocate the block and update the
-   * previously added blocks next pointer
-   */
-   info->in_holding = block;
-   return ret;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (codecs); i++)
+    if (! strcmp (codecs[i].name, name))
+      return codecs[i].codec;
+
+  return GEGL_TILE_CODEC_NONE;
+}
+
+gboolean
+gegl_tile_entry_decode (const GeglBufferTile *entry,
+                        const Babl           *format,
+                        gconstpointer         stored,
+                        gpointer              data,
+                        gint                  tile_size)
+{
+  guint i;
+
+  switch (entry->codec)
+    {
+      case GEGL_TILE_CODEC_NONE:
+        memcpy (data, stored, tile_size);
+        return TRUE;
+
+      case GEGL_TILE_CODEC_ZERO:
+        memset (data, 0, tile_size);
+        return TRUE;
+
+      default:
+        for (i = 0; i < G_N_ELEMENTS (codecs); i++)
+          if (codecs[i].codec == entry->codec)
+            return gegl_compression_decompress (
+                     gegl_compression (codecs[i].name), format,
+                     data, tile_size / babl_format_get_bytes_per_pixel (format),
+                     stored, entry->length);
+
+        g_warning ("unknown tile codec %i", entry->codec);
+        return FALSE;
+    }
+}
+
+gint
+gegl_tile_entry_compare (gconstpointer a,
+                         gconstpointer b)
+{
+  const GeglBufferTile *entryA = a;
+  const GeglBufferTile *entryB = b;
+
+  if (entryA->z != entryB->z)
+    return entryA->z < entryB->z ? -1 : 1;
+  if (entryA->y != entryB->y)
+    return entryA->y < entryB->y ? -1 : 1;
+  if (entryA->x != entryB->x)
+    return entryA->x < entryB->x ? -1 : 1;
+  return 0;
+}
+
+GeglBufferIndex *
+gegl_buffer_index_new (GeglBufferTile **tiles,
+                       gint             n_tiles)
+{
+  GeglBufferIndex *index;
+  GeglBufferTile  *entries;
+  gint             i;
+
+  index = g_malloc0 (sizeof (GeglBufferIndex) +
+                     sizeof (GeglBufferTile) * n_tiles);
+  entries = (GeglBufferTile *) (index + 1);
+
+  index->block.flags  = GEGL_FLAG_INDEX;
+  index->block.length = sizeof (GeglBufferIndex) +
+                        sizeof (GeglBufferTile) * n_tiles;
+  index->block.next   = 0;
+  index->n_tiles      = n_tiles;
+  index->entry_size   = sizeof (GeglBufferTile);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      entries[i] = *tiles[i];
+      entries[i].block.flags  = GEGL_FLAG_TILE;
+      entries[i].block.length = sizeof (GeglBufferTile);
+      entries[i].block.next   = 0;
+    }
+
+  qsort (entries, n_tiles, sizeof (GeglBufferTile), gegl_tile_entry_compare);
+
+  return index;
+}
+
+static gboolean
+is_zero (const guchar *data,
+         gint          size)
+{
+  const guint64 *words = (const guint64 *) data;
+  gint           i;
+
+  for (i = 0; i < size / 8; i++)
+    if (words[i])
+      return FALSE;
+
+  return TRUE;
+}
+
+static void
+compress_tile (gpointer data)
+{
+  SaveTile       *save_tile = data;
+  SaveInfo       *info      = save_tile->info;
+  GeglBufferTile *entry     = save_tile->entry;
+  guchar         *tile_data;
+  gint            size;
+
+  save_tile->tile = gegl_buffer_get_tile (info->buffer,
+                                          entry->x, entry->y, entry->z);
+  g_assert (save_tile->tile);
+
+  tile_data = gegl_tile_get_data (save_tile->tile);
+
+  entry->codec  = GEGL_TILE_CODEC_NONE;
+  entry->length = info->tile_size;
+
+  if (is_zero (tile_data, info->tile_size))
+    {
+      entry->codec  = GEGL_TILE_CODEC_ZERO;
+      entry->length = 0;
+    }
+  else if (info->compression)
+    {
+      save_tile->compressed = g_malloc (info->tile_size);
+
+      /* only keep the compressed data if it is smaller */
+      if (gegl_compression_compress (info->compression, info->format,
+                                     tile_data,
+                                     info->tile_size / info->header.bytes_per_pixel,
+                                     save_tile->compressed, &size,
+                                     info->tile_size - 1))
+        {
+          entry->codec  = info->codec;
+          entry->length = size;
+        }
+      else
+        {
+          g_free (save_tile->compressed);
+          save_tile->compressed = NULL;
+        }
+    }
+}
+
+/* hands a batch of tiles to the scheduler, to be fetched and compressed in
+ * parallel
+ */
+static void
+save_batch_start (SaveInfo  *info,
+                  SaveBatch *batch)
+{
+  gint i;
+
+  gegl_task_group_init (&batch->group);
+
+  for (i = 0; i < batch->n_tiles; i++)
+    {
+      batch->tiles[i].info = info;
+      gegl_task_group_push (&batch->group, compress_tile, &batch->tiles[i]);
+    }
+}
+
+/* waits for a batch to be compressed, and writes the stored data of its
+ * tiles out in order, with a single write
+ */
+static void
+save_batch_finish (SaveInfo  *info,
+                   SaveBatch *batch)
+{
+  gsize length = 0;
+  gint  i;
+
+  gegl_task_group_wait (&batch->group);
+
+  for (i = 0; i < batch->n_tiles; i++)
+    {
+      GeglBufferTile *entry = batch->tiles[i].entry;
+
+      if (entry->codec == GEGL_TILE_CODEC_ZERO)
+        {
+          entry->offset = 0;
+        }
+      else
+        {
+          gconstpointer data = batch->tiles[i].compressed ?
+                               batch->tiles[i].compressed :
+                               gegl_tile_get_data (batch->tiles[i].tile);
+
+          entry->offset = info->offset + length;
+
+          memcpy (batch->data + length, data, entry->length);
+          length += entry->length;
+        }
+
+      g_free (batch->tiles[i].compressed);
+      gegl_tile_unref (batch->tiles[i].tile);
+    }
+
+  if (length && ! info->failed)
+    {
+      if (write (info->o, batch->data, length) == (ssize_t) length)
+        {
+          info->offset += length;
+        }
+      else
+        {
+          g_warning ("%s: Could not write '%s': %s",
+                     G_STRFUNC, info->path, g_strerror (errno));
+          info->failed = TRUE;
+        }
+    }
+
+  batch->n_tiles = 0;
 }
 
 static void
@@ -187,23 +434,18 @@ gegl_buffer_header_init (GeglBufferHeader *header,
   }
 }
 
-void
-gegl_buffer_save (GeglBuffer          *buffer,
-                  const gchar         *path,
-                  const GeglRectangle *roi)
+static gboolean
+save_buffer (GeglBuffer          *buffer,
+             const gchar         *path,
+             const GeglRectangle *roi)
 {
   SaveInfo *info = g_slice_new0 (SaveInfo);
+  gboolean  success;
 
-  glong prediction = 0;
   gint bpp;
   gint tile_width;
   gint tile_height;
 
-  GEGL_BUFFER_SANITY;
-
-  if (! roi)
-    roi = &buffer->extent;
-
   GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
              "starting to save buffer %s, roi: %d,%d %dx%d",
              path, roi->x, roi->y, roi->width, roi->height);
@@ -223,7 +465,11 @@ gegl_buffer_save (GeglBuffer          *buffer,
 
 
   if (info->o == -1)
-    g_warning ("%s: Could not open '%s': %s", G_STRFUNC, info->path, g_strerror(errno));
+    {
+      g_warning ("%s: Could not open '%s': %s", G_STRFUNC, info->path, g_strerror(errno));
+      save_info_destroy (info);
+      return FALSE;
+    }
   tile_width  = buffer->tile_storage->tile_width;
   tile_height = buffer->tile_storage->tile_height;
   g_object_get (buffer, "px-size", &bpp, NULL);
@@ -238,8 +484,9 @@ gegl_buffer_save (GeglBuffer          *buffer,
                            bpp,
                            buffer->tile_storage->format
                            );
-  info->header.next = (prediction += sizeof (GeglBufferHeader));
   info->tile_size = tile_width * tile_height * bpp;
+  info->format    = buffer->tile_storage->format;
+  info->buffer    = buffer;
 
   g_assert (info->tile_size % 16 == 0);
 
@@ -289,76 +536,181 @@ gegl_buffer_save (GeglBuffer          *buffer,
              g_list_length (info->tiles));
   }
 
-  /* sort the list of tiles into zorder */
+  /* sort the list of tiles into zorder, this is the order the tile data
+   * is stored in, the index table is sorted by coordinates
+   */
   info->tiles = g_list_sort (info->tiles, z_order_compare);
 
-  /* set the offset in the file each tile will be stored on */
+  /* the tile data follows the header, the header is written last, once
+   * the offset of the index table behind the data is known
+   */
+  if (lseek (info->o, sizeof (GeglBufferHeader), SEEK_SET) == -1)
+    g_warning ("failed seeking");
+  info->offset = sizeof (GeglBufferHeader);
+
+  /* save each tile, the next batch of tiles is fetched and compressed
+   * while the current one is written
+   */
   {
-    GList *iter;
-    gint   predicted_offset = sizeof (GeglBufferHeader) +
-                              sizeof (GeglBufferTile) * (info->entry_count);
+    const gchar *codec_name = gegl_config ()->save_compression;
+    SaveBatch    batches[2];
+    SaveBatch   *current;
+    SaveBatch   *previous = NULL;
+    GList       *iter;
+    gint         batch_size;
+    gint         i;
+
+    /* tiles are saved raw unless asked for */
+    if (codec_name && ! strcmp (codec_name, "auto"))
+      codec_name = gegl_compression_best_for_format (info->format);
+    else if (! codec_name || ! gegl_compression (codec_name))
+      codec_name = "nop";
+
+    info->codec = gegl_tile_codec_from_name (codec_name);
+    if (info->codec != GEGL_TILE_CODEC_NONE)
+      info->compression = gegl_compression (codec_name);
+
+    batch_size = MIN (gegl_config_threads () * SAVE_BATCH_PER_THREAD,
+                      SAVE_BATCH_BYTES / info->tile_size);
+    batch_size = MAX (batch_size, 1);
+
+    for (i = 0; i < 2; i++)
+      {
+        batches[i].tiles   = g_new0 (SaveTile, batch_size);
+        batches[i].n_tiles = 0;
+        batches[i].data    = gegl_malloc ((gsize) batch_size * info->tile_size);
+      }
+    current = &batches[0];
+
     for (iter = info->tiles; iter; iter = iter->next)
       {
-        GeglBufferTile *entry = iter->data;
-        entry->block.next = iter->next?
-                            (prediction += sizeof (GeglBufferTile)):0;
-        entry->offset = predicted_offset;
-        predicted_offset += info->tile_size;
+        SaveTile *save_tile = &current->tiles[current->n_tiles++];
+
+        save_tile->entry      = iter->data;
+        save_tile->tile       = NULL;
+        save_tile->compressed = NULL;
+
+        if (current->n_tiles == batch_size || ! iter->next)
+          {
+            save_batch_start (info, current);
+
+            if (previous)
+              save_batch_finish (info, previous);
+
+            previous = current;
+            current  = current == &batches[0] ? &batches[1] : &batches[0];
+          }
       }
-  }
 
-  /* save the header */
-  {
-    ssize_t ret = write (info->o, &info->header, sizeof (GeglBufferHeader));
-	if (ret != -1)
-      info->offset += ret;
+    if (previous)
+      save_batch_finish (info, previous);
+
+    for (i = 0; i < 2; i++)
+      {
+        g_free (batches[i].tiles);
+        gegl_free (batches[i].data);
+      }
   }
-  g_assert (info->offset == info->header.next);
 
   /* save the index */
   {
-    GList *iter;
+    GeglBufferTile  **entries = g_new (GeglBufferTile *, info->entry_count);
+    GeglBufferIndex  *index;
+    GList            *iter;
+    gint              i = 0;
+
     for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferItem *item = iter->data;
+      entries[i++] = iter->data;
 
-        write_block (info, &item->block);
+    index = gegl_buffer_index_new (entries, info->entry_count);
 
+    info->header.next = info->offset;
+    if (! info->failed)
+      {
+        ssize_t ret = write (info->o, index, index->block.length);
+        if (ret == (ssize_t) index->block.length)
+          info->offset += ret;
+        else
+          info->failed = TRUE;
       }
+
+    g_free (index);
+    g_free (entries);
   }
-  write_block (info, NULL); /* terminate the index */
 
-  /* update header to point to start of new index (already done for
-   * this serial saver, and the header is already written.
-   */
+  /* save the header, only once all the rest made it to the file */
+  if (! info->failed)
+    {
+      ssize_t ret = -1;
 
-  /* save each tile */
-  {
-    GList *iter;
-    gint   i = 0;
-    for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferTile *entry = iter->data;
-        guchar          *data;
-        GeglTile        *tile;
-
-        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
-                                          entry->x,
-                                          entry->y,
-                                          entry->z);
-        g_assert (tile);
-        data = gegl_tile_get_data (tile);
-        g_assert (data);
-
-        g_assert (info->offset == entry->offset);
+      if (lseek (info->o, 0, SEEK_SET) != -1)
+        ret = write (info->o, &info->header, sizeof (GeglBufferHeader));
+      if (ret != sizeof (GeglBufferHeader))
         {
-          ssize_t ret = write (info->o, data, info->tile_size);
-	      if (ret != -1)
-            info->offset += ret;
+          g_warning ("%s: Could not write '%s': %s", G_STRFUNC, info->path, g_strerror(errno));
+          info->failed = TRUE;
         }
-        gegl_tile_unref (tile);
-        i++;
-      }
-  }
+    }
+
+  success = ! info->failed;
+
   save_info_destroy (info);
+
+  return success;
+}
+
+void
+gegl_buffer_save (GeglBuffer          *buffer,
+                  const gchar         *path,
+                  const GeglRectangle *roi)
+{
+  GEGL_BUFFER_SANITY;
+
+  if (! roi)
+    roi = &buffer->extent;
+
+  save_buffer (buffer, path, roi);
+}
+
+static gpointer
+save_thread (gpointer data)
+{
+  SaveJob  *job = data;
+  gboolean  success;
+
+  success = save_buffer (job->snapshot, job->path, &job->roi);
+
+  g_object_unref (job->snapshot);
+  g_free (job->path);
+  g_slice_free (SaveJob, job);
+
+  return GINT_TO_POINTER (success);
+}
+
+GThread *
+gegl_buffer_save_in_background (GeglBuffer          *buffer,
+                                const gchar         *path,
+                                const GeglRectangle *roi)
+{
+  SaveJob *job;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (! roi)
+    roi = &buffer->extent;
+
+  job       = g_slice_new0 (SaveJob);
+  job->path = g_strdup (path);
+  job->roi  = *roi;
+
+  /* the snapshot shares the tiles of the buffer, which are copied when
+   * either of them is written to; holding the storage lock keeps other
+   * threads from changing the buffer halfway through
+   */
+  g_rec_mutex_lock (&buffer->tile_storage->mutex);
+  job->snapshot = gegl_buffer_dup (buffer);
+  g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+
+  return g_thread_new ("GeglBuffer save", save_thread, job);
 }
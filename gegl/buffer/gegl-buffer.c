@@ -46,6 +46,7 @@
 #include "gegl-tile-backend-file.h"
 #include "gegl-tile-backend-swap.h"
 #include "gegl-tile-backend-ram.h"
+#include "gegl-tile-backend-mmap.h"
 #include "gegl-types-internal.h"
 #include "gegl-config.h"
 #include "gegl-buffer-cl-cache.h"
@@ -519,6 +520,8 @@ gegl_buffer_constructor (GType                  type,
       else
         {
           gboolean use_ram = FALSE;
+          gboolean use_mmap = FALSE;
+          gchar *mmap_dir = NULL;
           const char *maybe_path = NULL;
 
           if (!buffer->format)
@@ -535,7 +538,11 @@ gegl_buffer_constructor (GType                  type,
             maybe_path = gegl_config ()->swap;
 
           if (maybe_path)
-            use_ram = g_ascii_strcasecmp (maybe_path, "ram") == 0;
+            {
+              use_ram = g_ascii_strcasecmp (maybe_path, "ram") == 0;
+              use_mmap = gegl_tile_backend_mmap_parse_location (maybe_path,
+                                                                &mmap_dir);
+            }
           else
             use_ram = TRUE;
 
@@ -547,6 +554,16 @@ gegl_buffer_constructor (GType                  type,
                                       "format",      buffer->format,
                                       NULL);
             }
+          else if (use_mmap == TRUE)
+            {
+              backend = g_object_new (GEGL_TYPE_TILE_BACKEND_MMAP,
+                                      "tile-width",  buffer->tile_width,
+                                      "tile-height", buffer->tile_height,
+                                      "format",      buffer->format,
+                                      "path",        mmap_dir,
+                                      NULL);
+              g_free (mmap_dir);
+            }
           else if (buffer->path)
             {
               backend = g_object_new (GEGL_TYPE_TILE_BACKEND_FILE,
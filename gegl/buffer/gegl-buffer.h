@@ -98,6 +98,19 @@ void           gegl_buffer_remove_handler     (GeglBuffer          *buffer,
  */
 GeglBuffer *    gegl_buffer_open              (const gchar         *path);
 
+/**
+ * gegl_buffer_open_mapped:
+ * @path: the path to a gegl buffer on disk.
+ *
+ * Open an existing on-disk GeglBuffer like gegl_buffer_open(), mapping the
+ * file into memory. Tiles stored uncompressed are served straight from the
+ * mapping as they are first accessed, and copied only when written to, so
+ * that a region of a large buffer can be read without loading the rest.
+ *
+ * Returns: (transfer full): a GeglBuffer object.
+ */
+GeglBuffer *    gegl_buffer_open_mapped       (const gchar         *path);
+
 /**
  * gegl_buffer_save:
  * @buffer: (transfer none): a #GeglBuffer.
@@ -111,6 +124,24 @@ void            gegl_buffer_save              (GeglBuffer          *buffer,
                                                const gchar         *path,
                                                const GeglRectangle *roi);
 
+/**
+ * gegl_buffer_save_in_background:
+ * @buffer: (transfer none): a #GeglBuffer.
+ * @path: the path where the gegl buffer will be saved.
+ * @roi: the region of interest to write, or NULL for the whole buffer.
+ *
+ * Write a GeglBuffer to a file like gegl_buffer_save(), from a thread of its
+ * own. The contents saved are those of @buffer at the time of the call; the
+ * buffer can be read and written to by other threads while it is saved.
+ *
+ * Returns: (transfer full): the saving thread, to be joined with
+ * g_thread_join(), which returns a non-NULL pointer if the buffer was
+ * saved, or unreferenced with g_thread_unref().
+ */
+GThread *       gegl_buffer_save_in_background (GeglBuffer          *buffer,
+                                                const gchar         *path,
+                                                const GeglRectangle *roi);
+
 /**
  * gegl_buffer_load:
  * @path: the path to a gegl buffer on disk.
@@ -132,6 +163,35 @@ GeglBuffer *     gegl_buffer_load             (const gchar         *path);
  */
 void            gegl_buffer_flush             (GeglBuffer          *buffer);
 
+/**
+ * gegl_buffer_prefetch:
+ * @buffer: a #GeglBuffer
+ * @rect: the region that is about to be accessed.
+ *
+ * Hints that the tiles covering @rect will be accessed soon, allowing
+ * tiles that have been swapped out to be read back asynchronously. This
+ * never blocks, and has no effect on buffers not backed by swap.
+ */
+void            gegl_buffer_prefetch          (GeglBuffer          *buffer,
+                                               const GeglRectangle *rect);
+
+/**
+ * gegl_buffer_build_pyramid:
+ * @buffer: a #GeglBuffer
+ * @rect: (allow-none): the region to build the levels for, or NULL for the
+ * whole buffer.
+ * @levels: the number of levels to build above the base level, or 0 for all
+ * of them up to the one where @rect fits in a single tile.
+ *
+ * Computes the mipmap levels of @buffer over @rect ahead of time, on
+ * multiple threads, instead of on demand when a zoomed out view is first
+ * requested. From then on, the tiles of these levels that are affected by
+ * writes to @buffer are rebuilt in the background.
+ */
+void            gegl_buffer_build_pyramid     (GeglBuffer          *buffer,
+                                               const GeglRectangle *rect,
+                                               gint                 levels);
+
 
 /**
  * gegl_buffer_create_sub_buffer:
@@ -542,6 +602,55 @@ void              gegl_sampler_get            (GeglSampler    *sampler,
                                                void           *output,
                                                GeglAbyssPolicy repeat_mode);
 
+/**
+ * gegl_sampler_get_n:
+ * @sampler: a GeglSampler gotten from gegl_buffer_sampler_new
+ * @x: x coordinate of the first sample
+ * @y: y coordinate of the first sample
+ * @dx: x distance between consecutive samples
+ * @dy: y distance between consecutive samples
+ * @n: number of samples
+ * @scale: matrix representing extent of sampling area in source buffer,
+ * the same for all samples.
+ * @output: memory location for @n pixels of output data.
+ * @repeat_mode: how requests outside the buffer extent are handled.
+ *
+ * Perform @n samplings along a line, like the pixels of a scanline of an
+ * affine transform. The result is that of calling gegl_sampler_get ()
+ * with the coordinates advanced by @dx and @dy after each sample, but the
+ * samplers check the area of the buffer they hold once for a run of
+ * pixels, and convert the run to the output format at once.
+ */
+void              gegl_sampler_get_n          (GeglSampler    *sampler,
+                                               gdouble         x,
+                                               gdouble         y,
+                                               gdouble         dx,
+                                               gdouble         dy,
+                                               gint            n,
+                                               GeglMatrix2    *scale,
+                                               void           *output,
+                                               GeglAbyssPolicy repeat_mode);
+
+/**
+ * gegl_sampler_get_array:
+ * @sampler: a GeglSampler gotten from gegl_buffer_sampler_new
+ * @coordinates: (array): @n pairs of x and y coordinates to sample
+ * @n: number of samples
+ * @scale: matrix representing extent of sampling area in source buffer,
+ * the same for all samples.
+ * @output: memory location for @n pixels of output data.
+ * @repeat_mode: how requests outside the buffer extent are handled.
+ *
+ * Perform a sampling at each of the @n coordinates, like
+ * gegl_sampler_get_n () does for coordinates along a line.
+ */
+void              gegl_sampler_get_array      (GeglSampler    *sampler,
+                                               const gdouble  *coordinates,
+                                               gint            n,
+                                               GeglMatrix2    *scale,
+                                               void           *output,
+                                               GeglAbyssPolicy repeat_mode);
+
 /* code template utility, updates the jacobian matrix using
  * a user defined mapping function for displacement, example
  * with an identity transform (note that for the identity
@@ -0,0 +1,654 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+#include <babl/babl.h>
+
+#include "gegl.h"
+#include "gegl-compression.h"
+#include "gegl-config.h"
+#include "gegl-tile-alloc.h"
+
+
+typedef struct
+{
+  GeglCompression compression;
+  gboolean        delta;
+} PlanarCompression;
+
+static GHashTable *algorithms = NULL;
+static GMutex      algorithms_mutex;
+
+
+/* byte planes */
+
+static void
+planes_split (const guchar *data,
+              guchar       *planes,
+              gint          bpp,
+              gint          n,
+              gboolean      delta)
+{
+  gint c;
+
+  for (c = 0; c < bpp; c++)
+    {
+      const guchar *src  = data + c;
+      guchar       *dst  = planes + (gsize) c * n;
+      guchar        prev = 0;
+      gint          i;
+
+      if (delta)
+        {
+          for (i = 0; i < n; i++, src += bpp)
+            {
+              dst[i] = *src - prev;
+              prev   = *src;
+            }
+        }
+      else
+        {
+          for (i = 0; i < n; i++, src += bpp)
+            dst[i] = *src;
+        }
+    }
+}
+
+static void
+planes_join (const guchar *planes,
+             guchar       *data,
+             gint          bpp,
+             gint          n,
+             gboolean      delta)
+{
+  gint c;
+
+  for (c = 0; c < bpp; c++)
+    {
+      const guchar *src  = planes + (gsize) c * n;
+      guchar       *dst  = data + c;
+      guchar        prev = 0;
+      gint          i;
+
+      if (delta)
+        {
+          for (i = 0; i < n; i++, dst += bpp)
+            {
+              prev = *dst = src[i] + prev;
+            }
+        }
+      else
+        {
+          for (i = 0; i < n; i++, dst += bpp)
+            *dst = src[i];
+        }
+    }
+}
+
+
+/* nop */
+
+static gboolean
+nop_compress (const GeglCompression *compression,
+              gint                   bpp,
+              const guchar          *data,
+              gint                   n,
+              guchar                *compressed,
+              gint                  *compressed_size,
+              gint                   max_compressed_size)
+{
+  gint size = n * bpp;
+
+  if (size > max_compressed_size)
+    return FALSE;
+
+  memcpy (compressed, data, size);
+  *compressed_size = size;
+
+  return TRUE;
+}
+
+static gboolean
+nop_decompress (const GeglCompression *compression,
+                gint                   bpp,
+                guchar                *data,
+                gint                   n,
+                const guchar          *compressed,
+                gint                   compressed_size)
+{
+  if (compressed_size != n * bpp)
+    return FALSE;
+
+  memcpy (data, compressed, compressed_size);
+
+  return TRUE;
+}
+
+
+/* rle
+ *
+ * a control byte c < 128 is followed by c + 1 literal bytes, a control byte
+ * c >= 128 is followed by a single byte repeated c - 128 + RLE_MIN_RUN times.
+ */
+
+#define RLE_MIN_RUN     3
+#define RLE_MAX_RUN     (127 + RLE_MIN_RUN)
+#define RLE_MAX_LITERAL 128
+
+static gint
+rle_encode (const guchar *src,
+            gint          size,
+            guchar       *dst,
+            gint          max_size)
+{
+  guchar *out     = dst;
+  guchar *out_end = dst + max_size;
+  gint    i       = 0;
+
+  while (i < size)
+    {
+      gint run = 1;
+
+      while (i + run < size && run < RLE_MAX_RUN && src[i + run] == src[i])
+        run++;
+
+      if (run >= RLE_MIN_RUN)
+        {
+          if (out_end - out < 2)
+            return -1;
+
+          *out++ = 128 + run - RLE_MIN_RUN;
+          *out++ = src[i];
+          i += run;
+        }
+      else
+        {
+          gint start = i;
+          gint count;
+
+          while (i < size && i - start < RLE_MAX_LITERAL &&
+                 ! (i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2]))
+            i++;
+
+          count = i - start;
+
+          if (out_end - out < count + 1)
+            return -1;
+
+          *out++ = count - 1;
+          memcpy (out, src + start, count);
+          out += count;
+        }
+    }
+
+  return out - dst;
+}
+
+static gboolean
+rle_decode (const guchar *src,
+            gint          size,
+            guchar       *dst,
+            gint          dst_size)
+{
+  const guchar *in      = src;
+  const guchar *in_end  = src + size;
+  guchar       *out     = dst;
+  guchar       *out_end = dst + dst_size;
+
+  while (in < in_end)
+    {
+      gint c = *in++;
+
+      if (c < 128)
+        {
+          gint count = c + 1;
+
+          if (in_end - in < count || out_end - out < count)
+            return FALSE;
+
+          memcpy (out, in, count);
+          in  += count;
+          out += count;
+        }
+      else
+        {
+          gint count = c - 128 + RLE_MIN_RUN;
+
+          if (in == in_end || out_end - out < count)
+            return FALSE;
+
+          memset (out, *in++, count);
+          out += count;
+        }
+    }
+
+  return out == out_end;
+}
+
+
+/* lz
+ *
+ * a control byte c < 32 is followed by c + 1 literal bytes. otherwise the
+ * top 3 bits of c hold the match length - 2, with 7 meaning an additional
+ * length byte follows, and the low 5 bits together with the next byte hold
+ * the match distance - 1.
+ */
+
+#define LZ_HASH_BITS    13
+#define LZ_MAX_LITERAL  32
+#define LZ_MAX_DISTANCE 8192
+#define LZ_MAX_MATCH    (7 + 255 + 2)
+
+#define LZ_READ3(p)     ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16))
+#define LZ_HASH(v)      ((((v) * 2654435761u) >> (32 - LZ_HASH_BITS)))
+
+static guchar *
+lz_emit_literals (const guchar *src,
+                  gint          count,
+                  guchar       *out,
+                  guchar       *out_end)
+{
+  while (count)
+    {
+      gint chunk = MIN (count, LZ_MAX_LITERAL);
+
+      if (out_end - out < chunk + 1)
+        return NULL;
+
+      *out++ = chunk - 1;
+      memcpy (out, src, chunk);
+
+      out   += chunk;
+      src   += chunk;
+      count -= chunk;
+    }
+
+  return out;
+}
+
+static gint
+lz_encode (const guchar *src,
+           gint          size,
+           guchar       *dst,
+           gint          max_size)
+{
+  gint    table[1 << LZ_HASH_BITS];
+  guchar *out     = dst;
+  guchar *out_end = dst + max_size;
+  gint    anchor  = 0;
+  gint    i       = 0;
+
+  /* positions are stored off by one, so that zero means empty */
+  memset (table, 0, sizeof (table));
+
+  while (i + 3 < size)
+    {
+      guint32 seq  = LZ_READ3 (src + i);
+      guint   hash = LZ_HASH (seq);
+      gint    ref  = table[hash] - 1;
+
+      table[hash] = i + 1;
+
+      if (ref >= 0 && i - ref <= LZ_MAX_DISTANCE &&
+          LZ_READ3 (src + ref) == seq)
+        {
+          gint distance = i - ref - 1;
+          gint length   = 3;
+          gint code;
+
+          while (i + length < size && length < LZ_MAX_MATCH &&
+                 src[ref + length] == src[i + length])
+            length++;
+
+          out = lz_emit_literals (src + anchor, i - anchor, out, out_end);
+          if (! out || out_end - out < 3)
+            return -1;
+
+          code = length - 2;
+          if (code < 7)
+            {
+              *out++ = (code << 5) | (distance >> 8);
+            }
+          else
+            {
+              *out++ = (7 << 5) | (distance >> 8);
+              *out++ = code - 7;
+            }
+          *out++ = distance & 0xff;
+
+          i     += length;
+          anchor = i;
+        }
+      else
+        {
+          i++;
+        }
+    }
+
+  out = lz_emit_literals (src + anchor, size - anchor, out, out_end);
+  if (! out)
+    return -1;
+
+  return out - dst;
+}
+
+static gboolean
+lz_decode (const guchar *src,
+           gint          size,
+           guchar       *dst,
+           gint          dst_size)
+{
+  const guchar *in      = src;
+  const guchar *in_end  = src + size;
+  guchar       *out     = dst;
+  guchar       *out_end = dst + dst_size;
+
+  while (in < in_end)
+    {
+      gint c = *in++;
+
+      if (c < LZ_MAX_LITERAL)
+        {
+          gint count = c + 1;
+
+          if (in_end - in < count || out_end - out < count)
+            return FALSE;
+
+          memcpy (out, in, count);
+          in  += count;
+          out += count;
+        }
+      else
+        {
+          const guchar *ref;
+          gint          length = (c >> 5) + 2;
+          gint          distance;
+
+          if (length == 7 + 2)
+            {
+              if (in == in_end)
+                return FALSE;
+              length += *in++;
+            }
+
+          if (in == in_end)
+            return FALSE;
+          distance = (((c & 31) << 8) | *in++) + 1;
+
+          if (out - dst < distance || out_end - out < length)
+            return FALSE;
+
+          /* matches may overlap the output, copy byte by byte */
+          for (ref = out - distance; length--; )
+            *out++ = *ref++;
+        }
+    }
+
+  return out == out_end;
+}
+
+
+/* planar codecs */
+
+static gboolean
+planar_compress (const GeglCompression *compression,
+                 gint                   bpp,
+                 const guchar          *data,
+                 gint                   n,
+                 guchar                *compressed,
+                 gint                  *compressed_size,
+                 gint                   max_compressed_size,
+                 gint                (* encode) (const guchar *src,
+                                                 gint          size,
+                                                 guchar       *dst,
+                                                 gint          max_size))
+{
+  const PlanarCompression *planar = (const PlanarCompression *) compression;
+  guchar                  *planes = gegl_tile_alloc (n * bpp);
+  gint                     size;
+
+  planes_split (data, planes, bpp, n, planar->delta);
+  size = encode (planes, n * bpp, compressed, max_compressed_size);
+
+  gegl_tile_free (planes);
+
+  if (size < 0)
+    return FALSE;
+
+  *compressed_size = size;
+
+  return TRUE;
+}
+
+static gboolean
+planar_decompress (const GeglCompression *compression,
+                   gint                   bpp,
+                   guchar                *data,
+                   gint                   n,
+                   const guchar          *compressed,
+                   gint                   compressed_size,
+                   gboolean            (* decode) (const guchar *src,
+                                                   gint          size,
+                                                   guchar       *dst,
+                                                   gint          dst_size))
+{
+  const PlanarCompression *planar = (const PlanarCompression *) compression;
+  guchar                  *planes = gegl_tile_alloc (n * bpp);
+  gboolean                 success;
+
+  success = decode (compressed, compressed_size, planes, n * bpp);
+
+  if (success)
+    planes_join (planes, data, bpp, n, planar->delta);
+
+  gegl_tile_free (planes);
+
+  return success;
+}
+
+static gboolean
+rle_compress (const GeglCompression *compression,
+              gint                   bpp,
+              const guchar          *data,
+              gint                   n,
+              guchar                *compressed,
+              gint                  *compressed_size,
+              gint                   max_compressed_size)
+{
+  return planar_compress (compression, bpp, data, n,
+                          compressed, compressed_size, max_compressed_size,
+                          rle_encode);
+}
+
+static gboolean
+rle_decompress (const GeglCompression *compression,
+                gint                   bpp,
+                guchar                *data,
+                gint                   n,
+                const guchar          *compressed,
+                gint                   compressed_size)
+{
+  return planar_decompress (compression, bpp, data, n,
+                            compressed, compressed_size,
+                            rle_decode);
+}
+
+static gboolean
+lz_compress (const GeglCompression *compression,
+             gint                   bpp,
+             const guchar          *data,
+             gint                   n,
+             guchar                *compressed,
+             gint                  *compressed_size,
+             gint                   max_compressed_size)
+{
+  return planar_compress (compression, bpp, data, n,
+                          compressed, compressed_size, max_compressed_size,
+                          lz_encode);
+}
+
+static gboolean
+lz_decompress (const GeglCompression *compression,
+               gint                   bpp,
+               guchar                *data,
+               gint                   n,
+               const guchar          *compressed,
+               gint                   compressed_size)
+{
+  return planar_decompress (compression, bpp, data, n,
+                            compressed, compressed_size,
+                            lz_decode);
+}
+
+
+static const GeglCompression nop_compression =
+{
+  nop_compress, nop_decompress
+};
+
+static const PlanarCompression rle_compression =
+{
+  { rle_compress, rle_decompress }, FALSE
+};
+
+static const PlanarCompression delta_compression =
+{
+  { rle_compress, rle_decompress }, TRUE
+};
+
+static const PlanarCompression lz_compression =
+{
+  { lz_compress, lz_decompress }, FALSE
+};
+
+static void
+gegl_compression_init (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      algorithms = g_hash_table_new (g_str_hash, g_str_equal);
+
+      g_hash_table_insert (algorithms, "nop",
+                           (gpointer) &nop_compression);
+      g_hash_table_insert (algorithms, "rle",
+                           (gpointer) &rle_compression.compression);
+      g_hash_table_insert (algorithms, "delta",
+                           (gpointer) &delta_compression.compression);
+      g_hash_table_insert (algorithms, "lz",
+                           (gpointer) &lz_compression.compression);
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+void
+gegl_compression_register (const gchar           *name,
+                           const GeglCompression *compression)
+{
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (compression != NULL);
+
+  gegl_compression_init ();
+
+  g_mutex_lock (&algorithms_mutex);
+  g_hash_table_insert (algorithms,
+                       (gpointer) g_intern_string (name),
+                       (gpointer) compression);
+  g_mutex_unlock (&algorithms_mutex);
+}
+
+const GeglCompression *
+gegl_compression (const gchar *name)
+{
+  const GeglCompression *compression;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  gegl_compression_init ();
+
+  g_mutex_lock (&algorithms_mutex);
+  compression = g_hash_table_lookup (algorithms, name);
+  g_mutex_unlock (&algorithms_mutex);
+
+  return compression;
+}
+
+const gchar *
+gegl_compression_for_format (const Babl *format)
+{
+  const gchar *name = gegl_config ()->compression;
+
+  if (name && gegl_compression (name))
+    return name;
+
+  return gegl_compression_best_for_format (format);
+}
+
+const gchar *
+gegl_compression_best_for_format (const Babl *format)
+{
+  /* 8-bit data is mostly flat regions, masks and smooth gradients, which
+   * delta coded runs handle well and fast; wider components rarely repeat
+   * exactly, but their byte planes have enough redundancy for lz
+   */
+  if (babl_format_get_type (format, 0) == babl_type ("u8"))
+    return "delta";
+
+  return "lz";
+}
+
+gboolean
+gegl_compression_compress (const GeglCompression *compression,
+                           const Babl            *format,
+                           gconstpointer          data,
+                           gint                   n,
+                           gpointer               compressed,
+                           gint                  *compressed_size,
+                           gint                   max_compressed_size)
+{
+  g_return_val_if_fail (compression != NULL, FALSE);
+  g_return_val_if_fail (format != NULL, FALSE);
+  g_return_val_if_fail (compressed_size != NULL, FALSE);
+
+  return compression->compress (compression,
+                                babl_format_get_bytes_per_pixel (format),
+                                data, n,
+                                compressed, compressed_size,
+                                max_compressed_size);
+}
+
+gboolean
+gegl_compression_decompress (const GeglCompression *compression,
+                             const Babl            *format,
+                             gpointer               data,
+                             gint                   n,
+                             gconstpointer          compressed,
+                             gint                   compressed_size)
+{
+  g_return_val_if_fail (compression != NULL, FALSE);
+  g_return_val_if_fail (format != NULL, FALSE);
+
+  return compression->decompress (compression,
+                                  babl_format_get_bytes_per_pixel (format),
+                                  data, n,
+                                  compressed, compressed_size);
+}
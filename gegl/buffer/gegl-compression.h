@@ -0,0 +1,95 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_COMPRESSION_H__
+#define __GEGL_COMPRESSION_H__
+
+#include <glib.h>
+#include <babl/babl.h>
+
+G_BEGIN_DECLS
+
+/***
+ * Lossless codecs for tile data. All codecs operate on whole pixels of a
+ * given format, and work on the data split into byte planes, so that
+ * corresponding bytes of neighbouring pixels end up next to each other.
+ *
+ * The built-in codecs are:
+ *
+ *  "nop"   - stores the data as is
+ *  "rle"   - run-length encoding of each byte plane, fast and suited to flat
+ *            regions and masks
+ *  "delta" - like "rle", of the differences between neighbouring pixels,
+ *            which also catches smooth gradients in 8-bit data
+ *  "lz"    - an LZ77 style codec over the byte planes, for higher bit depth
+ *            formats
+ */
+
+typedef struct _GeglCompression GeglCompression;
+
+struct _GeglCompression
+{
+  /* returns FALSE if the compressed data doesn't fit in
+   * max_compressed_size bytes
+   */
+  gboolean (* compress)   (const GeglCompression *compression,
+                           gint                   bpp,
+                           const guchar          *data,
+                           gint                   n,
+                           guchar                *compressed,
+                           gint                  *compressed_size,
+                           gint                   max_compressed_size);
+
+  gboolean (* decompress) (const GeglCompression *compression,
+                           gint                   bpp,
+                           guchar                *data,
+                           gint                   n,
+                           const guchar          *compressed,
+                           gint                   compressed_size);
+};
+
+void                    gegl_compression_register   (const gchar           *name,
+                                                     const GeglCompression *compression);
+
+const GeglCompression * gegl_compression            (const gchar           *name);
+
+/* the name of the codec best suited to data in format */
+const gchar           * gegl_compression_best_for_format
+                                                    (const Babl            *format);
+
+/* the codec of the compressed tile store for data in format, the
+ * compression of the GeglConfig if set, else the best suited one
+ */
+const gchar           * gegl_compression_for_format (const Babl            *format);
+
+gboolean                gegl_compression_compress   (const GeglCompression *compression,
+                                                     const Babl            *format,
+                                                     gconstpointer          data,
+                                                     gint                   n,
+                                                     gpointer               compressed,
+                                                     gint                  *compressed_size,
+                                                     gint                   max_compressed_size);
+
+gboolean                gegl_compression_decompress (const GeglCompression *compression,
+                                                     const Babl            *format,
+                                                     gpointer               data,
+                                                     gint                   n,
+                                                     gconstpointer          compressed,
+                                                     gint                   compressed_size);
+
+G_END_DECLS
+
+#endif
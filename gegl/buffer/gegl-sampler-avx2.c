@@ -0,0 +1,142 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AVX2 versions of the linear and cubic interpolation of a span, two
+ * output pixels in one vector. this file is compiled with
+ * AVX2_EXTRA_CFLAGS, which do not allow the compiler to contract the
+ * multiplications and additions into FMA instructions, so the results are
+ * those of the SSE2 versions (see gegl-sampler-sse2.c).
+ */
+
+#include "config.h"
+
+#include <immintrin.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-sampler-linear.h"
+#include "gegl-sampler-cubic.h"
+
+#define ROWSTRIDE (GEGL_SAMPLER_MAXIMUM_WIDTH * 4)
+
+/* a pixel from a and one from b */
+static inline __m256
+load_pair (const gfloat *a,
+           const gfloat *b)
+{
+  return _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (a)),
+                               _mm_loadu_ps (b), 1);
+}
+
+/* a weight for the pixel from a and one for the pixel from b */
+static inline __m256
+set_pair (gfloat a,
+          gfloat b)
+{
+  return _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_set1_ps (a)),
+                               _mm_set1_ps (b), 1);
+}
+
+void
+gegl_sampler_linear_interpolate_span_avx2 (GeglSampler  *self,
+                                           const gint   *ix,
+                                           const gint   *iy,
+                                           const gfloat *x,
+                                           const gfloat *y,
+                                           gint          n,
+                                           gfloat       *newval)
+{
+  gint i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+    {
+      const gfloat *a   = _gegl_sampler_get_span_ptr (self, ix[i],     iy[i]);
+      const gfloat *b   = _gegl_sampler_get_span_ptr (self, ix[i + 1], iy[i + 1]);
+      const gfloat  xya = x[i] * y[i];
+      const gfloat  xyb = x[i + 1] * y[i + 1];
+      const gfloat  wya = y[i] - xya;
+      const gfloat  wyb = y[i + 1] - xyb;
+      const gfloat  xza = x[i] - xya;
+      const gfloat  xzb = x[i + 1] - xyb;
+      const gfloat  wza = (gfloat) 1. - (x[i] + wya);
+      const gfloat  wzb = (gfloat) 1. - (x[i + 1] + wyb);
+      __m256        sum;
+
+      sum = _mm256_mul_ps (set_pair (xya, xyb),
+                           load_pair (a + ROWSTRIDE + 4, b + ROWSTRIDE + 4));
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (set_pair (wya, wyb),
+                                               load_pair (a + ROWSTRIDE,
+                                                          b + ROWSTRIDE)));
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (set_pair (xza, xzb),
+                                               load_pair (a + 4, b + 4)));
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (set_pair (wza, wzb),
+                                               load_pair (a, b)));
+
+      _mm256_storeu_ps (newval + 4 * i, sum);
+    }
+
+  if (i < n)
+    gegl_sampler_linear_interpolate_span_sse2 (self, ix + i, iy + i,
+                                               x + i, y + i, n - i,
+                                               newval + 4 * i);
+}
+
+void
+gegl_sampler_cubic_interpolate_span_avx2 (GeglSampler  *self,
+                                          const gint   *ix,
+                                          const gint   *iy,
+                                          const gfloat *x,
+                                          const gfloat *y,
+                                          gint          n,
+                                          gfloat       *newval)
+{
+  GeglSamplerCubic *cubic = (GeglSamplerCubic*)(self);
+  gint              i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+    {
+      const gfloat *a = _gegl_sampler_get_span_ptr (self, ix[i], iy[i]) -
+                        ROWSTRIDE - 4;
+      const gfloat *b = _gegl_sampler_get_span_ptr (self, ix[i + 1], iy[i + 1]) -
+                        ROWSTRIDE - 4;
+      gfloat        kxa[4], kya[4];
+      gfloat        kxb[4], kyb[4];
+      __m256        sum = _mm256_setzero_ps ();
+      gint          j, k;
+
+      for (k = 0; k < 4; k++)
+        {
+          kxa[k] = gegl_sampler_cubic_kernel (x[i] - (k - 1), cubic->b, cubic->c);
+          kya[k] = gegl_sampler_cubic_kernel (y[i] - (k - 1), cubic->b, cubic->c);
+          kxb[k] = gegl_sampler_cubic_kernel (x[i + 1] - (k - 1), cubic->b, cubic->c);
+          kyb[k] = gegl_sampler_cubic_kernel (y[i + 1] - (k - 1), cubic->b, cubic->c);
+        }
+
+      for (j = 0; j < 4; j++, a += ROWSTRIDE, b += ROWSTRIDE)
+        for (k = 0; k < 4; k++)
+          sum = _mm256_add_ps (sum,
+                               _mm256_mul_ps (set_pair (kya[j] * kxa[k],
+                                                        kyb[j] * kxb[k]),
+                                              load_pair (a + 4 * k, b + 4 * k)));
+
+      _mm256_storeu_ps (newval + 4 * i, sum);
+    }
+
+  if (i < n)
+    gegl_sampler_cubic_interpolate_span_sse2 (self, ix + i, iy + i,
+                                              x + i, y + i, n - i,
+                                              newval + 4 * i);
+}
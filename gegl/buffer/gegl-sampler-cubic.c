@@ -23,6 +23,7 @@
 
 #include "gegl.h"
 #include "gegl-types-internal.h"
+#include "gegl-cpuaccel.h"
 #include "gegl-sampler-cubic.h"
 
 enum
@@ -41,6 +42,12 @@ static void gegl_sampler_cubic_get      (      GeglSampler     *sampler,
                                                GeglMatrix2     *scale,
                                                void            *output,
                                                GeglAbyssPolicy  repeat_mode);
+static void gegl_sampler_cubic_get_n    (      GeglSampler     *sampler,
+                                         const gdouble         *coordinates,
+                                               gint             n,
+                                               GeglMatrix2     *scale,
+                                               void            *output,
+                                               GeglAbyssPolicy  repeat_mode);
 static void get_property                (      GObject         *gobject,
                                                guint            prop_id,
                                                GValue          *value,
@@ -49,9 +56,13 @@ static void set_property                (      GObject         *gobject,
                                                guint            prop_id,
                                          const GValue          *value,
                                                GParamSpec      *pspec);
-static inline gfloat cubicKernel        (const gfloat           x,
-                                         const gdouble          b,
-                                         const gdouble          c);
+static void gegl_sampler_cubic_interpolate_span (GeglSampler  *self,
+                                                 const gint   *ix,
+                                                 const gint   *iy,
+                                                 const gfloat *x,
+                                                 const gfloat *y,
+                                                 gint          n,
+                                                 gfloat       *newval);
 
 
 G_DEFINE_TYPE (GeglSamplerCubic, gegl_sampler_cubic, GEGL_TYPE_SAMPLER)
@@ -67,6 +78,7 @@ gegl_sampler_cubic_class_init (GeglSamplerCubicClass *klass)
   object_class->finalize     = gegl_sampler_cubic_finalize;
 
   sampler_class->get     = gegl_sampler_cubic_get;
+  sampler_class->get_n   = gegl_sampler_cubic_get_n;
 
   g_object_class_install_property ( object_class, PROP_B,
     g_param_spec_double ("b",
@@ -104,6 +116,8 @@ gegl_sampler_cubic_finalize (GObject *object)
 static void
 gegl_sampler_cubic_init (GeglSamplerCubic *self)
 {
+  GeglCpuAccelFlags accel = gegl_cpu_accel_get_support ();
+
   /*
    * In principle, x=y=-1 and width=height=4 are enough. The following
    * values are chosen so as to make the context_rect symmetrical
@@ -150,30 +164,75 @@ gegl_sampler_cubic_init (GeglSamplerCubic *self)
        */
       self->c = 0.5 * (1.0 - self->b);
     }
+
+  /* picked for each sampler, as for the linear one */
+  self->interpolate_span = gegl_sampler_cubic_interpolate_span;
+
+#ifdef USE_SSE2
+  if (accel & GEGL_CPU_ACCEL_X86_SSE2)
+    self->interpolate_span = gegl_sampler_cubic_interpolate_span_sse2;
+#endif
+
+#ifdef USE_AVX2
+  if (accel & GEGL_CPU_ACCEL_X86_AVX2)
+    self->interpolate_span = gegl_sampler_cubic_interpolate_span_avx2;
+#endif
+
+  (void) accel;
 }
 
-void
-gegl_sampler_cubic_get (      GeglSampler     *self,
-                        const gdouble          absolute_x,
-                        const gdouble          absolute_y,
-                              GeglMatrix2     *scale,
-                              void            *output,
-                              GeglAbyssPolicy  repeat_mode)
+/*
+ * Interpolates the 4x4 pixels around sampler_bptr, x and y being the
+ * position of the sampling point relative to the center of the pixel at
+ * sampler_bptr.
+ */
+static inline void
+gegl_sampler_cubic_interpolate (GeglSamplerCubic *cubic,
+                                gfloat           *sampler_bptr,
+                                const gfloat      x,
+                                const gfloat      y,
+                                gfloat           *newval)
 {
-  GeglSamplerCubic *cubic       = (GeglSamplerCubic*)(self);
   const gint        offsets[16] = {
                                     -4-GEGL_SAMPLER_MAXIMUM_WIDTH   *4, 4, 4, 4,
                                       (GEGL_SAMPLER_MAXIMUM_WIDTH-3)*4, 4, 4, 4,
                                       (GEGL_SAMPLER_MAXIMUM_WIDTH-3)*4, 4, 4, 4,
                                       (GEGL_SAMPLER_MAXIMUM_WIDTH-3)*4, 4, 4, 4
                                   };
-  gfloat           *sampler_bptr;
   gfloat            factor;
-  gfloat            newval[4]   = {0, 0, 0, 0};
   gint              i,
                     j,
                     k           = 0;
 
+  newval[0] = newval[1] = newval[2] = newval[3] = 0;
+
+  for (j=-1; j<3; j++)
+    for (i=-1; i<3; i++)
+      {
+        sampler_bptr += offsets[k++];
+
+        factor = gegl_sampler_cubic_kernel (y - j, cubic->b, cubic->c) *
+                 gegl_sampler_cubic_kernel (x - i, cubic->b, cubic->c);
+
+        newval[0] += factor * sampler_bptr[0];
+        newval[1] += factor * sampler_bptr[1];
+        newval[2] += factor * sampler_bptr[2];
+        newval[3] += factor * sampler_bptr[3];
+      }
+}
+
+void
+gegl_sampler_cubic_get (      GeglSampler     *self,
+                        const gdouble          absolute_x,
+                        const gdouble          absolute_y,
+                              GeglMatrix2     *scale,
+                              void            *output,
+                              GeglAbyssPolicy  repeat_mode)
+{
+  GeglSamplerCubic *cubic       = (GeglSamplerCubic*)(self);
+  gfloat           *sampler_bptr;
+  gfloat            newval[4];
+
   /*
    * The "-1/2"s are there because we want the index of the pixel
    * center to the left and top of the location, and with GIMP's
@@ -201,21 +260,77 @@ gegl_sampler_cubic_get (      GeglSampler     *self,
 
   sampler_bptr = gegl_sampler_get_ptr (self, ix, iy, repeat_mode);
 
-  for (j=-1; j<3; j++)
-    for (i=-1; i<3; i++)
-      {
-        sampler_bptr += offsets[k++];
+  gegl_sampler_cubic_interpolate (cubic, sampler_bptr, x, y, newval);
 
-        factor = cubicKernel (y - j, cubic->b, cubic->c) *
-                 cubicKernel (x - i, cubic->b, cubic->c);
+  babl_process (self->fish, newval, output, 1);
+}
 
-        newval[0] += factor * sampler_bptr[0];
-        newval[1] += factor * sampler_bptr[1];
-        newval[2] += factor * sampler_bptr[2];
-        newval[3] += factor * sampler_bptr[3];
-      }
+static void
+gegl_sampler_cubic_interpolate_span (GeglSampler  *self,
+                                     const gint   *ix,
+                                     const gint   *iy,
+                                     const gfloat *x,
+                                     const gfloat *y,
+                                     gint          n,
+                                     gfloat       *newval)
+{
+  GeglSamplerCubic *cubic = (GeglSamplerCubic*)(self);
+  gint              i;
+
+  for (i = 0; i < n; i++)
+    gegl_sampler_cubic_interpolate (cubic,
+                                    _gegl_sampler_get_span_ptr (self, ix[i], iy[i]),
+                                    x[i], y[i],
+                                    newval + 4 * i);
+}
 
-  babl_process (self->fish, newval, output, 1);
+/*
+ * The same as gegl_sampler_cubic_get () for each of the coordinates,
+ * checking the area held by the sampler once for a span of pixels.
+ */
+static void
+gegl_sampler_cubic_get_n (      GeglSampler     *self,
+                          const gdouble         *coordinates,
+                                gint             n,
+                                GeglMatrix2     *scale,
+                                void            *output,
+                                GeglAbyssPolicy  repeat_mode)
+{
+  GeglSamplerCubic *cubic = (GeglSamplerCubic*)(self);
+  const gint        bpp   = babl_format_get_bytes_per_pixel (self->format);
+  guchar           *out   = output;
+
+  while (n > 0)
+    {
+      gint   ix[GEGL_SAMPLER_SPAN];
+      gint   iy[GEGL_SAMPLER_SPAN];
+      gfloat x[GEGL_SAMPLER_SPAN];
+      gfloat y[GEGL_SAMPLER_SPAN];
+      gfloat newval[4 * GEGL_SAMPLER_SPAN];
+      gint   m = MIN (n, GEGL_SAMPLER_SPAN);
+      gint   i;
+
+      for (i = 0; i < m; i++)
+        {
+          const double iabsolute_x = (double) coordinates[2 * i]     - 0.5;
+          const double iabsolute_y = (double) coordinates[2 * i + 1] - 0.5;
+
+          ix[i] = floorf (iabsolute_x);
+          iy[i] = floorf (iabsolute_y);
+          x[i]  = iabsolute_x - ix[i];
+          y[i]  = iabsolute_y - iy[i];
+        }
+
+      m = _gegl_sampler_get_span (self, ix, iy, m, repeat_mode);
+
+      cubic->interpolate_span (self, ix, iy, x, y, m, newval);
+
+      babl_process (self->fish, newval, out, m);
+
+      coordinates += 2 * m;
+      out         += bpp * m;
+      n           -= m;
+    }
 }
 
 static void
@@ -265,23 +380,3 @@ set_property (GObject      *object,
         break;
     }
 }
-
-static inline gfloat
-cubicKernel (const gfloat  x,
-             const gdouble b,
-             const gdouble c)
-{
-  const gfloat x2 = x*x;
-  const gfloat ax = ( x<(gfloat) 0. ? -x : x );
-
-  if (x2 <= (gfloat) 1.) return ( (gfloat) ((12-9*b-6*c)/6) * ax +
-                                  (gfloat) ((-18+12*b+6*c)/6) ) * x2 +
-                                  (gfloat) ((6-2*b)/6);
-
-  if (x2 < (gfloat) 4.) return ( (gfloat) ((-b-6*c)/6) * ax +
-                                 (gfloat) ((6*b+30*c)/6) ) * x2 +
-                                 (gfloat) ((-12*b-48*c)/6) * ax +
-                                 (gfloat) ((8*b+24*c)/6);
-
-  return (gfloat) 0.;
-}
@@ -33,12 +33,13 @@ typedef struct _GeglSamplerCubicClass GeglSamplerCubicClass;
 
 struct _GeglSamplerCubic
 {
-  GeglSampler parent_instance;
+  GeglSampler         parent_instance;
 
   /*< private >*/
-  gdouble     b;
-  gdouble     c;
-  gchar      *type;
+  gdouble             b;
+  gdouble             c;
+  gchar              *type;
+  GeglSamplerSpanFunc interpolate_span;
 };
 
 struct _GeglSamplerCubicClass
@@ -48,6 +49,53 @@ struct _GeglSamplerCubicClass
 
 GType gegl_sampler_cubic_get_type (void) G_GNUC_CONST;
 
+/*
+ * The weight of a pixel at distance x from the sampling point, shared by
+ * the scalar and SIMD versions of the sampler.
+ */
+static inline gfloat
+gegl_sampler_cubic_kernel (const gfloat  x,
+                           const gdouble b,
+                           const gdouble c)
+{
+  const gfloat x2 = x*x;
+  const gfloat ax = ( x<(gfloat) 0. ? -x : x );
+
+  if (x2 <= (gfloat) 1.) return ( (gfloat) ((12-9*b-6*c)/6) * ax +
+                                  (gfloat) ((-18+12*b+6*c)/6) ) * x2 +
+                                  (gfloat) ((6-2*b)/6);
+
+  if (x2 < (gfloat) 4.) return ( (gfloat) ((-b-6*c)/6) * ax +
+                                 (gfloat) ((6*b+30*c)/6) ) * x2 +
+                                 (gfloat) ((-12*b-48*c)/6) * ax +
+                                 (gfloat) ((8*b+24*c)/6);
+
+  return (gfloat) 0.;
+}
+
+/* SIMD versions of the interpolation of a span, picked by
+ * gegl_sampler_cubic_init () when the CPU supports them
+ */
+#ifdef USE_SSE2
+void gegl_sampler_cubic_interpolate_span_sse2 (GeglSampler  *self,
+                                               const gint   *ix,
+                                               const gint   *iy,
+                                               const gfloat *x,
+                                               const gfloat *y,
+                                               gint          n,
+                                               gfloat       *newval);
+#endif
+
+#ifdef USE_AVX2
+void gegl_sampler_cubic_interpolate_span_avx2 (GeglSampler  *self,
+                                               const gint   *ix,
+                                               const gint   *iy,
+                                               const gfloat *x,
+                                               const gfloat *y,
+                                               gint          n,
+                                               gfloat       *newval);
+#endif
+
 G_END_DECLS
 
 #endif
@@ -23,6 +23,7 @@
 
 #include "gegl.h"
 #include "gegl-types-internal.h"
+#include "gegl-cpuaccel.h"
 #include "gegl-sampler-linear.h"
 
 enum
@@ -37,6 +38,19 @@ static void gegl_sampler_linear_get (      GeglSampler* restrict  self,
                                            GeglMatrix2           *scale,
                                            void*        restrict  output,
                                            GeglAbyssPolicy        repeat_mode);
+static void gegl_sampler_linear_get_n (      GeglSampler* restrict  self,
+                                       const gdouble*     restrict  coordinates,
+                                             gint                   n,
+                                             GeglMatrix2           *scale,
+                                             void*        restrict  output,
+                                             GeglAbyssPolicy        repeat_mode);
+static void gegl_sampler_linear_interpolate_span (GeglSampler  *self,
+                                                  const gint   *ix,
+                                                  const gint   *iy,
+                                                  const gfloat *x,
+                                                  const gfloat *y,
+                                                  gint          n,
+                                                  gfloat       *newval);
 
 G_DEFINE_TYPE (GeglSamplerLinear, gegl_sampler_linear, GEGL_TYPE_SAMPLER)
 
@@ -45,7 +59,8 @@ gegl_sampler_linear_class_init (GeglSamplerLinearClass *klass)
 {
   GeglSamplerClass *sampler_class = GEGL_SAMPLER_CLASS (klass);
 
-  sampler_class->get = gegl_sampler_linear_get;
+  sampler_class->get   = gegl_sampler_linear_get;
+  sampler_class->get_n = gegl_sampler_linear_get_n;
 }
 
 /*
@@ -66,53 +81,45 @@ gegl_sampler_linear_class_init (GeglSamplerLinearClass *klass)
 static void
 gegl_sampler_linear_init (GeglSamplerLinear *self)
 {
+  GeglCpuAccelFlags accel = gegl_cpu_accel_get_support ();
+
   GEGL_SAMPLER (self)->level[0].context_rect.x      = -1 -   LINEAR_EXTRA_ELBOW_ROOM;
   GEGL_SAMPLER (self)->level[0].context_rect.y      = -1 -   LINEAR_EXTRA_ELBOW_ROOM;
   GEGL_SAMPLER (self)->level[0].context_rect.width  =  3 + 2*LINEAR_EXTRA_ELBOW_ROOM;
   GEGL_SAMPLER (self)->level[0].context_rect.height =  3 + 2*LINEAR_EXTRA_ELBOW_ROOM;
   GEGL_SAMPLER (self)->interpolate_format = babl_format ("RaGaBaA float");
-}
-
-static void
-gegl_sampler_linear_get (      GeglSampler*    restrict  self,
-                         const gdouble                   absolute_x,
-                         const gdouble                   absolute_y,
-                               GeglMatrix2              *scale,
-                               void*           restrict  output,
-                               GeglAbyssPolicy           repeat_mode)
-{
-  const gint pixels_per_buffer_row = GEGL_SAMPLER_MAXIMUM_WIDTH;
-  const gint channels = 4;
 
-  /*
-   * The "-1/2"s are there because we want the index of the pixel to
-   * the left and top of the location, and with GIMP's convention the
-   * top left of the top left pixel is located at
-   * (1/2,1/2). Basically, we are converting from a coordinate system
-   * in which the origin is at the top left pixel of the pixel with
-   * index (0,0), to a coordinate system in which the origin is at the
-   * center of the same pixel.
+  /* picked for each sampler rather than for the class, so that turning
+   * the CPU acceleration off takes effect on the next sampler created
    */
-  const float iabsolute_x = (float) absolute_x - 0.5;
-  const float iabsolute_y = (float) absolute_y - 0.5;
+  self->interpolate_span = gegl_sampler_linear_interpolate_span;
 
-  const gint ix = floorf (iabsolute_x);
-  const gint iy = floorf (iabsolute_y);
+#ifdef USE_SSE2
+  if (accel & GEGL_CPU_ACCEL_X86_SSE2)
+    self->interpolate_span = gegl_sampler_linear_interpolate_span_sse2;
+#endif
 
-  /*
-   * Point the data tile pointer to the first channel of the top_left
-   * pixel value:
-   */
-  const gfloat* restrict in_bptr =
-    gegl_sampler_get_ptr (self, ix, iy, repeat_mode);
+#ifdef USE_AVX2
+  if (accel & GEGL_CPU_ACCEL_X86_AVX2)
+    self->interpolate_span = gegl_sampler_linear_interpolate_span_avx2;
+#endif
 
-  /*
-   * x is the x-coordinate of the sampling point relative to the
-   * position of the center of the top left pixel. Similarly for
-   * y. Range of values: [0,1].
-   */
-  const gfloat x = iabsolute_x - ix;
-  const gfloat y = iabsolute_y - iy;
+  (void) accel;
+}
+
+/*
+ * Interpolates bilinearly between the pixel at in_bptr and its right,
+ * bottom and bottom right neighbours, x and y being the position of the
+ * sampling point relative to the center of the pixel at in_bptr.
+ */
+static inline void
+gegl_sampler_linear_interpolate (const gfloat* restrict in_bptr,
+                                 const gfloat           x,
+                                 const gfloat           y,
+                                       gfloat* restrict newval)
+{
+  const gint pixels_per_buffer_row = GEGL_SAMPLER_MAXIMUM_WIDTH;
+  const gint channels = 4;
 
   /*
    * First bilinear weight:
@@ -159,8 +166,6 @@ gegl_sampler_linear_get (      GeglSampler*    restrict  self,
    */
   const gfloat w_times_z = (gfloat) 1. - ( x + w_times_y );
 
-  gfloat newval[4];
-
   newval[0] =
     x_times_y * bot_rite_0
     +
@@ -196,7 +201,115 @@ gegl_sampler_linear_get (      GeglSampler*    restrict  self,
     x_times_z * top_rite_3
     +
     w_times_z * top_left_3;
-
-    babl_process (self->fish, newval, output, 1);
   }
 }
+
+static void
+gegl_sampler_linear_get (      GeglSampler*    restrict  self,
+                         const gdouble                   absolute_x,
+                         const gdouble                   absolute_y,
+                               GeglMatrix2              *scale,
+                               void*           restrict  output,
+                               GeglAbyssPolicy           repeat_mode)
+{
+  /*
+   * The "-1/2"s are there because we want the index of the pixel to
+   * the left and top of the location, and with GIMP's convention the
+   * top left of the top left pixel is located at
+   * (1/2,1/2). Basically, we are converting from a coordinate system
+   * in which the origin is at the top left pixel of the pixel with
+   * index (0,0), to a coordinate system in which the origin is at the
+   * center of the same pixel.
+   */
+  const float iabsolute_x = (float) absolute_x - 0.5;
+  const float iabsolute_y = (float) absolute_y - 0.5;
+
+  const gint ix = floorf (iabsolute_x);
+  const gint iy = floorf (iabsolute_y);
+
+  /*
+   * Point the data tile pointer to the first channel of the top_left
+   * pixel value:
+   */
+  const gfloat* restrict in_bptr =
+    gegl_sampler_get_ptr (self, ix, iy, repeat_mode);
+
+  gfloat newval[4];
+
+  /*
+   * x is the x-coordinate of the sampling point relative to the
+   * position of the center of the top left pixel. Similarly for
+   * y. Range of values: [0,1].
+   */
+  gegl_sampler_linear_interpolate (in_bptr,
+                                   iabsolute_x - ix, iabsolute_y - iy,
+                                   newval);
+
+  babl_process (self->fish, newval, output, 1);
+}
+
+static void
+gegl_sampler_linear_interpolate_span (GeglSampler  *self,
+                                      const gint   *ix,
+                                      const gint   *iy,
+                                      const gfloat *x,
+                                      const gfloat *y,
+                                      gint          n,
+                                      gfloat       *newval)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    gegl_sampler_linear_interpolate (_gegl_sampler_get_span_ptr (self, ix[i], iy[i]),
+                                     x[i], y[i],
+                                     newval + 4 * i);
+}
+
+/*
+ * The same as gegl_sampler_linear_get () for each of the coordinates,
+ * checking the area held by the sampler once for a span of pixels.
+ */
+static void
+gegl_sampler_linear_get_n (      GeglSampler*    restrict  self,
+                           const gdouble*        restrict  coordinates,
+                                 gint                      n,
+                                 GeglMatrix2              *scale,
+                                 void*           restrict  output,
+                                 GeglAbyssPolicy           repeat_mode)
+{
+  GeglSamplerLinear *linear = (GeglSamplerLinear*)(self);
+  const gint         bpp    = babl_format_get_bytes_per_pixel (self->format);
+  guchar            *out    = output;
+
+  while (n > 0)
+    {
+      gint   ix[GEGL_SAMPLER_SPAN];
+      gint   iy[GEGL_SAMPLER_SPAN];
+      gfloat x[GEGL_SAMPLER_SPAN];
+      gfloat y[GEGL_SAMPLER_SPAN];
+      gfloat newval[4 * GEGL_SAMPLER_SPAN];
+      gint   m = MIN (n, GEGL_SAMPLER_SPAN);
+      gint   i;
+
+      for (i = 0; i < m; i++)
+        {
+          const float iabsolute_x = (float) coordinates[2 * i]     - 0.5;
+          const float iabsolute_y = (float) coordinates[2 * i + 1] - 0.5;
+
+          ix[i] = floorf (iabsolute_x);
+          iy[i] = floorf (iabsolute_y);
+          x[i]  = iabsolute_x - ix[i];
+          y[i]  = iabsolute_y - iy[i];
+        }
+
+      m = _gegl_sampler_get_span (self, ix, iy, m, repeat_mode);
+
+      linear->interpolate_span (self, ix, iy, x, y, m, newval);
+
+      babl_process (self->fish, newval, out, m);
+
+      coordinates += 2 * m;
+      out         += bpp * m;
+      n           -= m;
+    }
+}
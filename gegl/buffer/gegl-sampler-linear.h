@@ -34,9 +34,10 @@ typedef struct _GeglSamplerLinearClass GeglSamplerLinearClass;
 
 struct _GeglSamplerLinear
 {
-  GeglSampler parent_instance;
+  GeglSampler         parent_instance;
 
   /*< private >*/
+  GeglSamplerSpanFunc interpolate_span;
 };
 
 struct _GeglSamplerLinearClass
@@ -46,6 +47,29 @@ struct _GeglSamplerLinearClass
 
 GType gegl_sampler_linear_get_type (void) G_GNUC_CONST;
 
+/* SIMD versions of the interpolation of a span, picked by
+ * gegl_sampler_linear_init () when the CPU supports them
+ */
+#ifdef USE_SSE2
+void gegl_sampler_linear_interpolate_span_sse2 (GeglSampler  *self,
+                                                const gint   *ix,
+                                                const gint   *iy,
+                                                const gfloat *x,
+                                                const gfloat *y,
+                                                gint          n,
+                                                gfloat       *newval);
+#endif
+
+#ifdef USE_AVX2
+void gegl_sampler_linear_interpolate_span_avx2 (GeglSampler  *self,
+                                                const gint   *ix,
+                                                const gint   *iy,
+                                                const gfloat *x,
+                                                const gfloat *y,
+                                                gint          n,
+                                                gfloat       *newval);
+#endif
+
 G_END_DECLS
 
 #endif
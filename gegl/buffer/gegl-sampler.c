@@ -76,6 +76,13 @@ static void buffer_contents_changed (GeglBuffer          *buffer,
 
 static void constructed (GObject *sampler);
 
+static void get_n       (GeglSampler         *self,
+                         const gdouble       *coordinates,
+                         gint                 n,
+                         GeglMatrix2         *scale,
+                         void                *output,
+                         GeglAbyssPolicy      repeat_mode);
+
 static GType gegl_sampler_gtype_from_enum  (GeglSamplerType      sampler_type);
 
 G_DEFINE_TYPE (GeglSampler, gegl_sampler, G_TYPE_OBJECT)
@@ -92,6 +99,7 @@ gegl_sampler_class_init (GeglSamplerClass *klass)
   klass->prepare    = NULL;
   klass->get        = NULL;
   klass->set_buffer = set_buffer;
+  klass->get_n      = get_n;
 
   object_class->set_property = set_property;
   object_class->get_property = get_property;
@@ -173,6 +181,111 @@ gegl_sampler_get (GeglSampler     *self,
   self->get (self, x, y, scale, output, repeat_mode);
 }
 
+/* samplers without a get_n of their own sample one pixel at a time */
+static void
+get_n (GeglSampler     *self,
+       const gdouble   *coordinates,
+       gint             n,
+       GeglMatrix2     *scale,
+       void            *output,
+       GeglAbyssPolicy  repeat_mode)
+{
+  const gint  bpp = babl_format_get_bytes_per_pixel (self->format);
+  guchar     *out = output;
+  gint        i;
+
+  for (i = 0; i < n; i++)
+    {
+      self->get (self, coordinates[0], coordinates[1], scale, out, repeat_mode);
+
+      coordinates += 2;
+      out         += bpp;
+    }
+}
+
+void
+gegl_sampler_get_array (GeglSampler     *self,
+                        const gdouble   *coordinates,
+                        gint             n,
+                        GeglMatrix2     *scale,
+                        void            *output,
+                        GeglAbyssPolicy  repeat_mode)
+{
+  if (n <= 0)
+    return;
+
+  if (self->lvel)
+    {
+      const gint  bpp = babl_format_get_bytes_per_pixel (self->format);
+      guchar     *out = output;
+      gint        i;
+
+      for (i = 0; i < n; i++, out += bpp)
+        gegl_sampler_get (self, coordinates[2 * i], coordinates[2 * i + 1],
+                          scale, out, repeat_mode);
+      return;
+    }
+
+  if (gegl_cl_is_accelerated ())
+    gegl_buffer_cl_cache_flush (self->buffer, NULL);
+
+  GEGL_SAMPLER_GET_CLASS (self)->get_n (self, coordinates, n, scale,
+                                        output, repeat_mode);
+}
+
+void
+gegl_sampler_get_n (GeglSampler     *self,
+                    gdouble          x,
+                    gdouble          y,
+                    gdouble          dx,
+                    gdouble          dy,
+                    gint             n,
+                    GeglMatrix2     *scale,
+                    void            *output,
+                    GeglAbyssPolicy  repeat_mode)
+{
+  GeglSamplerClass *klass = GEGL_SAMPLER_GET_CLASS (self);
+  const gint        bpp   = babl_format_get_bytes_per_pixel (self->format);
+  gdouble           coordinates[2 * GEGL_SAMPLER_SPAN];
+  guchar           *out   = output;
+
+  if (n <= 0)
+    return;
+
+  if (self->lvel)
+    {
+      for (; n; n--, out += bpp, x += dx, y += dy)
+        gegl_sampler_get (self, x, y, scale, out, repeat_mode);
+      return;
+    }
+
+  if (gegl_cl_is_accelerated ())
+    gegl_buffer_cl_cache_flush (self->buffer, NULL);
+
+  /* the coordinates are stepped like a caller sampling one pixel at a time
+   * would, for the same results
+   */
+  while (n)
+    {
+      const gint m = MIN (n, GEGL_SAMPLER_SPAN);
+      gint       i;
+
+      for (i = 0; i < m; i++)
+        {
+          coordinates[2 * i]     = x;
+          coordinates[2 * i + 1] = y;
+
+          x += dx;
+          y += dy;
+        }
+
+      klass->get_n (self, coordinates, m, scale, out, repeat_mode);
+
+      n   -= m;
+      out += m * bpp;
+    }
+}
+
 void
 gegl_sampler_prepare (GeglSampler *self)
 {
@@ -336,6 +449,77 @@ GeglRectangle _gegl_sampler_compute_rectangle (GeglSampler *sampler,
   return rectangle;
 }
 
+/*
+ * Makes the level 0 buffer of the sampler hold the context of the pixels
+ * at x[i], y[i], for as many of the first n pixels as fit in it, and
+ * returns their number. The area fetched is stretched along the
+ * direction of the run, for the pixels that follow.
+ */
+gint
+_gegl_sampler_get_span (GeglSampler     *sampler,
+                        const gint      *x,
+                        const gint      *y,
+                        gint             n,
+                        GeglAbyssPolicy  repeat_mode)
+{
+  GeglSamplerLevel    *level   = &sampler->level[0];
+  const GeglRectangle *context = &level->context_rect;
+  GeglRectangle        need;
+  gint                 x0 = x[0], x1 = x[0];
+  gint                 y0 = y[0], y1 = y[0];
+  gint                 m;
+
+  for (m = 1; m < n; m++)
+    {
+      const gint nx0 = MIN (x0, x[m]);
+      const gint nx1 = MAX (x1, x[m]);
+      const gint ny0 = MIN (y0, y[m]);
+      const gint ny1 = MAX (y1, y[m]);
+
+      if (nx1 - nx0 + context->width  > GEGL_SAMPLER_MAXIMUM_WIDTH ||
+          ny1 - ny0 + context->height > GEGL_SAMPLER_MAXIMUM_HEIGHT)
+        break;
+
+      x0 = nx0; x1 = nx1;
+      y0 = ny0; y1 = ny1;
+    }
+
+  need.x      = x0 + context->x;
+  need.y      = y0 + context->y;
+  need.width  = x1 - x0 + context->width;
+  need.height = y1 - y0 + context->height;
+
+  if (! gegl_rectangle_contains (&level->sampler_rectangle, &need))
+    {
+      const gint run_x = x[m - 1] - x[0];
+      const gint run_y = y[m - 1] - y[0];
+
+      if (ABS (run_x) >= ABS (run_y))
+        {
+          if (run_x < 0)
+            need.x -= GEGL_SAMPLER_MAXIMUM_WIDTH - need.width;
+          need.width = GEGL_SAMPLER_MAXIMUM_WIDTH;
+        }
+      else
+        {
+          if (run_y < 0)
+            need.y -= GEGL_SAMPLER_MAXIMUM_HEIGHT - need.height;
+          need.height = GEGL_SAMPLER_MAXIMUM_HEIGHT;
+        }
+
+      level->sampler_rectangle = need;
+
+      gegl_buffer_get (sampler->buffer,
+                       &level->sampler_rectangle,
+                       1.0,
+                       sampler->interpolate_format,
+                       level->sampler_buffer,
+                       GEGL_SAMPLER_ROWSTRIDE,
+                       repeat_mode);
+    }
+
+  return m;
+}
 
 gfloat *
 gegl_sampler_get_from_mipmap (GeglSampler    *sampler,
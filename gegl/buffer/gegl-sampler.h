@@ -44,9 +44,28 @@ G_BEGIN_DECLS
 #define GEGL_SAMPLER_MAXIMUM_WIDTH (GEGL_SAMPLER_MAXIMUM_HEIGHT)
 #define GEGL_SAMPLER_BPP 16
 #define GEGL_SAMPLER_ROWSTRIDE (GEGL_SAMPLER_MAXIMUM_WIDTH * GEGL_SAMPLER_BPP)
+/*
+ * The largest number of pixels a sampler interpolates before converting
+ * them to the output format in one go.
+ */
+#define GEGL_SAMPLER_SPAN 64
 
 typedef struct _GeglSamplerClass GeglSamplerClass;
 
+/*
+ * Interpolates n pixels of the span held by the sampler (see
+ * _gegl_sampler_get_span ()), ix, iy being the pixel to the top left of
+ * each sampling point and x, y the position of the point relative to the
+ * center of that pixel. Writes four RaGaBaA floats per pixel to newval.
+ */
+typedef void (*GeglSamplerSpanFunc) (GeglSampler  *self,
+                                     const gint   *ix,
+                                     const gint   *iy,
+                                     const gfloat *x,
+                                     const gfloat *y,
+                                     gint          n,
+                                     gfloat       *newval);
+
 typedef struct GeglSamplerLevel
 {
   GeglRectangle  context_rect;
@@ -84,6 +103,12 @@ struct _GeglSamplerClass
   GeglSamplerGetFun   get;
   void  (*set_buffer) (GeglSampler     *self,
                        GeglBuffer      *buffer);
+  void  (*get_n)      (GeglSampler     *self,
+                       const gdouble   *coordinates,
+                       gint             n,
+                       GeglMatrix2     *scale,
+                       void            *output,
+                       GeglAbyssPolicy  repeat_mode);
 };
 
 GType gegl_sampler_get_type    (void) G_GNUC_CONST;
@@ -112,6 +137,12 @@ GeglRectangle _gegl_sampler_compute_rectangle (GeglSampler *sampler,
                                                gint         y,
                                                gint         level);
 
+gint     _gegl_sampler_get_span       (GeglSampler     *sampler,
+                                       const gint      *x,
+                                       const gint      *y,
+                                       gint             n,
+                                       GeglAbyssPolicy  repeat_mode);
+
 /*
  * Gets a pointer to the center pixel, within a buffer that has a
  * rowstride of GEGL_SAMPLER_MAXIMUM_WIDTH * 16 (16 is the bpp of RaGaBaA
@@ -155,6 +186,23 @@ gegl_sampler_get_ptr (GeglSampler    *sampler,
   }
 }
 
+/*
+ * Gets a pointer to a pixel within the area fetched by
+ * _gegl_sampler_get_span (), without checking that it is there.
+ */
+static inline gfloat *
+_gegl_sampler_get_span_ptr (GeglSampler *sampler,
+                            gint         x,
+                            gint         y)
+{
+  GeglSamplerLevel *level = &sampler->level[0];
+  gint              dx    = x - level->sampler_rectangle.x;
+  gint              dy    = y - level->sampler_rectangle.y;
+  gint              sof   = (dx + dy * GEGL_SAMPLER_MAXIMUM_WIDTH) * GEGL_SAMPLER_BPP;
+
+  return (gfloat*)((guchar *)level->sampler_buffer + sof);
+}
+
 G_END_DECLS
 
 #endif /* __GEGL_SAMPLER_H__ */
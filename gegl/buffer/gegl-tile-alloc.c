@@ -0,0 +1,465 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gegl-tile-alloc.h"
+
+/* the number of distinct block sizes that are pooled, allocations of other
+ * sizes go straight to malloc
+ */
+#define MAX_CLASSES     16
+
+/* blocks held by each thread per class, half of a magazine is exchanged
+ * with the depot at a time so that a thread alternating between allocating
+ * and freeing around the boundary doesn't hit the depot every time
+ */
+#define MAGAZINE_SIZE   16
+#define HALF_MAGAZINE   (MAGAZINE_SIZE / 2)
+
+/* the number of half magazines kept in the depot of each class, above this
+ * freed blocks are returned to the system
+ */
+#define MAX_DEPOT       64
+
+typedef struct _SizeClass SizeClass;
+
+typedef struct
+{
+  gpointer   real;   /* the pointer returned by g_malloc */
+  SizeClass *klass;  /* NULL for unpooled blocks */
+} BlockHeader;
+
+#define HEADER_SIZE     ((sizeof (BlockHeader) + 15) & ~(gsize) 15)
+#define BLOCK_HEADER(p) ((BlockHeader *) ((gchar *) (p) - HEADER_SIZE))
+
+typedef struct
+{
+  gpointer blocks[HALF_MAGAZINE];
+} DepotMagazine;
+
+struct _SizeClass
+{
+  gsize   size;
+  gsize   align;
+  gint    index;
+
+  GMutex  mutex;
+  GSList *depot;       /* list of full DepotMagazines */
+  gint    n_depot;
+
+  gint    n_blocks;    /* blocks currently allocated from the system */
+};
+
+typedef struct
+{
+  gint     n;
+  gpointer blocks[MAGAZINE_SIZE];
+} Magazine;
+
+typedef struct
+{
+  Magazine magazines[MAX_CLASSES];
+} ThreadCache;
+
+static void thread_cache_free (gpointer data);
+
+static SizeClass  classes[MAX_CLASSES];
+static gint       n_classes     = 0;
+static GMutex     classes_mutex;
+static GSList    *thread_caches = NULL; /* protected by classes_mutex */
+static GPrivate   thread_cache_key = G_PRIVATE_INIT (thread_cache_free);
+
+static gint       n_unpooled    = 0;
+
+
+static gpointer
+block_new (SizeClass *klass,
+           gsize      size,
+           gsize      align)
+{
+  gchar       *real;
+  gchar       *ret;
+  BlockHeader *header;
+
+  real = g_malloc (size + align + HEADER_SIZE);
+  ret  = real + HEADER_SIZE;
+  ret += (align - GPOINTER_TO_SIZE (ret) % align) % align;
+
+  header        = BLOCK_HEADER (ret);
+  header->real  = real;
+  header->klass = klass;
+
+  return ret;
+}
+
+static inline void
+block_destroy (gpointer block)
+{
+  g_free (BLOCK_HEADER (block)->real);
+}
+
+static SizeClass *
+size_class_lookup (gsize size)
+{
+  gint n = g_atomic_int_get (&n_classes);
+  gint i;
+
+  for (i = 0; i < n; i++)
+    if (classes[i].size == size)
+      return &classes[i];
+
+  g_mutex_lock (&classes_mutex);
+
+  for (i = n; i < n_classes; i++)
+    if (classes[i].size == size)
+      break;
+
+  if (i == n_classes)
+    {
+      if (n_classes == MAX_CLASSES)
+        {
+          g_mutex_unlock (&classes_mutex);
+          return NULL;
+        }
+
+      classes[i].size  = size;
+      classes[i].align = size >= GEGL_TILE_ALLOC_LARGE ?
+                           GEGL_TILE_ALLOC_CACHE_LINE : 16;
+      classes[i].index = i;
+      g_mutex_init (&classes[i].mutex);
+
+      /* publish the class only once it is fully initialized */
+      g_atomic_int_set (&n_classes, n_classes + 1);
+    }
+
+  g_mutex_unlock (&classes_mutex);
+
+  return &classes[i];
+}
+
+static ThreadCache *
+thread_cache_get (void)
+{
+  ThreadCache *cache = g_private_get (&thread_cache_key);
+
+  if (G_UNLIKELY (! cache))
+    {
+      cache = g_new0 (ThreadCache, 1);
+      g_private_set (&thread_cache_key, cache);
+
+      g_mutex_lock (&classes_mutex);
+      thread_caches = g_slist_prepend (thread_caches, cache);
+      g_mutex_unlock (&classes_mutex);
+    }
+
+  return cache;
+}
+
+/* move the topmost HALF_MAGAZINE blocks of a magazine to the depot, or
+ * back to the system when the depot is full
+ */
+static void
+depot_push (SizeClass *klass,
+            Magazine  *magazine)
+{
+  gpointer *blocks = &magazine->blocks[magazine->n - HALF_MAGAZINE];
+  gint      i;
+
+  magazine->n -= HALF_MAGAZINE;
+
+  g_mutex_lock (&klass->mutex);
+
+  if (klass->n_depot < MAX_DEPOT)
+    {
+      DepotMagazine *depot_magazine = g_slice_new (DepotMagazine);
+
+      memcpy (depot_magazine->blocks, blocks, sizeof (depot_magazine->blocks));
+      klass->depot = g_slist_prepend (klass->depot, depot_magazine);
+      klass->n_depot++;
+
+      g_mutex_unlock (&klass->mutex);
+      return;
+    }
+
+  g_mutex_unlock (&klass->mutex);
+
+  for (i = 0; i < HALF_MAGAZINE; i++)
+    block_destroy (blocks[i]);
+
+  g_atomic_int_add (&klass->n_blocks, -HALF_MAGAZINE);
+}
+
+static gboolean
+depot_pop (SizeClass *klass,
+           Magazine  *magazine)
+{
+  DepotMagazine *depot_magazine = NULL;
+
+  if (! klass->depot)
+    return FALSE;
+
+  g_mutex_lock (&klass->mutex);
+
+  if (klass->depot)
+    {
+      depot_magazine = klass->depot->data;
+      klass->depot   = g_slist_delete_link (klass->depot, klass->depot);
+      klass->n_depot--;
+    }
+
+  g_mutex_unlock (&klass->mutex);
+
+  if (! depot_magazine)
+    return FALSE;
+
+  memcpy (&magazine->blocks[magazine->n], depot_magazine->blocks,
+          sizeof (depot_magazine->blocks));
+  magazine->n += HALF_MAGAZINE;
+
+  g_slice_free (DepotMagazine, depot_magazine);
+
+  return TRUE;
+}
+
+static void
+magazine_flush (SizeClass *klass,
+                Magazine  *magazine)
+{
+  while (magazine->n >= HALF_MAGAZINE)
+    depot_push (klass, magazine);
+
+  if (magazine->n)
+    {
+      gint i;
+
+      for (i = 0; i < magazine->n; i++)
+        block_destroy (magazine->blocks[i]);
+
+      g_atomic_int_add (&klass->n_blocks, -magazine->n);
+      magazine->n = 0;
+    }
+}
+
+static void
+thread_cache_free (gpointer data)
+{
+  ThreadCache *cache = data;
+  gint         n     = g_atomic_int_get (&n_classes);
+  gint         i;
+
+  g_mutex_lock (&classes_mutex);
+  thread_caches = g_slist_remove (thread_caches, cache);
+  g_mutex_unlock (&classes_mutex);
+
+  /* hand the blocks of an exiting thread over to the depot, where other
+   * threads can pick them up
+   */
+  for (i = 0; i < n; i++)
+    magazine_flush (&classes[i], &cache->magazines[i]);
+
+  g_free (cache);
+}
+
+gpointer
+gegl_tile_alloc (gsize size)
+{
+  SizeClass *klass = size_class_lookup (size);
+  Magazine  *magazine;
+
+  if (G_UNLIKELY (! klass))
+    {
+      g_atomic_int_inc (&n_unpooled);
+
+      return block_new (NULL, size, GEGL_TILE_ALLOC_CACHE_LINE);
+    }
+
+  magazine = &thread_cache_get ()->magazines[klass->index];
+
+  if (magazine->n || depot_pop (klass, magazine))
+    return magazine->blocks[--magazine->n];
+
+  g_atomic_int_inc (&klass->n_blocks);
+
+  return block_new (klass, klass->size, klass->align);
+}
+
+gpointer
+gegl_tile_alloc0 (gsize size)
+{
+  gpointer ret = gegl_tile_alloc (size);
+
+  memset (ret, 0, size);
+
+  return ret;
+}
+
+void
+gegl_tile_free (gpointer ptr)
+{
+  SizeClass *klass;
+  Magazine  *magazine;
+
+  g_return_if_fail (ptr != NULL);
+
+  klass = BLOCK_HEADER (ptr)->klass;
+
+  if (G_UNLIKELY (! klass))
+    {
+      g_atomic_int_add (&n_unpooled, -1);
+      block_destroy (ptr);
+      return;
+    }
+
+  magazine = &thread_cache_get ()->magazines[klass->index];
+
+  if (magazine->n == MAGAZINE_SIZE)
+    depot_push (klass, magazine);
+
+  magazine->blocks[magazine->n++] = ptr;
+}
+
+static guint64
+pooled_blocks (SizeClass *klass)
+{
+  guint64  count;
+  GSList  *iter;
+
+  /* the magazines of other threads are read without synchronization, the
+   * result is only an estimate
+   */
+  count = (guint64) klass->n_depot * HALF_MAGAZINE;
+
+  for (iter = thread_caches; iter; iter = iter->next)
+    {
+      ThreadCache *cache = iter->data;
+
+      count += cache->magazines[klass->index].n;
+    }
+
+  return count;
+}
+
+guint64
+gegl_tile_alloc_get_pooled (void)
+{
+  guint64 total = 0;
+  gint    n     = g_atomic_int_get (&n_classes);
+  gint    i;
+
+  g_mutex_lock (&classes_mutex);
+
+  for (i = 0; i < n; i++)
+    total += pooled_blocks (&classes[i]) * classes[i].size;
+
+  g_mutex_unlock (&classes_mutex);
+
+  return total;
+}
+
+guint64
+gegl_tile_alloc_get_in_use (void)
+{
+  guint64 total = 0;
+  gint    n     = g_atomic_int_get (&n_classes);
+  gint    i;
+
+  g_mutex_lock (&classes_mutex);
+
+  for (i = 0; i < n; i++)
+    {
+      gint64 in_use = g_atomic_int_get (&classes[i].n_blocks) -
+                      (gint64) pooled_blocks (&classes[i]);
+
+      total += MAX (in_use, 0) * classes[i].size;
+    }
+
+  g_mutex_unlock (&classes_mutex);
+
+  return total;
+}
+
+void
+gegl_tile_alloc_trim (void)
+{
+  ThreadCache *cache = g_private_get (&thread_cache_key);
+  gint         n     = g_atomic_int_get (&n_classes);
+  gint         i;
+
+  for (i = 0; i < n; i++)
+    {
+      SizeClass *klass = &classes[i];
+      GSList    *depot;
+      GSList    *iter;
+
+      if (cache)
+        magazine_flush (klass, &cache->magazines[i]);
+
+      g_mutex_lock (&klass->mutex);
+      depot          = klass->depot;
+      klass->depot   = NULL;
+      klass->n_depot = 0;
+      g_mutex_unlock (&klass->mutex);
+
+      for (iter = depot; iter; iter = iter->next)
+        {
+          DepotMagazine *depot_magazine = iter->data;
+          gint           j;
+
+          for (j = 0; j < HALF_MAGAZINE; j++)
+            block_destroy (depot_magazine->blocks[j]);
+
+          g_atomic_int_add (&klass->n_blocks, -HALF_MAGAZINE);
+          g_slice_free (DepotMagazine, depot_magazine);
+        }
+
+      g_slist_free (depot);
+    }
+}
+
+void
+gegl_tile_alloc_stats (void)
+{
+  gint n = g_atomic_int_get (&n_classes);
+  gint i;
+
+  g_warning ("Tile allocator statistics: in use:%" G_GUINT64_FORMAT
+             " bytes pooled:%" G_GUINT64_FORMAT " bytes unpooled blocks:%i",
+             gegl_tile_alloc_get_in_use (),
+             gegl_tile_alloc_get_pooled (),
+             g_atomic_int_get (&n_unpooled));
+
+  g_mutex_lock (&classes_mutex);
+
+  for (i = 0; i < n; i++)
+    g_warning ("  size class %" G_GSIZE_FORMAT ": blocks:%i pooled:%"
+               G_GUINT64_FORMAT,
+               classes[i].size,
+               g_atomic_int_get (&classes[i].n_blocks),
+               pooled_blocks (&classes[i]));
+
+  g_mutex_unlock (&classes_mutex);
+}
+
+void
+gegl_tile_alloc_cleanup (void)
+{
+  gegl_tile_alloc_trim ();
+}
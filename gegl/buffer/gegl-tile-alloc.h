@@ -0,0 +1,56 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_ALLOC_H__
+#define __GEGL_TILE_ALLOC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Pooled allocator for tile data (and tile structs).
+ *
+ * Blocks are grouped in size classes keyed on the requested size, which
+ * for tile data is the tile_size of the storage, so all tiles of a buffer
+ * share a class. Freed blocks are kept in per-thread magazines and a
+ * shared depot per class, and handed out again without going through
+ * malloc. Blocks of GEGL_TILE_ALLOC_LARGE bytes or more are aligned to a
+ * cache line, smaller blocks to 16 bytes.
+ */
+
+#define GEGL_TILE_ALLOC_CACHE_LINE 64
+#define GEGL_TILE_ALLOC_LARGE      256
+
+gpointer gegl_tile_alloc         (gsize    size);
+gpointer gegl_tile_alloc0        (gsize    size);
+void     gegl_tile_free          (gpointer ptr);
+
+/* bytes handed out and not yet freed, and bytes held by the pool for
+ * reuse
+ */
+guint64  gegl_tile_alloc_get_in_use (void);
+guint64  gegl_tile_alloc_get_pooled (void);
+
+/* return pooled memory of the depot and the calling thread's magazines to
+ * the system
+ */
+void     gegl_tile_alloc_trim    (void);
+void     gegl_tile_alloc_stats   (void);
+void     gegl_tile_alloc_cleanup (void);
+
+G_END_DECLS
+
+#endif
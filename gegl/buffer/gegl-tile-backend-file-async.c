@@ -40,6 +40,10 @@
 #include <string.h>
 #include <errno.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #include <glib-object.h>
 #include <glib/gprintf.h>
 #include <glib/gstdio.h>
@@ -52,6 +56,8 @@
 #include "gegl-buffer-types.h"
 #include "gegl-debug.h"
 #include "gegl-config.h"
+#include "gegl-tile.h"
+#include "gegl-buffer-private.h"
 
 
 #ifndef HAVE_FSYNC
@@ -63,6 +69,16 @@
 #endif
 
 
+/* a read-only mapping of a buffer file, shared by the backend and the
+ * tiles pointing into it
+ */
+typedef struct
+{
+  gint    ref_count;
+  guchar *data;
+  gsize   size;
+} GeglFileMapping;
+
 struct _GeglTileBackendFile
 {
   GeglTileBackend  parent_instance;
@@ -106,15 +122,6 @@ struct _GeglTileBackendFile
   gint             in_offset;
   gint             out_offset;
 
-  /* current offset, used when writing the index */
-  gint             offset;
-
-  /* when writing buffer blocks the writer keeps one block unwritten
-   * at all times to be able to keep track of the ->next offsets in
-   * the blocks.
-   */
-  GeglFileBackendEntry *in_holding;
-
   /* loading buffer */
   GList           *tiles;
 
@@ -134,12 +141,16 @@ struct _GeglTileBackendFile
 
   /* for reading */
   int              i;
+
+  /* serve uncompressed tiles from a mapping of the file as it was
+   * opened, see gegl_buffer_open_mapped()
+   */
+  gboolean         mapped;
+  GeglFileMapping *mapping;
 };
 
 
 static void     gegl_tile_backend_file_ensure_exist (GeglTileBackendFile  *self);
-static gboolean gegl_tile_backend_file_write_block  (GeglTileBackendFile  *self,
-                                                     GeglFileBackendEntry *block);
 static void     gegl_tile_backend_file_dbg_alloc    (int                   size);
 static void     gegl_tile_backend_file_dbg_dealloc  (int                   size);
 
@@ -185,14 +196,9 @@ gegl_tile_backend_file_push_queue (GeglFileBackendThreadParams *params)
 
   if (params->entry)
     {
-      if (params->operation == OP_WRITE)
-        {
-          params->entry->tile_link = g_queue_peek_tail_link (&queue);
-          queue_size += params->length + sizeof (GList) +
-            sizeof (GeglFileBackendThreadParams);
-        }
-      else /* OP_WRITE_BLOCK */
-        params->entry->block_link = g_queue_peek_tail_link (&queue);
+      params->entry->tile_link = g_queue_peek_tail_link (&queue);
+      queue_size += params->length + sizeof (GList) +
+        sizeof (GeglFileBackendThreadParams);
     }
 
   /* wake up the writer thread */
@@ -255,10 +261,7 @@ gegl_tile_backend_file_writer_thread (gpointer ignored)
       if (params->entry)
         {
           in_progress = params;
-          if (params->operation == OP_WRITE)
-            params->entry->tile_link = NULL;
-          else /* OP_WRITE_BLOCK */
-            params->entry->block_link = NULL;
+          params->entry->tile_link = NULL;
         }
       g_mutex_unlock (&mutex);
 
@@ -267,9 +270,6 @@ gegl_tile_backend_file_writer_thread (gpointer ignored)
         case OP_WRITE:
           gegl_tile_backend_file_write (params);
           break;
-        case OP_WRITE_BLOCK:
-          gegl_tile_backend_file_write (params);
-          break;
         case OP_TRUNCATE:
           if (ftruncate (params->file->o, params->length) != 0)
             g_warning ("failed to resize file: %s", g_strerror (errno));
@@ -306,6 +306,112 @@ gegl_tile_backend_file_writer_thread (gpointer ignored)
   return NULL;
 }
 
+static GeglFileMapping *
+gegl_file_mapping_new (gint fd)
+{
+#ifdef HAVE_SYS_MMAN_H
+  GeglFileMapping *mapping;
+  struct stat      st;
+  gpointer         data;
+
+  if (fstat (fd, &st) != 0 || st.st_size == 0)
+    return NULL;
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+      g_warning ("unable to map buffer file: %s", g_strerror (errno));
+      return NULL;
+    }
+
+  mapping            = g_slice_new (GeglFileMapping);
+  mapping->ref_count = 1;
+  mapping->data      = data;
+  mapping->size      = st.st_size;
+
+  return mapping;
+#else
+  return NULL;
+#endif
+}
+
+static GeglFileMapping *
+gegl_file_mapping_ref (GeglFileMapping *mapping)
+{
+  g_atomic_int_inc (&mapping->ref_count);
+  return mapping;
+}
+
+static void
+gegl_file_mapping_unref (gpointer data)
+{
+  GeglFileMapping *mapping = data;
+
+  if (! g_atomic_int_dec_and_test (&mapping->ref_count))
+    return;
+
+#ifdef HAVE_SYS_MMAN_H
+  munmap (mapping->data, mapping->size);
+#endif
+  g_slice_free (GeglFileMapping, mapping);
+}
+
+/* releases the mapped tile of entry, the tiles sharing its data might
+ * still use the slot of the entry, which is thus never written again.
+ * those tiles are read only, and copy the data before being written to
+ * even once they are its last users
+ */
+static void
+gegl_tile_backend_file_entry_unmap (GeglFileBackendEntry *entry)
+{
+  if (entry->mapped_tile)
+    {
+      gegl_tile_unref (entry->mapped_tile);
+      entry->mapped_tile = NULL;
+    }
+}
+
+/* returns a tile sharing the data of the mapping of the file, or NULL if
+ * the tile has to be read
+ */
+static GeglTile *
+gegl_tile_backend_file_get_mapped_tile (GeglTileBackendFile  *self,
+                                        GeglFileBackendEntry *entry)
+{
+  gint tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  if (! entry->mapped_tile)
+    {
+      GeglTile *tile;
+      gboolean  queued;
+
+      if (entry->tile->codec != GEGL_TILE_CODEC_NONE ||
+          entry->tile->offset + tile_size > self->mapping->size)
+        return NULL;
+
+      /* data still on its way to the file */
+      g_mutex_lock (&mutex);
+      queued = entry->tile_link ||
+               (in_progress && in_progress->entry == entry);
+      g_mutex_unlock (&mutex);
+
+      if (queued)
+        return NULL;
+
+      tile = gegl_tile_new_bare ();
+      gegl_tile_set_data_full (tile,
+                               self->mapping->data + entry->tile->offset,
+                               tile_size,
+                               gegl_file_mapping_unref,
+                               gegl_file_mapping_ref (self->mapping));
+      tile->is_read_only = 1;
+
+      entry->mapped_tile = tile;
+    }
+
+  return gegl_tile_dup (entry->mapped_tile);
+}
+
 static void
 gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
                                    GeglFileBackendEntry *entry,
@@ -314,9 +420,30 @@ gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
   gint    tile_size  = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   gint    to_be_read = tile_size;
   goffset offset     = entry->tile->offset;
+  guchar *stored     = dest;
 
   gegl_tile_backend_file_ensure_exist (self);
 
+  if (entry->tile->codec == GEGL_TILE_CODEC_ZERO)
+    {
+      memset (dest, 0, tile_size);
+      return;
+    }
+  else if (entry->tile->codec != GEGL_TILE_CODEC_NONE)
+    {
+      /* compressed tiles are decoded as they are read, they are never
+       * queued for writing, as tiles are rewritten uncompressed
+       */
+      if (entry->tile->length > (guint32) tile_size)
+        {
+          g_warning ("corrupt tile entry %i,%i,%i", entry->tile->x, entry->tile->y, entry->tile->z);
+          return;
+        }
+
+      to_be_read = entry->tile->length;
+      stored     = g_malloc (to_be_read);
+    }
+
   if (entry->tile_link || in_progress)
     {
       GeglFileBackendThreadParams *queued_op = NULL;
@@ -346,26 +473,43 @@ gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
       if (lseek (self->i, offset, SEEK_SET) < 0)
         {
           g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
+          if (stored != dest)
+            g_free (stored);
           return;
         }
       self->in_offset = offset;
     }
 
-  while (to_be_read > 0)
+  {
+    gint size = to_be_read;
+
+    while (to_be_read > 0)
+      {
+        GError *error = NULL;
+        gint    byte_read;
+
+        byte_read = read (self->i, stored + size - to_be_read, to_be_read);
+        if (byte_read <= 0)
+          {
+            g_message ("unable to read tile data from self: "
+                       "%s (%d/%d bytes read) %s",
+                       g_strerror (errno), byte_read, to_be_read, error?error->message:"--");
+            if (stored != dest)
+              g_free (stored);
+            return;
+          }
+        to_be_read      -= byte_read;
+        self->in_offset += byte_read;
+      }
+  }
+
+  if (stored != dest)
     {
-      GError *error = NULL;
-      gint    byte_read;
-
-      byte_read = read (self->i, dest + tile_size - to_be_read, to_be_read);
-      if (byte_read <= 0)
-        {
-          g_message ("unable to read tile data from self: "
-                     "%s (%d/%d bytes read) %s",
-                     g_strerror (errno), byte_read, to_be_read, error?error->message:"--");
-          return;
-        }
-      to_be_read      -= byte_read;
-      self->in_offset += byte_read;
+      if (! gegl_tile_entry_decode (entry->tile,
+                                    gegl_tile_backend_get_format (GEGL_TILE_BACKEND (self)),
+                                    stored, dest, tile_size))
+        g_warning ("failed to decode tile %i,%i,%i", entry->tile->x, entry->tile->y, entry->tile->z);
+      g_free (stored);
     }
 
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->tile->x, entry->tile->y, entry->tile->z, (gint)offset);
@@ -423,21 +567,20 @@ gegl_tile_backend_file_file_entry_create (gint x,
 {
   GeglFileBackendEntry *entry = g_new0 (GeglFileBackendEntry, 1);
 
-  entry->tile       = gegl_tile_entry_new (x, y, z);
-  entry->tile_link  = NULL;
-  entry->block_link = NULL;
+  entry->tile        = gegl_tile_entry_new (x, y, z);
+  entry->tile_link   = NULL;
+  entry->mapped_tile = NULL;
 
   return entry;
 }
 
-static inline GeglFileBackendEntry *
-gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+/* gives entry a slot for uncompressed tile data */
+static void
+gegl_tile_backend_file_entry_allocate (GeglTileBackendFile  *self,
+                                       GeglFileBackendEntry *entry)
 {
-  GeglFileBackendEntry *entry = gegl_tile_backend_file_file_entry_create (0,0,0);
-
-  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
-
-  gegl_tile_backend_file_ensure_exist (self);
+  entry->tile->codec  = GEGL_TILE_CODEC_NONE;
+  entry->tile->length = 0;
 
   if (self->free_list)
     {
@@ -475,6 +618,19 @@ gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
         }
     }
   gegl_tile_backend_file_dbg_alloc (gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self)));
+}
+
+static inline GeglFileBackendEntry *
+gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+{
+  GeglFileBackendEntry *entry = gegl_tile_backend_file_file_entry_create (0,0,0);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
+
+  gegl_tile_backend_file_ensure_exist (self);
+
+  gegl_tile_backend_file_entry_allocate (self, entry);
+
   return entry;
 }
 
@@ -485,31 +641,31 @@ gegl_tile_backend_file_file_entry_destroy (GeglTileBackendFile  *self,
   guint64 *offset = g_new (guint64, 1);
   *offset = entry->tile->offset;
 
-  if (entry->tile_link || entry->block_link)
+  if (entry->tile_link)
     {
-      gint   i;
-      GList *link;
-
       g_mutex_lock (&mutex);
 
-      for (i = 0, link = entry->tile_link;
-           i < 2;
-           i++, link = entry->block_link)
+      if (entry->tile_link)
         {
-          if (link)
-            {
-              GeglFileBackendThreadParams *queued_op = link->data;
-              queued_op->file->pending_ops -= 1;
-              g_queue_delete_link (&queue, link);
-              g_free (queued_op->source);
-              g_free (queued_op);
-            }
+          GeglFileBackendThreadParams *queued_op = entry->tile_link->data;
+          queued_op->file->pending_ops -= 1;
+          g_queue_delete_link (&queue, entry->tile_link);
+          g_free (queued_op->source);
+          g_free (queued_op);
         }
 
       g_mutex_unlock (&mutex);
     }
 
-  self->free_list = g_slist_prepend (self->free_list, offset);
+  /* only slots of uncompressed tiles can be reused, and only if no
+   * tiles point into them
+   */
+  if (entry->tile->codec == GEGL_TILE_CODEC_NONE && ! entry->mapped_tile)
+    self->free_list = g_slist_prepend (self->free_list, offset);
+  else
+    g_free (offset);
+
+  gegl_tile_backend_file_entry_unmap (entry);
   g_hash_table_remove (self->index, entry);
 
   gegl_tile_backend_file_dbg_dealloc (gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self)));
@@ -553,89 +709,6 @@ gegl_tile_backend_file_write_header (GeglTileBackendFile *self)
   return TRUE;
 }
 
-static gboolean
-gegl_tile_backend_file_write_block (GeglTileBackendFile  *self,
-                                    GeglFileBackendEntry *item)
-{
-  gegl_tile_backend_file_ensure_exist (self);
-  if (self->in_holding)
-    {
-      GeglFileBackendThreadParams *params;
-      GeglBufferBlock *block           = &(self->in_holding->tile->block);
-      guint64          next_allocation = self->offset + block->length;
-      gint             length          = block->length;
-      guchar          *new_source;
-
-      /* update the next offset pointer in the previous block */
-      if (item == NULL)
-          /* the previous block was the last block */
-          block->next = 0;
-      else
-          block->next = next_allocation;
-
-      /* XXX: should promiscuosuly try to compress here as well,. if revisions
-              are not matching..
-       */
-
-      if (self->in_holding->block_link)
-        {
-          g_mutex_lock (&mutex);
-
-          if (self->in_holding->block_link)
-            {
-              params = self->in_holding->block_link->data;
-              params->offset = self->offset;
-              memcpy (params->source, block, length);
-              g_mutex_unlock (&mutex);
-
-              self->offset = next_allocation;
-              self->in_holding = item;
-              GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Overwrote queue block: length:%i flags:%i next:%i at offset %i",
-                         block->length,
-                         block->flags,
-                         (gint)block->next,
-                         (gint)self->offset);
-              return TRUE;
-            }
-
-          g_mutex_unlock (&mutex);
-        }
-
-      params     = g_new0 (GeglFileBackendThreadParams, 1);
-      new_source = g_malloc (length);
-
-      memcpy (new_source, block, length);
-
-      params->operation = OP_WRITE_BLOCK;
-      params->length    = length;
-      params->file      = self;
-      params->offset    = self->offset;
-      params->source    = new_source;
-      params->entry     = self->in_holding;
-
-      gegl_tile_backend_file_push_queue (params);
-
-      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Pushed write of block: length:%i flags:%i next:%i at offset %i",
-                 block->length,
-                 block->flags,
-                 (gint)block->next,
-                 (gint)self->offset);
-
-      self->offset = next_allocation;
-    }
-  else
-    {
-      /* we're setting up for the first write */
-      self->offset = self->next_pre_alloc; /* start writing header at end
-                                            * of file, worry about writing
-                                            * header inside free list later
-                                            */
-    }
-  self->in_holding = item;
-
-  return TRUE;
-}
-
 void
 gegl_tile_backend_file_stats (void)
 {
@@ -700,6 +773,16 @@ gegl_tile_backend_file_get_tile (GeglTileSource *self,
   if (!entry)
     return NULL;
 
+  if (tile_backend_file->mapping)
+    tile = gegl_tile_backend_file_get_mapped_tile (tile_backend_file, entry);
+
+  if (tile)
+    {
+      gegl_tile_set_rev (tile, entry->tile->rev);
+      gegl_tile_mark_as_stored (tile);
+      return tile;
+    }
+
   tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   tile      = gegl_tile_new (tile_size);
   gegl_tile_set_rev (tile, entry->tile->rev);
@@ -732,6 +815,15 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
       entry->tile->z = z;
       g_hash_table_insert (tile_backend_file->index, entry, entry);
     }
+  else if (entry->tile->codec != GEGL_TILE_CODEC_NONE || entry->mapped_tile)
+    {
+      /* the stored data of a compressed tile is too small to be
+       * overwritten in place, and mapped tiles might still be using the
+       * data; the space is lost until the file is saved again
+       */
+      gegl_tile_backend_file_entry_unmap (entry);
+      gegl_tile_backend_file_entry_allocate (tile_backend_file, entry);
+    }
   entry->tile->rev = gegl_tile_get_rev (tile);
 
   gegl_tile_backend_file_entry_write (tile_backend_file, entry, gegl_tile_get_data (tile));
@@ -799,24 +891,48 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "flushing %s", self->path);
 
   self->header.rev ++;
-  self->header.next = self->next_pre_alloc; /* this is the offset
-                                               we start handing
-                                               out headers from*/
+  /* the index is always written as a table, which might upgrade an older
+   * file to the current revision
+   */
+  self->header.flags = (self->header.flags & ~0xff) | GEGL_FILE_SPEC_REV;
+  self->header.next  = self->next_pre_alloc; /* write the index at the end
+                                                of the tile data */
   tiles = g_hash_table_get_keys (self->index);
 
   if (tiles == NULL)
     self->header.next = 0;
   else
     {
-      GList *iter;
+      GeglFileBackendThreadParams  *params;
+      GeglBufferTile              **entries;
+      GeglBufferIndex              *index;
+      GList                        *iter;
+      gint                          n_tiles = 0;
+
+      entries = g_new (GeglBufferTile *, g_hash_table_size (self->index));
+
       for (iter = tiles; iter; iter = iter->next)
         {
           GeglFileBackendEntry *item = iter->data;
 
-          gegl_tile_backend_file_write_block (self, item);
+          entries[n_tiles++] = item->tile;
         }
-      gegl_tile_backend_file_write_block (self, NULL); /* terminate the index */
       g_list_free (tiles);
+
+      index = gegl_buffer_index_new (entries, n_tiles);
+      g_free (entries);
+
+      params            = g_new0 (GeglFileBackendThreadParams, 1);
+      params->operation = OP_WRITE;
+      params->source    = (guchar *) index;
+      params->offset    = self->header.next;
+      params->length    = index->block.length;
+      params->file      = self;
+
+      gegl_tile_backend_file_push_queue (params);
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "pushed write of index table of %i entries at %i",
+                 n_tiles, (gint)self->header.next);
     }
 
   gegl_tile_backend_file_write_header (self);
@@ -829,7 +945,8 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
 enum
 {
   PROP_0,
-  PROP_PATH
+  PROP_PATH,
+  PROP_MAPPED
 };
 
 static gpointer
@@ -883,6 +1000,9 @@ gegl_tile_backend_file_set_property (GObject      *object,
           g_free (self->path);
         self->path = g_value_dup_string (value);
         break;
+      case PROP_MAPPED:
+        self->mapped = g_value_get_boolean (value);
+        break;
 
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -903,6 +1023,9 @@ gegl_tile_backend_file_get_property (GObject    *object,
       case PROP_PATH:
         g_value_set_string (value, self->path);
         break;
+      case PROP_MAPPED:
+        g_value_set_boolean (value, self->mapped);
+        break;
 
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -965,6 +1088,9 @@ gegl_tile_backend_file_finalize (GObject *object)
   if (self->free_list)
     gegl_tile_backend_file_free_free_list (self);
 
+  if (self->mapping)
+    gegl_file_mapping_unref (self->mapping);
+
   if (self->path)
     {
       gegl_tile_backend_unlink_swap (self->path);
@@ -1071,8 +1197,10 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
       GeglFileBackendEntry *existing =
         gegl_tile_backend_file_lookup_entry (self, item->tile.x, item->tile.y, item->tile.z);
 
-      if (item->tile.offset > max)
-        max = item->tile.offset + tile_size;
+      if (item->tile.codec == GEGL_TILE_CODEC_NONE)
+        max = MAX (max, item->tile.offset + tile_size);
+      else if (item->tile.codec != GEGL_TILE_CODEC_ZERO)
+        max = MAX (max, item->tile.offset + item->tile.length);
 
       if (existing)
         {
@@ -1102,6 +1230,7 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
                   rect.x = existing->tile->x * self->header.tile_width;
                   rect.y = existing->tile->y * self->header.tile_height;
                 }
+              gegl_tile_backend_file_entry_unmap (existing);
               g_free (existing->tile);
               g_free (existing);
 
@@ -1200,6 +1329,9 @@ gegl_tile_backend_file_constructed (GObject *object)
       /* insert each of the entries into the hash table */
       gegl_tile_backend_file_load_index (self, TRUE);
       self->exist = TRUE;
+
+      if (self->mapped)
+        self->mapping = gegl_file_mapping_new (self->i);
       g_assert (self->i != -1);
       g_assert (self->o != -1);
 
@@ -1278,6 +1410,14 @@ gegl_tile_backend_file_class_init (GeglTileBackendFileClass *klass)
                                                         NULL,
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAPPED,
+                                   g_param_spec_boolean ("mapped",
+                                                         "mapped",
+                                                         "Serve the tiles of an existing file from a read-only memory mapping of it",
+                                                         FALSE,
+                                                         G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE));
 }
 
 static void
@@ -42,7 +42,6 @@ typedef struct _GeglTileBackendFileClass GeglTileBackendFileClass;
 typedef enum
 {
   OP_WRITE,
-  OP_WRITE_BLOCK,
   OP_TRUNCATE,
   OP_SYNC
 } GeglFileBackendThreadOp;
@@ -50,10 +49,13 @@ typedef enum
 typedef struct
 {
   GeglBufferTile *tile;
-  /* reference to the writer queue links of this entry when writing
-     tile data or a GeglBufferBlock*/
+  /* reference to the writer queue link of this entry when writing
+     tile data */
   GList          *tile_link;
-  GList          *block_link;
+  /* a tile whose data points into the mapping of a mapped file, the
+     tiles handed out share its data so that they are copied when
+     written to */
+  GeglTile       *mapped_tile;
 } GeglFileBackendEntry;
 
 typedef struct
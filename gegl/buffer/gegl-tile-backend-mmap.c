@@ -0,0 +1,705 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef G_OS_WIN32
+#include <process.h>
+#define getpid() _getpid()
+#endif
+
+#include <glib-object.h>
+#include <glib/gstdio.h>
+
+#include "gegl-buffer-backend.h"
+#include "gegl-tile-backend.h"
+#include "gegl-tile-backend-mmap.h"
+#include "gegl-debug.h"
+
+/* We need the private header to point tiles into the mappings */
+#include "gegl-buffer-private.h"
+
+#if defined (HAVE_SYS_MMAN_H) && ! defined (MAP_ANONYMOUS) && defined (MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* the size of each mapping, the store grows by one chunk at a time. The
+ * size of a chunk is a multiple of CHUNK_ALIGN, so that the chunks of a
+ * file start at page boundaries
+ */
+#define CHUNK_SIZE  (16 * 1024 * 1024)
+#define CHUNK_ALIGN (64 * 1024)
+
+typedef struct _MmapSlot  MmapSlot;
+typedef struct _MmapChunk MmapChunk;
+typedef struct _MmapEntry MmapEntry;
+
+/* room for the data of one tile in a mapping */
+struct _MmapSlot
+{
+  GeglMmapStore *store;
+  guchar        *data;
+  gboolean       used;    /* holds the data of an entry */
+  gboolean       pinned;  /* referenced by a tile we handed out */
+};
+
+struct _MmapChunk
+{
+  guchar   *data;
+  gsize     size;
+  gboolean  mapped;  /* FALSE when we had to fall back to the heap */
+  MmapSlot *slots;
+};
+
+/* the mappings of a backend. Tiles handed out point into them, and keep
+ * the store alive after the backend is gone, until the last one of them is
+ * freed
+ */
+struct _GeglMmapStore
+{
+  gint     ref_count;
+  GMutex   mutex;
+  gint     fd;          /* -1 for anonymous mappings */
+  guint64  file_size;
+  gint     slot_size;
+  GSList  *chunks;
+  GSList  *free_slots;
+};
+
+struct _MmapEntry
+{
+  gint      x;
+  gint      y;
+  MmapSlot *slot;
+};
+
+G_DEFINE_TYPE (GeglTileBackendMmap, gegl_tile_backend_mmap, GEGL_TYPE_TILE_BACKEND)
+#define parent_class gegl_tile_backend_mmap_parent_class
+
+enum
+{
+  PROP_0,
+  PROP_PATH
+};
+
+static gsize   mapped_total = 0;
+static gint    n_zero_copy  = 0;
+static gint    n_copies     = 0;
+
+
+static GeglMmapStore *
+store_new (gint fd,
+           gint slot_size)
+{
+  GeglMmapStore *store = g_slice_new0 (GeglMmapStore);
+
+  store->ref_count = 1;
+  store->fd        = fd;
+  store->slot_size = slot_size;
+  g_mutex_init (&store->mutex);
+
+  return store;
+}
+
+static GeglMmapStore *
+store_ref (GeglMmapStore *store)
+{
+  g_atomic_int_inc (&store->ref_count);
+
+  return store;
+}
+
+static void
+store_unref (GeglMmapStore *store)
+{
+  GSList *iter;
+
+  if (! g_atomic_int_dec_and_test (&store->ref_count))
+    return;
+
+  for (iter = store->chunks; iter; iter = iter->next)
+    {
+      MmapChunk *chunk = iter->data;
+
+#ifdef HAVE_SYS_MMAN_H
+      if (chunk->mapped)
+        munmap (chunk->data, chunk->size);
+      else
+#endif
+        g_free (chunk->data);
+
+      g_atomic_pointer_add (&mapped_total, -(gssize) chunk->size);
+
+      g_free (chunk->slots);
+      g_slice_free (MmapChunk, chunk);
+    }
+
+  g_slist_free (store->chunks);
+  g_slist_free (store->free_slots);
+
+  if (store->fd != -1)
+    close (store->fd);
+
+  g_mutex_clear (&store->mutex);
+  g_slice_free (GeglMmapStore, store);
+}
+
+static guchar *
+store_map (GeglMmapStore *store,
+           gsize          size,
+           gboolean      *mapped)
+{
+#ifdef HAVE_SYS_MMAN_H
+  gpointer data;
+
+  if (store->fd != -1)
+    {
+      if (ftruncate (store->fd, store->file_size + size) == 0)
+        {
+          data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       store->fd, store->file_size);
+
+          if (data != MAP_FAILED)
+            {
+              store->file_size += size;
+              *mapped = TRUE;
+
+              return data;
+            }
+        }
+
+      g_warning ("unable to map tile file, using anonymous memory: %s",
+                 g_strerror (errno));
+
+      close (store->fd);
+      store->fd = -1;
+    }
+
+  data = mmap (NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (data != MAP_FAILED)
+    {
+      *mapped = TRUE;
+
+      return data;
+    }
+#endif
+
+  *mapped = FALSE;
+
+  return g_malloc (size);
+}
+
+/* maps another chunk, called with the mutex of the store held */
+static void
+store_grow (GeglMmapStore *store)
+{
+  MmapChunk *chunk   = g_slice_new0 (MmapChunk);
+  gint       n_slots = MAX (CHUNK_SIZE / store->slot_size, 1);
+  gint       i;
+
+  chunk->size  = (gsize) n_slots * store->slot_size;
+  chunk->size  = (chunk->size + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+  chunk->data  = store_map (store, chunk->size, &chunk->mapped);
+  chunk->slots = g_new0 (MmapSlot, n_slots);
+
+  for (i = n_slots - 1; i >= 0; i--)
+    {
+      chunk->slots[i].store = store;
+      chunk->slots[i].data  = chunk->data + (gsize) i * store->slot_size;
+
+      store->free_slots = g_slist_prepend (store->free_slots,
+                                           &chunk->slots[i]);
+    }
+
+  store->chunks = g_slist_prepend (store->chunks, chunk);
+
+  g_atomic_pointer_add (&mapped_total, chunk->size);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "mapped %i tiles (%i bytes)",
+             n_slots, (gint) chunk->size);
+}
+
+/* called with the mutex of the store held */
+static MmapSlot *
+store_slot_new (GeglMmapStore *store)
+{
+  MmapSlot *slot;
+
+  if (! store->free_slots)
+    store_grow (store);
+
+  slot              = store->free_slots->data;
+  store->free_slots = g_slist_delete_link (store->free_slots,
+                                           store->free_slots);
+  slot->used        = TRUE;
+
+  return slot;
+}
+
+/* called with the mutex of the store held, the slot is reused once no tile
+ * refers to it anymore
+ */
+static void
+store_slot_release (GeglMmapStore *store,
+                    MmapSlot      *slot)
+{
+  slot->used = FALSE;
+
+  if (! slot->pinned)
+    store->free_slots = g_slist_prepend (store->free_slots, slot);
+}
+
+/* the destroy notify of tiles pointing into a mapping */
+static void
+slot_unpin (gpointer data)
+{
+  MmapSlot      *slot  = data;
+  GeglMmapStore *store = slot->store;
+
+  g_mutex_lock (&store->mutex);
+
+  slot->pinned = FALSE;
+
+  if (! slot->used)
+    store->free_slots = g_slist_prepend (store->free_slots, slot);
+
+  g_mutex_unlock (&store->mutex);
+
+  store_unref (store);
+}
+
+static inline MmapEntry *
+lookup_entry (GeglTileBackendMmap *self,
+              gint                 x,
+              gint                 y)
+{
+  MmapEntry key;
+
+  key.x    = x;
+  key.y    = y;
+  key.slot = NULL;
+
+  return g_hash_table_lookup (self->entries, &key);
+}
+
+static GeglTile *
+get_tile (GeglTileSource *tile_store,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileBackendMmap *self  = GEGL_TILE_BACKEND_MMAP (tile_store);
+  GeglMmapStore       *store = self->store;
+  MmapEntry           *entry;
+  MmapSlot            *slot;
+  GeglTile            *tile;
+
+  if (z != 0)
+    return NULL;
+
+  entry = lookup_entry (self, x, y);
+
+  if (! entry)
+    return NULL;
+
+  slot = entry->slot;
+
+  g_mutex_lock (&store->mutex);
+
+  if (! slot->pinned)
+    {
+      slot->pinned = TRUE;
+      store_ref (store);
+
+      g_mutex_unlock (&store->mutex);
+
+      tile                      = gegl_tile_new_bare ();
+      tile->data                = slot->data;
+      tile->size                = store->slot_size;
+      tile->destroy_notify      = slot_unpin;
+      tile->destroy_notify_data = slot;
+
+      g_atomic_int_inc (&n_zero_copy);
+    }
+  else
+    {
+      g_mutex_unlock (&store->mutex);
+
+      /* the data is still referenced by an earlier tile, that might by now
+       * be shared with another buffer, we can't hand out another alias
+       */
+      tile = gegl_tile_new (store->slot_size);
+      memcpy (gegl_tile_get_data (tile), slot->data, store->slot_size);
+
+      g_atomic_int_inc (&n_copies);
+    }
+
+  gegl_tile_mark_as_stored (tile);
+
+  return tile;
+}
+
+static gboolean
+set_tile (GeglTileSource *tile_store,
+          GeglTile       *tile,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileBackendMmap *self  = GEGL_TILE_BACKEND_MMAP (tile_store);
+  GeglMmapStore       *store = self->store;
+  MmapEntry           *entry;
+
+  if (z != 0)
+    return FALSE;
+
+  entry = lookup_entry (self, x, y);
+
+  if (! entry)
+    {
+      entry       = g_slice_new0 (MmapEntry);
+      entry->x    = x;
+      entry->y    = y;
+      g_hash_table_insert (self->entries, entry, entry);
+    }
+  else if (tile->data == entry->slot->data)
+    {
+      /* the tile was written to in place */
+      gegl_tile_mark_as_stored (tile);
+      return TRUE;
+    }
+
+  g_mutex_lock (&store->mutex);
+
+  /* don't change the data under the feet of tiles that still refer to the
+   * old slot, move to a new one instead
+   */
+  if (entry->slot && entry->slot->pinned)
+    {
+      store_slot_release (store, entry->slot);
+      entry->slot = NULL;
+    }
+
+  if (! entry->slot)
+    entry->slot = store_slot_new (store);
+
+  g_mutex_unlock (&store->mutex);
+
+  memcpy (entry->slot->data, gegl_tile_get_data (tile), store->slot_size);
+
+  gegl_tile_mark_as_stored (tile);
+
+  return TRUE;
+}
+
+static gboolean
+void_tile (GeglTileSource *tile_store,
+           GeglTile       *tile,
+           gint            x,
+           gint            y,
+           gint            z)
+{
+  GeglTileBackendMmap *self = GEGL_TILE_BACKEND_MMAP (tile_store);
+
+  if (z == 0)
+    {
+      MmapEntry *entry = lookup_entry (self, x, y);
+
+      if (entry != NULL)
+        g_hash_table_remove (self->entries, entry);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+exist_tile (GeglTileSource *tile_store,
+            GeglTile       *tile,
+            gint            x,
+            gint            y,
+            gint            z)
+{
+  GeglTileBackendMmap *self = GEGL_TILE_BACKEND_MMAP (tile_store);
+
+  if (z != 0)
+    return FALSE;
+
+  return lookup_entry (self, x, y) != NULL;
+}
+
+static gpointer
+gegl_tile_backend_mmap_command (GeglTileSource  *tile_store,
+                                GeglTileCommand  command,
+                                gint             x,
+                                gint             y,
+                                gint             z,
+                                gpointer         data)
+{
+  switch (command)
+    {
+      case GEGL_TILE_GET:
+        return get_tile (tile_store, x, y, z);
+
+      case GEGL_TILE_SET:
+        set_tile (tile_store, data, x, y, z);
+        return NULL;
+
+      case GEGL_TILE_IDLE:
+        return NULL;
+
+      case GEGL_TILE_VOID:
+        void_tile (tile_store, data, x, y, z);
+        return NULL;
+
+      case GEGL_TILE_EXIST:
+        return GINT_TO_POINTER (exist_tile (tile_store, data, x, y, z));
+
+      case GEGL_TILE_FLUSH:
+        return NULL;
+
+      default:
+        g_assert (command < GEGL_TILE_LAST_COMMAND &&
+                  command >= 0);
+    }
+  return NULL;
+}
+
+static guint
+mmap_entry_hash_func (gconstpointer key)
+{
+  const MmapEntry *e = key;
+  guint            hash;
+  gint             i;
+  gint             srcA = e->x;
+  gint             srcB = e->y;
+
+  /* interleave the 16 least significant bits of the coordinates */
+  hash = 0;
+  for (i = 16; i >= 0; i--)
+    {
+#define ADD_BIT(bit)    do { hash |= (((bit) != 0) ? 1 : 0); hash <<= 1; } while (0)
+      ADD_BIT (srcA & (1 << i));
+      ADD_BIT (srcB & (1 << i));
+#undef ADD_BIT
+    }
+  return hash;
+}
+
+static gboolean
+mmap_entry_equal_func (gconstpointer a,
+                       gconstpointer b)
+{
+  const MmapEntry *ea = a;
+  const MmapEntry *eb = b;
+
+  return ea->x == eb->x && ea->y == eb->y;
+}
+
+static void
+mmap_entry_free_func (gpointer data)
+{
+  MmapEntry *entry = data;
+
+  if (entry->slot)
+    {
+      GeglMmapStore *store = entry->slot->store;
+
+      g_mutex_lock (&store->mutex);
+      store_slot_release (store, entry->slot);
+      g_mutex_unlock (&store->mutex);
+    }
+
+  g_slice_free (MmapEntry, entry);
+}
+
+gboolean
+gegl_tile_backend_mmap_parse_location (const gchar  *location,
+                                       gchar       **dir)
+{
+  if (! location ||
+      g_ascii_strncasecmp (location, "mmap", 4) != 0 ||
+      (location[4] != '\0' && location[4] != ':'))
+    return FALSE;
+
+  if (dir)
+    {
+      if (location[4] == ':' && location[5] != '\0')
+        *dir = g_strdup (location + 5);
+      else
+        *dir = NULL;
+    }
+
+  return TRUE;
+}
+
+void
+gegl_tile_backend_mmap_stats (void)
+{
+  g_warning ("Mmap backend: mapped:%" G_GUINT64_FORMAT " bytes "
+             "zero-copy tiles:%i copied tiles:%i",
+             (guint64) (gsize) g_atomic_pointer_get (&mapped_total),
+             g_atomic_int_get (&n_zero_copy),
+             g_atomic_int_get (&n_copies));
+}
+
+static gint
+gegl_tile_backend_mmap_open_file (const gchar *dir)
+{
+  gint   fd = -1;
+#ifdef HAVE_SYS_MMAN_H
+  static gint no = 0;
+  gchar *filename;
+  gchar *path;
+
+  filename = g_strdup_printf ("%i-mmap-%i.swap", getpid (),
+                              g_atomic_int_add (&no, 1));
+  path     = g_build_filename (dir, filename, NULL);
+  g_free (filename);
+
+  fd = g_open (path, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd == -1)
+    g_warning ("Could not open tile file '%s', using anonymous memory: %s",
+               path, g_strerror (errno));
+  else
+    /* the mappings keep the data reachable, and the space is returned
+     * when the last of them goes away, however the process ends
+     */
+    g_unlink (path);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "created mmap tile file %s", path);
+
+  g_free (path);
+#endif
+
+  return fd;
+}
+
+static void
+gegl_tile_backend_mmap_constructed (GObject *object)
+{
+  GeglTileBackendMmap *self    = GEGL_TILE_BACKEND_MMAP (object);
+  GeglTileBackend     *backend = GEGL_TILE_BACKEND (object);
+  gint                 fd      = -1;
+
+  G_OBJECT_CLASS (parent_class)->constructed (object);
+
+  gegl_tile_backend_set_flush_on_destroy (backend, FALSE);
+
+  if (self->path)
+    fd = gegl_tile_backend_mmap_open_file (self->path);
+
+  self->store = store_new (fd, gegl_tile_backend_get_tile_size (backend));
+}
+
+static void
+gegl_tile_backend_mmap_finalize (GObject *object)
+{
+  GeglTileBackendMmap *self = GEGL_TILE_BACKEND_MMAP (object);
+
+  g_hash_table_unref (self->entries);
+
+  if (self->store)
+    store_unref (self->store);
+
+  g_free (self->path);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gegl_tile_backend_mmap_set_property (GObject      *object,
+                                     guint         property_id,
+                                     const GValue *value,
+                                     GParamSpec   *pspec)
+{
+  GeglTileBackendMmap *self = GEGL_TILE_BACKEND_MMAP (object);
+
+  switch (property_id)
+    {
+      case PROP_PATH:
+        g_free (self->path);
+        self->path = g_value_dup_string (value);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+gegl_tile_backend_mmap_get_property (GObject    *object,
+                                     guint       property_id,
+                                     GValue     *value,
+                                     GParamSpec *pspec)
+{
+  GeglTileBackendMmap *self = GEGL_TILE_BACKEND_MMAP (object);
+
+  switch (property_id)
+    {
+      case PROP_PATH:
+        g_value_set_string (value, self->path);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+gegl_tile_backend_mmap_class_init (GeglTileBackendMmapClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->get_property = gegl_tile_backend_mmap_get_property;
+  gobject_class->set_property = gegl_tile_backend_mmap_set_property;
+  gobject_class->constructed  = gegl_tile_backend_mmap_constructed;
+  gobject_class->finalize     = gegl_tile_backend_mmap_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PATH,
+                                   g_param_spec_string ("path",
+                                                        "path",
+                                                        "The directory of the file backing the mappings, anonymous memory is mapped if NULL",
+                                                        NULL,
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_READWRITE));
+}
+
+static void
+gegl_tile_backend_mmap_init (GeglTileBackendMmap *self)
+{
+  GEGL_TILE_SOURCE (self)->command = gegl_tile_backend_mmap_command;
+
+  self->entries = g_hash_table_new_full (mmap_entry_hash_func,
+                                         mmap_entry_equal_func,
+                                         NULL,
+                                         mmap_entry_free_func);
+}
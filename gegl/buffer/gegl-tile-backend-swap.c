@@ -17,6 +17,11 @@
  *           2012, 2013 Ville Sokk <ville.sokk@gmail.com>
  */
 
+/* for fallocate () */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "config.h"
 
 #include <fcntl.h>
@@ -24,7 +29,11 @@
 #include <unistd.h>
 #endif
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 #ifdef G_OS_WIN32
 #include <process.h>
@@ -64,33 +73,73 @@ typedef enum
   OP_TRUNCATE,
 } ThreadOp;
 
+typedef struct _ThreadParams ThreadParams;
+typedef struct _ReadOp       ReadOp;
+
 typedef struct
 {
-  guint64  offset;
-  GList   *link;
-  gint     x;
-  gint     y;
-  gint     z;
+  guint64       offset;
+  GList        *link;        /* the queued write of this entry */
+  ThreadParams *in_progress; /* the write of this entry being carried out */
+  ReadOp       *read;        /* a read-ahead of this entry */
+  gint          x;
+  gint          y;
+  gint          z;
 } SwapEntry;
 
-typedef struct
+struct _ThreadParams
 {
   SwapEntry *entry;
+  guint64    offset;
   gint       length;
   GeglTile  *tile;
   ThreadOp   operation;
-} ThreadParams;
+};
+
+/* a tile read ahead of being requested. It is either queued for the reader
+ * thread, being read, or done and waiting for the tile to be requested
+ */
+struct _ReadOp
+{
+  SwapEntry *entry;
+  GeglTile  *tile;
+  guint64    offset;
+  gint       length;
+  gboolean   reading;
+  gboolean   cancelled;
+  GList      link;
+};
+
+#define LINK_GET_READ_OP(l) \
+        ((ReadOp *) ((guchar *) l - G_STRUCT_OFFSET (ReadOp, link)))
 
 typedef struct
 {
   guint64 start;
   guint64 end;
+  guint64 punched; /* the length of the gap when it was last punched */
+  GList   link;    /* in the free list of its size class */
 } SwapGap;
 
+#define LINK_GET_GAP(l) \
+        ((SwapGap *) ((guchar *) l - G_STRUCT_OFFSET (SwapGap, link)))
+
 
 static void        gegl_tile_backend_swap_push_queue    (ThreadParams *params);
-static void        gegl_tile_backend_swap_write         (ThreadParams *params);
+static void        gegl_tile_backend_swap_write         (ThreadParams **ops,
+                                                         gint           n_ops);
+static gint        gegl_tile_backend_swap_pop_batch     (ThreadParams **batch);
 static gpointer    gegl_tile_backend_swap_writer_thread (gpointer ignored);
+static gpointer    gegl_tile_backend_swap_reader_thread (gpointer ignored);
+static void        gegl_tile_backend_swap_read_free     (ReadOp                *op);
+static void        gegl_tile_backend_swap_cancel_read   (SwapEntry             *entry);
+static gboolean    gegl_tile_backend_swap_prefetch_entry (GeglTileBackendSwap  *self,
+                                                          SwapEntry            *entry);
+static GeglTile *  gegl_tile_backend_swap_take_prefetched (SwapEntry           *entry);
+static void        gegl_tile_backend_swap_read_ahead    (GeglTileBackendSwap   *self,
+                                                         gint                   x,
+                                                         gint                   y,
+                                                         gint                   z);
 static void        gegl_tile_backend_swap_entry_read    (GeglTileBackendSwap   *self,
                                                          SwapEntry             *entry,
                                                          guchar                *dest);
@@ -101,8 +150,9 @@ static SwapEntry * gegl_tile_backend_swap_entry_create  (gint
                                                          gint                   y,
                                                          gint                   z);
 static guint64     gegl_tile_backend_swap_find_offset   (gint                   tile_size);
-static SwapGap *   gegl_tile_backend_swap_gap_new       (guint64                start,
-                                                         guint64                end);
+static void        gegl_tile_backend_swap_free_range    (guint64                start,
+                                                         guint64                end,
+                                                         gboolean               punch);
 static void        gegl_tile_backend_swap_entry_destroy (GeglTileBackendSwap   *self,
                                                          SwapEntry             *entry);
 static void        gegl_tile_backend_swap_resize        (guint64 size);
@@ -150,16 +200,76 @@ static gchar   *path       = NULL;
 static gint     in_fd      = -1;
 static gint     out_fd     = -1;
 static guint64  in_offset  = 0;
-static guint64  out_offset = 0;
-static GList   *gap_list   = NULL;
 static guint64  total      = 0;
 
-static GThread      *writer_thread = NULL;
-static GQueue       *queue         = NULL;
-static ThreadParams *in_progress   = NULL;
-static gboolean      exit_thread   = FALSE;
+/* the free space of the swap file is kept as gaps, that are coalesced with
+ * their neighbours when freed. The gaps are indexed by their start and end
+ * offsets for coalescing, and sorted by size into segregated free lists,
+ * the free list n holding gaps of 2^n to 2^(n+1)-1 bytes
+ */
+#define N_GAP_CLASSES  64
+
+/* the most gaps checked in the free list of the requested size, before
+ * falling back to the larger free lists, where any gap fits
+ */
+#define MAX_GAP_SCAN   8
+
+/* freed space is returned to the file system once a gap reaches this size,
+ * and again every time it doubles
+ */
+#define PUNCH_MIN      (1024 * 1024)
+
+static GMutex      gap_mutex;
+static GQueue      gap_classes[N_GAP_CLASSES];
+static GHashTable *gap_starts    = NULL;
+static GHashTable *gap_ends      = NULL;
+static guint64     gap_total     = 0;
+static guint64     punched_total = 0;
+
+/* the most writes gathered by a writer thread at a time, adjacent ones
+ * are coalesced into a single write
+ */
+#define MAX_BATCH 64
+
+static GThread     **writer_threads   = NULL;
+static gint          n_writer_threads = 0;
+static GQueue       *queue            = NULL;
+static gint          queue_size       = 0;
+static gboolean      exit_thread      = FALSE;
 static GMutex        mutex;
 static GCond         queue_cond;
+static GCond         max_cond;
+static GCond         write_cond;
+
+/* read-ahead, also protected by mutex. At most MAX_READ_AHEAD tiles are
+ * queued or waiting to be requested, the oldest unrequested ones are
+ * dropped to make room for new ones
+ */
+#define MAX_READ_AHEAD 256
+
+/* strides between consecutively requested tiles larger than this aren't
+ * considered an access pattern
+ */
+#define MAX_STRIDE     16
+
+static GThread      *reader_thread     = NULL;
+static GQueue        read_queue        = G_QUEUE_INIT;
+static GQueue        prefetched        = G_QUEUE_INIT;
+static gint          n_reading         = 0;
+static GCond         read_cond;
+static GCond         read_done_cond;
+
+static guint64       reads_ahead       = 0;
+static guint64       read_ahead_hits   = 0;
+static guint64       read_ahead_wasted = 0;
+
+/* writer statistics, protected by mutex */
+static gint          peak_queue_length = 0;
+static gint          peak_queue_size   = 0;
+static guint64       bytes_written     = 0;
+static guint64       n_writes          = 0;
+static guint64       n_tiles_written   = 0;
+static gint64        write_time        = 0;
 
 
 static void
@@ -167,65 +277,198 @@ gegl_tile_backend_swap_push_queue (ThreadParams *params)
 {
   g_mutex_lock (&mutex);
 
+  /* block if the queue has gotten too big */
+  if (params->operation == OP_WRITE)
+    while (queue_size > gegl_config ()->queue_size)
+      g_cond_wait (&max_cond, &mutex);
+
   g_queue_push_tail (queue, params);
 
   if (params->operation == OP_WRITE)
-    params->entry->link = g_queue_peek_tail_link (queue);
+    {
+      params->entry->link = g_queue_peek_tail_link (queue);
+      queue_size += params->length;
+    }
+
+  peak_queue_length = MAX (peak_queue_length, g_queue_get_length (queue));
+  peak_queue_size   = MAX (peak_queue_size, queue_size);
 
-  /* wake up the writer thread */
+  /* wake up a writer thread */
   g_cond_signal (&queue_cond);
 
   g_mutex_unlock (&mutex);
 }
 
+static gint
+gegl_tile_backend_swap_compare_ops (gconstpointer a,
+                                    gconstpointer b)
+{
+  const ThreadParams *pa = *(const ThreadParams **) a;
+  const ThreadParams *pb = *(const ThreadParams **) b;
+
+  return pa->offset < pb->offset ? -1 : pa->offset > pb->offset;
+}
+
+/* writes ops, which are sorted by offset and adjacent in the file, with as
+ * few system calls as possible
+ */
 static void
-gegl_tile_backend_swap_write (ThreadParams *params)
+gegl_tile_backend_swap_write (ThreadParams **ops,
+                              gint           n_ops)
 {
-  gint    to_be_written = params->length;
-  guint64 offset        = params->entry->offset;
+  guint64 offset = ops[0]->offset;
+
+#if defined (HAVE_PWRITEV) && defined (HAVE_SYS_UIO_H)
+  struct iovec  iov[MAX_BATCH];
+  struct iovec *vec   = iov;
+  gint          n_vec = n_ops;
+  gint          i;
+
+  for (i = 0; i < n_ops; i++)
+    {
+      iov[i].iov_base = gegl_tile_get_data (ops[i]->tile);
+      iov[i].iov_len  = ops[i]->length;
+    }
+
+  while (n_vec > 0)
+    {
+      gssize wrote = pwritev (out_fd, vec, n_vec, offset);
+
+      if (wrote <= 0)
+        {
+          g_message ("unable to write tile data to self: %s",
+                     g_strerror (errno));
+          break;
+        }
+
+      offset += wrote;
+
+      while (n_vec > 0 && wrote >= (gssize) vec->iov_len)
+        {
+          wrote -= vec->iov_len;
+          vec++;
+          n_vec--;
+        }
+
+      if (n_vec > 0)
+        {
+          vec->iov_base  = (guchar *) vec->iov_base + wrote;
+          vec->iov_len  -= wrote;
+        }
+    }
+#else
+  gint i;
 
-  if (out_offset != offset)
+  for (i = 0; i < n_ops; i++)
     {
+      guchar *data          = gegl_tile_get_data (ops[i]->tile);
+      gint    to_be_written = ops[i]->length;
+
+#ifndef HAVE_PWRITE
+      /* without pwrite() there is only a single writer thread */
       if (lseek (out_fd, offset, SEEK_SET) < 0)
         {
           g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
           return;
         }
-      out_offset = offset;
+#endif
+
+      while (to_be_written > 0)
+        {
+          gint wrote;
+
+#ifdef HAVE_PWRITE
+          wrote = pwrite (out_fd, data + ops[i]->length - to_be_written,
+                          to_be_written, offset);
+#else
+          wrote = write (out_fd, data + ops[i]->length - to_be_written,
+                         to_be_written);
+#endif
+          if (wrote <= 0)
+            {
+              g_message ("unable to write tile data to self: "
+                         "%s (%d/%d bytes written)",
+                         g_strerror (errno), wrote, to_be_written);
+              return;
+            }
+
+          to_be_written -= wrote;
+          offset        += wrote;
+        }
+    }
+#endif
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "writer thread wrote %i tiles at %i",
+             n_ops, (gint) ops[0]->offset);
+}
+
+/* takes the operations a writer thread should carry out next off the
+ * queue, called with the mutex held. This is either a single truncate, or
+ * up to MAX_BATCH writes of entries no other writer thread is busy with
+ */
+static gint
+gegl_tile_backend_swap_pop_batch (ThreadParams **batch)
+{
+  GList *link = g_queue_peek_head_link (queue);
+  gint   n    = 0;
+
+  if (link && ((ThreadParams *) link->data)->operation == OP_TRUNCATE)
+    {
+      batch[n++] = g_queue_pop_head (queue);
+      return n;
     }
 
-  while (to_be_written > 0)
+  while (link && n < MAX_BATCH)
     {
-      gint wrote;
-      wrote = write (out_fd,
-                     gegl_tile_get_data (params->tile) + params->length
-                     - to_be_written,
-                     to_be_written);
-      if (wrote <= 0)
+      ThreadParams *params = link->data;
+      GList        *next   = link->next;
+
+      /* keep the order of resizes and writes */
+      if (params->operation == OP_TRUNCATE)
+        break;
+
+      /* an older write of the same entry is still being carried out,
+       * leave this one for later so that they don't race
+       */
+      if (! params->entry->in_progress)
         {
-          g_message ("unable to write tile data to self: "
-                     "%s (%d/%d bytes written)",
-                     g_strerror (errno), wrote, to_be_written);
-          break;
+          g_queue_delete_link (queue, link);
+
+          params->offset               = params->entry->offset;
+          params->entry->link          = NULL;
+          params->entry->in_progress   = params;
+          queue_size                  -= params->length;
+
+          batch[n++] = params;
         }
 
-      to_be_written -= wrote;
-      out_offset    += wrote;
+      link = next;
+    }
+
+  if (n)
+    {
+      /* unblock the threads waiting for the queue to shrink */
+      if (queue_size < gegl_config ()->queue_size)
+        g_cond_broadcast (&max_cond);
     }
 
-  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "writer thread wrote at %i", (gint)offset);
+  return n;
 }
 
 static gpointer
 gegl_tile_backend_swap_writer_thread (gpointer ignored)
 {
+  ThreadParams *batch[MAX_BATCH];
+
   while (TRUE)
     {
-      ThreadParams *params;
+      gint n_ops;
+      gint i;
 
       g_mutex_lock (&mutex);
 
-      while (g_queue_is_empty (queue) && !exit_thread)
+      while (! exit_thread &&
+             ! (n_ops = gegl_tile_backend_swap_pop_batch (batch)))
         g_cond_wait (&queue_cond, &mutex);
 
       if (exit_thread)
@@ -235,41 +478,357 @@ gegl_tile_backend_swap_writer_thread (gpointer ignored)
           return NULL;
         }
 
-      params = (ThreadParams *)g_queue_pop_head (queue);
-      if (params->operation == OP_WRITE)
+      g_mutex_unlock (&mutex);
+
+      if (batch[0]->operation == OP_TRUNCATE)
+        {
+          if (ftruncate (out_fd, total) != 0)
+            g_warning ("failed to resize swap file: %s", g_strerror (errno));
+        }
+      else
+        {
+          gint64 start = g_get_monotonic_time ();
+          gint   first = 0;
+          gint   n_runs = 0;
+
+          qsort (batch, n_ops, sizeof (ThreadParams *),
+                 gegl_tile_backend_swap_compare_ops);
+
+          /* coalesce runs of tiles that are adjacent in the file */
+          for (i = 1; i <= n_ops; i++)
+            {
+              if (i == n_ops ||
+                  batch[i]->offset != batch[i - 1]->offset + batch[i - 1]->length)
+                {
+                  gegl_tile_backend_swap_write (batch + first, i - first);
+                  first = i;
+                  n_runs++;
+                }
+            }
+
+          g_mutex_lock (&mutex);
+          write_time += g_get_monotonic_time () - start;
+          n_writes   += n_runs;
+          g_mutex_unlock (&mutex);
+        }
+
+      g_mutex_lock (&mutex);
+
+      for (i = 0; i < n_ops; i++)
         {
-          in_progress = params;
-          params->entry->link = NULL;
+          ThreadParams *params = batch[i];
+
+          if (params->operation == OP_WRITE)
+            {
+              params->entry->in_progress = NULL;
+              bytes_written += params->length;
+              n_tiles_written++;
+
+              gegl_tile_unref (params->tile);
+            }
+
+          g_slice_free (ThreadParams, params);
         }
 
+      /* wake up writers waiting for these entries to be written, and
+       * threads waiting to destroy them
+       */
+      g_cond_broadcast (&queue_cond);
+      g_cond_broadcast (&write_cond);
+
       g_mutex_unlock (&mutex);
+    }
+
+  return NULL;
+}
+
+#ifdef HAVE_PREAD
+static gboolean
+gegl_tile_backend_swap_read_at (guchar  *dest,
+                                gint     length,
+                                guint64  offset)
+{
+  gint to_be_read = length;
+
+  while (to_be_read > 0)
+    {
+      gssize byte_read = pread (in_fd, dest + length - to_be_read,
+                                to_be_read, offset);
 
-      switch (params->operation)
+      if (byte_read <= 0)
         {
-        case OP_WRITE:
-          gegl_tile_backend_swap_write (params);
-          break;
-        case OP_TRUNCATE:
-          if (ftruncate (out_fd, total) != 0)
-            g_warning ("failed to resize swap file: %s", g_strerror (errno));
-          break;
+          g_message ("unable to read tile data from swap: "
+                     "%s (%d/%d bytes read)",
+                     g_strerror (errno), (gint) byte_read, to_be_read);
+          return FALSE;
+        }
+
+      to_be_read -= byte_read;
+      offset     += byte_read;
+    }
+
+  return TRUE;
+}
+#endif
+
+static gpointer
+gegl_tile_backend_swap_reader_thread (gpointer ignored)
+{
+#ifdef HAVE_PREAD
+  while (TRUE)
+    {
+      ReadOp   *op;
+      GeglTile *tile;
+      gboolean  success;
+
+      g_mutex_lock (&mutex);
+
+      while (g_queue_is_empty (&read_queue) && ! exit_thread)
+        g_cond_wait (&read_cond, &mutex);
+
+      if (exit_thread)
+        {
+          g_mutex_unlock (&mutex);
+          return NULL;
         }
 
+      op = LINK_GET_READ_OP (g_queue_peek_head_link (&read_queue));
+      g_queue_unlink (&read_queue, &op->link);
+      op->reading = TRUE;
+      n_reading++;
+
+      g_mutex_unlock (&mutex);
+
+      tile    = gegl_tile_new (op->length);
+      success = gegl_tile_backend_swap_read_at (gegl_tile_get_data (tile),
+                                                op->length, op->offset);
+
       g_mutex_lock (&mutex);
 
-      in_progress = NULL;
+      op->reading = FALSE;
+      n_reading--;
+
+      if (op->cancelled || ! success)
+        {
+          if (! op->cancelled)
+            op->entry->read = NULL;
 
-      if (params->operation == OP_WRITE)
-        gegl_tile_unref (params->tile);
+          gegl_tile_unref (tile);
+          g_slice_free (ReadOp, op);
+        }
+      else
+        {
+          op->tile = tile;
+          g_queue_push_tail_link (&prefetched, &op->link);
+        }
 
-      g_slice_free (ThreadParams, params);
+      g_cond_broadcast (&read_done_cond);
 
       g_mutex_unlock (&mutex);
     }
+#endif
 
   return NULL;
 }
 
+/* frees a queued or done read, called with the mutex held */
+static void
+gegl_tile_backend_swap_read_free (ReadOp *op)
+{
+  if (op->tile)
+    g_queue_unlink (&prefetched, &op->link);
+  else
+    g_queue_unlink (&read_queue, &op->link);
+
+  if (op->tile)
+    gegl_tile_unref (op->tile);
+
+  op->entry->read = NULL;
+
+  g_slice_free (ReadOp, op);
+}
+
+/* drops the read-ahead of an entry that is about to change or go away,
+ * called with the mutex held
+ */
+static void
+gegl_tile_backend_swap_cancel_read (SwapEntry *entry)
+{
+  ReadOp *op = entry->read;
+
+  if (! op)
+    return;
+
+  if (op->reading)
+    {
+      /* the reader thread frees it once it is done */
+      op->cancelled = TRUE;
+      entry->read   = NULL;
+    }
+  else
+    {
+      if (op->tile)
+        read_ahead_wasted++;
+
+      gegl_tile_backend_swap_read_free (op);
+    }
+}
+
+/* queues a read of entry on the reader thread, returns TRUE if the entry
+ * is being read ahead
+ */
+static gboolean
+gegl_tile_backend_swap_prefetch_entry (GeglTileBackendSwap *self,
+                                       SwapEntry           *entry)
+{
+#ifdef HAVE_PREAD
+  ReadOp *op;
+
+  if (entry->read)
+    return TRUE;
+
+  /* entries with pending writes are served from the writer queue anyway */
+  if (entry->link || entry->in_progress)
+    return FALSE;
+
+  g_mutex_lock (&mutex);
+
+  if (entry->read || entry->link || entry->in_progress || exit_thread)
+    {
+      gboolean reading = entry->read != NULL;
+
+      g_mutex_unlock (&mutex);
+      return reading;
+    }
+
+  if (g_queue_get_length (&read_queue) + n_reading +
+      g_queue_get_length (&prefetched) >= MAX_READ_AHEAD)
+    {
+      if (g_queue_is_empty (&prefetched))
+        {
+          g_mutex_unlock (&mutex);
+          return FALSE;
+        }
+
+      read_ahead_wasted++;
+      gegl_tile_backend_swap_read_free (LINK_GET_READ_OP (g_queue_peek_head_link (&prefetched)));
+    }
+
+  if (! reader_thread)
+    reader_thread = g_thread_new ("swap reader",
+                                  gegl_tile_backend_swap_reader_thread,
+                                  NULL);
+
+  op         = g_slice_new0 (ReadOp);
+  op->entry  = entry;
+  op->offset = entry->offset;
+  op->length = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  entry->read = op;
+  g_queue_push_tail_link (&read_queue, &op->link);
+  reads_ahead++;
+
+  g_cond_signal (&read_cond);
+
+  g_mutex_unlock (&mutex);
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/* returns the tile read ahead for entry, if any, waiting for the read to
+ * finish if it is being carried out
+ */
+static GeglTile *
+gegl_tile_backend_swap_take_prefetched (SwapEntry *entry)
+{
+  GeglTile *tile = NULL;
+  ReadOp   *op;
+
+  if (! entry->read)
+    return NULL;
+
+  g_mutex_lock (&mutex);
+
+  while ((op = entry->read) && op->reading)
+    g_cond_wait (&read_done_cond, &mutex);
+
+  if (op)
+    {
+      if (op->tile)
+        {
+          tile     = op->tile;
+          op->tile = NULL;
+
+          g_queue_unlink (&prefetched, &op->link);
+          entry->read = NULL;
+          g_slice_free (ReadOp, op);
+
+          read_ahead_hits++;
+        }
+      else
+        {
+          /* not started yet, we are faster reading it ourselves */
+          gegl_tile_backend_swap_read_free (op);
+        }
+    }
+
+  g_mutex_unlock (&mutex);
+
+  return tile;
+}
+
+/* keeps track of the stride between consecutive requests, and once the
+ * same stride was seen twice in a row, reads the next tiles along it
+ * ahead of time
+ */
+static void
+gegl_tile_backend_swap_read_ahead (GeglTileBackendSwap *self,
+                                   gint                 x,
+                                   gint                 y,
+                                   gint                 z)
+{
+  gint n_tiles  = gegl_config ()->swap_read_ahead;
+  gint stride_x = x - self->last_x;
+  gint stride_y = y - self->last_y;
+  gint i;
+
+  if (z == self->last_z &&
+      stride_x == self->stride_x && stride_y == self->stride_y &&
+      (stride_x || stride_y))
+    {
+      self->n_sequential++;
+    }
+  else
+    {
+      self->n_sequential = 0;
+      self->stride_x     = stride_x;
+      self->stride_y     = stride_y;
+    }
+
+  self->last_x = x;
+  self->last_y = y;
+  self->last_z = z;
+
+  if (n_tiles <= 0 || self->n_sequential < 1 ||
+      ABS (stride_x) > MAX_STRIDE || ABS (stride_y) > MAX_STRIDE)
+    return;
+
+  for (i = 1; i <= n_tiles; i++)
+    {
+      SwapEntry *entry;
+
+      entry = gegl_tile_backend_swap_lookup_entry (self,
+                                                   x + i * stride_x,
+                                                   y + i * stride_y,
+                                                   z);
+      if (entry)
+        gegl_tile_backend_swap_prefetch_entry (self, entry);
+    }
+}
+
 static void
 gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
                                    SwapEntry           *entry,
@@ -281,15 +840,15 @@ gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
 
   gegl_tile_backend_swap_ensure_exist ();
 
-  if (entry->link || in_progress)
+  if (entry->link || entry->in_progress)
     {
       ThreadParams *queued_op = NULL;
       g_mutex_lock (&mutex);
 
       if (entry->link)
         queued_op = entry->link->data;
-      else if (in_progress && in_progress->entry == entry)
-        queued_op = in_progress;
+      else if (entry->in_progress)
+        queued_op = entry->in_progress;
 
       if (queued_op)
         {
@@ -344,6 +903,13 @@ gegl_tile_backend_swap_entry_write (GeglTileBackendSwap *self,
 
   gegl_tile_backend_swap_ensure_exist ();
 
+  if (entry->read)
+    {
+      g_mutex_lock (&mutex);
+      gegl_tile_backend_swap_cancel_read (entry);
+      g_mutex_unlock (&mutex);
+    }
+
   if (entry->link)
     {
       g_mutex_lock (&mutex);
@@ -381,71 +947,204 @@ gegl_tile_backend_swap_entry_create (gint x,
 {
   SwapEntry *entry = g_slice_new0 (SwapEntry);
 
-  entry->x    = x;
-  entry->y    = y;
-  entry->z    = z;
-  entry->link = NULL;
+  entry->x           = x;
+  entry->y           = y;
+  entry->z           = z;
+  entry->link        = NULL;
+  entry->in_progress = NULL;
+  entry->read        = NULL;
 
   return entry;
 }
 
+static inline gint
+gegl_tile_backend_swap_gap_class (guint64 length)
+{
+  gint class = 0;
+
+  while (length >>= 1)
+    class++;
+
+  return class;
+}
+
+static void
+gegl_tile_backend_swap_gap_insert (SwapGap *gap)
+{
+  if (! gap_starts)
+    {
+      gap_starts = g_hash_table_new (g_int64_hash, g_int64_equal);
+      gap_ends   = g_hash_table_new (g_int64_hash, g_int64_equal);
+    }
+
+  g_hash_table_insert (gap_starts, &gap->start, gap);
+  g_hash_table_insert (gap_ends,   &gap->end,   gap);
+
+  g_queue_push_head_link (
+    &gap_classes[gegl_tile_backend_swap_gap_class (gap->end - gap->start)],
+    &gap->link);
+
+  gap_total += gap->end - gap->start;
+}
+
+static void
+gegl_tile_backend_swap_gap_remove (SwapGap *gap)
+{
+  g_hash_table_remove (gap_starts, &gap->start);
+  g_hash_table_remove (gap_ends,   &gap->end);
+
+  g_queue_unlink (
+    &gap_classes[gegl_tile_backend_swap_gap_class (gap->end - gap->start)],
+    &gap->link);
+
+  gap_total -= gap->end - gap->start;
+}
+
+static SwapGap *
+gegl_tile_backend_swap_gap_fit (gint tile_size)
+{
+  gint   class = gegl_tile_backend_swap_gap_class (tile_size);
+  GList *link;
+  gint   i;
+
+  /* the gaps in the free list of the requested size may be too small */
+  for (link = g_queue_peek_head_link (&gap_classes[class]), i = 0;
+       link && i < MAX_GAP_SCAN;
+       link = link->next, i++)
+    {
+      SwapGap *gap = LINK_GET_GAP (link);
+
+      if (gap->end - gap->start >= tile_size)
+        return gap;
+    }
+
+  /* while any gap in the larger ones fits */
+  for (class++; class < N_GAP_CLASSES; class++)
+    {
+      if ((link = g_queue_peek_head_link (&gap_classes[class])))
+        return LINK_GET_GAP (link);
+    }
+
+  return NULL;
+}
+
 static guint64
 gegl_tile_backend_swap_find_offset (gint tile_size)
 {
   SwapGap *gap;
   guint64  offset;
 
-  if (gap_list)
+  g_mutex_lock (&gap_mutex);
+
+  gap = gegl_tile_backend_swap_gap_fit (tile_size);
+
+  if (! gap)
     {
-      GList *link = gap_list;
+      guint64 old_total = total;
 
-      while (link)
-        {
-          guint64 length;
+      gegl_tile_backend_swap_resize (total + 32 * tile_size);
 
-          gap    = link->data;
-          length = gap->end - gap->start;
+      /* coalesces with a gap at the end of the file */
+      gegl_tile_backend_swap_free_range (old_total, total, FALSE);
 
-          if (length > tile_size)
-            {
-              offset = gap->start;
-              gap->start += tile_size;
+      gap = gegl_tile_backend_swap_gap_fit (tile_size);
+    }
 
-              return offset;
-            }
-          else if (length == tile_size)
-            {
-              offset = gap->start;
-              g_slice_free (SwapGap, gap);
-              gap_list = g_list_delete_link (gap_list, link);
+  gegl_tile_backend_swap_gap_remove (gap);
 
-              return offset;
-            }
+  offset      = gap->start;
+  gap->start += tile_size;
 
-          link = link->next;
-        }
+  if (gap->start < gap->end)
+    {
+      gap->punched = MIN (gap->punched, gap->end - gap->start);
+      gegl_tile_backend_swap_gap_insert (gap);
+    }
+  else
+    {
+      g_slice_free (SwapGap, gap);
     }
 
-  offset = total;
+  g_mutex_unlock (&gap_mutex);
+
+  return offset;
+}
 
-  gegl_tile_backend_swap_resize (total + 32 * tile_size);
+static void
+gegl_tile_backend_swap_punch (SwapGap *gap)
+{
+#if defined (HAVE_FALLOCATE) && defined (FALLOC_FL_PUNCH_HOLE)
+  guint64 length = gap->end - gap->start;
 
-  gap = gegl_tile_backend_swap_gap_new (offset + tile_size, total);
-  gap_list = g_list_append (gap_list, gap);
+  if (length < PUNCH_MIN || length < 2 * gap->punched)
+    return;
 
-  return offset;
+  if (fallocate (out_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 gap->start, length) == 0)
+    {
+      punched_total += length - gap->punched;
+      gap->punched   = length;
+    }
+  else
+    {
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "unable to punch hole in swap: %s",
+                 g_strerror (errno));
+
+      /* don't try again for this gap */
+      gap->punched = G_MAXUINT64 / 2;
+    }
+#endif
 }
 
-static SwapGap *
-gegl_tile_backend_swap_gap_new (guint64 start,
-                                guint64 end)
+/* returns the range start-end to the free space, called with gap_mutex
+ * held. Only the data of ranges that are punched must no longer be
+ * written to or read from the file
+ */
+static void
+gegl_tile_backend_swap_free_range (guint64  start,
+                                   guint64  end,
+                                   gboolean punch)
 {
-  SwapGap *gap = g_slice_new (SwapGap);
+  SwapGap *gap   = NULL;
+  SwapGap *lower = gap_ends   ? g_hash_table_lookup (gap_ends,   &start) : NULL;
+  SwapGap *upper = gap_starts ? g_hash_table_lookup (gap_starts, &end)   : NULL;
+
+  if (lower)
+    {
+      gegl_tile_backend_swap_gap_remove (lower);
+      lower->end = end;
+      gap = lower;
+    }
+
+  if (upper)
+    {
+      gegl_tile_backend_swap_gap_remove (upper);
 
-  gap->start = start;
-  gap->end = end;
+      if (gap)
+        {
+          gap->end     = upper->end;
+          gap->punched = MAX (gap->punched, upper->punched);
+          g_slice_free (SwapGap, upper);
+        }
+      else
+        {
+          upper->start = start;
+          gap = upper;
+        }
+    }
 
-  return gap;
+  if (! gap)
+    {
+      gap          = g_slice_new0 (SwapGap);
+      gap->start   = start;
+      gap->end     = end;
+      gap->punched = punch ? 0 : end - start;
+    }
+
+  gegl_tile_backend_swap_gap_insert (gap);
+
+  if (punch)
+    gegl_tile_backend_swap_punch (gap);
 }
 
 static void
@@ -454,101 +1153,43 @@ gegl_tile_backend_swap_entry_destroy (GeglTileBackendSwap *self,
 {
   guint64  start, end;
   gint     tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
-  GList   *hlink;
 
-  if (entry->link)
+  if (entry->link || entry->in_progress || entry->read)
     {
       GList *link;
 
       g_mutex_lock (&mutex);
 
+      gegl_tile_backend_swap_cancel_read (entry);
+
       if ((link = entry->link))
         {
           ThreadParams *queued_op = link->data;
           g_queue_delete_link (queue, link);
+          queue_size -= queued_op->length;
           gegl_tile_unref (queued_op->tile);
           g_slice_free (ThreadParams, queued_op);
+          entry->link = NULL;
+
+          if (queue_size < gegl_config ()->queue_size)
+            g_cond_broadcast (&max_cond);
         }
 
+      /* the space of the entry can't be reused before a pending write to
+       * it has landed, or it could overwrite newer data
+       */
+      while (entry->in_progress)
+        g_cond_wait (&write_cond, &mutex);
+
       g_mutex_unlock (&mutex);
     }
 
   start = entry->offset;
   end = start + tile_size;
 
-  if ((hlink = gap_list))
-    while (hlink)
-      {
-        GList *llink = hlink->prev;
-        SwapGap *lgap, *hgap;
-
-        if (llink)
-          lgap = llink->data;
-
-        hgap = hlink->data;
-
-        /* attempt to merge lower, upper and this gap */
-        if (llink != NULL && lgap->end == start &&
-            hgap->start == end)
-          {
-            llink->next = hlink->next;
-            if (hlink->next)
-              hlink->next->prev = llink;
-            lgap->end = hgap->end;
-
-            g_slice_free (SwapGap, hgap);
-            hlink->next = NULL;
-            hlink->prev = NULL;
-            g_list_free (hlink);
-            break;
-          }
-        /* attempt to merge with upper gap */
-        else if (hgap->start == end)
-          {
-            hgap->start = start;
-            break;
-          }
-        /* attempt to merge with lower gap */
-        else if (llink != NULL && lgap->end == start)
-          {
-            lgap->end = end;
-            break;
-          }
-        /* create new gap */
-        else if (hgap->start > end)
-          {
-            lgap = gegl_tile_backend_swap_gap_new (start, end);
-            gap_list = g_list_insert_before (gap_list, hlink, lgap);
-            break;
-          }
-
-        /* if there's no more elements in the list after this */
-        else if (hlink->next == NULL)
-          {
-            /* attempt to merge with the last gap */
-            if (hgap->end == start)
-              {
-                hgap->end = end;
-              }
-            /* create a new gap in the end of the list */
-            else
-              {
-                GList *new_link;
-                hgap = gegl_tile_backend_swap_gap_new (start, end);
-                new_link = g_list_alloc ();
-                new_link->next = NULL;
-                new_link->prev = hlink;
-                new_link->data = hgap;
-                hlink->next = new_link;
-              }
-            break;
-          }
-
-        hlink = hlink->next;
-      }
-  else
-    gap_list = g_list_prepend (NULL,
-                               gegl_tile_backend_swap_gap_new (start, end));
+  g_mutex_lock (&gap_mutex);
+  gegl_tile_backend_swap_free_range (start, end, TRUE);
+  g_mutex_unlock (&gap_mutex);
 
   g_hash_table_remove (self->index, entry);
   g_slice_free (SwapEntry, entry);
@@ -574,7 +1215,11 @@ gegl_tile_backend_swap_lookup_entry (GeglTileBackendSwap *self,
                                      gint                 y,
                                      gint                 z)
 {
-  SwapEntry key = {0, NULL, x, y, z};
+  SwapEntry key;
+
+  key.x = x;
+  key.y = y;
+  key.z = z;
 
   return g_hash_table_lookup (self->index, &key);
 }
@@ -596,6 +1241,15 @@ gegl_tile_backend_swap_get_tile (GeglTileSource *self,
   if (!entry)
     return NULL;
 
+  gegl_tile_backend_swap_read_ahead (tile_backend_swap, x, y, z);
+
+  tile = gegl_tile_backend_swap_take_prefetched (entry);
+  if (tile)
+    {
+      gegl_tile_mark_as_stored (tile);
+      return tile;
+    }
+
   tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   tile      = gegl_tile_new (tile_size);
   gegl_tile_mark_as_stored (tile);
@@ -701,6 +1355,34 @@ gegl_tile_backend_swap_command (GeglTileSource  *self,
         return gegl_tile_backend_swap_exist_tile (self, data, x, y, z);
       case GEGL_TILE_FLUSH:
         return NULL;
+      case GEGL_TILE_PREFETCH:
+        {
+          GeglTileBackendSwap *swap  = GEGL_TILE_BACKEND_SWAP (self);
+          SwapEntry           *entry;
+
+          entry = gegl_tile_backend_swap_lookup_entry (swap, x, y, z);
+          if (entry &&
+              gegl_tile_backend_swap_prefetch_entry (swap, entry))
+            return (gpointer) TRUE;
+        }
+        return NULL;
+      case GEGL_TILE_IS_CACHED:
+        {
+          GeglTileBackendSwap *swap   = GEGL_TILE_BACKEND_SWAP (self);
+          SwapEntry           *entry;
+          gboolean             cached = FALSE;
+
+          /* a tile already read ahead is as good as a cached one */
+          entry = gegl_tile_backend_swap_lookup_entry (swap, x, y, z);
+          if (entry && entry->read)
+            {
+              g_mutex_lock (&mutex);
+              cached = entry->read && entry->read->tile;
+              g_mutex_unlock (&mutex);
+            }
+
+          return GINT_TO_POINTER (cached);
+        }
 
       default:
         g_assert (command < GEGL_TILE_LAST_COMMAND &&
@@ -812,16 +1494,56 @@ static void
 gegl_tile_backend_swap_class_init (GeglTileBackendSwapClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  gint          i;
 
   parent_class = g_type_class_peek_parent (klass);
 
   gobject_class->constructed  = gegl_tile_backend_swap_constructed;
   gobject_class->finalize     = gegl_tile_backend_swap_finalize;
 
-  queue         = g_queue_new ();
-  writer_thread = g_thread_new ("swap writer",
-                                gegl_tile_backend_swap_writer_thread,
-                                NULL);
+  queue = g_queue_new ();
+
+#if defined (HAVE_PWRITE) || defined (HAVE_PWRITEV)
+  n_writer_threads = CLAMP (gegl_config ()->swap_writers, 1, 64);
+#else
+  n_writer_threads = 1;
+#endif
+
+  writer_threads = g_new (GThread *, n_writer_threads);
+  for (i = 0; i < n_writer_threads; i++)
+    writer_threads[i] = g_thread_new ("swap writer",
+                                      gegl_tile_backend_swap_writer_thread,
+                                      NULL);
+}
+
+void
+gegl_tile_backend_swap_stats (void)
+{
+  g_mutex_lock (&mutex);
+
+  g_warning ("Swap statistics: writers:%i queued:%i (%i bytes) "
+             "peak queued:%i (%i bytes) written:%" G_GUINT64_FORMAT
+             " tiles in %" G_GUINT64_FORMAT " writes, %.2f MB/s",
+             n_writer_threads,
+             queue ? g_queue_get_length (queue) : 0, queue_size,
+             peak_queue_length, peak_queue_size,
+             n_tiles_written, n_writes,
+             write_time ? bytes_written / (gdouble) write_time : 0.0);
+  g_warning ("Swap read-ahead: read:%" G_GUINT64_FORMAT " used:%"
+             G_GUINT64_FORMAT " wasted:%" G_GUINT64_FORMAT,
+             reads_ahead, read_ahead_hits, read_ahead_wasted);
+
+  g_mutex_unlock (&mutex);
+
+  g_mutex_lock (&gap_mutex);
+
+  g_warning ("Swap space: size:%" G_GUINT64_FORMAT " free:%" G_GUINT64_FORMAT
+             " in %i gaps, punched:%" G_GUINT64_FORMAT,
+             total, gap_total,
+             gap_starts ? g_hash_table_size (gap_starts) : 0,
+             punched_total);
+
+  g_mutex_unlock (&gap_mutex);
 }
 
 void
@@ -829,30 +1551,68 @@ gegl_tile_backend_swap_cleanup (void)
 {
   if (in_fd != -1 && out_fd != -1)
     {
+      gint i;
+
+      g_mutex_lock (&mutex);
       exit_thread = TRUE;
-      g_cond_signal (&queue_cond);
-      g_thread_join (writer_thread);
+      g_cond_broadcast (&queue_cond);
+      g_mutex_unlock (&mutex);
+
+      for (i = 0; i < n_writer_threads; i++)
+        g_thread_join (writer_threads[i]);
+
+      if (reader_thread)
+        {
+          g_mutex_lock (&mutex);
+          g_cond_broadcast (&read_cond);
+          g_mutex_unlock (&mutex);
+
+          g_thread_join (reader_thread);
+          reader_thread = NULL;
+        }
+
+      g_free (writer_threads);
+      writer_threads   = NULL;
+      n_writer_threads = 0;
 
       if (g_queue_get_length (queue) != 0)
         g_warning ("tile-backend-swap writer queue wasn't empty before freeing\n");
 
       g_queue_free (queue);
+      queue = NULL;
 
-      if (gap_list)
+      if (gap_starts)
         {
-          SwapGap *gap = gap_list->data;
+          gint n_gaps = g_hash_table_size (gap_starts);
 
-          if (gap_list->next)
-            g_warning ("tile-backend-swap gap list had more than one element\n");
+          if (n_gaps > 1)
+            g_warning ("tile-backend-swap had %i gaps instead of one\n", n_gaps);
 
-          g_warn_if_fail (gap->start == 0 && gap->end == total);
+          g_warn_if_fail (gap_total == total);
 
-          g_slice_free (SwapGap, gap_list->data);
-          g_list_free (gap_list);
+          for (i = 0; i < N_GAP_CLASSES; i++)
+            {
+              GList *link;
+
+              while ((link = g_queue_peek_head_link (&gap_classes[i])))
+                {
+                  SwapGap *gap = LINK_GET_GAP (link);
+
+                  gegl_tile_backend_swap_gap_remove (gap);
+                  g_slice_free (SwapGap, gap);
+                }
+            }
+
+          g_hash_table_unref (gap_starts);
+          g_hash_table_unref (gap_ends);
+          gap_starts = gap_ends = NULL;
         }
       else
         g_warn_if_fail (total == 0);
 
+      total = 0;
+      punched_total = 0;
+
       close (in_fd);
       close (out_fd);
 
@@ -44,10 +44,20 @@ struct _GeglTileBackendSwap
 {
   GeglTileBackend  parent_instance;
   GHashTable      *index;
+
+  /* the access pattern detection of read-ahead */
+  gint             last_x;
+  gint             last_y;
+  gint             last_z;
+  gint             stride_x;
+  gint             stride_y;
+  gint             n_sequential;
 };
 
 GType gegl_tile_backend_swap_get_type (void) G_GNUC_CONST;
 
+void  gegl_tile_backend_swap_stats    (void);
+
 G_END_DECLS
 
 #endif
@@ -249,7 +249,7 @@ gegl_tile_backend_unlink_swap (gchar *path)
 
   /* Ensure we delete only files in our known swap directory for safety. */
   if (g_file_test (path, G_FILE_TEST_EXISTS) &&
-      g_strcmp0 (dirname, gegl_config()->swap) == 0)
+      g_strcmp0 (dirname, gegl_swap_dir ()) == 0)
     g_unlink (path);
 
   g_free (dirname);
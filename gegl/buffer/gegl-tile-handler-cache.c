@@ -18,6 +18,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+
 #include <glib.h>
 #include <glib-object.h>
 
@@ -37,24 +39,58 @@
 #define GEGL_DEBUG_CACHE_HITS
 */
 
+/* The cache is split in CACHE_SHARDS independent shards, each with its own
+ * hash table, LRU queue and mutex. Which shard a tile lives in is decided by
+ * the hash of its coordinates and handler, so threads working on different
+ * tiles rarely contend for the same lock. Eviction is an approximate LRU;
+ * the least recently used tile of a shard is evicted, with the shard picked
+ * round-robin by a clock hand.
+ *
+ * Each shard also keeps the subset of its items holding dirty tiles in a
+ * separate queue, in the same LRU order, so washing does not have to scan
+ * the whole cache. Items are added to it when their tile goes from stored
+ * to dirty, and are dropped lazily when the tile turns out to be stored
+ * by the time it reaches the tail.
+ */
+#define CACHE_SHARD_BITS 6
+#define CACHE_SHARDS     (1 << CACHE_SHARD_BITS)
+
 typedef struct CacheItem
 {
   GeglTileHandlerCache *handler; /* The specific handler that cached this item*/
   GeglTile *tile;                /* The tile */
-  GList     link;                /*  Link in the cache_queue, to avoid
+  GList     link;                /*  Link in the shard queue, to avoid
                                   *  queue lookups involving g_list_find() */
+  GList     handler_link;        /*  Link in the items queue of the handler */
+  GList     dirty_link;          /*  Link in the shard dirty queue */
+  gboolean  dirty_queued;        /*  Whether dirty_link is in the dirty queue */
+  guint     stamp;               /*  Shard clock at the last access */
 
   gint      x;                   /* The coordinates this tile was cached for */
   gint      y;
   gint      z;
 } CacheItem;
 
+typedef struct CacheShard
+{
+  GMutex      mutex;
+  GHashTable *ht;
+  GQueue      queue;             /* most recently used item at the head */
+  GQueue      dirty_queue;       /* items with (possibly) dirty tiles, in
+                                    the same order as queue */
+  guint       clock;             /* incremented on every insert and access */
+} CacheShard;
+
 #define LINK_GET_ITEM(link) \
         ((CacheItem *) ((guchar *) link - G_STRUCT_OFFSET (CacheItem, link)))
+#define HANDLER_LINK_GET_ITEM(link) \
+        ((CacheItem *) ((guchar *) link - G_STRUCT_OFFSET (CacheItem, handler_link)))
+#define DIRTY_LINK_GET_ITEM(link) \
+        ((CacheItem *) ((guchar *) link - G_STRUCT_OFFSET (CacheItem, dirty_link)))
 
 
 static void       gegl_tile_handler_cache_dispose    (GObject              *object);
-static gboolean   gegl_tile_handler_cache_wash       (GeglTileHandlerCache *cache);
+static void       gegl_tile_handler_cache_finalize   (GObject              *object);
 static gpointer   gegl_tile_handler_cache_command    (GeglTileSource       *tile_store,
                                                       GeglTileCommand       command,
                                                       gint                  x,
@@ -82,13 +118,17 @@ static void       gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cach
                                                       gint                  x,
                                                       gint                  y,
                                                       gint                  z);
+static guint      gegl_tile_handler_cache_hashfunc   (gconstpointer         key);
+static gboolean   gegl_tile_handler_cache_equalfunc  (gconstpointer         a,
+                                                      gconstpointer         b);
 
 
-static GMutex       mutex                 = { 0, };
-static GQueue      *cache_queue           = NULL;
-static GHashTable  *cache_ht              = NULL;
+static CacheShard   cache_shards[CACHE_SHARDS];
+static gboolean     cache_initialized     = FALSE;
+static gint         cache_clock_hand      = 0; /* next shard to trim or wash */
 static gint         cache_wash_percentage = 20;
-static guint64      cache_total           = 0; /* approximate amount of bytes stored */
+static gsize        cache_total           = 0; /* approximate amount of bytes stored,
+                                                  updated atomically */
 #ifdef GEGL_DEBUG_CACHE_HITS
 static gint         cache_hits            = 0;
 static gint         cache_misses          = 0;
@@ -103,51 +143,125 @@ gegl_tile_handler_cache_class_init (GeglTileHandlerCacheClass *class)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (class);
 
-  gobject_class->dispose = gegl_tile_handler_cache_dispose;
+  gobject_class->dispose  = gegl_tile_handler_cache_dispose;
+  gobject_class->finalize = gegl_tile_handler_cache_finalize;
 }
 
 static void
 gegl_tile_handler_cache_init (GeglTileHandlerCache *cache)
 {
   ((GeglTileSource*)cache)->command = gegl_tile_handler_cache_command;
+  g_mutex_init (&cache->mutex);
+  g_queue_init (&cache->items);
   gegl_tile_cache_init ();
 }
 
+static inline CacheShard *
+cache_get_shard (const CacheItem *key)
+{
+  /* use the high bits of a multiplicative hash, the low bits of the plain
+   * hash are used for the bucket within the shard
+   */
+  guint hash = gegl_tile_handler_cache_hashfunc (key) * 2654435761u;
+
+  return &cache_shards[hash >> (32 - CACHE_SHARD_BITS)];
+}
+
+/* removes the item from the shard and from its handler, must be called with
+ * the shard mutex held. The item and the cache's reference to the tile are
+ * left for the caller to dispose of.
+ */
 static void
-gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
+cache_shard_unlink (CacheShard *shard,
+                    CacheItem  *item)
+{
+  GeglTileHandlerCache *handler = item->handler;
+
+  g_queue_unlink (&shard->queue, &item->link);
+  if (item->dirty_queued)
+    g_queue_unlink (&shard->dirty_queue, &item->dirty_link);
+  g_hash_table_remove (shard->ht, item);
+
+  g_mutex_lock (&handler->mutex);
+  g_queue_unlink (&handler->items, &item->handler_link);
+  g_mutex_unlock (&handler->mutex);
+
+  g_atomic_int_add (&handler->count, -1);
+  g_atomic_pointer_add (&cache_total, -(gssize) item->tile->size);
+}
+
+/* removes and returns the item cached for the given coordinates, or NULL
+ */
+static CacheItem *
+cache_remove (GeglTileHandlerCache *cache,
+              gint                  x,
+              gint                  y,
+              gint                  z)
 {
-  CacheItem            *item;
-  GSList               *iter;
+  CacheShard *shard;
+  CacheItem   key;
+  CacheItem  *item;
 
+  key.x       = x;
+  key.y       = y;
+  key.z       = z;
+  key.handler = cache;
+
+  shard = cache_get_shard (&key);
+
+  g_mutex_lock (&shard->mutex);
+  item = g_hash_table_lookup (shard->ht, &key);
+  if (item)
+    cache_shard_unlink (shard, item);
+  g_mutex_unlock (&shard->mutex);
+
+  return item;
+}
+
+static void
+gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
+{
   if (cache->tile_storage->hot_tile)
     {
       gegl_tile_unref (cache->tile_storage->hot_tile);
       cache->tile_storage->hot_tile = NULL;
     }
 
-  if (!cache->count)
+  if (!g_atomic_int_get (&cache->count))
     return;
 
-  g_mutex_lock (&mutex);
-  {
-    for (iter = cache->items; iter; iter = cache->items)
+  while (TRUE)
     {
-      item = iter->data;
-      if (item->tile)
+      CacheItem *item;
+      GList     *link;
+      gint       x = 0, y = 0, z = 0;
+
+      /* the coordinates are copied out under the handler lock, since the
+       * item can be evicted by another thread before we get hold of its
+       * shard.
+       */
+      g_mutex_lock (&cache->mutex);
+      link = g_queue_peek_head_link (&cache->items);
+      if (link)
         {
-          cache_total -= item->tile->size;
-          gegl_tile_mark_as_stored (item->tile); // to avoid saving 
+          item = HANDLER_LINK_GET_ITEM (link);
+          x = item->x;
+          y = item->y;
+          z = item->z;
+        }
+      g_mutex_unlock (&cache->mutex);
+
+      if (!link)
+        break;
+
+      item = cache_remove (cache, x, y, z);
+      if (item)
+        {
+          gegl_tile_mark_as_stored (item->tile); // to avoid saving
           gegl_tile_unref (item->tile);
-          cache->count--;
+          g_slice_free (CacheItem, item);
         }
-      g_queue_unlink (cache_queue, &item->link);
-      cache->items = g_slist_remove (cache->items, item);
-      g_hash_table_remove (cache_ht, item);
-      g_slice_free (CacheItem, item);
     }
-  }
-
-  g_mutex_unlock (&mutex);
 }
 
 static void
@@ -165,6 +279,16 @@ gegl_tile_handler_cache_dispose (GObject *object)
   G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->dispose (object);
 }
 
+static void
+gegl_tile_handler_cache_finalize (GObject *object)
+{
+  GeglTileHandlerCache *cache = GEGL_TILE_HANDLER_CACHE (object);
+
+  g_mutex_clear (&cache->mutex);
+
+  G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->finalize (object);
+}
+
 static GeglTile *
 gegl_tile_handler_cache_get_tile_command (GeglTileSource *tile_store,
                                           gint        x,
@@ -182,12 +306,12 @@ gegl_tile_handler_cache_get_tile_command (GeglTileSource *tile_store,
   if (tile)
     {
 #ifdef GEGL_DEBUG_CACHE_HITS
-      cache_hits++;
+      g_atomic_int_inc (&cache_hits);
 #endif
       return tile;
     }
 #ifdef GEGL_DEBUG_CACHE_HITS
-  cache_misses++;
+  g_atomic_int_inc (&cache_misses);
 #endif
 
   if (source)
@@ -215,22 +339,33 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
       case GEGL_TILE_FLUSH:
         {
           GList     *link;
+          GSList    *tiles = NULL;
 
           if (gegl_cl_is_accelerated ())
             gegl_buffer_cl_cache_flush2 (cache, NULL);
 
-          if (cache->count)
+          if (g_atomic_int_get (&cache->count))
             {
-              for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
+              /* collect the tiles first, storing them can take a while and
+               * should not hold up other threads using the cache
+               */
+              g_mutex_lock (&cache->mutex);
+              for (link = g_queue_peek_head_link (&cache->items); link; link = link->next)
+                {
+                  CacheItem *item = HANDLER_LINK_GET_ITEM (link);
+
+                  if (item->tile != NULL)
+                    tiles = g_slist_prepend (tiles, gegl_tile_ref (item->tile));
+                }
+              g_mutex_unlock (&cache->mutex);
+
+              while (tiles)
                 {
-                  CacheItem *item = LINK_GET_ITEM (link);
-                  GeglTile  *tile = item->tile;
-
-                  if (tile != NULL &&
-                      item->handler == cache)
-                    {
-                      gegl_tile_store (tile);
-                    }
+                  GeglTile *tile = tiles->data;
+
+                  gegl_tile_store (tile);
+                  gegl_tile_unref (tile);
+                  tiles = g_slist_delete_link (tiles, tiles);
                 }
             }
         }
@@ -242,7 +377,15 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
          */
         return gegl_tile_handler_cache_get_tile_command (tile_store, x, y, z);
       case GEGL_TILE_IS_CACHED:
-        return GINT_TO_POINTER(gegl_tile_handler_cache_has_tile (cache, x, y, z));
+        if (gegl_tile_handler_cache_has_tile (cache, x, y, z))
+          return (gpointer)TRUE;
+        /* a tile read ahead below is about as good */
+        break;
+      case GEGL_TILE_PREFETCH:
+        /* nothing to read ahead for tiles we already hold */
+        if (gegl_tile_handler_cache_has_tile (cache, x, y, z))
+          return NULL;
+        break;
       case GEGL_TILE_EXIST:
         {
           gboolean exist = gegl_tile_handler_cache_has_tile (cache, x, y, z);
@@ -252,7 +395,7 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
         break;
       case GEGL_TILE_IDLE:
         {
-          gboolean action = gegl_tile_handler_cache_wash (cache);
+          gboolean action = gegl_tile_handler_cache_wash (1) > 0;
           if (action)
             return GINT_TO_POINTER(action);
           /* with no action, we chain up to lower levels */
@@ -274,53 +417,125 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
   return gegl_tile_handler_source_command (handler, command, x, y, z, data);
 }
 
-/* write the least recently used dirty tile to disk if it
- * is in the wash_percentage (20%) least recently used tiles,
- * calling this function in an idle handler distributes the
- * tile flushing overhead over time.
+static gint
+cache_wash_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  const GeglTile *ta = *(GeglTile * const *) a;
+  const GeglTile *tb = *(GeglTile * const *) b;
+
+  if (ta->tile_storage != tb->tile_storage)
+    return ta->tile_storage < tb->tile_storage ? -1 : 1;
+  if (ta->z != tb->z)
+    return ta->z - tb->z;
+  if (ta->y != tb->y)
+    return ta->y - tb->y;
+  return ta->x - tb->x;
+}
+
+/* write up to max_tiles of the least recently used dirty tiles to their
+ * storage, a dirty tile is only written if it is among the wash_percentage
+ * (20%) least recently used tiles of its shard, calling this function in an
+ * idle handler distributes the tile flushing overhead over time. The tiles
+ * are written in storage and coordinate order, so that writes can be
+ * coalesced by the backend. Returns the number of tiles written.
  */
-gboolean
-gegl_tile_handler_cache_wash (GeglTileHandlerCache *cache)
+gint
+gegl_tile_handler_cache_wash (gint max_tiles)
 {
-  GeglTile  *last_dirty = NULL;
-  guint      count      = 0;
-  gint       length     = g_queue_get_length (cache_queue);
-  gint       wash_tiles = cache_wash_percentage * length / 100;
-  GList     *link;
+  GeglTile **tiles;
+  gint       n_tiles = 0;
+  gint       start;
+  gint       i;
 
-  for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
+  if (max_tiles <= 0)
+    return 0;
+
+  tiles = g_new (GeglTile *, max_tiles);
+  start = g_atomic_int_add (&cache_clock_hand, 1);
+
+  for (i = 0; i < CACHE_SHARDS && n_tiles < max_tiles; i++)
     {
-      CacheItem *item = LINK_GET_ITEM (link);
-      GeglTile  *tile = item->tile;
+      CacheShard *shard = &cache_shards[(start + i) & (CACHE_SHARDS - 1)];
+      GList      *link;
+      guint       min_age;
+
+      g_mutex_lock (&shard->mutex);
+      min_age = (100 - cache_wash_percentage) * g_queue_get_length (&shard->queue) / 100;
+
+      while (n_tiles < max_tiles &&
+             (link = g_queue_peek_tail_link (&shard->dirty_queue)))
+        {
+          CacheItem *item = DIRTY_LINK_GET_ITEM (link);
+
+          if (gegl_tile_is_stored (item->tile))
+            {
+              g_queue_unlink (&shard->dirty_queue, link);
+              item->dirty_queued = FALSE;
+              continue;
+            }
 
-      count++;
-      if (!gegl_tile_is_stored (tile))
-        if (count > length - wash_tiles)
-          last_dirty = tile;
+          /* the access clock approximates the LRU position */
+          if (shard->clock - item->stamp < min_age)
+            break;
+
+          g_queue_unlink (&shard->dirty_queue, link);
+          item->dirty_queued = FALSE;
+          tiles[n_tiles++] = gegl_tile_ref (item->tile);
+        }
+      g_mutex_unlock (&shard->mutex);
     }
 
-  if (last_dirty != NULL)
+  qsort (tiles, n_tiles, sizeof (GeglTile *), cache_wash_compare);
+
+  for (i = 0; i < n_tiles; i++)
     {
-      gegl_tile_store (last_dirty);
-      return TRUE;
+      gegl_tile_store (tiles[i]);
+      gegl_tile_unref (tiles[i]);
     }
-  return FALSE;
+
+  g_free (tiles);
+
+  return n_tiles;
 }
 
-static inline CacheItem *
-cache_lookup (GeglTileHandlerCache *cache,
-              gint                  x,
-              gint                  y,
-              gint                  z)
+/* queues the item's tile for washing if it is not queued already, must be
+ * called with the shard mutex held.
+ */
+static inline void
+cache_shard_queue_dirty (CacheShard *shard,
+                         CacheItem  *item)
 {
-  CacheItem key;
+  if (!item->dirty_queued)
+    {
+      g_queue_push_head_link (&shard->dirty_queue, &item->dirty_link);
+      item->dirty_queued = TRUE;
+    }
+}
 
-  key.x       = x;
-  key.y       = y;
-  key.z       = z;
+void
+gegl_tile_handler_cache_mark_dirty (GeglTileHandlerCache *cache,
+                                    GeglTile             *tile)
+{
+  CacheShard *shard;
+  CacheItem   key;
+  CacheItem  *item;
+
+  if (g_atomic_int_get (&cache->count) == 0)
+    return;
+
+  key.x       = tile->x;
+  key.y       = tile->y;
+  key.z       = tile->z;
   key.handler = cache;
 
-  return g_hash_table_lookup (cache_ht, &key);
+  shard = cache_get_shard (&key);
+
+  g_mutex_lock (&shard->mutex);
+  item = g_hash_table_lookup (shard->ht, &key);
+  if (item && item->tile == tile)
+    cache_shard_queue_dirty (shard, item);
+  g_mutex_unlock (&shard->mutex);
 }
 
 /* returns the requested Tile if it is in the cache, NULL otherwize.
@@ -331,28 +546,45 @@ gegl_tile_handler_cache_get_tile (GeglTileHandlerCache *cache,
                                   gint                  y,
                                   gint                  z)
 {
-  CacheItem *result;
+  CacheShard *shard;
+  CacheItem   key;
+  CacheItem  *result;
+  GeglTile   *tile = NULL;
 
-  if (cache->count == 0)
+  if (g_atomic_int_get (&cache->count) == 0)
     return NULL;
 
-  g_mutex_lock (&mutex);
-  result = cache_lookup (cache, x, y, z);
+  key.x       = x;
+  key.y       = y;
+  key.z       = z;
+  key.handler = cache;
+
+  shard = cache_get_shard (&key);
+
+  g_mutex_lock (&shard->mutex);
+  result = g_hash_table_lookup (shard->ht, &key);
   if (result)
     {
-      g_queue_unlink (cache_queue, &result->link);
-      g_queue_push_head_link (cache_queue, &result->link);
-      g_mutex_unlock (&mutex);
-      while (result->tile == NULL)
-      {
-        g_printerr ("NULL tile in %s %p %i %i %i %p\n", __FUNCTION__, result, result->x, result->y, result->z,
-                result->tile);
-        return NULL;
-      }
-      return gegl_tile_ref (result->tile);
+      g_queue_unlink (&shard->queue, &result->link);
+      g_queue_push_head_link (&shard->queue, &result->link);
+      if (result->dirty_queued)
+        {
+          g_queue_unlink (&shard->dirty_queue, &result->dirty_link);
+          g_queue_push_head_link (&shard->dirty_queue, &result->dirty_link);
+        }
+      result->stamp = ++shard->clock;
+      if (result->tile == NULL)
+        {
+          g_printerr ("NULL tile in %s %p %i %i %i %p\n", __FUNCTION__, result, result->x, result->y, result->z,
+                  result->tile);
+        }
+      else
+        {
+          tile = gegl_tile_ref (result->tile);
+        }
     }
-  g_mutex_unlock (&mutex);
-  return NULL;
+  g_mutex_unlock (&shard->mutex);
+  return tile;
 }
 
 static gboolean
@@ -372,32 +604,56 @@ gegl_tile_handler_cache_has_tile (GeglTileHandlerCache *cache,
   return FALSE;
 }
 
+/* evicts the least recently used tile of the next non-empty shard under the
+ * clock hand.
+ */
 static gboolean
-gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
+gegl_tile_handler_cache_trim (void)
 {
-  GList *link;
+  gint start = g_atomic_int_add (&cache_clock_hand, 1);
+  gint i;
 
-  link = g_queue_pop_tail_link (cache_queue);
-
-  if (link != NULL)
+  for (i = 0; i < CACHE_SHARDS; i++)
     {
-      CacheItem *last_writable = LINK_GET_ITEM (link);
-      GeglTile *tile = last_writable->tile;
-      GeglTileStorage *storage = tile->tile_storage;
+      CacheShard      *shard = &cache_shards[(start + i) & (CACHE_SHARDS - 1)];
+      CacheItem       *last_writable = NULL;
+      GList           *link;
 
-      last_writable->handler->items = g_slist_remove (last_writable->handler->items, last_writable);
-      g_hash_table_remove (cache_ht, last_writable);
-      cache_total -= tile->size;
+      g_mutex_lock (&shard->mutex);
+      link = g_queue_peek_tail_link (&shard->queue);
+      if (link != NULL)
+        {
+          last_writable = LINK_GET_ITEM (link);
+          cache_shard_unlink (shard, last_writable);
+        }
+      g_mutex_unlock (&shard->mutex);
 
-      if (storage && storage->hot_tile == tile)
+      if (last_writable != NULL)
         {
-          storage->hot_tile = NULL;
+          GeglTile        *tile    = last_writable->tile;
+          GeglTileStorage *storage = tile->tile_storage;
+
+          /* the hot tile is only touched under the storage lock; when the
+           * storage is busy, the hot tile keeps its own reference and is
+           * dropped by its owner
+           */
+          if (storage && g_rec_mutex_trylock (&storage->mutex))
+            {
+              if (storage->hot_tile == tile)
+                {
+                  storage->hot_tile = NULL;
+                  gegl_tile_unref (tile);
+                }
+              g_rec_mutex_unlock (&storage->mutex);
+            }
+
+          /* the tile is released outside the shard lock, since it might have
+           * to be written back through its storage
+           */
           gegl_tile_unref (tile);
+          g_slice_free (CacheItem, last_writable);
+          return TRUE;
         }
-
-      gegl_tile_unref (tile);
-      g_slice_free (CacheItem, last_writable);
-      return TRUE;
     }
 
   return FALSE;
@@ -409,24 +665,16 @@ gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cache,
                                     gint                  y,
                                     gint                  z)
 {
-  CacheItem *item;
+  CacheItem *item = cache_remove (cache, x, y, z);
 
-  g_mutex_lock (&mutex);
-  item = cache_lookup (cache, x, y, z);
   if (item)
     {
-      cache_total -= item->tile->size;
       item->tile->tile_storage = NULL;
       gegl_tile_mark_as_stored (item->tile); /* to cheat it out of being stored */
       gegl_tile_unref (item->tile);
 
-      g_queue_unlink (cache_queue, &item->link);
-      cache->items = g_slist_remove (cache->items, item);
-
-      g_hash_table_remove (cache_ht, item);
       g_slice_free (CacheItem, item);
     }
-  g_mutex_unlock (&mutex);
 }
 
 
@@ -436,27 +684,15 @@ gegl_tile_handler_cache_void (GeglTileHandlerCache *cache,
                               gint                  y,
                               gint                  z)
 {
-  CacheItem *item;
-
-  g_mutex_lock (&mutex);
-  item = cache_lookup (cache, x, y, z);
-  if (item)
-    {
-      cache_total -= item->tile->size;
-      g_queue_unlink (cache_queue, &item->link);
-      cache->items = g_slist_remove (cache->items, item);
-      g_hash_table_remove (cache_ht, item);
-      cache->count--;
-    }
-  g_mutex_unlock (&mutex);
+  CacheItem *item = cache_remove (cache, x, y, z);
 
   if (item)
     {
       gegl_tile_void (item->tile);
       gegl_tile_unref (item->tile);
-    }
 
-  g_slice_free (CacheItem, item);
+      g_slice_free (CacheItem, item);
+    }
 }
 
 void
@@ -466,13 +702,21 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
                                 gint                  y,
                                 gint                  z)
 {
-  CacheItem *item = g_slice_new (CacheItem);
+  CacheItem  *item = g_slice_new (CacheItem);
+  CacheShard *shard;
 
   item->handler   = cache;
   item->tile      = gegl_tile_ref (tile);
   item->link.data = item;
   item->link.next = NULL;
   item->link.prev = NULL;
+  item->handler_link.data = item;
+  item->handler_link.next = NULL;
+  item->handler_link.prev = NULL;
+  item->dirty_link.data   = item;
+  item->dirty_link.next   = NULL;
+  item->dirty_link.prev   = NULL;
+  item->dirty_queued      = FALSE;
   item->x         = x;
   item->y         = y;
   item->z         = z;
@@ -487,24 +731,32 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
 
   /* XXX: this is a window when the tile is a zero tile during update */
 
-  g_mutex_lock (&mutex);
-  cache_total  += item->tile->size;
-  g_queue_push_head_link (cache_queue, &item->link);
+  shard = cache_get_shard (item);
 
-  cache->count ++;
+  g_mutex_lock (&shard->mutex);
+  g_queue_push_head_link (&shard->queue, &item->link);
+  g_hash_table_insert (shard->ht, item, item);
+  item->stamp = ++shard->clock;
+  if (!gegl_tile_is_stored (tile))
+    cache_shard_queue_dirty (shard, item);
 
-  cache->items = g_slist_prepend (cache->items, item);
-  g_hash_table_insert (cache_ht, item, item);
+  g_mutex_lock (&cache->mutex);
+  g_queue_push_head_link (&cache->items, &item->handler_link);
+  g_mutex_unlock (&cache->mutex);
 
-  while (cache_total > gegl_config()->tile_cache_size)
+  g_atomic_int_inc (&cache->count);
+  g_atomic_pointer_add (&cache_total, item->tile->size);
+  g_mutex_unlock (&shard->mutex);
+
+  while ((gsize) g_atomic_pointer_get (&cache_total) > gegl_config()->tile_cache_size)
     {
 #ifdef GEGL_DEBUG_CACHE_HITS
-      GEGL_NOTE(GEGL_DEBUG_CACHE, "cache_total:"G_GUINT64_FORMAT" > cache_size:"G_GUINT64_FORMAT, cache_total, gegl_config()->tile_cache_size);
-      GEGL_NOTE(GEGL_DEBUG_CACHE, "%f%% hit:%i miss:%i  %i]", cache_hits*100.0/(cache_hits+cache_misses), cache_hits, cache_misses, g_queue_get_length (cache_queue));
+      GEGL_NOTE(GEGL_DEBUG_CACHE, "cache_total:%"G_GSIZE_FORMAT" > cache_size:%"G_GUINT64_FORMAT, (gsize) g_atomic_pointer_get (&cache_total), gegl_config()->tile_cache_size);
+      GEGL_NOTE(GEGL_DEBUG_CACHE, "%f%% hit:%i miss:%i]", cache_hits*100.0/(cache_hits+cache_misses), cache_hits, cache_misses);
 #endif
-      gegl_tile_handler_cache_trim (cache);
+      if (!gegl_tile_handler_cache_trim ())
+        break;
     }
-  g_mutex_unlock (&mutex);
 }
 
 GeglTileHandler *
@@ -558,22 +810,44 @@ gegl_tile_handler_cache_equalfunc (gconstpointer a,
 void
 gegl_tile_cache_init (void)
 {
-  if (cache_queue == NULL)
-    cache_queue = g_queue_new ();
-  if (cache_ht == NULL)
-    cache_ht = g_hash_table_new (gegl_tile_handler_cache_hashfunc, gegl_tile_handler_cache_equalfunc);
+  static GMutex init_mutex = { 0, };
+  gint          i;
+
+  if (cache_initialized)
+    return;
+
+  g_mutex_lock (&init_mutex);
+  if (!cache_initialized)
+    {
+      for (i = 0; i < CACHE_SHARDS; i++)
+        {
+          g_mutex_init (&cache_shards[i].mutex);
+          g_queue_init (&cache_shards[i].queue);
+          g_queue_init (&cache_shards[i].dirty_queue);
+          cache_shards[i].clock = 0;
+          cache_shards[i].ht = g_hash_table_new (gegl_tile_handler_cache_hashfunc,
+                                                 gegl_tile_handler_cache_equalfunc);
+        }
+      cache_initialized = TRUE;
+    }
+  g_mutex_unlock (&init_mutex);
 }
 
 void
 gegl_tile_cache_destroy (void)
 {
-  if (cache_queue)
+  gint i;
+
+  if (!cache_initialized)
+    return;
+
+  for (i = 0; i < CACHE_SHARDS; i++)
     {
-      while (g_queue_pop_head_link (cache_queue));
-      g_queue_free (cache_queue);
+      while (g_queue_pop_head_link (&cache_shards[i].queue));
+      while (g_queue_pop_head_link (&cache_shards[i].dirty_queue));
+      g_hash_table_destroy (cache_shards[i].ht);
+      cache_shards[i].ht = NULL;
+      g_mutex_clear (&cache_shards[i].mutex);
     }
-  if (cache_ht)
-    g_hash_table_destroy (cache_ht);
-  cache_queue = NULL;
-  cache_ht = NULL;
+  cache_initialized = FALSE;
 }
@@ -40,8 +40,9 @@ struct _GeglTileHandlerCache
 {
   GeglTileHandler  parent_instance;
   GeglTileStorage *tile_storage;
-  GSList          *items;
-  int              count; /* number of items held by cache */
+  GMutex           mutex; /* protects items */
+  GQueue           items; /* the items held by this cache, in the cache shards */
+  gint             count; /* number of items held by cache */
 };
 
 struct _GeglTileHandlerCacheClass
@@ -58,4 +59,15 @@ void              gegl_tile_handler_cache_insert   (GeglTileHandlerCache *cache,
                                                     gint                  y,
                                                     gint                  z);
 
+/* called when a cached tile goes from being stored to being dirty, queues
+ * it for washing.
+ */
+void              gegl_tile_handler_cache_mark_dirty (GeglTileHandlerCache *cache,
+                                                      GeglTile             *tile);
+
+/* writes up to max_tiles of the least recently used dirty tiles in the
+ * cache to their storage, returns the number of tiles written.
+ */
+gint              gegl_tile_handler_cache_wash     (gint                  max_tiles);
+
 #endif
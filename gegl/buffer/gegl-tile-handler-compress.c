@@ -0,0 +1,527 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <babl/babl.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include "gegl-types.h"
+#include "gegl-buffer-types.h"
+#include "gegl-buffer-private.h"
+#include "gegl-tile-handler.h"
+#include "gegl-tile-handler-cache.h"
+#include "gegl-tile-handler-private.h"
+#include "gegl-tile-handler-compress.h"
+#include "gegl-tile-backend.h"
+#include "gegl-tile-storage.h"
+#include "gegl-tile-alloc.h"
+#include "gegl-config.h"
+#include "gegl-debug.h"
+
+
+G_DEFINE_TYPE (GeglTileHandlerCompress, gegl_tile_handler_compress,
+               GEGL_TYPE_TILE_HANDLER)
+
+/* tiles that don't shrink to at least this fraction of their size are
+ * passed on to the backend instead
+ */
+#define MAX_COMPRESSED_RATIO 0.75
+
+/* compressed data is immutable and reference counted, so that it can be
+ * decompressed outside the lock while the entry gets replaced or evicted
+ */
+typedef struct
+{
+  gint   ref_count;
+  gint   size;
+  guchar data[];
+} CompressBlob;
+
+typedef struct
+{
+  GeglTileHandlerCompress *compress;
+  CompressBlob            *blob;
+  GList                    link;
+  gint                     x;
+  gint                     y;
+  gint                     z;
+} CompressEntry;
+
+#define LINK_GET_ENTRY(l) \
+        ((CompressEntry *) ((guchar *) l - G_STRUCT_OFFSET (CompressEntry, link)))
+
+/* all compressing handlers share a single budget, the entries of all of
+ * them are kept in one queue with the most recently used ones at the head
+ */
+static GMutex  mutex;
+static GQueue  queue = G_QUEUE_INIT;
+static guint64 total = 0;
+
+static GeglTileHandlerCompressStats stats;
+
+
+static CompressBlob *
+blob_ref (CompressBlob *blob)
+{
+  g_atomic_int_inc (&blob->ref_count);
+
+  return blob;
+}
+
+static void
+blob_unref (CompressBlob *blob)
+{
+  if (g_atomic_int_dec_and_test (&blob->ref_count))
+    g_free (blob);
+}
+
+static guint
+entry_hash (gconstpointer key)
+{
+  const CompressEntry *entry = key;
+
+  return (entry->x * 73856093) ^ (entry->y * 19349663) ^ (entry->z * 83492791);
+}
+
+static gboolean
+entry_equal (gconstpointer a,
+             gconstpointer b)
+{
+  const CompressEntry *ea = a;
+  const CompressEntry *eb = b;
+
+  return ea->x == eb->x && ea->y == eb->y && ea->z == eb->z;
+}
+
+static CompressEntry *
+lookup_entry (GeglTileHandlerCompress *compress,
+              gint                     x,
+              gint                     y,
+              gint                     z)
+{
+  CompressEntry key;
+
+  key.x = x;
+  key.y = y;
+  key.z = z;
+
+  return g_hash_table_lookup (compress->entries, &key);
+}
+
+/* takes an entry out of the cache, called with the mutex held */
+static void
+entry_unlink (CompressEntry *entry)
+{
+  gint tile_size = gegl_tile_backend_get_tile_size (entry->compress->backend);
+
+  g_hash_table_remove (entry->compress->entries, entry);
+  g_queue_unlink (&queue, &entry->link);
+
+  total          -= entry->blob->size;
+  stats.size     -= entry->blob->size;
+  stats.raw_size -= tile_size;
+}
+
+static void
+entry_free (CompressEntry *entry)
+{
+  blob_unref (entry->blob);
+  g_slice_free (CompressEntry, entry);
+}
+
+/* called with the mutex held */
+static void
+entry_remove (CompressEntry *entry)
+{
+  entry_unlink (entry);
+  entry_free (entry);
+}
+
+/* writes an entry taken out of the cache to the backend of its handler and
+ * frees it, called without the mutex, but with the mutex of the entry's
+ * storage held
+ */
+static void
+entry_spill (CompressEntry *entry)
+{
+  GeglTileHandlerCompress *compress  = entry->compress;
+  gint                     tile_size = gegl_tile_backend_get_tile_size (compress->backend);
+  const Babl              *format    = gegl_tile_backend_get_format (compress->backend);
+  GeglTile                *tile;
+
+  tile = gegl_tile_new (tile_size);
+
+  if (gegl_compression_decompress (compress->compression, format,
+                                   gegl_tile_get_data (tile),
+                                   tile_size / babl_format_get_bytes_per_pixel (format),
+                                   entry->blob->data, entry->blob->size))
+    {
+      gegl_tile_handler_source_command (compress, GEGL_TILE_SET,
+                                        entry->x, entry->y, entry->z, tile);
+    }
+  else
+    {
+      g_warning ("failed to decompress tile %i, %i, %i", entry->x, entry->y, entry->z);
+    }
+
+  gegl_tile_unref (tile);
+
+  entry_free (entry);
+}
+
+/* takes the least recently used entries out of the cache until we are
+ * within budget, called with the mutex held. Entries of other storages are
+ * only taken if their storage mutex can be locked without waiting, since
+ * the thread owning it might be waiting for us; it stays locked, so that
+ * the tile can't be read from the backend before it is spilled there.
+ * The entries are put in victims, to be spilled with spill () once the
+ * mutex is released
+ */
+static void
+trim (GQueue *victims)
+{
+  guint64  budget = gegl_config ()->compressed_cache_size;
+  GList   *link   = g_queue_peek_tail_link (&queue);
+
+  while (total > budget && link)
+    {
+      CompressEntry   *entry   = LINK_GET_ENTRY (link);
+      GeglTileStorage *storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) entry->compress);
+      GList           *prev    = link->prev;
+
+      if (! storage || g_rec_mutex_trylock (&storage->mutex))
+        {
+          entry_unlink (entry);
+          g_queue_push_tail_link (victims, &entry->link);
+
+          stats.spilled++;
+        }
+
+      link = prev;
+    }
+}
+
+/* spills the entries taken by trim (), called without the mutex */
+static void
+spill (GQueue *victims)
+{
+  GList *link;
+
+  while ((link = g_queue_pop_head_link (victims)))
+    {
+      CompressEntry   *entry   = LINK_GET_ENTRY (link);
+      GeglTileStorage *storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) entry->compress);
+
+      entry_spill (entry);
+
+      if (storage)
+        g_rec_mutex_unlock (&storage->mutex);
+    }
+}
+
+static gpointer
+set_tile (GeglTileHandlerCompress *compress,
+          GeglTile                *tile,
+          gint                     x,
+          gint                     y,
+          gint                     z)
+{
+  gint           tile_size = gegl_tile_backend_get_tile_size (compress->backend);
+  const Babl    *format    = gegl_tile_backend_get_format (compress->backend);
+  gint           max_size  = tile_size * MAX_COMPRESSED_RATIO;
+  guchar        *scratch   = gegl_tile_alloc (tile_size);
+  CompressBlob  *blob      = NULL;
+  GQueue         victims   = G_QUEUE_INIT;
+  CompressEntry *entry;
+  gint           size;
+
+  if (gegl_compression_compress (compress->compression, format,
+                                 gegl_tile_get_data (tile),
+                                 tile_size / babl_format_get_bytes_per_pixel (format),
+                                 scratch, &size, max_size))
+    {
+      blob            = g_malloc (sizeof (CompressBlob) + size);
+      blob->ref_count = 1;
+      blob->size      = size;
+      memcpy (blob->data, scratch, size);
+    }
+
+  gegl_tile_free (scratch);
+
+  g_mutex_lock (&mutex);
+
+  entry = lookup_entry (compress, x, y, z);
+
+  if (! blob)
+    {
+      /* the tile doesn't compress, any older compressed version must go as
+       * it would otherwise shadow what we store in the backend
+       */
+      if (entry)
+        entry_remove (entry);
+
+      stats.rejected++;
+
+      g_mutex_unlock (&mutex);
+
+      return gegl_tile_handler_source_command (compress, GEGL_TILE_SET,
+                                               x, y, z, tile);
+    }
+
+  if (entry)
+    {
+      total      -= entry->blob->size;
+      stats.size -= entry->blob->size;
+
+      blob_unref (entry->blob);
+      g_queue_unlink (&queue, &entry->link);
+    }
+  else
+    {
+      entry           = g_slice_new0 (CompressEntry);
+      entry->compress = compress;
+      entry->x        = x;
+      entry->y        = y;
+      entry->z        = z;
+
+      g_hash_table_insert (compress->entries, entry, entry);
+
+      stats.raw_size += tile_size;
+    }
+
+  entry->blob = blob;
+  g_queue_push_head_link (&queue, &entry->link);
+
+  total      += size;
+  stats.size += size;
+  stats.stored++;
+
+  trim (&victims);
+
+  g_mutex_unlock (&mutex);
+
+  spill (&victims);
+
+  gegl_tile_mark_as_stored (tile);
+
+  return NULL;
+}
+
+static GeglTile *
+get_tile (GeglTileHandlerCompress *compress,
+          gint                     x,
+          gint                     y,
+          gint                     z)
+{
+  gint           tile_size = gegl_tile_backend_get_tile_size (compress->backend);
+  const Babl    *format    = gegl_tile_backend_get_format (compress->backend);
+  CompressBlob  *blob      = NULL;
+  CompressEntry *entry;
+  GeglTile      *tile;
+
+  g_mutex_lock (&mutex);
+
+  entry = lookup_entry (compress, x, y, z);
+
+  if (entry)
+    {
+      blob = blob_ref (entry->blob);
+
+      g_queue_unlink (&queue, &entry->link);
+      g_queue_push_head_link (&queue, &entry->link);
+
+      stats.hits++;
+    }
+  else
+    {
+      stats.misses++;
+    }
+
+  g_mutex_unlock (&mutex);
+
+  if (! blob)
+    return gegl_tile_handler_source_command (compress, GEGL_TILE_GET,
+                                             x, y, z, NULL);
+
+  tile = gegl_tile_new (tile_size);
+
+  if (! gegl_compression_decompress (compress->compression, format,
+                                     gegl_tile_get_data (tile),
+                                     tile_size / babl_format_get_bytes_per_pixel (format),
+                                     blob->data, blob->size))
+    {
+      g_warning ("failed to decompress tile %i, %i, %i", x, y, z);
+    }
+
+  blob_unref (blob);
+
+  return tile;
+}
+
+static void
+void_tile (GeglTileHandlerCompress *compress,
+           gint                     x,
+           gint                     y,
+           gint                     z)
+{
+  CompressEntry *entry;
+
+  g_mutex_lock (&mutex);
+
+  entry = lookup_entry (compress, x, y, z);
+  if (entry)
+    entry_remove (entry);
+
+  g_mutex_unlock (&mutex);
+}
+
+static void
+drop_all (GeglTileHandlerCompress *compress)
+{
+  GList *entries;
+  GList *iter;
+
+  g_mutex_lock (&mutex);
+
+  entries = g_hash_table_get_keys (compress->entries);
+
+  for (iter = entries; iter; iter = iter->next)
+    entry_remove (iter->data);
+
+  g_list_free (entries);
+
+  g_mutex_unlock (&mutex);
+}
+
+static gpointer
+gegl_tile_handler_compress_command (GeglTileSource  *tile_store,
+                                    GeglTileCommand  command,
+                                    gint             x,
+                                    gint             y,
+                                    gint             z,
+                                    gpointer         data)
+{
+  GeglTileHandlerCompress *compress = (GeglTileHandlerCompress *) tile_store;
+
+  switch (command)
+    {
+      case GEGL_TILE_GET:
+        return get_tile (compress, x, y, z);
+      case GEGL_TILE_SET:
+        return set_tile (compress, data, x, y, z);
+      case GEGL_TILE_EXIST:
+      case GEGL_TILE_IS_CACHED:
+      case GEGL_TILE_PREFETCH:
+        {
+          gboolean exist;
+
+          g_mutex_lock (&mutex);
+          exist = lookup_entry (compress, x, y, z) != NULL;
+          g_mutex_unlock (&mutex);
+
+          /* tiles held compressed are not read from the backend */
+          if (exist)
+            return command != GEGL_TILE_PREFETCH ? (gpointer) TRUE : NULL;
+        }
+        break;
+      case GEGL_TILE_VOID:
+        void_tile (compress, x, y, z);
+        break;
+      case GEGL_TILE_REINIT:
+        drop_all (compress);
+        break;
+      default:
+        break;
+    }
+
+  return gegl_tile_handler_source_command (compress, command, x, y, z, data);
+}
+
+static void
+gegl_tile_handler_compress_finalize (GObject *object)
+{
+  GeglTileHandlerCompress *compress = GEGL_TILE_HANDLER_COMPRESS (object);
+
+  /* the buffer is going away, there is no need to spill anything */
+  drop_all (compress);
+
+  g_hash_table_unref (compress->entries);
+
+  G_OBJECT_CLASS (gegl_tile_handler_compress_parent_class)->finalize (object);
+}
+
+static void
+gegl_tile_handler_compress_class_init (GeglTileHandlerCompressClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gegl_tile_handler_compress_finalize;
+}
+
+static void
+gegl_tile_handler_compress_init (GeglTileHandlerCompress *self)
+{
+  ((GeglTileSource *) self)->command = gegl_tile_handler_compress_command;
+
+  self->entries = g_hash_table_new (entry_hash, entry_equal);
+}
+
+GeglTileHandler *
+gegl_tile_handler_compress_new (GeglTileBackend *backend)
+{
+  GeglTileHandlerCompress *compress;
+  const gchar             *name;
+
+  compress = g_object_new (GEGL_TYPE_TILE_HANDLER_COMPRESS, NULL);
+
+  name = gegl_compression_for_format (gegl_tile_backend_get_format (backend));
+
+  compress->backend     = backend;
+  compress->compression = gegl_compression (name);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "compressing evicted tiles with %s", name);
+
+  return (void*)compress;
+}
+
+void
+gegl_tile_handler_compress_get_stats (GeglTileHandlerCompressStats *stats_out)
+{
+  g_return_if_fail (stats_out != NULL);
+
+  g_mutex_lock (&mutex);
+  *stats_out = stats;
+  g_mutex_unlock (&mutex);
+}
+
+void
+gegl_tile_handler_compress_stats (void)
+{
+  GeglTileHandlerCompressStats s;
+
+  gegl_tile_handler_compress_get_stats (&s);
+
+  g_warning ("Compressed cache statistics: hits:%" G_GUINT64_FORMAT
+             " misses:%" G_GUINT64_FORMAT " stored:%" G_GUINT64_FORMAT
+             " rejected:%" G_GUINT64_FORMAT " spilled:%" G_GUINT64_FORMAT
+             " size:%" G_GUINT64_FORMAT " ratio:%.2f",
+             s.hits, s.misses, s.stored, s.rejected, s.spilled, s.size,
+             s.size ? (gdouble) s.raw_size / s.size : 0.0);
+}
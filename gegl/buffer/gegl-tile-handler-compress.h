@@ -0,0 +1,77 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_HANDLER_COMPRESS_H__
+#define __GEGL_TILE_HANDLER_COMPRESS_H__
+
+#include "gegl-tile-handler.h"
+#include "gegl-compression.h"
+
+/***
+ * GeglTileHandlerCompress is a GeglTileHandler that sits between the cache
+ * and a disk backed backend, and keeps tiles evicted from the cache
+ * compressed in memory. Tiles only spill to the backend when the shared
+ * compressed-cache-size budget is exhausted, or when they don't compress.
+ */
+
+G_BEGIN_DECLS
+
+#define GEGL_TYPE_TILE_HANDLER_COMPRESS            (gegl_tile_handler_compress_get_type ())
+#define GEGL_TILE_HANDLER_COMPRESS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEGL_TYPE_TILE_HANDLER_COMPRESS, GeglTileHandlerCompress))
+#define GEGL_TILE_HANDLER_COMPRESS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GEGL_TYPE_TILE_HANDLER_COMPRESS, GeglTileHandlerCompressClass))
+#define GEGL_IS_TILE_HANDLER_COMPRESS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GEGL_TYPE_TILE_HANDLER_COMPRESS))
+#define GEGL_IS_TILE_HANDLER_COMPRESS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GEGL_TYPE_TILE_HANDLER_COMPRESS))
+#define GEGL_TILE_HANDLER_COMPRESS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GEGL_TYPE_TILE_HANDLER_COMPRESS, GeglTileHandlerCompressClass))
+
+
+typedef struct _GeglTileHandlerCompress      GeglTileHandlerCompress;
+typedef struct _GeglTileHandlerCompressClass GeglTileHandlerCompressClass;
+
+struct _GeglTileHandlerCompress
+{
+  GeglTileHandler        parent_instance;
+  GeglTileBackend       *backend;
+  const GeglCompression *compression;
+  GHashTable            *entries;
+};
+
+struct _GeglTileHandlerCompressClass
+{
+  GeglTileHandlerClass parent_class;
+};
+
+typedef struct
+{
+  guint64 hits;
+  guint64 misses;
+  guint64 stored;      /* tiles compressed into the tier */
+  guint64 rejected;    /* tiles that didn't compress well enough */
+  guint64 spilled;     /* tiles written to the backend to stay in budget */
+  guint64 size;        /* compressed bytes held */
+  guint64 raw_size;    /* uncompressed size of the tiles held */
+} GeglTileHandlerCompressStats;
+
+GType             gegl_tile_handler_compress_get_type  (void) G_GNUC_CONST;
+
+GeglTileHandler * gegl_tile_handler_compress_new       (GeglTileBackend *backend);
+
+void              gegl_tile_handler_compress_get_stats (GeglTileHandlerCompressStats *stats);
+
+void              gegl_tile_handler_compress_stats     (void);
+
+G_END_DECLS
+
+#endif
@@ -57,6 +57,7 @@ _new_empty_tile (const gint tile_size)
 
       memset (gegl_tile_get_data (tile), 0x00, tile_size);
       tile->is_zero_tile = 1;
+      tile->is_uniform   = 1;
     }
   else
     {
@@ -70,6 +71,7 @@ _new_empty_tile (const gint tile_size)
           allocated_tile->destroy_notify = NULL;
           allocated_tile->size           = common_empty_size;
           allocated_tile->is_zero_tile   = 1;
+          allocated_tile->is_uniform     = 1;
 
           g_once_init_leave (&common_tile, allocated_tile);
         }
@@ -33,11 +33,48 @@
 #include "gegl-tile-backend.h"
 #include "gegl-tile-storage.h"
 #include "gegl-algorithms.h"
+#include "gegl-utils.h"
+#include "gegl-config.h"
+#include "gegl-scheduler.h"
 
 
 G_DEFINE_TYPE (GeglTileHandlerZoom, gegl_tile_handler_zoom,
                GEGL_TYPE_TILE_HANDLER)
 
+typedef struct
+{
+  GeglTileHandlerZoom *zoom;
+  gint                 z;
+  gint                 stamp;   /* the stamp of the zoom handler when the
+                                 * level was started
+                                 */
+} BuildLevel;
+
+typedef struct
+{
+  BuildLevel *level;
+  gint        x;
+  gint        y;
+} BuildTile;
+
+typedef struct
+{
+  GeglTileHandlerZoom *zoom;
+  gint                 x;
+  gint                 y;
+  gint                 z;
+  gint                 stamp;
+  gint64               key;
+} PrefetchTile;
+
+/* the tiles of a level, those computed ahead of their request and the
+ * rebuilds of damaged tiles are computed by the threads of the scheduler.
+ * prefetches and rebuilds are not waited for, their groups are only there
+ * to count them
+ */
+static GeglTaskGroup prefetch_group;
+static GeglTaskGroup rebuild_group;
+
 static inline void set_blank (GeglTile   *dst_tile,
                               gint        width,
                               gint        height,
@@ -60,6 +97,27 @@ static inline void set_blank (GeglTile   *dst_tile,
     }
 }
 
+static inline void set_uniform (GeglTile     *dst_tile,
+                                gint          width,
+                                gint          height,
+                                gint          bpp,
+                                const guchar *pixel,
+                                gint          i,
+                                gint          j)
+{
+  guchar *dst_data  = gegl_tile_get_data (dst_tile);
+  gint    rowstride = width * bpp;
+  gint    scanline;
+
+  guchar *dst = dst_data + j * height / 2 * rowstride + i * rowstride / 2;
+
+  for (scanline = 0; scanline < height / 2; scanline++)
+    {
+      gegl_memset_pattern (dst, pixel, bpp, width / 2);
+      dst += rowstride;
+    }
+}
+
 static inline void set_half (GeglTile   * dst_tile,
                              GeglTile   * src_tile,
                              gint         width,
@@ -78,59 +136,113 @@ static inline void set_half (GeglTile   * dst_tile,
   gegl_downscale_2x2 (format, width, height, src_data, width * bpp, dst_data, width * bpp);
 }
 
-static GeglTile *
-get_tile (GeglTileSource *gegl_tile_source,
-          gint            x,
-          gint            y,
-          gint            z)
+static void
+get_source_tiles (GeglTileHandlerZoom *zoom,
+                  GeglTile            *source_tile[2][2],
+                  gint                 x,
+                  gint                 y,
+                  gint                 z)
 {
-  GeglTileSource      *source = ((GeglTileHandler *) gegl_tile_source)->source;
-  GeglTileHandlerZoom *zoom   = (GeglTileHandlerZoom *) gegl_tile_source;
-  GeglTile            *tile   = NULL;
-  GeglTileStorage     *tile_storage;
-  gint                 tile_width;
-  gint                 tile_height;
+  gint i, j;
 
-  if (source)
-    tile = gegl_tile_source_get_tile (source, x, y, z);
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 2; j++)
+      {
+        /* we get the tile from ourselves, to make successive rescales work
+         * correctly */
+        source_tile[i][j] = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (zoom),
+                                                       x * 2 + i, y * 2 + j, z - 1);
+      }
+}
 
-  if (tile || (z == 0))
-    return tile;
+/* computes the tile x, y, z from the four tiles below it, which it
+ * unreferences. the tile is not inserted in the cache, so this needs no
+ * lock on the tile storage.
+ */
+static GeglTile *
+downscale_tile (GeglTileHandlerZoom *zoom,
+                GeglTile            *source_tile[2][2],
+                gint                 x,
+                gint                 y,
+                gint                 z)
+{
+  GeglTileStorage *tile_storage;
+  GeglTile        *tile;
+  gint             tile_width;
+  gint             tile_height;
+
+  if (source_tile[0][0] == NULL &&
+      source_tile[0][1] == NULL &&
+      source_tile[1][0] == NULL &&
+      source_tile[1][1] == NULL)
+    {
+      return NULL;   /* no data from level below, return NULL and let GeglTileHandlerEmpty
+                        fill in the shared empty tile */
+    }
 
   tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
 
-  if (z > tile_storage->seen_zoom)
-    tile_storage->seen_zoom = z;
-
   tile_width = tile_storage->tile_width;
   tile_height = tile_storage->tile_height;
 
   {
-    gint        i, j;
-    const Babl *format = gegl_tile_backend_get_format (zoom->backend);
-    GeglTile   *source_tile[2][2] = { { NULL, NULL }, { NULL, NULL } };
-
+    gint          i, j;
+    const Babl   *format = gegl_tile_backend_get_format (zoom->backend);
+    const guchar *pixel[2][2];
+    guchar        zero[128] = { 0, };
+    gint          bpp;
+    gboolean      all_uniform = TRUE;
+
+    bpp = babl_format_get_bytes_per_pixel (format);
+
+    /* the pixel of each quarter that is filled with a single value, missing
+     * tiles count as uniformly zero
+     */
     for (i = 0; i < 2; i++)
       for (j = 0; j < 2; j++)
         {
-          /* we get the tile from ourselves, to make successive rescales work
-           * correctly */
-            source_tile[i][j] = gegl_tile_source_get_tile (gegl_tile_source,
-                                                          x * 2 + i, y * 2 + j, z - 1);
+          if (bpp > (gint) sizeof (zero))
+            pixel[i][j] = NULL;
+          else if (! source_tile[i][j])
+            pixel[i][j] = zero;
+          else if (gegl_tile_is_uniform (source_tile[i][j]))
+            pixel[i][j] = gegl_tile_get_data (source_tile[i][j]);
+          else
+            pixel[i][j] = NULL;
+
+          if (! pixel[i][j] || ! pixel[0][0] ||
+              memcmp (pixel[i][j], pixel[0][0], bpp))
+            all_uniform = FALSE;
         }
 
-    if (source_tile[0][0] == NULL &&
-        source_tile[0][1] == NULL &&
-        source_tile[1][0] == NULL &&
-        source_tile[1][1] == NULL)
+    /* the average of a single value is that value, share the data of a
+     * uniform tile instead of computing it
+     */
+    if (all_uniform)
       {
-        return NULL;   /* no data from level below, return NULL and let GeglTileHandlerEmpty
-                          fill in the shared empty tile */
-      }
+        GeglTile *uniform = gegl_tile_new_uniform (tile_storage->tile_size,
+                                                   bpp, pixel[0][0]);
+
+        uniform->tile_storage = tile_storage;
+        tile = gegl_tile_dup (uniform);
+        tile->x = x;
+        tile->y = y;
+        tile->z = z;
+        gegl_tile_unref (uniform);
+
+        for (i = 0; i < 2; i++)
+          for (j = 0; j < 2; j++)
+            if (source_tile[i][j])
+              gegl_tile_unref (source_tile[i][j]);
 
-    g_assert (tile == NULL);
+        return tile;
+      }
 
-    tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (zoom), x, y, z);
+    tile = gegl_tile_new (tile_storage->tile_size);
+    tile->tile_storage = tile_storage;
+    tile->x = x;
+    tile->y = y;
+    tile->z = z;
 
     gegl_tile_lock (tile);
 
@@ -139,7 +251,10 @@ get_tile (GeglTileSource *gegl_tile_source,
         {
           if (source_tile[i][j])
             {
-              set_half (tile, source_tile[i][j], tile_width, tile_height, format, i, j);
+              if (pixel[i][j])
+                set_uniform (tile, tile_width, tile_height, bpp, pixel[i][j], i, j);
+              else
+                set_half (tile, source_tile[i][j], tile_width, tile_height, format, i, j);
               gegl_tile_unref (source_tile[i][j]);
             }
           else
@@ -153,6 +268,421 @@ get_tile (GeglTileSource *gegl_tile_source,
   return tile;
 }
 
+static GeglTile *
+get_tile (GeglTileSource *gegl_tile_source,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileSource       *source = ((GeglTileHandler *) gegl_tile_source)->source;
+  GeglTileHandlerZoom  *zoom   = (GeglTileHandlerZoom *) gegl_tile_source;
+  GeglTile             *tile   = NULL;
+  GeglTile             *source_tile[2][2];
+  GeglTileStorage      *tile_storage;
+  GeglTileHandlerCache *cache;
+
+  if (source)
+    tile = gegl_tile_source_get_tile (source, x, y, z);
+
+  if (tile || (z == 0))
+    return tile;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  if (z > tile_storage->seen_zoom)
+    tile_storage->seen_zoom = z;
+
+  get_source_tiles (zoom, source_tile, x, y, z);
+
+  tile = downscale_tile (zoom, source_tile, x, y, z);
+
+  cache = _gegl_tile_handler_get_cache ((GeglTileHandler *) zoom);
+  if (tile && cache)
+    gegl_tile_handler_cache_insert (cache, tile, x, y, z);
+
+  return tile;
+}
+
+static void
+build_tile (gpointer data)
+{
+  BuildTile           *build = data;
+  BuildLevel          *level = build->level;
+  GeglTileHandlerZoom *zoom  = level->zoom;
+  GeglTileStorage     *tile_storage;
+  GeglTile            *source_tile[2][2];
+  GeglTile            *tile  = NULL;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  /* only fetching the tiles below, and inserting the result, needs the
+   * storage lock; the downscaling is done in parallel
+   */
+  g_rec_mutex_lock (&tile_storage->mutex);
+  if (! gegl_tile_source_exist (GEGL_TILE_SOURCE (zoom),
+                                build->x, build->y, level->z))
+    get_source_tiles (zoom, source_tile, build->x, build->y, level->z);
+  else
+    source_tile[0][0] = source_tile[0][1] =
+    source_tile[1][0] = source_tile[1][1] = NULL;
+  g_rec_mutex_unlock (&tile_storage->mutex);
+
+  tile = downscale_tile (zoom, source_tile, build->x, build->y, level->z);
+
+  if (tile)
+    {
+      GeglTileHandlerCache *cache;
+
+      cache = _gegl_tile_handler_get_cache ((GeglTileHandler *) zoom);
+
+      /* drop the tile if the base level changed while it was computed, it
+       * is then rebuilt from the damage, or on demand
+       */
+      g_rec_mutex_lock (&tile_storage->mutex);
+      if (cache && g_atomic_int_get (&zoom->stamp) == level->stamp)
+        {
+          gegl_tile_handler_cache_insert (cache, tile, build->x, build->y,
+                                          level->z);
+
+          /* the base level may have changed while inserting */
+          if (g_atomic_int_get (&zoom->stamp) != level->stamp)
+            gegl_tile_source_void (GEGL_TILE_SOURCE (zoom),
+                                   build->x, build->y, level->z);
+        }
+      g_rec_mutex_unlock (&tile_storage->mutex);
+
+      gegl_tile_unref (tile);
+    }
+}
+
+static gpointer
+init_groups (gpointer data)
+{
+  gegl_task_group_init (&prefetch_group);
+  gegl_task_group_init (&rebuild_group);
+
+  return NULL;
+}
+
+static void
+ensure_groups (void)
+{
+  static GOnce groups_once = G_ONCE_INIT;
+
+  g_once (&groups_once, init_groups, NULL);
+}
+
+static GHashTable *
+tile_set_new (void)
+{
+  return g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+}
+
+static void
+tile_set_add (GHashTable *set,
+              gint        x,
+              gint        y)
+{
+  gint64 key = ((gint64) x << 32) | (guint32) y;
+
+  if (! g_hash_table_contains (set, &key))
+    g_hash_table_add (set, g_memdup (&key, sizeof (key)));
+}
+
+/* builds the given tiles of level 1 and the tiles above them, up to
+ * levels, one level at a time
+ */
+static void
+build_levels (GeglTileHandlerZoom *zoom,
+              GHashTable          *tiles,
+              gint                 levels)
+{
+  GeglTileStorage *tile_storage;
+  gint             z;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  g_rec_mutex_lock (&tile_storage->mutex);
+  if (levels > tile_storage->seen_zoom)
+    tile_storage->seen_zoom = levels;
+  g_rec_mutex_unlock (&tile_storage->mutex);
+
+  g_hash_table_ref (tiles);
+
+  for (z = 1; z <= levels && g_hash_table_size (tiles); z++)
+    {
+      BuildLevel      level;
+      BuildTile      *builds;
+      GeglTaskGroup   group;
+      GHashTable     *next = tile_set_new ();
+      GHashTableIter  iter;
+      gpointer        key;
+      gint            i = 0;
+
+      level.zoom  = zoom;
+      level.z     = z;
+      level.stamp = g_atomic_int_get (&zoom->stamp);
+
+      builds = g_new (BuildTile, g_hash_table_size (tiles));
+
+      gegl_task_group_init (&group);
+
+      g_hash_table_iter_init (&iter, tiles);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          gint64 coords = *(gint64 *) key;
+
+          builds[i].level = &level;
+          builds[i].x     = coords >> 32;
+          builds[i].y     = (gint32) (coords & 0xffffffff);
+
+          tile_set_add (next, gegl_tile_indice (builds[i].x, 2),
+                              gegl_tile_indice (builds[i].y, 2));
+
+          gegl_task_group_push (&group, build_tile, &builds[i++]);
+        }
+
+      gegl_task_group_wait (&group);
+
+      g_free (builds);
+
+      g_hash_table_unref (tiles);
+      tiles = next;
+    }
+
+  g_hash_table_unref (tiles);
+}
+
+/* run by the scheduler, where waiting for the builds of a level runs
+ * other tasks rather than idling
+ */
+static void
+rebuild_damage (gpointer data)
+{
+  GeglTileHandlerZoom *zoom = data;
+  GeglTileStorage     *tile_storage;
+  GHashTable          *tiles;
+  gint                 levels;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  g_mutex_lock (&zoom->mutex);
+  tiles        = zoom->damage;
+  levels       = zoom->levels;
+  zoom->damage = tile_set_new ();
+  zoom->queued = FALSE;
+  g_mutex_unlock (&zoom->mutex);
+
+  build_levels (zoom, tiles, levels);
+
+  g_hash_table_unref (tiles);
+  g_object_unref (tile_storage);
+}
+
+void
+gegl_tile_handler_zoom_build (GeglTileHandlerZoom *zoom,
+                              const GeglRectangle *rect,
+                              gint                 levels)
+{
+  GeglTileStorage *tile_storage;
+  GHashTable      *tiles;
+  gint             tile_width;
+  gint             tile_height;
+  gint             x0, y0, x1, y1;
+  gint             x, y;
+
+  g_return_if_fail (GEGL_IS_TILE_HANDLER_ZOOM (zoom));
+  g_return_if_fail (rect != NULL);
+
+  if (levels < 1 || rect->width < 1 || rect->height < 1)
+    return;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  /* the level 1 tiles covering rect */
+  tile_width  = tile_storage->tile_width * 2;
+  tile_height = tile_storage->tile_height * 2;
+
+  x0 = gegl_tile_indice (rect->x, tile_width);
+  y0 = gegl_tile_indice (rect->y, tile_height);
+  x1 = gegl_tile_indice (rect->x + rect->width - 1, tile_width);
+  y1 = gegl_tile_indice (rect->y + rect->height - 1, tile_height);
+
+  tiles = tile_set_new ();
+  for (y = y0; y <= y1; y++)
+    for (x = x0; x <= x1; x++)
+      tile_set_add (tiles, x, y);
+
+  g_mutex_lock (&zoom->mutex);
+  zoom->levels = MAX (zoom->levels, levels);
+  g_mutex_unlock (&zoom->mutex);
+
+  build_levels (zoom, tiles, levels);
+
+  g_hash_table_unref (tiles);
+}
+
+void
+gegl_tile_handler_zoom_damage (GeglTileHandlerZoom *zoom,
+                               gint                 x,
+                               gint                 y)
+{
+  g_atomic_int_inc (&zoom->stamp);
+
+  /* without threads there is no one to rebuild in the background, the
+   * voided tiles are computed again when requested
+   */
+  if (! g_atomic_int_get (&zoom->levels) || gegl_config_threads () < 2)
+    return;
+
+  ensure_groups ();
+
+  g_mutex_lock (&zoom->mutex);
+  if (zoom->levels)
+    {
+      tile_set_add (zoom->damage, gegl_tile_indice (x, 2),
+                                  gegl_tile_indice (y, 2));
+
+      if (! zoom->queued)
+        {
+          zoom->queued = TRUE;
+
+          /* keeps the storage, and with it ourselves, alive until the
+           * rebuild ran
+           */
+          g_object_ref (_gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom));
+          gegl_task_group_push (&rebuild_group, rebuild_damage, zoom);
+        }
+    }
+  g_mutex_unlock (&zoom->mutex);
+}
+
+/* the tile x, y, z packed into a key, tile indices stay well within 28
+ * bits and levels within 8
+ */
+static inline gint64
+prefetch_key (gint x,
+              gint y,
+              gint z)
+{
+  return ((gint64) (z & 0xff) << 56) |
+         ((gint64) (x & 0xfffffff) << 28) |
+         (gint64) (y & 0xfffffff);
+}
+
+/* computes a tile ahead of its request, and puts it in the cache for the
+ * request to find. like build_tile () it holds the storage lock only to
+ * fetch the tiles below and to insert the result.
+ */
+static void
+prefetch_tile (gpointer data)
+{
+  PrefetchTile        *prefetch = data;
+  GeglTileHandlerZoom *zoom     = prefetch->zoom;
+  GeglTileStorage     *tile_storage;
+  GeglTile            *source_tile[2][2];
+  GeglTile            *tile;
+
+  tile_storage = _gegl_tile_handler_get_tile_storage ((GeglTileHandler *) zoom);
+
+  g_rec_mutex_lock (&tile_storage->mutex);
+  if (! gegl_tile_source_exist (GEGL_TILE_SOURCE (zoom),
+                                prefetch->x, prefetch->y, prefetch->z))
+    get_source_tiles (zoom, source_tile, prefetch->x, prefetch->y, prefetch->z);
+  else
+    source_tile[0][0] = source_tile[0][1] =
+    source_tile[1][0] = source_tile[1][1] = NULL;
+  g_rec_mutex_unlock (&tile_storage->mutex);
+
+  tile = downscale_tile (zoom, source_tile,
+                         prefetch->x, prefetch->y, prefetch->z);
+
+  if (tile)
+    {
+      GeglTileHandlerCache *cache;
+
+      cache = _gegl_tile_handler_get_cache ((GeglTileHandler *) zoom);
+
+      g_rec_mutex_lock (&tile_storage->mutex);
+      if (cache &&
+          g_atomic_int_get (&zoom->stamp) == prefetch->stamp &&
+          ! gegl_tile_source_exist (GEGL_TILE_SOURCE (zoom),
+                                    prefetch->x, prefetch->y, prefetch->z))
+        {
+          gegl_tile_handler_cache_insert (cache, tile, prefetch->x,
+                                          prefetch->y, prefetch->z);
+
+          if (g_atomic_int_get (&zoom->stamp) != prefetch->stamp)
+            gegl_tile_source_void (GEGL_TILE_SOURCE (zoom),
+                                   prefetch->x, prefetch->y, prefetch->z);
+        }
+      g_rec_mutex_unlock (&tile_storage->mutex);
+
+      gegl_tile_unref (tile);
+    }
+
+  g_mutex_lock (&zoom->mutex);
+  g_hash_table_remove (zoom->prefetching, &prefetch->key);
+  g_mutex_unlock (&zoom->mutex);
+
+  g_object_unref (tile_storage);
+  g_slice_free (PrefetchTile, prefetch);
+}
+
+/* returns TRUE if the tile is read or computed in the background */
+static gpointer
+prefetch (GeglTileHandlerZoom *zoom,
+          gint                 x,
+          gint                 y,
+          gint                 z)
+{
+  GeglTileHandler *handler = (GeglTileHandler *) zoom;
+  GeglTileStorage *tile_storage;
+  PrefetchTile    *job;
+  gint64           key;
+
+  /* tiles held below, or in the cache, are left to the handlers below;
+   * without threads the storage is not locked by its users, and tiles
+   * are not computed in the background
+   */
+  if (z == 0 || gegl_config_threads () < 2 ||
+      gegl_tile_handler_source_command (handler, GEGL_TILE_EXIST,
+                                        x, y, z, NULL))
+    return gegl_tile_handler_source_command (handler, GEGL_TILE_PREFETCH,
+                                             x, y, z, NULL);
+
+  tile_storage = _gegl_tile_handler_get_tile_storage (handler);
+  if (! tile_storage)
+    return NULL;
+
+  key = prefetch_key (x, y, z);
+
+  g_mutex_lock (&zoom->mutex);
+  if (g_hash_table_contains (zoom->prefetching, &key))
+    {
+      g_mutex_unlock (&zoom->mutex);
+      return (gpointer) TRUE;
+    }
+  g_hash_table_add (zoom->prefetching, g_memdup (&key, sizeof (key)));
+  g_mutex_unlock (&zoom->mutex);
+
+  ensure_groups ();
+
+  job        = g_slice_new (PrefetchTile);
+  job->zoom  = zoom;
+  job->x     = x;
+  job->y     = y;
+  job->z     = z;
+  job->stamp = g_atomic_int_get (&zoom->stamp);
+  job->key   = key;
+
+  /* keeps the storage, and with it ourselves, alive until computed */
+  g_object_ref (tile_storage);
+  gegl_task_group_push (&prefetch_group, prefetch_tile, job);
+
+  return (gpointer) TRUE;
+}
+
 static gpointer
 gegl_tile_handler_zoom_command (GeglTileSource  *tile_store,
                                 GeglTileCommand  command,
@@ -165,19 +695,40 @@ gegl_tile_handler_zoom_command (GeglTileSource  *tile_store,
 
   if (command == GEGL_TILE_GET)
     return get_tile (tile_store, x, y, z);
+  else if (command == GEGL_TILE_PREFETCH)
+    return prefetch ((GeglTileHandlerZoom *) tile_store, x, y, z);
   else
     return gegl_tile_handler_source_command (handler, command, x, y, z, data);
 }
 
+static void
+gegl_tile_handler_zoom_finalize (GObject *object)
+{
+  GeglTileHandlerZoom *self = GEGL_TILE_HANDLER_ZOOM (object);
+
+  g_hash_table_unref (self->damage);
+  g_hash_table_unref (self->prefetching);
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (gegl_tile_handler_zoom_parent_class)->finalize (object);
+}
+
 static void
 gegl_tile_handler_zoom_class_init (GeglTileHandlerZoomClass *klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gegl_tile_handler_zoom_finalize;
 }
 
 static void
 gegl_tile_handler_zoom_init (GeglTileHandlerZoom *self)
 {
   ((GeglTileSource *) self)->command = gegl_tile_handler_zoom_command;
+
+  g_mutex_init (&self->mutex);
+  self->damage      = tile_set_new ();
+  self->prefetching = tile_set_new ();
 }
 
 GeglTileHandler *
@@ -44,6 +44,18 @@ struct _GeglTileHandlerZoom
   GeglTileHandler       parent_instance;
   GeglTileBackend      *backend;
   GeglTileStorage      *tile_storage;
+
+  GMutex                mutex;   /* protects the pyramid state below */
+  gint                  levels;  /* the number of levels kept built in the
+                                  * background, 0 if they are only built on
+                                  * demand
+                                  */
+  GHashTable           *damage;  /* the level 1 tiles waiting to be rebuilt */
+  gboolean              queued;  /* whether a rebuild is queued */
+  gint                  stamp;   /* bumped whenever base tiles change */
+  GHashTable           *prefetching; /* the tiles being computed ahead of
+                                      * a request
+                                      */
 };
 
 struct _GeglTileHandlerZoomClass
@@ -55,6 +67,21 @@ GType             gegl_tile_handler_zoom_get_type (void) G_GNUC_CONST;
 
 GeglTileHandler * gegl_tile_handler_zoom_new      (GeglTileBackend *backend);
 
+/* computes levels 1 to levels of the pyramid over rect, given in tile
+ * storage coordinates, one level at a time with the tiles of a level in
+ * parallel. the levels are kept built in the background from then on.
+ */
+void              gegl_tile_handler_zoom_build    (GeglTileHandlerZoom *zoom,
+                                                   const GeglRectangle *rect,
+                                                   gint                 levels);
+
+/* called when the base tile x, y changed, queues the tiles above it for
+ * rebuilding if the pyramid is kept built.
+ */
+void              gegl_tile_handler_zoom_damage   (GeglTileHandlerZoom *zoom,
+                                                   gint                 x,
+                                                   gint                 y);
+
 G_END_DECLS
 
 #endif
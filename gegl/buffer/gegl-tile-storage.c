@@ -28,6 +28,8 @@
 #include "gegl-tile-handler-empty.h"
 #include "gegl-tile-handler-zoom.h"
 #include "gegl-tile-handler-cache.h"
+#include "gegl-tile-handler-compress.h"
+#include "gegl-tile-backend-swap.h"
 #include "gegl-tile-handler-log.h"
 #include "gegl-tile-handler-private.h"
 #include "gegl-types-internal.h"
@@ -76,6 +78,18 @@ gegl_tile_storage_new (GeglTileBackend *backend)
   _gegl_tile_handler_set_tile_storage (handler, tile_storage);
   _gegl_tile_handler_set_cache (handler, (GeglTileHandlerCache *) cache);
 
+  /* handlers are prepended, so the compressed tier ends up between the
+   * cache and the backend
+   */
+  if (gegl_config ()->compressed_cache_size > 0 &&
+      GEGL_IS_TILE_BACKEND_SWAP (backend))
+    {
+      GeglTileHandler *compress = gegl_tile_handler_compress_new (backend);
+
+      gegl_tile_handler_chain_add (tile_handler_chain, compress);
+      g_object_unref (compress);
+    }
+
   gegl_tile_handler_chain_add (tile_handler_chain, cache);
   gegl_tile_handler_chain_add (tile_handler_chain, zoom);
   gegl_tile_handler_chain_add (tile_handler_chain, empty);
@@ -85,6 +99,7 @@ gegl_tile_storage_new (GeglTileBackend *backend)
   g_object_unref (empty);
 
   tile_storage->cache = (GeglTileHandlerCache *) cache;
+  tile_storage->zoom  = (GeglTileHandlerZoom *) zoom;
   ((GeglTileHandlerCache *) cache)->tile_storage = tile_storage;
   gegl_tile_handler_chain_bind (tile_handler_chain);
 
@@ -21,6 +21,7 @@
 
 #include "gegl-tile-handler-chain.h"
 #include "gegl-tile-handler-cache.h"
+#include "gegl-tile-handler-zoom.h"
 
 /***
  * GeglTileStorage provide the command API to GeglBuffer, and setup a chain of GeglTileHandler to
@@ -40,6 +41,7 @@ struct _GeglTileStorage
 {
   GeglTileHandlerChain parent_instance;
   GeglTileHandlerCache *cache;
+  GeglTileHandlerZoom  *zoom;
   GRecMutex      mutex;
   const Babl    *format;
   gint           tile_width;
@@ -34,10 +34,7 @@
 #include "gegl-buffer-private.h"
 #include "gegl-tile-source.h"
 #include "gegl-tile-storage.h"
-
-static GMutex cowmutex = { 0, }; /* copy on write is maintained in a doubly linked
-                                  * list, which must be protected by a mutex
-                                  */
+#include "gegl-tile-alloc.h"
 
 GeglTile *gegl_tile_ref (GeglTile *tile)
 {
@@ -45,7 +42,30 @@ GeglTile *gegl_tile_ref (GeglTile *tile)
   return tile;
 }
 
+/* destroy_notify of data from gegl_malloc (), the default of tiles, and of
+ * data from gegl_tile_alloc (), used only for the tiles allocating it here
+ */
 static int free_data_directly;
+static int free_tile_data;
+
+static void
+gegl_tile_free_data (guchar         *data,
+                     gint           *n_clones,
+                     GDestroyNotify  destroy_notify,
+                     gpointer        destroy_notify_data)
+{
+  if (data && destroy_notify)
+    {
+      if (destroy_notify == (void*)&free_data_directly)
+        gegl_free (data);
+      else if (destroy_notify == (void*)&free_tile_data)
+        gegl_tile_free (data);
+      else
+        destroy_notify (destroy_notify_data);
+    }
+
+  gegl_tile_free (n_clones);
+}
 
 void gegl_tile_unref (GeglTile *tile)
 {
@@ -58,39 +78,20 @@ void gegl_tile_unref (GeglTile *tile)
    */
   gegl_tile_store (tile);
 
-  g_mutex_lock (&cowmutex);
-  if (tile->data)
-    {
-      if (tile->next_shared == tile)
-        { /* no clones */
-          g_mutex_unlock (&cowmutex);
-          if (tile->destroy_notify)
-            {
-              if (tile->destroy_notify == (void*)&free_data_directly)
-                gegl_free (tile->data);
-              else
-                tile->destroy_notify (tile->destroy_notify_data);
-            }
-          tile->data = NULL;
-        }
-      else
-        {
-          tile->prev_shared->next_shared = tile->next_shared;
-          tile->next_shared->prev_shared = tile->prev_shared;
-          g_mutex_unlock (&cowmutex);
-        }
-    }
-  else
-    g_mutex_unlock (&cowmutex);
+  /* the last tile referencing the data frees it */
+  if (g_atomic_int_dec_and_test (tile->n_clones))
+    gegl_tile_free_data (tile->data, tile->n_clones,
+                         tile->destroy_notify, tile->destroy_notify_data);
 
-  g_slice_free (GeglTile, tile);
-}
+  tile->data = NULL;
 
+  gegl_tile_free (tile);
+}
 
-GeglTile *
-gegl_tile_new_bare (void)
+static GeglTile *
+gegl_tile_new_bare_internal (void)
 {
-  GeglTile *tile     = g_slice_new0 (GeglTile);
+  GeglTile *tile     = gegl_tile_alloc0 (sizeof (GeglTile));
   tile->ref_count    = 1;
   tile->tile_storage = NULL;
   tile->stored_rev   = 1;
@@ -98,37 +99,53 @@ gegl_tile_new_bare (void)
   tile->lock         = 0;
   tile->data         = NULL;
 
-  tile->next_shared = tile;
-  tile->prev_shared = tile;
-
   tile->destroy_notify = (void*)&free_data_directly;
   tile->destroy_notify_data = NULL;
 
   return tile;
 }
 
+static gint *
+gegl_tile_n_clones_new (void)
+{
+  gint *n_clones = gegl_tile_alloc (sizeof (gint));
+
+  *n_clones = 1;
+
+  return n_clones;
+}
+
+GeglTile *
+gegl_tile_new_bare (void)
+{
+  GeglTile *tile = gegl_tile_new_bare_internal ();
+
+  tile->n_clones = gegl_tile_n_clones_new ();
+
+  return tile;
+}
+
 GeglTile *
 gegl_tile_dup (GeglTile *src)
 {
-  GeglTile *tile = gegl_tile_new_bare ();
+  GeglTile *tile = gegl_tile_new_bare_internal ();
 
-  g_mutex_lock (&cowmutex);
+  /* src is referenced by the caller, so its data can not go away under
+   * us; taking a reference on the shared counter is all that is needed
+   */
+  g_atomic_int_inc (src->n_clones);
 
   tile->tile_storage = src->tile_storage;
   tile->data         = src->data;
   tile->size         = src->size;
   tile->is_zero_tile = src->is_zero_tile;
+  tile->is_uniform   = src->is_uniform;
+  tile->is_read_only = src->is_read_only;
+  tile->n_clones     = src->n_clones;
 
   tile->destroy_notify      = src->destroy_notify;
   tile->destroy_notify_data = src->destroy_notify_data;
 
-  tile->next_shared              = src->next_shared;
-  src->next_shared               = tile;
-  tile->prev_shared              = src;
-  tile->next_shared->prev_shared = tile;
-
-  g_mutex_unlock (&cowmutex);
-
   return tile;
 }
 
@@ -137,17 +154,103 @@ gegl_tile_new (gint size)
 {
   GeglTile *tile = gegl_tile_new_bare ();
 
-  tile->data = gegl_malloc (size);
-  tile->size = size;
+  tile->data           = gegl_tile_alloc (size);
+  tile->size           = size;
+  tile->destroy_notify = (void*)&free_tile_data;
+
+  return tile;
+}
+
+/* the most distinct uniform tiles whose data is shared, further ones get
+ * data of their own
+ */
+#define MAX_UNIFORM_TILES 64
+
+static GMutex      uniform_mutex;
+static GHashTable *uniform_tiles = NULL;
+
+GeglTile *
+gegl_tile_new_uniform (gint          size,
+                       gint          bpp,
+                       gconstpointer pixel)
+{
+  GeglTile *template = NULL;
+  GeglTile *tile;
+  GBytes   *key;
+  guchar   *key_data;
+
+  g_return_val_if_fail (bpp > 0 && size % bpp == 0, NULL);
+
+  key_data = g_malloc (sizeof (gint) + bpp);
+  memcpy (key_data, &size, sizeof (gint));
+  memcpy (key_data + sizeof (gint), pixel, bpp);
+  key = g_bytes_new_take (key_data, sizeof (gint) + bpp);
+
+  g_mutex_lock (&uniform_mutex);
+
+  if (! uniform_tiles)
+    uniform_tiles = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+                                           (GDestroyNotify) g_bytes_unref,
+                                           (GDestroyNotify) gegl_tile_unref);
+
+  template = g_hash_table_lookup (uniform_tiles, key);
+
+  if (! template)
+    {
+      template = gegl_tile_new (size);
+      gegl_memset_pattern (template->data, pixel, bpp, size / bpp);
+      template->is_uniform = 1;
+
+      if (g_hash_table_size (uniform_tiles) < MAX_UNIFORM_TILES)
+        {
+          g_hash_table_insert (uniform_tiles, g_bytes_ref (key), template);
+        }
+      else
+        {
+          g_mutex_unlock (&uniform_mutex);
+          g_bytes_unref (key);
+
+          return template;
+        }
+    }
+
+  /* the template keeps a share of the data, so writing to the tile
+   * always expands it into data of its own
+   */
+  tile = gegl_tile_dup (template);
+
+  g_mutex_unlock (&uniform_mutex);
+
+  g_bytes_unref (key);
 
   return tile;
 }
 
+gboolean
+gegl_tile_is_uniform (GeglTile *tile)
+{
+  return tile->is_uniform;
+}
+
+void
+gegl_tile_uniform_cleanup (void)
+{
+  g_mutex_lock (&uniform_mutex);
+
+  if (uniform_tiles)
+    {
+      g_hash_table_unref (uniform_tiles);
+      uniform_tiles = NULL;
+    }
+
+  g_mutex_unlock (&uniform_mutex);
+}
+
 static gpointer
 gegl_memdup (gpointer src, gsize size)
 {
   gpointer ret;
-  ret = gegl_malloc (size);
+  ret = gegl_tile_alloc (size);
   memcpy (ret, src, size);
   return ret;
 }
@@ -155,34 +258,39 @@ gegl_memdup (gpointer src, gsize size)
 static void
 gegl_tile_unclone (GeglTile *tile)
 {
-  g_mutex_lock (&cowmutex);
-  if (tile->next_shared != tile)
+  guchar         *data                = tile->data;
+  gint           *n_clones            = tile->n_clones;
+  GDestroyNotify  destroy_notify      = tile->destroy_notify;
+  gpointer        destroy_notify_data = tile->destroy_notify_data;
+
+  /* a count of one means we are the only tile left referencing the data,
+   * which is then ours to write to, unless it is read only
+   */
+  if (g_atomic_int_get (n_clones) == 1 && ! tile->is_read_only)
+    return;
+
+  /* the tile data is shared with other tiles,
+   * create a local copy
+   */
+  if (tile->is_zero_tile)
     {
-      tile->prev_shared->next_shared = tile->next_shared;
-      tile->next_shared->prev_shared = tile->prev_shared;
-      tile->prev_shared              = tile;
-      tile->next_shared              = tile;
-      g_mutex_unlock (&cowmutex);
-
-      /* the tile data is shared with other tiles,
-       * create a local copy
-       */
-      if (tile->is_zero_tile)
-        {
-          tile->data = gegl_calloc (tile->size, 1);
-          tile->is_zero_tile = 0;
-        }
-      else
-        {
-          tile->data = gegl_memdup (tile->data, tile->size);
-        }
-      tile->destroy_notify           = (void*)&free_data_directly;
-      tile->destroy_notify_data      = NULL;
+      tile->data = gegl_tile_alloc0 (tile->size);
+      tile->is_zero_tile = 0;
     }
   else
     {
-      g_mutex_unlock (&cowmutex);
+      tile->data = gegl_memdup (data, tile->size);
     }
+  tile->is_read_only             = 0;
+  tile->n_clones                 = gegl_tile_n_clones_new ();
+  tile->destroy_notify           = (void*)&free_tile_data;
+  tile->destroy_notify_data      = NULL;
+
+  /* drop our share of the old data, the other clones might all have been
+   * released while we were copying, in which case it is ours to free
+   */
+  if (g_atomic_int_dec_and_test (n_clones))
+    gegl_tile_free_data (data, n_clones, destroy_notify, destroy_notify_data);
 }
 
 void
@@ -198,6 +306,9 @@ gegl_tile_lock (GeglTile *tile)
     g_usleep (5);
   }
 
+  /* the data is about to change */
+  tile->is_uniform = 0;
+
   gegl_tile_unclone (tile);
 }
 
@@ -210,19 +321,28 @@ _gegl_tile_void_pyramid (GeglTileSource *source,
   if (z > ((GeglTileStorage*)source)->seen_zoom)
     return;
   gegl_tile_source_void (source, x, y, z);
-  _gegl_tile_void_pyramid (source, x/2, y/2, z+1);
+  _gegl_tile_void_pyramid (source,
+                           gegl_tile_indice (x, 2),
+                           gegl_tile_indice (y, 2),
+                           z+1);
 }
 
-static void
+void
 gegl_tile_void_pyramid (GeglTile *tile)
 {
   if (tile->tile_storage &&
       tile->tile_storage->seen_zoom &&
       tile->z == 0) /* we only accepting voiding the base level */
     {
+      /* the damage comes first, so that tiles being built in the
+       * background from the old data are not kept
+       */
+      if (tile->tile_storage->zoom)
+        gegl_tile_handler_zoom_damage (tile->tile_storage->zoom,
+                                       tile->x, tile->y);
       _gegl_tile_void_pyramid (GEGL_TILE_SOURCE (tile->tile_storage),
-                               tile->x/2,
-                               tile->y/2,
+                               gegl_tile_indice (tile->x, 2),
+                               gegl_tile_indice (tile->y, 2),
                                tile->z+1);
       return;
     }
@@ -247,6 +367,15 @@ gegl_tile_unlock (GeglTile *tile)
         gegl_tile_void_pyramid (tile);
       }
       tile->rev++;
+
+    /* let the cache know when a stored tile became dirty, so it can be
+     * washed later
+     */
+    if (tile->rev == tile->stored_rev + 1 &&
+        tile->tile_storage && tile->tile_storage->cache)
+      {
+        gegl_tile_handler_cache_mark_dirty (tile->tile_storage->cache, tile);
+      }
   }
 
   g_atomic_int_add (&tile->lock, -1);
@@ -306,8 +435,13 @@ void gegl_tile_set_data (GeglTile *tile,
                          gpointer  pixel_data,
                          gint      pixel_data_size)
 {
-  tile->data = pixel_data;
-  tile->size = pixel_data_size;
+  tile->data       = pixel_data;
+  tile->size       = pixel_data_size;
+  tile->is_uniform = 0;
+
+  /* data set from outside comes from gegl_malloc () */
+  if (tile->destroy_notify == (void*)&free_tile_data)
+    tile->destroy_notify = (void*)&free_data_directly;
 }
 
 void gegl_tile_set_data_full (GeglTile      *tile,
@@ -318,6 +452,7 @@ void gegl_tile_set_data_full (GeglTile      *tile,
 {
   tile->data                = pixel_data;
   tile->size                = pixel_data_size;
+  tile->is_uniform          = 0;
   tile->destroy_notify      = destroy_notify;
   tile->destroy_notify_data = destroy_notify_data;
 }
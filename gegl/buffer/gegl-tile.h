@@ -24,6 +24,16 @@
 
 GeglTile   * gegl_tile_new            (gint             size);
 GeglTile   * gegl_tile_new_bare       (void);
+
+/* returns a tile of size bytes with all its pixels of bpp bytes set to
+ * pixel. The data is shared with other uniform tiles of the same pixel
+ * until the tile is locked for writing
+ */
+GeglTile   * gegl_tile_new_uniform    (gint              size,
+                                       gint              bpp,
+                                       gconstpointer     pixel);
+gboolean     gegl_tile_is_uniform     (GeglTile         *tile);
+void         gegl_tile_uniform_cleanup (void);
 GeglTile   * gegl_tile_ref            (GeglTile         *tile);
 
 void         gegl_tile_unref          (GeglTile         *tile);
@@ -43,6 +53,8 @@ void         gegl_tile_mark_as_stored (GeglTile         *tile);
 gboolean     gegl_tile_is_stored      (GeglTile         *tile);
 gboolean     gegl_tile_store          (GeglTile         *tile);
 void         gegl_tile_void           (GeglTile         *tile);
+/* void the tiles of the mipmap levels above a tile of the base level */
+void         gegl_tile_void_pyramid   (GeglTile         *tile);
 GeglTile    *gegl_tile_dup            (GeglTile         *tile);
 
 void         gegl_tile_set_rev        (GeglTile         *tile,
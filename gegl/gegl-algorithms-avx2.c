@@ -0,0 +1,328 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AVX2 versions of the 2x2 downscale and the boxfilter for pixels of four
+ * u8, u16 or float components, picked by gegl_algorithms_init () when the
+ * CPU supports them. this file is compiled with AVX2_EXTRA_CFLAGS.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <glib-object.h>
+
+#include <babl/babl.h>
+
+#include <immintrin.h>
+
+#include "gegl-types.h"
+#include "gegl-algorithms.h"
+
+void
+gegl_downscale_2x2_u8_avx2 (gint    bpp,
+                            gint    src_width,
+                            gint    src_height,
+                            guchar *src_data,
+                            gint    src_rowstride,
+                            guchar *dst_data,
+                            gint    dst_rowstride)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  gint          y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const guchar *a   = src_data + src_rowstride * y * 2;
+      const guchar *b   = a + src_rowstride;
+      guchar       *dst = dst_data + dst_rowstride * y;
+      gint          x   = 0;
+
+      /* eight destination pixels at a time, summed in 16 bits */
+      for (; x + 8 <= src_width / 2; x += 8)
+        {
+          __m256i a0 = _mm256_loadu_si256 ((const __m256i *) (a + x * 8));
+          __m256i a1 = _mm256_loadu_si256 ((const __m256i *) (a + x * 8 + 32));
+          __m256i b0 = _mm256_loadu_si256 ((const __m256i *) (b + x * 8));
+          __m256i b1 = _mm256_loadu_si256 ((const __m256i *) (b + x * 8 + 32));
+          __m256i s0, s1, s2, s3;
+          __m256i d0, d1;
+
+          /* the unpacks work within 128 bit lanes, each lane holds two
+           * source pixels of a row after them
+           */
+          s0 = _mm256_add_epi16 (_mm256_unpacklo_epi8 (a0, zero),
+                                 _mm256_unpacklo_epi8 (b0, zero));
+          s1 = _mm256_add_epi16 (_mm256_unpackhi_epi8 (a0, zero),
+                                 _mm256_unpackhi_epi8 (b0, zero));
+          s2 = _mm256_add_epi16 (_mm256_unpacklo_epi8 (a1, zero),
+                                 _mm256_unpacklo_epi8 (b1, zero));
+          s3 = _mm256_add_epi16 (_mm256_unpackhi_epi8 (a1, zero),
+                                 _mm256_unpackhi_epi8 (b1, zero));
+
+          d0 = _mm256_add_epi16 (_mm256_unpacklo_epi64 (s0, s1),
+                                 _mm256_unpackhi_epi64 (s0, s1));
+          d1 = _mm256_add_epi16 (_mm256_unpacklo_epi64 (s2, s3),
+                                 _mm256_unpackhi_epi64 (s2, s3));
+
+          d0 = _mm256_srli_epi16 (d0, 2);
+          d1 = _mm256_srli_epi16 (d1, 2);
+
+          /* the pack interleaves the lanes of d0 and d1, put the pixels
+           * back in order
+           */
+          d0 = _mm256_packus_epi16 (d0, d1);
+          d0 = _mm256_permute4x64_epi64 (d0, _MM_SHUFFLE (3, 1, 2, 0));
+
+          _mm256_storeu_si256 ((__m256i *) (dst + x * 4), d0);
+        }
+
+      for (; x < src_width / 2; x++)
+        {
+          gint i;
+
+          for (i = 0; i < 4; i++)
+            dst[x * 4 + i] = ((guint) a[x * 8 + i] + a[x * 8 + 4 + i] +
+                              b[x * 8 + i] + b[x * 8 + 4 + i]) / 4;
+        }
+    }
+}
+
+void
+gegl_downscale_2x2_u16_avx2 (gint    bpp,
+                             gint    src_width,
+                             gint    src_height,
+                             guchar *src_data,
+                             gint    src_rowstride,
+                             guchar *dst_data,
+                             gint    dst_rowstride)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  gint          y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const guint16 *a   = (const guint16 *) (src_data + src_rowstride * y * 2);
+      const guint16 *b   = (const guint16 *) (src_data + src_rowstride * y * 2 +
+                                              src_rowstride);
+      guint16       *dst = (guint16 *) (dst_data + dst_rowstride * y);
+      gint           x   = 0;
+
+      /* four destination pixels at a time, summed in 32 bits */
+      for (; x + 4 <= src_width / 2; x += 4)
+        {
+          __m256i a0 = _mm256_loadu_si256 ((const __m256i *) (a + x * 8));
+          __m256i a1 = _mm256_loadu_si256 ((const __m256i *) (a + x * 8 + 16));
+          __m256i b0 = _mm256_loadu_si256 ((const __m256i *) (b + x * 8));
+          __m256i b1 = _mm256_loadu_si256 ((const __m256i *) (b + x * 8 + 16));
+          __m256i d0, d1;
+
+          d0 = _mm256_add_epi32 (
+                 _mm256_add_epi32 (_mm256_unpacklo_epi16 (a0, zero),
+                                   _mm256_unpackhi_epi16 (a0, zero)),
+                 _mm256_add_epi32 (_mm256_unpacklo_epi16 (b0, zero),
+                                   _mm256_unpackhi_epi16 (b0, zero)));
+          d1 = _mm256_add_epi32 (
+                 _mm256_add_epi32 (_mm256_unpacklo_epi16 (a1, zero),
+                                   _mm256_unpackhi_epi16 (a1, zero)),
+                 _mm256_add_epi32 (_mm256_unpacklo_epi16 (b1, zero),
+                                   _mm256_unpackhi_epi16 (b1, zero)));
+
+          d0 = _mm256_srli_epi32 (d0, 2);
+          d1 = _mm256_srli_epi32 (d1, 2);
+
+          d0 = _mm256_packus_epi32 (d0, d1);
+          d0 = _mm256_permute4x64_epi64 (d0, _MM_SHUFFLE (3, 1, 2, 0));
+
+          _mm256_storeu_si256 ((__m256i *) (dst + x * 4), d0);
+        }
+
+      for (; x < src_width / 2; x++)
+        {
+          gint i;
+
+          for (i = 0; i < 4; i++)
+            dst[x * 4 + i] = ((guint) a[x * 8 + i] + a[x * 8 + 4 + i] +
+                              b[x * 8 + i] + b[x * 8 + 4 + i]) / 4;
+        }
+    }
+}
+
+void
+gegl_downscale_2x2_float_avx2 (gint    bpp,
+                               gint    src_width,
+                               gint    src_height,
+                               guchar *src_data,
+                               gint    src_rowstride,
+                               guchar *dst_data,
+                               gint    dst_rowstride)
+{
+  const __m256 quarter = _mm256_set1_ps (0.25f);
+  gint         y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const gfloat *a   = (const gfloat *) (src_data + src_rowstride * y * 2);
+      const gfloat *b   = (const gfloat *) (src_data + src_rowstride * y * 2 +
+                                            src_rowstride);
+      gfloat       *dst = (gfloat *) (dst_data + dst_rowstride * y);
+      gint          x   = 0;
+
+      /* two destination pixels at a time, summed in the order of the
+       * scalar code
+       */
+      for (; x + 2 <= src_width / 2; x += 2)
+        {
+          __m256 a0 = _mm256_loadu_ps (a + x * 8);
+          __m256 a1 = _mm256_loadu_ps (a + x * 8 + 8);
+          __m256 b0 = _mm256_loadu_ps (b + x * 8);
+          __m256 b1 = _mm256_loadu_ps (b + x * 8 + 8);
+          __m256 sum;
+
+          /* the left source pixels in one register, the right in another */
+          sum = _mm256_add_ps (_mm256_permute2f128_ps (a0, a1, 0x20),
+                               _mm256_permute2f128_ps (a0, a1, 0x31));
+          sum = _mm256_add_ps (sum, _mm256_permute2f128_ps (b0, b1, 0x20));
+          sum = _mm256_add_ps (sum, _mm256_permute2f128_ps (b0, b1, 0x31));
+
+          _mm256_storeu_ps (dst + x * 4, _mm256_mul_ps (sum, quarter));
+        }
+
+      for (; x < src_width / 2; x++)
+        {
+          __m128 sum;
+
+          sum = _mm_add_ps (_mm_loadu_ps (a + x * 8),
+                            _mm_loadu_ps (a + x * 8 + 4));
+          sum = _mm_add_ps (sum, _mm_loadu_ps (b + x * 8));
+          sum = _mm_add_ps (sum, _mm_loadu_ps (b + x * 8 + 4));
+
+          _mm_storeu_ps (dst + x * 4,
+                         _mm_mul_ps (sum, _mm256_castps256_ps128 (quarter)));
+        }
+    }
+}
+
+typedef __m256d v4d;
+
+static inline v4d
+v4d_mul (v4d     a,
+         gdouble w)
+{
+  return _mm256_mul_pd (a, _mm256_set1_pd (w));
+}
+
+static inline v4d
+v4d_madd (v4d     sum,
+          v4d     a,
+          gdouble w)
+{
+  /* not fused, to round like the scalar code */
+  return _mm256_add_pd (sum, _mm256_mul_pd (a, _mm256_set1_pd (w)));
+}
+
+static inline v4d
+load_u8 (const guint8 *src)
+{
+  gint32 pixel;
+
+  memcpy (&pixel, src, sizeof (pixel));
+
+  return _mm256_cvtepi32_pd (_mm_cvtepu8_epi32 (_mm_cvtsi32_si128 (pixel)));
+}
+
+static inline void
+store_u8 (guint8 *dst,
+          v4d     v)
+{
+  __m128i i = _mm256_cvtpd_epi32 (v);
+  gint32  pixel;
+
+  i = _mm_packus_epi16 (_mm_packus_epi32 (i, i), i);
+
+  pixel = _mm_cvtsi128_si32 (i);
+  memcpy (dst, &pixel, sizeof (pixel));
+}
+
+static inline v4d
+load_u16 (const guint16 *src)
+{
+  __m128i v = _mm_loadl_epi64 ((const __m128i *) src);
+
+  return _mm256_cvtepi32_pd (_mm_cvtepu16_epi32 (v));
+}
+
+static inline void
+store_u16 (guint16 *dst,
+           v4d      v)
+{
+  __m128i i = _mm256_cvtpd_epi32 (v);
+
+  _mm_storel_epi64 ((__m128i *) dst, _mm_packus_epi32 (i, i));
+}
+
+static inline v4d
+load_float (const gfloat *src)
+{
+  return _mm256_cvtps_pd (_mm_loadu_ps (src));
+}
+
+static inline void
+store_float (gfloat *dst,
+             v4d     v)
+{
+  _mm_storeu_ps (dst, _mm256_cvtpd_ps (v));
+}
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_u8_avx2
+#define BOXFILTER_TYPE       guint8
+#define BOXFILTER_LOAD       load_u8
+#define BOXFILTER_STORE      store_u8
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_u16_avx2
+#define BOXFILTER_TYPE       guint16
+#define BOXFILTER_LOAD       load_u16
+#define BOXFILTER_STORE      store_u16
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_float_avx2
+#define BOXFILTER_TYPE       gfloat
+#define BOXFILTER_LOAD       load_float
+#define BOXFILTER_STORE      store_float
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
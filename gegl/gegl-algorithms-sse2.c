@@ -0,0 +1,359 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SSE2 versions of the 2x2 downscale and the boxfilter for pixels of four
+ * u8, u16 or float components, picked by gegl_algorithms_init () when the
+ * CPU supports them. this file is compiled with SSE2_EXTRA_CFLAGS.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <glib-object.h>
+
+#include <babl/babl.h>
+
+#include <emmintrin.h>
+
+#include "gegl-types.h"
+#include "gegl-algorithms.h"
+
+void
+gegl_downscale_2x2_u8_sse2 (gint    bpp,
+                            gint    src_width,
+                            gint    src_height,
+                            guchar *src_data,
+                            gint    src_rowstride,
+                            guchar *dst_data,
+                            gint    dst_rowstride)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint          y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const guchar *a   = src_data + src_rowstride * y * 2;
+      const guchar *b   = a + src_rowstride;
+      guchar       *dst = dst_data + dst_rowstride * y;
+      gint          x   = 0;
+
+      /* four destination pixels at a time, summed in 16 bits */
+      for (; x + 4 <= src_width / 2; x += 4)
+        {
+          __m128i a0 = _mm_loadu_si128 ((const __m128i *) (a + x * 8));
+          __m128i a1 = _mm_loadu_si128 ((const __m128i *) (a + x * 8 + 16));
+          __m128i b0 = _mm_loadu_si128 ((const __m128i *) (b + x * 8));
+          __m128i b1 = _mm_loadu_si128 ((const __m128i *) (b + x * 8 + 16));
+          __m128i s0, s1, s2, s3;
+          __m128i d0, d1;
+
+          /* the two rows added, two source pixels per register */
+          s0 = _mm_add_epi16 (_mm_unpacklo_epi8 (a0, zero),
+                              _mm_unpacklo_epi8 (b0, zero));
+          s1 = _mm_add_epi16 (_mm_unpackhi_epi8 (a0, zero),
+                              _mm_unpackhi_epi8 (b0, zero));
+          s2 = _mm_add_epi16 (_mm_unpacklo_epi8 (a1, zero),
+                              _mm_unpacklo_epi8 (b1, zero));
+          s3 = _mm_add_epi16 (_mm_unpackhi_epi8 (a1, zero),
+                              _mm_unpackhi_epi8 (b1, zero));
+
+          /* the left and right pixels added */
+          d0 = _mm_add_epi16 (_mm_unpacklo_epi64 (s0, s1),
+                              _mm_unpackhi_epi64 (s0, s1));
+          d1 = _mm_add_epi16 (_mm_unpacklo_epi64 (s2, s3),
+                              _mm_unpackhi_epi64 (s2, s3));
+
+          d0 = _mm_srli_epi16 (d0, 2);
+          d1 = _mm_srli_epi16 (d1, 2);
+
+          _mm_storeu_si128 ((__m128i *) (dst + x * 4),
+                            _mm_packus_epi16 (d0, d1));
+        }
+
+      for (; x < src_width / 2; x++)
+        {
+          gint i;
+
+          for (i = 0; i < 4; i++)
+            dst[x * 4 + i] = ((guint) a[x * 8 + i] + a[x * 8 + 4 + i] +
+                              b[x * 8 + i] + b[x * 8 + 4 + i]) / 4;
+        }
+    }
+}
+
+void
+gegl_downscale_2x2_u16_sse2 (gint    bpp,
+                             gint    src_width,
+                             gint    src_height,
+                             guchar *src_data,
+                             gint    src_rowstride,
+                             guchar *dst_data,
+                             gint    dst_rowstride)
+{
+  const __m128i zero  = _mm_setzero_si128 ();
+  const __m128i bias  = _mm_set1_epi32 (0x8000);
+  const __m128i bias2 = _mm_set1_epi16 ((gshort) 0x8000);
+  gint          y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const guint16 *a   = (const guint16 *) (src_data + src_rowstride * y * 2);
+      const guint16 *b   = (const guint16 *) (src_data + src_rowstride * y * 2 +
+                                              src_rowstride);
+      guint16       *dst = (guint16 *) (dst_data + dst_rowstride * y);
+      gint           x   = 0;
+
+      /* two destination pixels at a time, summed in 32 bits */
+      for (; x + 2 <= src_width / 2; x += 2)
+        {
+          __m128i a0 = _mm_loadu_si128 ((const __m128i *) (a + x * 8));
+          __m128i a1 = _mm_loadu_si128 ((const __m128i *) (a + x * 8 + 8));
+          __m128i b0 = _mm_loadu_si128 ((const __m128i *) (b + x * 8));
+          __m128i b1 = _mm_loadu_si128 ((const __m128i *) (b + x * 8 + 8));
+          __m128i d0, d1;
+
+          d0 = _mm_add_epi32 (_mm_add_epi32 (_mm_unpacklo_epi16 (a0, zero),
+                                             _mm_unpackhi_epi16 (a0, zero)),
+                              _mm_add_epi32 (_mm_unpacklo_epi16 (b0, zero),
+                                             _mm_unpackhi_epi16 (b0, zero)));
+          d1 = _mm_add_epi32 (_mm_add_epi32 (_mm_unpacklo_epi16 (a1, zero),
+                                             _mm_unpackhi_epi16 (a1, zero)),
+                              _mm_add_epi32 (_mm_unpacklo_epi16 (b1, zero),
+                                             _mm_unpackhi_epi16 (b1, zero)));
+
+          d0 = _mm_srli_epi32 (d0, 2);
+          d1 = _mm_srli_epi32 (d1, 2);
+
+          /* there is no unsigned 32 to 16 bit pack before SSE4.1, pack
+           * the values moved to the signed range, and move them back
+           */
+          d0 = _mm_packs_epi32 (_mm_sub_epi32 (d0, bias),
+                                _mm_sub_epi32 (d1, bias));
+
+          _mm_storeu_si128 ((__m128i *) (dst + x * 4),
+                            _mm_add_epi16 (d0, bias2));
+        }
+
+      for (; x < src_width / 2; x++)
+        {
+          gint i;
+
+          for (i = 0; i < 4; i++)
+            dst[x * 4 + i] = ((guint) a[x * 8 + i] + a[x * 8 + 4 + i] +
+                              b[x * 8 + i] + b[x * 8 + 4 + i]) / 4;
+        }
+    }
+}
+
+void
+gegl_downscale_2x2_float_sse2 (gint    bpp,
+                               gint    src_width,
+                               gint    src_height,
+                               guchar *src_data,
+                               gint    src_rowstride,
+                               guchar *dst_data,
+                               gint    dst_rowstride)
+{
+  const __m128 quarter = _mm_set1_ps (0.25f);
+  gint         y;
+
+  if (!src_data || !dst_data)
+    return;
+
+  for (y = 0; y < src_height / 2; y++)
+    {
+      const gfloat *a   = (const gfloat *) (src_data + src_rowstride * y * 2);
+      const gfloat *b   = (const gfloat *) (src_data + src_rowstride * y * 2 +
+                                            src_rowstride);
+      gfloat       *dst = (gfloat *) (dst_data + dst_rowstride * y);
+      gint          x;
+
+      /* summed in the order of the scalar code, multiplying by a quarter
+       * gives the same result as dividing by four
+       */
+      for (x = 0; x < src_width / 2; x++)
+        {
+          __m128 sum;
+
+          sum = _mm_add_ps (_mm_loadu_ps (a + x * 8),
+                            _mm_loadu_ps (a + x * 8 + 4));
+          sum = _mm_add_ps (sum, _mm_loadu_ps (b + x * 8));
+          sum = _mm_add_ps (sum, _mm_loadu_ps (b + x * 8 + 4));
+
+          _mm_storeu_ps (dst + x * 4, _mm_mul_ps (sum, quarter));
+        }
+    }
+}
+
+/* four doubles, in two SSE2 registers */
+typedef struct
+{
+  __m128d lo;
+  __m128d hi;
+} v4d;
+
+static inline v4d
+v4d_mul (v4d     a,
+         gdouble w)
+{
+  const __m128d wv = _mm_set1_pd (w);
+  v4d           r;
+
+  r.lo = _mm_mul_pd (a.lo, wv);
+  r.hi = _mm_mul_pd (a.hi, wv);
+
+  return r;
+}
+
+static inline v4d
+v4d_madd (v4d     sum,
+          v4d     a,
+          gdouble w)
+{
+  const __m128d wv = _mm_set1_pd (w);
+
+  sum.lo = _mm_add_pd (sum.lo, _mm_mul_pd (a.lo, wv));
+  sum.hi = _mm_add_pd (sum.hi, _mm_mul_pd (a.hi, wv));
+
+  return sum;
+}
+
+static inline v4d
+v4d_from_epi32 (__m128i v)
+{
+  v4d r;
+
+  r.lo = _mm_cvtepi32_pd (v);
+  r.hi = _mm_cvtepi32_pd (_mm_srli_si128 (v, 8));
+
+  return r;
+}
+
+/* rounds to the nearest integer, like lrint () */
+static inline __m128i
+v4d_to_epi32 (v4d v)
+{
+  return _mm_unpacklo_epi64 (_mm_cvtpd_epi32 (v.lo), _mm_cvtpd_epi32 (v.hi));
+}
+
+static inline v4d
+load_u8 (const guint8 *src)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint32        pixel;
+  __m128i       v;
+
+  memcpy (&pixel, src, sizeof (pixel));
+
+  v = _mm_cvtsi32_si128 (pixel);
+  v = _mm_unpacklo_epi16 (_mm_unpacklo_epi8 (v, zero), zero);
+
+  return v4d_from_epi32 (v);
+}
+
+static inline void
+store_u8 (guint8 *dst,
+          v4d     v)
+{
+  __m128i i = v4d_to_epi32 (v);
+  gint32  pixel;
+
+  i = _mm_packus_epi16 (_mm_packs_epi32 (i, i), i);
+
+  pixel = _mm_cvtsi128_si32 (i);
+  memcpy (dst, &pixel, sizeof (pixel));
+}
+
+static inline v4d
+load_u16 (const guint16 *src)
+{
+  __m128i v = _mm_loadl_epi64 ((const __m128i *) src);
+
+  v = _mm_unpacklo_epi16 (v, _mm_setzero_si128 ());
+
+  return v4d_from_epi32 (v);
+}
+
+static inline void
+store_u16 (guint16 *dst,
+           v4d      v)
+{
+  __m128i i = v4d_to_epi32 (v);
+
+  /* moved to the signed range for the pack, see the downscale */
+  i = _mm_packs_epi32 (_mm_sub_epi32 (i, _mm_set1_epi32 (0x8000)), i);
+  i = _mm_add_epi16 (i, _mm_set1_epi16 ((gshort) 0x8000));
+
+  _mm_storel_epi64 ((__m128i *) dst, i);
+}
+
+static inline v4d
+load_float (const gfloat *src)
+{
+  __m128 v = _mm_loadu_ps (src);
+  v4d    r;
+
+  r.lo = _mm_cvtps_pd (v);
+  r.hi = _mm_cvtps_pd (_mm_movehl_ps (v, v));
+
+  return r;
+}
+
+static inline void
+store_float (gfloat *dst,
+             v4d     v)
+{
+  _mm_storeu_ps (dst, _mm_movelh_ps (_mm_cvtpd_ps (v.lo),
+                                     _mm_cvtpd_ps (v.hi)));
+}
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_u8_sse2
+#define BOXFILTER_TYPE       guint8
+#define BOXFILTER_LOAD       load_u8
+#define BOXFILTER_STORE      store_u8
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_u16_sse2
+#define BOXFILTER_TYPE       guint16
+#define BOXFILTER_LOAD       load_u16
+#define BOXFILTER_STORE      store_u16
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
+
+#define BOXFILTER_FUNCNAME   gegl_resample_boxfilter_float_sse2
+#define BOXFILTER_TYPE       gfloat
+#define BOXFILTER_LOAD       load_float
+#define BOXFILTER_STORE      store_float
+#include "gegl-algorithms-boxfilter-simd.inc"
+#undef BOXFILTER_FUNCNAME
+#undef BOXFILTER_TYPE
+#undef BOXFILTER_LOAD
+#undef BOXFILTER_STORE
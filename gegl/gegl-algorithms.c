@@ -27,9 +27,72 @@
 
 #include "gegl-types.h"
 #include "gegl-algorithms.h"
+#include "gegl-cpuaccel.h"
 
 #include <math.h>
 
+typedef void (*GeglDownscale2x2Func) (gint    bpp,
+                                      gint    src_width,
+                                      gint    src_height,
+                                      guchar *src_data,
+                                      gint    src_rowstride,
+                                      guchar *dst_data,
+                                      gint    dst_rowstride);
+
+typedef void (*GeglBoxfilterFunc) (guchar              *dest_buf,
+                                   const guchar        *source_buf,
+                                   const GeglRectangle *dst_rect,
+                                   const GeglRectangle *src_rect,
+                                   gint                 s_rowstride,
+                                   gdouble              scale,
+                                   gint                 bpp,
+                                   gint                 d_rowstride);
+
+/* the kernels used for pixels of four components, replaced with SIMD
+ * versions by gegl_algorithms_init () when the CPU has them
+ */
+static GeglDownscale2x2Func downscale_2x2_u8_rgba    = gegl_downscale_2x2_u8;
+static GeglDownscale2x2Func downscale_2x2_u16_rgba   = gegl_downscale_2x2_u16;
+static GeglDownscale2x2Func downscale_2x2_float_rgba = gegl_downscale_2x2_float;
+
+static GeglBoxfilterFunc    boxfilter_u8_rgba        = gegl_resample_boxfilter_u8;
+static GeglBoxfilterFunc    boxfilter_u16_rgba       = gegl_resample_boxfilter_u16;
+static GeglBoxfilterFunc    boxfilter_float_rgba     = gegl_resample_boxfilter_float;
+
+void
+gegl_algorithms_init (void)
+{
+  GeglCpuAccelFlags accel = gegl_cpu_accel_get_support ();
+
+#ifdef USE_SSE2
+  if (accel & GEGL_CPU_ACCEL_X86_SSE2)
+    {
+      downscale_2x2_u8_rgba    = gegl_downscale_2x2_u8_sse2;
+      downscale_2x2_u16_rgba   = gegl_downscale_2x2_u16_sse2;
+      downscale_2x2_float_rgba = gegl_downscale_2x2_float_sse2;
+
+      boxfilter_u8_rgba        = gegl_resample_boxfilter_u8_sse2;
+      boxfilter_u16_rgba       = gegl_resample_boxfilter_u16_sse2;
+      boxfilter_float_rgba     = gegl_resample_boxfilter_float_sse2;
+    }
+#endif
+
+#ifdef USE_AVX2
+  if (accel & GEGL_CPU_ACCEL_X86_AVX2)
+    {
+      downscale_2x2_u8_rgba    = gegl_downscale_2x2_u8_avx2;
+      downscale_2x2_u16_rgba   = gegl_downscale_2x2_u16_avx2;
+      downscale_2x2_float_rgba = gegl_downscale_2x2_float_avx2;
+
+      boxfilter_u8_rgba        = gegl_resample_boxfilter_u8_avx2;
+      boxfilter_u16_rgba       = gegl_resample_boxfilter_u16_avx2;
+      boxfilter_float_rgba     = gegl_resample_boxfilter_float_avx2;
+    }
+#endif
+
+  (void) accel;
+}
+
 void gegl_downscale_2x2 (const Babl *format,
                          gint    src_width,
                          gint    src_height,
@@ -42,11 +105,26 @@ void gegl_downscale_2x2 (const Babl *format,
   const Babl *comp_type = babl_format_get_type (format, 0);
 
   if (comp_type == babl_type ("float"))
-    gegl_downscale_2x2_float (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    {
+      if (bpp == 4 * sizeof (gfloat))
+        downscale_2x2_float_rgba (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+      else
+        gegl_downscale_2x2_float (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    }
   else if (comp_type == babl_type ("u8"))
-    gegl_downscale_2x2_u8 (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    {
+      if (bpp == 4 * sizeof (guint8))
+        downscale_2x2_u8_rgba (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+      else
+        gegl_downscale_2x2_u8 (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    }
   else if (comp_type == babl_type ("u16"))
-    gegl_downscale_2x2_u16 (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    {
+      if (bpp == 4 * sizeof (guint16))
+        downscale_2x2_u16_rgba (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+      else
+        gegl_downscale_2x2_u16 (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
+    }
   else if (comp_type == babl_type ("u32"))
     gegl_downscale_2x2_u32 (bpp, src_width, src_height, src_data, src_rowstride, dst_data, dst_rowstride);
   else if (comp_type == babl_type ("double"))
@@ -97,17 +175,35 @@ void gegl_resample_boxfilter (guchar              *dest_buf,
   const gint bpp = babl_format_get_bytes_per_pixel (format);
 
   if (comp_type == babl_type ("u8"))
-    gegl_resample_boxfilter_u8 (dest_buf, source_buf, dst_rect, src_rect,
-                                s_rowstride, scale, bpp, d_rowstride);
+    {
+      if (bpp == 4 * sizeof (guint8))
+        boxfilter_u8_rgba (dest_buf, source_buf, dst_rect, src_rect,
+                           s_rowstride, scale, bpp, d_rowstride);
+      else
+        gegl_resample_boxfilter_u8 (dest_buf, source_buf, dst_rect, src_rect,
+                                    s_rowstride, scale, bpp, d_rowstride);
+    }
   else if (comp_type == babl_type ("u16"))
-    gegl_resample_boxfilter_u16 (dest_buf, source_buf, dst_rect, src_rect,
-                                 s_rowstride, scale, bpp, d_rowstride);
+    {
+      if (bpp == 4 * sizeof (guint16))
+        boxfilter_u16_rgba (dest_buf, source_buf, dst_rect, src_rect,
+                            s_rowstride, scale, bpp, d_rowstride);
+      else
+        gegl_resample_boxfilter_u16 (dest_buf, source_buf, dst_rect, src_rect,
+                                     s_rowstride, scale, bpp, d_rowstride);
+    }
   else if (comp_type == babl_type ("u32"))
     gegl_resample_boxfilter_u32 (dest_buf, source_buf, dst_rect, src_rect,
                                  s_rowstride, scale, bpp, d_rowstride);
   else if (comp_type == babl_type ("float"))
-    gegl_resample_boxfilter_float (dest_buf, source_buf, dst_rect, src_rect,
-                                   s_rowstride, scale, bpp, d_rowstride);
+    {
+      if (bpp == 4 * sizeof (gfloat))
+        boxfilter_float_rgba (dest_buf, source_buf, dst_rect, src_rect,
+                              s_rowstride, scale, bpp, d_rowstride);
+      else
+        gegl_resample_boxfilter_float (dest_buf, source_buf, dst_rect, src_rect,
+                                       s_rowstride, scale, bpp, d_rowstride);
+    }
   else if (comp_type == babl_type ("double"))
     gegl_resample_boxfilter_double (dest_buf, source_buf, dst_rect, src_rect,
                                     s_rowstride, scale, bpp, d_rowstride);
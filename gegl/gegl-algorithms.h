@@ -23,6 +23,11 @@ G_BEGIN_DECLS
 
 #define GEGL_SCALE_EPSILON 1.e-6
 
+/* Pick the fastest versions of the functions below for this CPU, called
+ * once from gegl_init ().
+ */
+void gegl_algorithms_init (void);
+
 void gegl_downscale_2x2 (const Babl *format,
                          gint    src_width,
                          gint    src_height,
@@ -146,6 +151,113 @@ void gegl_resample_nearest (guchar              *dst,
                             gint                 bpp,
                             gint                 dst_stride);
 
+/* SIMD versions of the functions above for pixels of four components */
+#ifdef USE_SSE2
+void gegl_downscale_2x2_float_sse2 (gint    bpp,
+                                    gint    src_width,
+                                    gint    src_height,
+                                    guchar *src_data,
+                                    gint    src_rowstride,
+                                    guchar *dst_data,
+                                    gint    dst_rowstride);
+
+void gegl_downscale_2x2_u16_sse2 (gint    bpp,
+                                  gint    src_width,
+                                  gint    src_height,
+                                  guchar *src_data,
+                                  gint    src_rowstride,
+                                  guchar *dst_data,
+                                  gint    dst_rowstride);
+
+void gegl_downscale_2x2_u8_sse2 (gint    bpp,
+                                 gint    src_width,
+                                 gint    src_height,
+                                 guchar *src_data,
+                                 gint    src_rowstride,
+                                 guchar *dst_data,
+                                 gint    dst_rowstride);
+
+void gegl_resample_boxfilter_float_sse2 (guchar              *dest_buf,
+                                         const guchar        *source_buf,
+                                         const GeglRectangle *dst_rect,
+                                         const GeglRectangle *src_rect,
+                                         gint                 s_rowstride,
+                                         gdouble              scale,
+                                         gint                 bpp,
+                                         gint                 d_rowstride);
+
+void gegl_resample_boxfilter_u16_sse2 (guchar              *dest_buf,
+                                       const guchar        *source_buf,
+                                       const GeglRectangle *dst_rect,
+                                       const GeglRectangle *src_rect,
+                                       gint                 s_rowstride,
+                                       gdouble              scale,
+                                       gint                 bpp,
+                                       gint                 d_rowstride);
+
+void gegl_resample_boxfilter_u8_sse2 (guchar              *dest_buf,
+                                      const guchar        *source_buf,
+                                      const GeglRectangle *dst_rect,
+                                      const GeglRectangle *src_rect,
+                                      gint                 s_rowstride,
+                                      gdouble              scale,
+                                      gint                 bpp,
+                                      gint                 d_rowstride);
+#endif
+
+#ifdef USE_AVX2
+void gegl_downscale_2x2_float_avx2 (gint    bpp,
+                                    gint    src_width,
+                                    gint    src_height,
+                                    guchar *src_data,
+                                    gint    src_rowstride,
+                                    guchar *dst_data,
+                                    gint    dst_rowstride);
+
+void gegl_downscale_2x2_u16_avx2 (gint    bpp,
+                                  gint    src_width,
+                                  gint    src_height,
+                                  guchar *src_data,
+                                  gint    src_rowstride,
+                                  guchar *dst_data,
+                                  gint    dst_rowstride);
+
+void gegl_downscale_2x2_u8_avx2 (gint    bpp,
+                                 gint    src_width,
+                                 gint    src_height,
+                                 guchar *src_data,
+                                 gint    src_rowstride,
+                                 guchar *dst_data,
+                                 gint    dst_rowstride);
+
+void gegl_resample_boxfilter_float_avx2 (guchar              *dest_buf,
+                                         const guchar        *source_buf,
+                                         const GeglRectangle *dst_rect,
+                                         const GeglRectangle *src_rect,
+                                         gint                 s_rowstride,
+                                         gdouble              scale,
+                                         gint                 bpp,
+                                         gint                 d_rowstride);
+
+void gegl_resample_boxfilter_u16_avx2 (guchar              *dest_buf,
+                                       const guchar        *source_buf,
+                                       const GeglRectangle *dst_rect,
+                                       const GeglRectangle *src_rect,
+                                       gint                 s_rowstride,
+                                       gdouble              scale,
+                                       gint                 bpp,
+                                       gint                 d_rowstride);
+
+void gegl_resample_boxfilter_u8_avx2 (guchar              *dest_buf,
+                                      const guchar        *source_buf,
+                                      const GeglRectangle *dst_rect,
+                                      const GeglRectangle *src_rect,
+                                      gint                 s_rowstride,
+                                      gdouble              scale,
+                                      gint                 bpp,
+                                      gint                 d_rowstride);
+#endif
+
 G_END_DECLS
 
 #endif /* __GEGL_ALGORITHMS_H__ */
\ No newline at end of file
@@ -38,6 +38,7 @@ enum
   PROP_0,
   PROP_QUALITY,
   PROP_TILE_CACHE_SIZE,
+  PROP_COMPRESSED_CACHE_SIZE,
   PROP_CHUNK_SIZE,
   PROP_SWAP,
   PROP_TILE_WIDTH,
@@ -45,6 +46,11 @@ enum
   PROP_THREADS,
   PROP_USE_OPENCL,
   PROP_QUEUE_SIZE,
+  PROP_SWAP_WRITERS,
+  PROP_SWAP_READ_AHEAD,
+  PROP_ITERATOR_PREFETCH,
+  PROP_COMPRESSION,
+  PROP_SAVE_COMPRESSION,
   PROP_APPLICATION_LICENSE
 };
 
@@ -64,6 +70,10 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_uint64 (value, config->tile_cache_size);
         break;
 
+      case PROP_COMPRESSED_CACHE_SIZE:
+        g_value_set_uint64 (value, config->compressed_cache_size);
+        break;
+
       case PROP_CHUNK_SIZE:
         g_value_set_int (value, config->chunk_size);
         break;
@@ -96,6 +106,26 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_int (value, config->queue_size);
         break;
 
+      case PROP_SWAP_WRITERS:
+        g_value_set_int (value, config->swap_writers);
+        break;
+
+      case PROP_SWAP_READ_AHEAD:
+        g_value_set_int (value, config->swap_read_ahead);
+        break;
+
+      case PROP_ITERATOR_PREFETCH:
+        g_value_set_int (value, config->iterator_prefetch);
+        break;
+
+      case PROP_COMPRESSION:
+        g_value_set_string (value, config->compression);
+        break;
+
+      case PROP_SAVE_COMPRESSION:
+        g_value_set_string (value, config->save_compression);
+        break;
+
       case PROP_APPLICATION_LICENSE:
         g_value_set_string (value, config->application_license);
         break;
@@ -119,6 +149,9 @@ gegl_config_set_property (GObject      *gobject,
       case PROP_TILE_CACHE_SIZE:
         config->tile_cache_size = g_value_get_uint64 (value);
         break;
+      case PROP_COMPRESSED_CACHE_SIZE:
+        config->compressed_cache_size = g_value_get_uint64 (value);
+        break;
       case PROP_CHUNK_SIZE:
         config->chunk_size = g_value_get_int (value);
         break;
@@ -145,6 +178,25 @@ gegl_config_set_property (GObject      *gobject,
       case PROP_QUEUE_SIZE:
         config->queue_size = g_value_get_int (value);
         break;
+      case PROP_SWAP_WRITERS:
+        config->swap_writers = g_value_get_int (value);
+        break;
+      case PROP_SWAP_READ_AHEAD:
+        config->swap_read_ahead = g_value_get_int (value);
+        break;
+      case PROP_ITERATOR_PREFETCH:
+        config->iterator_prefetch = g_value_get_int (value);
+        break;
+      case PROP_COMPRESSION:
+        if (config->compression)
+          g_free (config->compression);
+        config->compression = g_value_dup_string (value);
+        break;
+      case PROP_SAVE_COMPRESSION:
+        if (config->save_compression)
+          g_free (config->save_compression);
+        config->save_compression = g_value_dup_string (value);
+        break;
       case PROP_APPLICATION_LICENSE:
         if (config->application_license)
           g_free (config->application_license);
@@ -164,6 +216,12 @@ gegl_config_finalize (GObject *gobject)
   if (config->swap)
     g_free (config->swap);
 
+  if (config->compression)
+    g_free (config->compression);
+
+  if (config->save_compression)
+    g_free (config->save_compression);
+
   G_OBJECT_CLASS (gegl_config_parent_class)->finalize (gobject);
 }
 
@@ -203,6 +261,14 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_CONSTRUCT));
 
+  g_object_class_install_property (gobject_class, PROP_COMPRESSED_CACHE_SIZE,
+                                   g_param_spec_uint64 ("compressed-cache-size",
+                                                        "Compressed cache size",
+                                                        "size in bytes of the in-memory store of compressed tiles evicted from the tile cache, 0 disables it",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT));
+
   g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
                                    g_param_spec_int ("chunk-size",
                                                      "Chunk size",
@@ -231,7 +297,7 @@ gegl_config_class_init (GeglConfigClass *klass)
                                    g_param_spec_int ("threads",
                                                      "Number of threads",
                                                      "Number of concurrent evaluation threads",
-                                                     0, 16, 1,
+                                                     0, G_MAXINT, 1,
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT));
 
@@ -251,6 +317,46 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT));
 
+  g_object_class_install_property (gobject_class, PROP_SWAP_WRITERS,
+                                   g_param_spec_int ("swap-writers",
+                                                     "Swap writers",
+                                                     "Number of threads writing tiles to the swap file",
+                                                     1, 64, 1,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_SWAP_READ_AHEAD,
+                                   g_param_spec_int ("swap-read-ahead",
+                                                     "Swap read-ahead",
+                                                     "Number of tiles read from the swap file ahead of a sequential or strided access pattern, 0 disables read-ahead",
+                                                     0, 256, 8,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_ITERATOR_PREFETCH,
+                                   g_param_spec_int ("iterator-prefetch",
+                                                     "Iterator prefetch",
+                                                     "Number of tiles a buffer iterator requests ahead of the one being processed, 0 disables prefetching",
+                                                     0, 16, 2,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION,
+                                   g_param_spec_string ("compression",
+                                                        "Compression",
+                                                        "The codec compressing tiles, one of nop, rle, delta or lz, NULL picks one for the format of the tiles",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_SAVE_COMPRESSION,
+                                   g_param_spec_string ("save-compression",
+                                                        "Save compression",
+                                                        "The codec compressing the tiles of saved buffers, one of nop, rle, delta or lz, auto picks one for the format of the buffer",
+                                                        "nop",
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT));
+
   g_object_class_install_property (gobject_class, PROP_APPLICATION_LICENSE,
                                    g_param_spec_string ("application-license",
                                                         "Application license",
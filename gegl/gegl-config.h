@@ -37,12 +37,18 @@ struct _GeglConfig
 
   gchar   *swap;
   guint64  tile_cache_size;
+  guint64  compressed_cache_size;
   gint     chunk_size; /* The size of elements being processed at once */
   gdouble  quality;
   gint     tile_width;
   gint     tile_height;
   gboolean use_opencl;
   gint     queue_size;
+  gint     swap_writers;
+  gint     swap_read_ahead;
+  gint     iterator_prefetch;
+  gchar   *compression;
+  gchar   *save_compression;
   gchar   *application_license;
 };
 
@@ -54,8 +60,6 @@ struct _GeglConfigClass
 extern gint _gegl_threads;
 #define gegl_config_threads()  (_gegl_threads)
 
-#define GEGL_MAX_THREADS 16
-
 G_END_DECLS
 
 #endif
@@ -115,7 +115,15 @@ enum
 
 enum
 {
-  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0
+  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0,
+  ARCH_X86_INTEL_FEATURE_OSXSAVE  = 1 << 27,
+  ARCH_X86_INTEL_FEATURE_AVX      = 1 << 28
+};
+
+/* in ebx of leaf 7 */
+enum
+{
+  ARCH_X86_INTEL_FEATURE_AVX2     = 1 << 5
 };
 
 #if !defined(ARCH_X86_64) && (defined(PIC) || defined(__PIC__))
@@ -128,6 +136,15 @@ enum
              "=c" (ecx),           \
              "=d" (edx)            \
            : "0" (op))
+#define cpuid_count(op,count,eax,ebx,ecx,edx) \
+  __asm__ ("movl %%ebx, %%esi\n\t"             \
+           "cpuid\n\t"                         \
+           "xchgl %%ebx,%%esi"                 \
+           : "=a" (eax),                       \
+             "=S" (ebx),                       \
+             "=c" (ecx),                       \
+             "=d" (edx)                        \
+           : "0" (op), "2" (count))
 #else
 #define cpuid(op,eax,ebx,ecx,edx)  \
   __asm__ ("cpuid"                 \
@@ -136,6 +153,13 @@ enum
              "=c" (ecx),           \
              "=d" (edx)            \
            : "0" (op))
+#define cpuid_count(op,count,eax,ebx,ecx,edx) \
+  __asm__ ("cpuid"                             \
+           : "=a" (eax),                       \
+             "=b" (ebx),                       \
+             "=c" (ecx),                       \
+             "=d" (edx)                        \
+           : "0" (op), "2" (count))
 #endif
 
 
@@ -235,6 +259,33 @@ arch_accel_intel (void)
 
     if (ecx & ARCH_X86_INTEL_FEATURE_PNI)
       caps |= GEGL_CPU_ACCEL_X86_SSE3;
+
+#ifdef USE_AVX2
+    /* AVX2 also needs the OS to save the upper halves of the ymm
+     * registers, which it tells in XCR0
+     */
+    if ((ecx & ARCH_X86_INTEL_FEATURE_OSXSAVE) &&
+        (ecx & ARCH_X86_INTEL_FEATURE_AVX))
+      {
+        guint32 max_leaf;
+        guint32 xcr0_lo, xcr0_hi;
+
+        /* xgetbv, spelled out for assemblers that do not know it */
+        __asm__ (".byte 0x0f, 0x01, 0xd0"
+                 : "=a" (xcr0_lo), "=d" (xcr0_hi)
+                 : "c" (0));
+
+        cpuid (0, max_leaf, ebx, ecx, edx);
+
+        if ((xcr0_lo & 0x6) == 0x6 && max_leaf >= 7)
+          {
+            cpuid_count (7, 0, eax, ebx, ecx, edx);
+
+            if (ebx & ARCH_X86_INTEL_FEATURE_AVX2)
+              caps |= GEGL_CPU_ACCEL_X86_AVX2;
+          }
+      }
+#endif /* USE_AVX2 */
 #endif /* USE_SSE */
   }
 #endif /* USE_MMX */
@@ -400,7 +451,8 @@ arch_accel (void)
 
 #ifdef USE_SSE
   if ((caps & GEGL_CPU_ACCEL_X86_SSE) && !arch_accel_sse_os_support ())
-    caps &= ~(GEGL_CPU_ACCEL_X86_SSE | GEGL_CPU_ACCEL_X86_SSE2);
+    caps &= ~(GEGL_CPU_ACCEL_X86_SSE | GEGL_CPU_ACCEL_X86_SSE2 |
+              GEGL_CPU_ACCEL_X86_AVX2);
 #endif
 
   return caps;
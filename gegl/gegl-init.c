@@ -73,11 +73,13 @@ pid_is_running (gint pid)
 
 #include <sys/types.h>
 #include <signal.h>
+#include <errno.h>
 
 static inline gboolean
 pid_is_running (gint pid)
 {
-  return (kill (pid, 0) == 0);
+  /* EPERM means the process exists, but belongs to another user */
+  return (kill (pid, 0) == 0 || errno == EPERM);
 }
 #endif
 
@@ -88,6 +90,7 @@ guint gegl_debug_flags = 0;
 
 #include "gegl-types.h"
 #include "gegl-types-internal.h"
+#include "gegl-algorithms.h"
 #include "gegl-instrument.h"
 #include "gegl-init.h"
 #include "gegl-init-private.h"
@@ -100,10 +103,17 @@ guint gegl_debug_flags = 0;
 #include "buffer/gegl-buffer-private.h"
 #include "buffer/gegl-buffer-iterator-private.h"
 #include "buffer/gegl-tile-backend-ram.h"
+#include "buffer/gegl-tile-backend-mmap.h"
 #include "buffer/gegl-tile-backend-file.h"
+#include "buffer/gegl-tile-alloc.h"
+#include "buffer/gegl-tile-handler-compress.h"
+#include "buffer/gegl-tile-backend-swap.h"
 #include "gegl-config.h"
 #include "graph/gegl-node-private.h"
+#include "operation/gegl-operation-chunks.h"
+#include "process/gegl-point-chain.h"
 #include "gegl-random-private.h"
+#include "gegl-scheduler.h"
 
 static gboolean  gegl_post_parse_hook (GOptionContext *context,
                                        GOptionGroup   *group,
@@ -124,7 +134,8 @@ static gchar        *swap_dir = NULL;
 static void
 gegl_init_swap_dir (void)
 {
-  gchar *swapdir = NULL;
+  gchar    *swapdir  = NULL;
+  gboolean  use_mmap = FALSE;
 
   if (config->swap)
     {
@@ -134,7 +145,16 @@ gegl_init_swap_dir (void)
         }
       else
         {
-          swapdir = g_strstrip (g_strdup (config->swap));
+          /* "mmap:<dir>" maps the tiles of buffers from files in dir */
+          if (gegl_tile_backend_mmap_parse_location (config->swap, &swapdir))
+            use_mmap = TRUE;
+          else
+            swapdir = g_strdup (config->swap);
+        }
+
+      if (swapdir)
+        {
+          g_strstrip (swapdir);
 
           /* Remove any trailing separator, unless the path is only made of a leading separator. */
           while (strlen (swapdir) > strlen (G_DIR_SEPARATOR_S) && g_str_has_suffix (swapdir, G_DIR_SEPARATOR_S))
@@ -150,7 +170,18 @@ gegl_init_swap_dir (void)
       swapdir = NULL;
     }
 
-  g_object_set (config, "swap", swapdir, NULL);
+  if (use_mmap)
+    {
+      gchar *location = swapdir ? g_strconcat ("mmap:", swapdir, NULL)
+                                : g_strdup ("mmap");
+
+      g_object_set (config, "swap", location, NULL);
+      g_free (location);
+    }
+  else
+    {
+      g_object_set (config, "swap", swapdir, NULL);
+    }
 
   swap_dir = swapdir;
 
@@ -343,6 +374,25 @@ static void gegl_config_parse_env (GeglConfig *config)
   if (g_getenv ("GEGL_CACHE_SIZE"))
     config->tile_cache_size = atoll(g_getenv("GEGL_CACHE_SIZE"))* 1024*1024;
 
+  if (g_getenv ("GEGL_COMPRESSED_CACHE_SIZE"))
+    config->compressed_cache_size =
+      atoll(g_getenv("GEGL_COMPRESSED_CACHE_SIZE"))* 1024*1024;
+
+  if (g_getenv ("GEGL_SWAP_WRITERS"))
+    config->swap_writers = atoi(g_getenv("GEGL_SWAP_WRITERS"));
+
+  if (g_getenv ("GEGL_SWAP_READ_AHEAD"))
+    config->swap_read_ahead = atoi(g_getenv("GEGL_SWAP_READ_AHEAD"));
+
+  if (g_getenv ("GEGL_ITERATOR_PREFETCH"))
+    config->iterator_prefetch = atoi(g_getenv("GEGL_ITERATOR_PREFETCH"));
+
+  if (g_getenv ("GEGL_COMPRESSION"))
+    g_object_set (config, "compression", g_getenv ("GEGL_COMPRESSION"), NULL);
+
+  if (g_getenv ("GEGL_SAVE_COMPRESSION"))
+    g_object_set (config, "save-compression", g_getenv ("GEGL_SAVE_COMPRESSION"), NULL);
+
   if (g_getenv ("GEGL_CHUNK_SIZE"))
     config->chunk_size = atoi(g_getenv("GEGL_CHUNK_SIZE"));
 
@@ -359,11 +409,11 @@ static void gegl_config_parse_env (GeglConfig *config)
     {
       _gegl_threads = atoi(g_getenv("GEGL_THREADS"));
 
-      if (_gegl_threads > GEGL_MAX_THREADS)
+      if (_gegl_threads > (gint) g_get_num_processors ())
         {
-          g_warning ("Tried to use %i threads, max is %i",
-                     _gegl_threads, GEGL_MAX_THREADS);
-          _gegl_threads = GEGL_MAX_THREADS;
+          g_warning ("Tried to use %i threads, the machine has %i processors",
+                     _gegl_threads, g_get_num_processors ());
+          _gegl_threads = g_get_num_processors ();
         }
     }
 
@@ -411,16 +461,20 @@ static void swap_clean (void)
 
   if (dir != NULL)
     {
-      GPatternSpec *pattern = g_pattern_spec_new ("*");
+      /* only consider files named <pid>-*.swap like the ones we create,
+       * the swap directory may be shared with other files
+       */
+      GPatternSpec *pattern = g_pattern_spec_new ("*-*.swap");
       const gchar  *name;
 
       while ((name = g_dir_read_name (dir)) != NULL)
         {
-          if (g_pattern_match_string (pattern, name))
+          if (g_ascii_isdigit (name[0]) &&
+              g_pattern_match_string (pattern, name))
             {
               gint readpid = atoi (name);
 
-              if (!pid_is_running (readpid))
+              if (readpid > 0 && !pid_is_running (readpid))
                 {
                   gchar *fname = g_build_filename (gegl_swap_dir (),
                                                    name,
@@ -451,6 +505,7 @@ gegl_exit (void)
 
   gegl_tile_backend_swap_cleanup ();
   gegl_tile_cache_destroy ();
+  gegl_tile_uniform_cleanup ();
   gegl_operation_gtype_cleanup ();
   gegl_extension_handler_cleanup ();
   gegl_random_cleanup ();
@@ -473,7 +528,15 @@ gegl_exit (void)
     {
       gegl_buffer_stats ();
       gegl_tile_backend_ram_stats ();
+      gegl_tile_backend_mmap_stats ();
       gegl_tile_backend_file_stats ();
+      gegl_tile_alloc_stats ();
+      gegl_tile_handler_compress_stats ();
+      gegl_tile_backend_swap_stats ();
+      gegl_buffer_iterator_stats ();
+      gegl_scheduler_stats ();
+      gegl_operation_chunks_stats ();
+      gegl_point_chains_stats ();
     }
   global_time = gegl_ticks () - global_time;
   gegl_instrument ("gegl", "gegl", global_time);
@@ -493,6 +556,7 @@ gegl_exit (void)
 #endif
     }
   gegl_tile_cache_destroy ();
+  gegl_tile_alloc_cleanup ();
 
   if (gegl_swap_dir ())
     {
@@ -578,6 +642,8 @@ gegl_post_parse_hook (GOptionContext *context,
 
   babl_init ();
 
+  gegl_algorithms_init ();
+
 #ifdef GEGL_ENABLE_DEBUG
   {
     const char *env_string;
@@ -0,0 +1,308 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The threads doing the parallel work of GEGL.
+ *
+ * There is one worker thread less than gegl_config_threads (), the thread
+ * waiting for a group of tasks being the last one. Each worker has a deque
+ * of tasks: it pushes and pops the tasks it creates at the tail, while the
+ * other threads steal from the head. Threads that are not workers push to
+ * a deque they share. A thread waiting for a group runs queued tasks until
+ * the group is done, so tasks pushing and waiting for tasks of their own
+ * do not need more threads.
+ *
+ * Workers are added when gegl_config_threads () is raised, but never
+ * stopped; with fewer threads configured, fewer tasks are pushed.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gegl-config.h"
+#include "gegl-scheduler.h"
+
+typedef struct Task
+{
+  GeglTaskFunc   func;
+  gpointer       data;
+  GeglTaskGroup *group;
+} Task;
+
+typedef struct Deque
+{
+  GMutex mutex;
+  GQueue tasks;
+} Deque;
+
+/* the deques of the workers, replaced by a larger copy when workers are
+ * added, the old ones being kept for the threads still looking through them
+ */
+typedef struct Workers
+{
+  gint   n;
+  Deque *deques[];
+} Workers;
+
+static Workers   no_workers = {0, };
+static Workers  *workers    = &no_workers;
+static GMutex    workers_mutex;
+static Deque     shared;    /* for the threads that are not workers */
+static GPrivate  own_deque;
+
+/* the tasks in all the deques, and the threads sleeping until there are
+ * some, or until a group is done
+ */
+static gint      queued;
+static GMutex    sleep_mutex;
+static GCond     sleep_cond;
+
+static gint      tasks_run;
+static gint      tasks_stolen;
+static gint      sleeps;
+
+static Task *
+deque_pop (Deque *deque)
+{
+  Task *task;
+
+  g_mutex_lock (&deque->mutex);
+  task = g_queue_pop_tail (&deque->tasks);
+  g_mutex_unlock (&deque->mutex);
+
+  return task;
+}
+
+static Task *
+deque_steal (Deque *deque)
+{
+  Task *task;
+
+  g_mutex_lock (&deque->mutex);
+  task = g_queue_pop_head (&deque->tasks);
+  g_mutex_unlock (&deque->mutex);
+
+  return task;
+}
+
+/* the last task the thread pushed, else the oldest one of another thread */
+static Task *
+find_task (Deque *own)
+{
+  static gint  next_victim = 0;
+  Workers     *current;
+  Task        *task        = NULL;
+  gint         first;
+  gint         i;
+
+  if (g_atomic_int_get (&queued) == 0)
+    return NULL;
+
+  if (own)
+    task = deque_pop (own);
+
+  if (!task)
+    {
+      current = g_atomic_pointer_get (&workers);
+      first   = g_atomic_int_add (&next_victim, 1);
+
+      for (i = 0; i <= current->n && !task; i++)
+        {
+          guint  victim = (guint) (first + i) % (current->n + 1);
+          Deque *deque  = victim < current->n ? current->deques[victim]
+                                              : &shared;
+
+          if (deque != own)
+            task = deque_steal (deque);
+        }
+
+      if (task && own)
+        g_atomic_int_inc (&tasks_stolen);
+    }
+
+  if (task)
+    g_atomic_int_add (&queued, -1);
+
+  return task;
+}
+
+static void
+run_task (Task *task)
+{
+  GeglTaskGroup *group = task->group;
+
+  task->func (task->data);
+  g_slice_free (Task, task);
+
+  g_atomic_int_inc (&tasks_run);
+
+  /* the group can be gone as soon as its count reaches zero */
+  if (g_atomic_int_dec_and_test (&group->pending))
+    {
+      g_mutex_lock (&sleep_mutex);
+      g_cond_broadcast (&sleep_cond);
+      g_mutex_unlock (&sleep_mutex);
+    }
+}
+
+static gpointer
+worker_main (gpointer data)
+{
+  Deque *own = data;
+
+  g_private_set (&own_deque, own);
+
+  while (TRUE)
+    {
+      Task *task = find_task (own);
+
+      if (task)
+        {
+          run_task (task);
+          continue;
+        }
+
+      g_mutex_lock (&sleep_mutex);
+      while (g_atomic_int_get (&queued) == 0)
+        {
+          g_atomic_int_inc (&sleeps);
+          g_cond_wait (&sleep_cond, &sleep_mutex);
+        }
+      g_mutex_unlock (&sleep_mutex);
+    }
+
+  return NULL;
+}
+
+/* as many workers as there are configured threads but one */
+static void
+add_workers (void)
+{
+  gint     wanted = gegl_config_threads () - 1;
+  Workers *current;
+  gint     i;
+
+  if (g_atomic_pointer_get (&workers)->n >= wanted)
+    return;
+
+  g_mutex_lock (&workers_mutex);
+
+  if (workers->n < wanted)
+    {
+      current = g_malloc (sizeof (Workers) + wanted * sizeof (Deque *));
+      current->n = wanted;
+
+      for (i = 0; i < workers->n; i++)
+        current->deques[i] = workers->deques[i];
+
+      for (; i < wanted; i++)
+        {
+          current->deques[i] = g_new0 (Deque, 1);
+          g_mutex_init (&current->deques[i]->mutex);
+          g_queue_init (&current->deques[i]->tasks);
+        }
+
+      for (i = workers->n; i < wanted; i++)
+        g_thread_unref (g_thread_new ("gegl-worker", worker_main,
+                                      current->deques[i]));
+
+      g_atomic_pointer_set (&workers, current);
+    }
+
+  g_mutex_unlock (&workers_mutex);
+}
+
+static Deque *
+get_own_deque (void)
+{
+  Deque *own;
+
+  add_workers ();
+
+  own = g_private_get (&own_deque);
+
+  return own ? own : &shared;
+}
+
+void
+gegl_task_group_init (GeglTaskGroup *group)
+{
+  group->pending = 0;
+}
+
+void
+gegl_task_group_push (GeglTaskGroup *group,
+                      GeglTaskFunc   func,
+                      gpointer       data)
+{
+  Deque *deque = get_own_deque ();
+  Task  *task  = g_slice_new (Task);
+
+  task->func  = func;
+  task->data  = data;
+  task->group = group;
+
+  g_atomic_int_inc (&group->pending);
+
+  g_mutex_lock (&deque->mutex);
+  g_queue_push_tail (&deque->tasks, task);
+  g_mutex_unlock (&deque->mutex);
+
+  g_atomic_int_inc (&queued);
+
+  g_mutex_lock (&sleep_mutex);
+  g_cond_signal (&sleep_cond);
+  g_mutex_unlock (&sleep_mutex);
+}
+
+void
+gegl_task_group_wait (GeglTaskGroup *group)
+{
+  Deque *own;
+
+  if (g_atomic_int_get (&group->pending) == 0)
+    return;
+
+  own = g_private_get (&own_deque);
+
+  while (g_atomic_int_get (&group->pending))
+    {
+      Task *task = find_task (own ? own : &shared);
+
+      if (task)
+        {
+          run_task (task);
+          continue;
+        }
+
+      /* the remaining tasks of the group are running in other threads */
+      g_mutex_lock (&sleep_mutex);
+      while (g_atomic_int_get (&group->pending) &&
+             g_atomic_int_get (&queued) == 0)
+        g_cond_wait (&sleep_cond, &sleep_mutex);
+      g_mutex_unlock (&sleep_mutex);
+    }
+}
+
+void
+gegl_scheduler_stats (void)
+{
+  g_warning ("Scheduler: workers:%i tasks:%i stolen:%i sleeps:%i",
+             g_atomic_pointer_get (&workers)->n,
+             g_atomic_int_get (&tasks_run),
+             g_atomic_int_get (&tasks_stolen),
+             g_atomic_int_get (&sleeps));
+}
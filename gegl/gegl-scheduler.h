@@ -0,0 +1,56 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_SCHEDULER_H__
+#define __GEGL_SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*GeglTaskFunc) (gpointer data);
+
+typedef struct _GeglTaskGroup GeglTaskGroup;
+
+/* a set of tasks waited for together, usually on the stack of the thread
+ * pushing them
+ */
+struct _GeglTaskGroup
+{
+  /*< private >*/
+  gint pending;
+};
+
+void gegl_task_group_init (GeglTaskGroup *group);
+
+/* queues func (data) to be run by one of the threads of the scheduler, or
+ * by a thread waiting for a group
+ */
+void gegl_task_group_push (GeglTaskGroup *group,
+                           GeglTaskFunc   func,
+                           gpointer       data);
+
+/* returns once all the tasks of the group are done, running queued tasks
+ * in the meantime, so that nested waits do not take a thread out of the
+ * scheduler
+ */
+void gegl_task_group_wait (GeglTaskGroup *group);
+
+void gegl_scheduler_stats (void);
+
+G_END_DECLS
+
+#endif /* __GEGL_SCHEDULER_H__ */
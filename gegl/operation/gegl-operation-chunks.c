@@ -0,0 +1,288 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Threaded processing of a result in tile aligned chunks.
+ *
+ * The result is cut along the tile grid of the output buffer, so no two
+ * threads write to the same tile. The threads taking part pull the next
+ * chunk off a shared counter as soon as they are done with one, a slow
+ * chunk only holding up the thread processing it. A chunk is as many
+ * tiles as the class of the operation processes in about CHUNK_TIME,
+ * judging from its previous runs, but never so many that there are less
+ * than CHUNKS_PER_THREAD chunks for each thread.
+ *
+ * The time each thread spent processing chunks is recorded for every run,
+ * and gegl_operation_chunks_stats () reports how much longer than the
+ * average the busiest thread was, for each class.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-operation.h"
+#include "gegl-operation-chunks.h"
+#include "gegl-config.h"
+#include "gegl-scheduler.h"
+#include "gegl-buffer-private.h"
+
+#define CHUNK_TIME        1000 /* microseconds */
+#define CHUNKS_PER_THREAD 4
+
+typedef struct ChunkClass
+{
+  const gchar *name;
+  gdouble      pixel_time;  /* microseconds, 0 until measured */
+  gint         runs;
+  gint         chunks;
+  gint64       busiest;     /* the sums over the runs of the time of the */
+  gint64       average;     /* busiest thread and the average thread     */
+} ChunkClass;
+
+typedef struct ChunkJob
+{
+  GeglOperation          *operation;
+  GeglOperationChunkFunc  func;
+  gpointer                data;
+  const GeglRectangle    *result;
+
+  GeglRectangle           grid;    /* the tiles covering the result */
+  gint                    tile_width;
+  gint                    tile_height;
+  gint                    offset_x;
+  gint                    offset_y;
+  gint                    chunk_width;   /* in tiles */
+  gint                    chunk_height;
+  gint                    columns;
+  gint                    n_chunks;
+
+  gint                    next_chunk;
+  gint                    next_slot;
+  gint64                 *busy;
+  gint                    success;
+} ChunkJob;
+
+static GMutex      classes_mutex;
+static GHashTable *classes;
+
+static ChunkClass *
+chunk_class (GeglOperation *operation)
+{
+  GType       type = G_OBJECT_TYPE (operation);
+  ChunkClass *klass;
+
+  g_mutex_lock (&classes_mutex);
+
+  if (!classes)
+    classes = g_hash_table_new (NULL, NULL);
+
+  klass = g_hash_table_lookup (classes, GSIZE_TO_POINTER (type));
+  if (!klass)
+    {
+      klass = g_new0 (ChunkClass, 1);
+      klass->name = g_type_name (type);
+      g_hash_table_insert (classes, GSIZE_TO_POINTER (type), klass);
+    }
+
+  g_mutex_unlock (&classes_mutex);
+
+  return klass;
+}
+
+static void
+chunk_rect (ChunkJob      *job,
+            gint           chunk,
+            GeglRectangle *rect)
+{
+  GeglRectangle tiles;
+
+  tiles.x      = (job->grid.x + chunk % job->columns * job->chunk_width) *
+                 job->tile_width - job->offset_x;
+  tiles.y      = (job->grid.y + chunk / job->columns * job->chunk_height) *
+                 job->tile_height - job->offset_y;
+  tiles.width  = job->chunk_width  * job->tile_width;
+  tiles.height = job->chunk_height * job->tile_height;
+
+  gegl_rectangle_intersect (rect, &tiles, job->result);
+}
+
+static void
+chunks_run (gpointer data)
+{
+  ChunkJob *job   = data;
+  gint      slot  = g_atomic_int_add (&job->next_slot, 1);
+  gint64    start = g_get_monotonic_time ();
+  gint      chunk;
+
+  while ((chunk = g_atomic_int_add (&job->next_chunk, 1)) < job->n_chunks)
+    {
+      GeglRectangle rect;
+
+      chunk_rect (job, chunk, &rect);
+
+      if (!job->func (job->operation, &rect, job->data))
+        g_atomic_int_set (&job->success, FALSE);
+    }
+
+  job->busy[slot] = g_get_monotonic_time () - start;
+}
+
+static void
+chunks_record (ChunkClass          *klass,
+               const GeglRectangle *result,
+               const gint64        *busy,
+               gint                 threads,
+               gint                 n_chunks)
+{
+  gint64 total   = 0;
+  gint64 busiest = 0;
+  gint   i;
+
+  for (i = 0; i < threads; i++)
+    {
+      total  += busy[i];
+      busiest = MAX (busiest, busy[i]);
+    }
+
+  g_mutex_lock (&classes_mutex);
+
+  if (total > 0)
+    {
+      gdouble pixel_time = (gdouble) total / result->width / result->height;
+
+      if (klass->pixel_time > 0.0)
+        klass->pixel_time = 0.75 * klass->pixel_time + 0.25 * pixel_time;
+      else
+        klass->pixel_time = pixel_time;
+    }
+
+  klass->runs++;
+  klass->chunks  += n_chunks;
+  klass->busiest += busiest;
+  klass->average += total / threads;
+
+  g_mutex_unlock (&classes_mutex);
+}
+
+gboolean
+gegl_operation_process_chunks (GeglOperation          *operation,
+                               GeglBuffer             *output,
+                               const GeglRectangle    *result,
+                               gint                    level,
+                               GeglOperationChunkFunc  func,
+                               gpointer                data)
+{
+  ChunkClass    *klass   = chunk_class (operation);
+  ChunkJob       job     = {NULL, };
+  GeglTaskGroup  group;
+  gint           threads = gegl_config_threads ();
+  gint           n_tiles;
+  gint           chunk_tiles;
+  gdouble        pixel_time;
+  gint           i;
+
+  if (result->width <= 0 || result->height <= 0)
+    return TRUE;
+
+  job.operation   = operation;
+  job.func        = func;
+  job.data        = data;
+  job.result      = result;
+  job.success     = TRUE;
+  job.tile_width  = output->tile_width;
+  job.tile_height = output->tile_height;
+  /* rounded down, also for negative shifts, to stay on the tile grid */
+  job.offset_x    = gegl_tile_indice (output->shift_x, 1 << level);
+  job.offset_y    = gegl_tile_indice (output->shift_y, 1 << level);
+
+  job.grid.x      = gegl_tile_indice (result->x + job.offset_x, job.tile_width);
+  job.grid.y      = gegl_tile_indice (result->y + job.offset_y, job.tile_height);
+  job.grid.width  = gegl_tile_indice (result->x + result->width - 1 +
+                                      job.offset_x, job.tile_width) -
+                    job.grid.x + 1;
+  job.grid.height = gegl_tile_indice (result->y + result->height - 1 +
+                                      job.offset_y, job.tile_height) -
+                    job.grid.y + 1;
+
+  n_tiles = job.grid.width * job.grid.height;
+
+  g_mutex_lock (&classes_mutex);
+  pixel_time = klass->pixel_time;
+  g_mutex_unlock (&classes_mutex);
+
+  chunk_tiles = 1;
+  if (pixel_time > 0.0)
+    chunk_tiles = CLAMP (CHUNK_TIME / (pixel_time * job.tile_width *
+                                                   job.tile_height),
+                         1, n_tiles);
+  chunk_tiles = MIN (chunk_tiles,
+                     MAX (n_tiles / (threads * CHUNKS_PER_THREAD), 1));
+
+  /* whole rows of chunks, then several rows of tiles */
+  job.chunk_width  = MIN (chunk_tiles, job.grid.width);
+  job.chunk_height = MIN (MAX (chunk_tiles / job.grid.width, 1),
+                          job.grid.height);
+  job.columns      = (job.grid.width + job.chunk_width - 1) / job.chunk_width;
+  job.n_chunks     = job.columns *
+                     ((job.grid.height + job.chunk_height - 1) /
+                      job.chunk_height);
+
+  threads  = MAX (MIN (threads, job.n_chunks), 1);
+  job.busy = g_new0 (gint64, threads);
+
+  gegl_task_group_init (&group);
+  for (i = 1; i < threads; i++)
+    gegl_task_group_push (&group, chunks_run, &job);
+
+  chunks_run (&job);
+  gegl_task_group_wait (&group);
+
+  chunks_record (klass, result, job.busy, threads, job.n_chunks);
+
+  g_free (job.busy);
+
+  return job.success;
+}
+
+void
+gegl_operation_chunks_stats (void)
+{
+  GHashTableIter  iter;
+  gpointer        value;
+
+  g_mutex_lock (&classes_mutex);
+
+  if (classes)
+    {
+      g_hash_table_iter_init (&iter, classes);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          ChunkClass *klass = value;
+
+          /* how much longer the busiest thread took than the average one */
+          g_warning ("Chunks of %s: runs:%i chunks:%i pixel:%.4fus "
+                     "imbalance:%.1f%%",
+                     klass->name, klass->runs, klass->chunks,
+                     klass->pixel_time,
+                     klass->average ? 100.0 * (klass->busiest - klass->average) /
+                                      klass->average
+                                    : 0.0);
+        }
+    }
+
+  g_mutex_unlock (&classes_mutex);
+}
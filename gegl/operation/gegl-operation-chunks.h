@@ -0,0 +1,45 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_OPERATION_CHUNKS_H__
+#define __GEGL_OPERATION_CHUNKS_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* processes the part chunk of the result, returning FALSE on failure */
+typedef gboolean (*GeglOperationChunkFunc) (GeglOperation       *operation,
+                                            const GeglRectangle *chunk,
+                                            gpointer             data);
+
+/* cuts result into chunks along the tile grid of output, and has func
+ * called on them by the threads of the scheduler, each thread taking the
+ * next chunk when done with one. the chunks are sized from the time the
+ * class of operation took per pixel before.
+ */
+gboolean gegl_operation_process_chunks (GeglOperation          *operation,
+                                        GeglBuffer             *output,
+                                        const GeglRectangle    *result,
+                                        gint                    level,
+                                        GeglOperationChunkFunc  func,
+                                        gpointer                data);
+
+void     gegl_operation_chunks_stats   (void);
+
+G_END_DECLS
+
+#endif /* __GEGL_OPERATION_CHUNKS_H__ */
@@ -25,6 +25,7 @@
 #include "gegl-operation-point-composer.h"
 #include "gegl-operation-context.h"
 #include "gegl-config.h"
+#include "gegl-operation-chunks.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
@@ -32,67 +33,44 @@
 typedef struct ThreadData
 {
   GeglOperationPointComposerClass *klass;
-  GeglOperation                   *operation;
-  guchar                          *input;
-  guchar                          *aux;
-  guchar                          *output;
-  gint                            *pending;
-  gint                            *started;
+  GeglBuffer                      *input;
+  GeglBuffer                      *aux;
+  GeglBuffer                      *output;
+  const Babl                      *in_format;
+  const Babl                      *aux_format;
+  const Babl                      *out_format;
   gint                             level;
-  gboolean                         success;
-  GeglRectangle                    roi;
-
-  guchar                          *in_tmp;
-  guchar                          *aux_tmp;
-  guchar                          *output_tmp;
-  const Babl *input_fish;
-  const Babl *aux_fish;
-  const Babl *output_fish;
 } ThreadData;
 
-static void thread_process (gpointer thread_data, gpointer unused)
+/* a tile aligned chunk of the result, the iterator converting to and from
+ * the formats of the operation in the thread processing it
+ */
+static gboolean thread_process (GeglOperation       *operation,
+                                const GeglRectangle *chunk,
+                                gpointer             thread_data)
 {
   ThreadData *data = thread_data;
-
-  guchar *input = data->input;
-  guchar *aux = data->aux;
-  guchar *output = data->output;
-  glong samples = data->roi.width * data->roi.height;
-
-  if (data->input_fish && input)
-    {
-      babl_process (data->input_fish, data->input, data->in_tmp, samples);
-      input = data->in_tmp;
-    }
-  if (data->aux_fish && aux)
+  GeglBufferIterator *i = gegl_buffer_iterator_new (data->output, chunk, data->level, data->out_format,
+                                                    GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gboolean success = TRUE;
+  gint foo = 0, read = 0;
+
+  if (data->input)
+    read = gegl_buffer_iterator_add (i, data->input, chunk, data->level, data->in_format,
+                                     GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  if (data->aux)
+    foo = gegl_buffer_iterator_add (i, data->aux, chunk, data->level, data->aux_format,
+                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (i))
     {
-      babl_process (data->aux_fish, data->aux, data->aux_tmp, samples);
-      aux = data->aux_tmp;
+      if (!data->klass->process (operation, data->input?i->data[read]:NULL,
+                                            data->aux?i->data[foo]:NULL,
+                                            i->data[0], i->length, &(i->roi[0]), data->level))
+        success = FALSE;
     }
-  if (data->output_fish)
-    output = data->output_tmp;
-
-  if (!data->klass->process (data->operation,
-                       input, aux,
-                       output, samples,
-                       &data->roi, data->level))
-    data->success = FALSE;
-  
-  if (data->output_fish)
-    babl_process (data->output_fish, data->output_tmp, data->output, samples);
-
-  g_atomic_int_add (data->pending, -1);
-}
 
-static GThreadPool *thread_pool (void)
-{
-  static GThreadPool *pool = NULL;
-  if (!pool)
-    {
-      pool =  g_thread_pool_new (thread_process, NULL, gegl_config_threads (),
-                                 FALSE, NULL);
-    }
-  return pool;
+  return success;
 }
 
 static gboolean
@@ -212,126 +190,21 @@ gegl_operation_point_composer_process (GeglOperation       *operation,
 
   if ((result->width > 0) && (result->height > 0))
     {
-      const Babl *in_buf_format  = input?gegl_buffer_get_format(input):NULL;
-      const Babl *aux_buf_format = aux?gegl_buffer_get_format(aux):NULL;
-      const Babl *output_buf_format = output?gegl_buffer_get_format(output):NULL;
-
       if (gegl_operation_use_threading (operation, result) && result->height > 1)
       {
-        gint threads = gegl_config_threads ();
-        GThreadPool *pool = thread_pool ();
-        ThreadData thread_data[GEGL_MAX_THREADS];
-        GeglBufferIterator *i = gegl_buffer_iterator_new (output, result, level, output_buf_format,
-                                                          GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-        gint foo = 0, read = 0;
-
-        gint in_bpp = input?babl_format_get_bytes_per_pixel (in_format):0;
-        gint aux_bpp = aux?babl_format_get_bytes_per_pixel (aux_format):0;
-        gint out_bpp = babl_format_get_bytes_per_pixel (out_format);
-
-        gint in_buf_bpp = input?babl_format_get_bytes_per_pixel (in_buf_format):0;
-        gint aux_buf_bpp = aux?babl_format_get_bytes_per_pixel (aux_buf_format):0;
-        gint out_buf_bpp = babl_format_get_bytes_per_pixel (output_buf_format);
-        gint temp_id = 0;
-
-        if (input)
-        {
-          read = gegl_buffer_iterator_add (i, input, result, level, in_buf_format,
-                                           GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-          for (gint j = 0; j < threads; j ++)
-          {
-            if (in_buf_format != in_format)
-            {
-              thread_data[j].input_fish = babl_fish (in_buf_format, in_format);
-              thread_data[j].in_tmp = gegl_temp_buffer (temp_id++, in_bpp * result->width * result->height);
-            }
-            else
-            {
-              thread_data[j].input_fish = NULL;
-            }
-          }
-        }
-        else
-          for (gint j = 0; j < threads; j ++)
-            thread_data[j].input_fish = NULL;
-        if (aux)
-        {
-          foo = gegl_buffer_iterator_add (i, aux, result, level, aux_buf_format,
-                                          GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-          for (gint j = 0; j < threads; j ++)
-          {
-            if (aux_buf_format != aux_format)
-            {
-              thread_data[j].aux_fish = babl_fish (aux_buf_format, aux_format);
-              thread_data[j].aux_tmp = gegl_temp_buffer (temp_id++, aux_bpp * result->width * result->height);
-            }
-            else
-            {
-              thread_data[j].aux_fish = NULL;
-            }
-          }
-        }
-        else
-        {
-          for (gint j = 0; j < threads; j ++)
-            thread_data[j].aux_fish = NULL;
-        }
-
-        for (gint j = 0; j < threads; j ++)
-        {
-          if (output_buf_format != gegl_buffer_get_format (output))
-          {
-            thread_data[j].output_fish = babl_fish (out_format, output_buf_format);
-            thread_data[j].output_tmp = gegl_temp_buffer (temp_id++, out_bpp * result->width * result->height);
-          }
-          else
-          {
-            thread_data[j].output_fish = NULL;
-          }
-        }
-
-        while (gegl_buffer_iterator_next (i))
-          {
-            gint threads = gegl_config_threads ();
-            gint pending;
-            gint bit;
-
-            if (i->roi[0].height < threads)
-            {
-              threads = i->roi[0].height;
-            }
-
-            bit = i->roi[0].height / threads;
-            pending = threads;
-
-            for (gint j = 0; j < threads; j++)
-            {
-              thread_data[j].roi.x = (i->roi[0]).x;
-              thread_data[j].roi.width = (i->roi[0]).width;
-              thread_data[j].roi.y = (i->roi[0]).y + bit * j;
-              thread_data[j].roi.height = bit;
-            }
-            thread_data[threads-1].roi.height = i->roi[0].height - (bit * (threads-1));
-            
-            for (gint j = 0; j < threads; j++)
-            {
-              thread_data[j].klass = point_composer_class;
-              thread_data[j].operation = operation;
-              thread_data[j].input = input?((guchar*)i->data[read]) + (bit * j * i->roi[0].width * in_buf_bpp):NULL;
-              thread_data[j].aux = aux?((guchar*)i->data[foo]) + (bit * j * i->roi[0].width * aux_buf_bpp):NULL;
-              thread_data[j].output = ((guchar*)i->data[0]) + (bit * j * i->roi[0].width * out_buf_bpp);
-              thread_data[j].pending = &pending;
-              thread_data[j].level = level;
-              thread_data[j].success = TRUE;
-            }
-            pending = threads;
-
-            for (gint j = 1; j < threads; j++)
-              g_thread_pool_push (pool, &thread_data[j], NULL);
-            thread_process (&thread_data[0], NULL);
-
-            while (g_atomic_int_get (&pending)) {};
-          }
+        ThreadData data;
+
+        data.klass      = point_composer_class;
+        data.input      = input;
+        data.aux        = aux;
+        data.output     = output;
+        data.in_format  = in_format;
+        data.aux_format = aux_format;
+        data.out_format = out_format;
+        data.level      = level;
+
+        gegl_operation_process_chunks (operation, output, result, level,
+                                       thread_process, &data);
 
         return TRUE;
       }
@@ -769,30 +769,60 @@ gegl_operation_use_threading (GeglOperation *operation,
   return FALSE;
 }
 
-static guchar *gegl_temp_alloc[GEGL_MAX_THREADS * 4]={NULL,};
-static gint    gegl_temp_size[GEGL_MAX_THREADS * 4]={0,};
+typedef struct TempBuffer
+{
+  guchar *data;
+  gint    size;
+} TempBuffer;
+
+/* grown to the highest number asked for, as many threads as configured
+ * may each be using a few
+ */
+static GMutex      gegl_temp_mutex;
+static TempBuffer *gegl_temp_buffers   = NULL;
+static gint        gegl_temp_n_buffers = 0;
 
 guchar *gegl_temp_buffer (int no, int size)
 {
-  if (!gegl_temp_alloc[no] || gegl_temp_size[no] < size)
+  TempBuffer *temp;
+  guchar     *data;
+
+  g_mutex_lock (&gegl_temp_mutex);
+
+  if (no >= gegl_temp_n_buffers)
+  {
+    gint n = MAX (no + 1, gegl_temp_n_buffers * 2);
+
+    gegl_temp_buffers = g_renew (TempBuffer, gegl_temp_buffers, n);
+    memset (gegl_temp_buffers + gegl_temp_n_buffers, 0,
+            (n - gegl_temp_n_buffers) * sizeof (TempBuffer));
+    gegl_temp_n_buffers = n;
+  }
+
+  temp = &gegl_temp_buffers[no];
+  if (!temp->data || temp->size < size)
   {
-    if (gegl_temp_alloc[no])
-      gegl_free (gegl_temp_alloc[no]);
-    gegl_temp_alloc[no] = gegl_malloc (size);
-    gegl_temp_size[no] = size;
+    if (temp->data)
+      gegl_free (temp->data);
+    temp->data = gegl_malloc (size);
+    temp->size = size;
   }
-  return gegl_temp_alloc[no];
+  data = temp->data;
+
+  g_mutex_unlock (&gegl_temp_mutex);
+
+  return data;
 }
 
 void gegl_temp_buffer_free (void);
 void gegl_temp_buffer_free (void)
 {
   int no;
-  for (no = 0; no < GEGL_MAX_THREADS * 4; no++)
-    if (gegl_temp_alloc[no])
-    {
-      gegl_free (gegl_temp_alloc[no]);
-      gegl_temp_alloc[no] = NULL;
-      gegl_temp_size[no] = 0;
-    }
+  for (no = 0; no < gegl_temp_n_buffers; no++)
+    if (gegl_temp_buffers[no].data)
+      gegl_free (gegl_temp_buffers[no].data);
+
+  g_free (gegl_temp_buffers);
+  gegl_temp_buffers   = NULL;
+  gegl_temp_n_buffers = 0;
 }
@@ -25,6 +25,8 @@
 #include "gegl.h"
 #include "gegl-debug.h"
 #include "gegl-instrument.h"
+#include "gegl-config.h"
+#include "gegl-scheduler.h"
 
 #include "buffer/gegl-region.h"
 
@@ -36,6 +38,7 @@
 #include "process/gegl-graph-traversal.h"
 #include "process/gegl-graph-traversal-private.h"
 #include "process/gegl-list-visitor.h"
+#include "process/gegl-point-chain.h"
 
 #include "operation/gegl-operation.h"
 #include "operation/gegl-operation-context.h"
@@ -115,6 +118,9 @@ gegl_graph_rebuild (GeglGraphTraversal *path, GeglNode *node)
   g_list_free (path->dfs_path);
   g_list_free (path->bfs_path);
   g_hash_table_unref (path->contexts);
+  if (path->point_chains)
+    gegl_point_chains_free (path->point_chains);
+  path->point_chains = NULL;
 
   /* Replaces everything but shared_empty */
   _gegl_graph_do_build (path, node);
@@ -126,6 +132,8 @@ gegl_graph_free (GeglGraphTraversal *path)
   g_list_free (path->dfs_path);
   g_list_free (path->bfs_path);
   g_hash_table_unref (path->contexts);
+  if (path->point_chains)
+    gegl_point_chains_free (path->point_chains);
   if (path->shared_empty)
     g_object_unref (path->shared_empty);
 
@@ -201,7 +209,8 @@ gegl_graph_prepare (GeglGraphTraversal *path)
  * 
  * Prepare the graph to render request_roi, this will calculate
  * the area that needs to be rendered from each node in the
- * graph to fulfill this request.
+ * graph to fulfill this request, and find the chains of point
+ * operations that can be processed in a single pass.
  */
 
 void
@@ -317,6 +326,11 @@ gegl_graph_prepare_request (GeglGraphTraversal  *path,
           }
       }
     }
+
+  /* Chains of point operations depend on the rects and on what is cached */
+  if (path->point_chains)
+    gegl_point_chains_free (path->point_chains);
+  path->point_chains = gegl_point_chains_find (path);
 }
 
 void
@@ -365,13 +379,380 @@ gegl_graph_get_shared_empty (GeglGraphTraversal *path)
 }
 
 
+static GeglPointChain *
+gegl_graph_get_point_chain (GeglGraphTraversal *path,
+                            GeglNode           *node)
+{
+  if (!path->point_chains)
+    return NULL;
+
+  return g_hash_table_lookup (path->point_chains, node);
+}
+
+/* whether the context of node is still needed by the chain it is in */
+static gboolean
+gegl_graph_is_chained (GeglGraphTraversal *path,
+                       GeglNode           *node)
+{
+  GeglPointChain *chain = gegl_graph_get_point_chain (path, node);
+
+  return chain && gegl_point_chain_get_last (chain) != node;
+}
+
+/* processes node, returning its output, which is not referenced */
+static GeglBuffer *
+gegl_graph_process_node (GeglGraphTraversal   *path,
+                         GeglNode             *node,
+                         GeglOperationContext *context,
+                         gint                  level)
+{
+  GeglOperation  *operation        = node->operation;
+  GeglBuffer     *operation_result = NULL;
+  GeglPointChain *chain            = gegl_graph_get_point_chain (path, node);
+
+  /* the last node of a chain processes the whole chain */
+  if (chain && gegl_point_chain_get_last (chain) != node)
+    return NULL;
+
+  GEGL_NOTE (GEGL_DEBUG_PROCESS,
+             "Will process %s%s result_rect = %d, %d %d×%d",
+             chain ? "the point chain ending in " : "",
+             gegl_node_get_debug_name (node),
+             context->result_rect.x, context->result_rect.y, context->result_rect.width, context->result_rect.height);
+
+  if (context->need_rect.width > 0 && context->need_rect.height > 0)
+    {
+      if (context->cached)
+        {
+          GEGL_NOTE (GEGL_DEBUG_PROCESS,
+                     "Using cached result for %s",
+                     gegl_node_get_debug_name (node));
+          operation_result = GEGL_BUFFER (node->cache);
+        }
+      else
+        {
+          if (chain)
+            {
+              operation_result = gegl_point_chain_process (chain, gegl_graph_get_shared_empty (path), level);
+            }
+          else
+            {
+              /* Guarantee input pad */
+              if (gegl_node_has_pad (node, "input") &&
+                  !gegl_operation_context_get_object (context, "input"))
+                {
+                  gegl_operation_context_set_object (context, "input", G_OBJECT (gegl_graph_get_shared_empty(path)));
+                }
+
+              context->level = level;
+              gegl_operation_process (operation, context, "output", &context->need_rect, context->level);
+              operation_result = GEGL_BUFFER (gegl_operation_context_get_object (context, "output"));
+            }
+
+          if (operation_result && operation_result == (GeglBuffer *)operation->node->cache)
+            gegl_cache_computed (operation->node->cache, &context->need_rect, level);
+        }
+    }
+
+  return operation_result;
+}
+
+/* hands the output of node to the contexts of the nodes using it */
+static void
+gegl_graph_deliver (GeglGraphTraversal *path,
+                    GeglNode           *node,
+                    GeglBuffer         *operation_result)
+{
+  GeglPad *output_pad = gegl_node_get_pad (node, "output");
+  GList   *targets = gegl_graph_get_connected_output_contexts (path, output_pad);
+  GList   *targets_iter;
+
+  GEGL_NOTE (GEGL_DEBUG_PROCESS,
+             "Will deliver the results of %s:%s to %d targets",
+             gegl_node_get_debug_name (node),
+             "output",
+             g_list_length (targets));
+
+  if (g_list_length (targets) > 1)
+    gegl_object_set_has_forked (G_OBJECT (operation_result));
+
+  for (targets_iter = targets; targets_iter; targets_iter = g_list_next (targets_iter))
+    {
+      ContextConnection *target_con = targets_iter->data;
+      gegl_operation_context_set_object (target_con->context, target_con->name, G_OBJECT (operation_result));
+    }
+
+  g_list_free_full (targets, free_context_connection);
+}
+
+/* Concurrent processing of the branches of a graph.
+ *
+ * A node is ready once all the nodes it takes input from are done, and
+ * ready nodes are processed as tasks of the scheduler, in the order of the
+ * depth first path. A ready node is held back while the outputs of the
+ * nodes running, and of the nodes done whose outputs are still to be used,
+ * would take more than the tile cache, unless nothing is running.
+ * Operations that are not threaded are not safe to run alongside one
+ * another, at most one of them runs at a time while other ready nodes
+ * go ahead.
+ */
+
+typedef struct GraphJob GraphJob;
+
+typedef struct GraphNode
+{
+  GraphJob             *job;
+  GeglNode             *node;
+  GeglOperationContext *context;
+  gint                  index;     /* in the depth first path */
+  gint                  inputs;    /* connections from nodes not done yet */
+  gint                  consumers; /* connections to nodes not done yet */
+  guint64               bytes;     /* an estimate of the size of the output */
+  gboolean              serial;    /* its operation is not threaded */
+  GList                *sources;
+  GList                *targets;
+} GraphNode;
+
+struct GraphJob
+{
+  GeglGraphTraversal *path;
+  gint                level;
+  GraphNode          *nodes;
+  gint                n_nodes;
+  GHashTable         *by_context;
+
+  GMutex              mutex;
+  GeglTaskGroup       group;
+  GQueue              ready;
+  gint                running;
+  gboolean            serial_running;
+  guint64             live;     /* the bytes of the outputs in use */
+  guint64             budget;
+  GeglBuffer         *result;
+};
+
+static void graph_node_process (gpointer data);
+
+static gint
+graph_node_compare (gconstpointer a,
+                    gconstpointer b,
+                    gpointer      user_data)
+{
+  return ((const GraphNode *) a)->index - ((const GraphNode *) b)->index;
+}
+
+/* called with the mutex of the job locked */
+static void
+graph_dispatch (GraphJob *job)
+{
+  GList *link = job->ready.head;
+
+  while (link)
+    {
+      GraphNode *gnode = link->data;
+      GList     *next  = link->next;
+
+      if (gnode->serial && job->serial_running)
+        {
+          link = next;
+          continue;
+        }
+
+      if (job->running > 0 && job->live + gnode->bytes > job->budget)
+        break;
+
+      g_queue_delete_link (&job->ready, link);
+      job->running++;
+      job->live += gnode->bytes;
+      if (gnode->serial)
+        job->serial_running = TRUE;
+      gegl_task_group_push (&job->group, graph_node_process, gnode);
+
+      link = next;
+    }
+}
+
+static void
+graph_node_process (gpointer data)
+{
+  GraphNode  *gnode = data;
+  GraphJob   *job   = gnode->job;
+  GeglBuffer *operation_result;
+  GList      *iter;
+
+  GEGL_INSTRUMENT_START();
+
+  operation_result = gegl_graph_process_node (job->path, gnode->node,
+                                              gnode->context, job->level);
+
+  g_mutex_lock (&job->mutex);
+
+  if (operation_result)
+    gegl_graph_deliver (job->path, gnode->node, operation_result);
+
+  if (gnode->consumers == 0)
+    {
+      /* the last node of the path */
+      if (operation_result)
+        job->result = g_object_ref (operation_result);
+      else if (gegl_node_has_pad (gnode->node, "output"))
+        job->result = g_object_ref (gegl_graph_get_shared_empty (job->path));
+
+      job->live -= gnode->bytes;
+    }
+
+  if (!gegl_graph_is_chained (job->path, gnode->node))
+    gegl_operation_context_purge (gnode->context);
+
+  for (iter = gnode->sources; iter; iter = iter->next)
+    {
+      GraphNode *source = iter->data;
+
+      if (--source->consumers == 0)
+        job->live -= source->bytes;
+    }
+
+  for (iter = gnode->targets; iter; iter = iter->next)
+    {
+      GraphNode *target = iter->data;
+
+      if (--target->inputs == 0)
+        g_queue_insert_sorted (&job->ready, target, graph_node_compare, NULL);
+    }
+
+  job->running--;
+  if (gnode->serial)
+    job->serial_running = FALSE;
+  graph_dispatch (job);
+
+  GEGL_INSTRUMENT_END ("process", gegl_node_get_operation (gnode->node));
+
+  g_mutex_unlock (&job->mutex);
+}
+
+/* the concurrent processing is for graphs with branches only */
+static gboolean
+gegl_graph_has_branches (GeglGraphTraversal *path)
+{
+  GList *list_iter;
+
+  for (list_iter = path->dfs_path; list_iter; list_iter = list_iter->next)
+    {
+      GeglNode *node    = GEGL_NODE (list_iter->data);
+      GSList   *pads;
+      gint      sources = 0;
+
+      for (pads = node->input_pads; pads; pads = pads->next)
+        {
+          GeglPad *source_pad = gegl_pad_get_connected_to (pads->data);
+
+          if (source_pad &&
+              g_hash_table_contains (path->contexts, gegl_pad_get_node (source_pad)))
+            sources++;
+        }
+
+      if (sources > 1)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static GeglBuffer *
+gegl_graph_process_concurrent (GeglGraphTraversal *path,
+                               gint                level)
+{
+  GraphJob  job = {NULL, };
+  GList    *list_iter;
+  gint      i;
+
+  job.path       = path;
+  job.level      = level;
+  job.n_nodes    = g_list_length (path->dfs_path);
+  job.nodes      = g_new0 (GraphNode, job.n_nodes);
+  job.by_context = g_hash_table_new (NULL, NULL);
+  job.budget     = gegl_config ()->tile_cache_size;
+  g_mutex_init (&job.mutex);
+  g_queue_init (&job.ready);
+
+  /* created before any thread can ask for it */
+  gegl_graph_get_shared_empty (path);
+
+  for (list_iter = path->dfs_path, i = 0; list_iter; list_iter = list_iter->next, i++)
+    {
+      GraphNode  *gnode  = &job.nodes[i];
+      const Babl *format;
+
+      gnode->job     = &job;
+      gnode->node    = GEGL_NODE (list_iter->data);
+      gnode->context = g_hash_table_lookup (path->contexts, gnode->node);
+      gnode->index   = i;
+      gnode->serial  = !GEGL_OPERATION_GET_CLASS (gnode->node->operation)->threaded;
+
+      format = gegl_operation_get_format (gnode->node->operation, "output");
+      if (!gnode->context->cached && !gegl_graph_is_chained (path, gnode->node))
+        gnode->bytes = (guint64) gnode->context->need_rect.width *
+                       gnode->context->need_rect.height *
+                       (format ? babl_format_get_bytes_per_pixel (format) : 16);
+
+      g_hash_table_insert (job.by_context, gnode->context, gnode);
+    }
+
+  for (i = 0; i < job.n_nodes; i++)
+    {
+      GraphNode *gnode   = &job.nodes[i];
+      GList     *targets = gegl_graph_get_connected_output_contexts (
+                             path, gegl_node_get_pad (gnode->node, "output"));
+      GList     *targets_iter;
+
+      for (targets_iter = targets; targets_iter; targets_iter = targets_iter->next)
+        {
+          ContextConnection *target_con = targets_iter->data;
+          GraphNode         *target     = g_hash_table_lookup (job.by_context,
+                                                               target_con->context);
+
+          gnode->targets = g_list_prepend (gnode->targets, target);
+          target->sources = g_list_prepend (target->sources, gnode);
+          gnode->consumers++;
+          target->inputs++;
+        }
+
+      g_list_free_full (targets, free_context_connection);
+    }
+
+  for (i = 0; i < job.n_nodes; i++)
+    if (job.nodes[i].inputs == 0)
+      g_queue_push_tail (&job.ready, &job.nodes[i]);
+
+  gegl_task_group_init (&job.group);
+
+  g_mutex_lock (&job.mutex);
+  graph_dispatch (&job);
+  g_mutex_unlock (&job.mutex);
+
+  gegl_task_group_wait (&job.group);
+
+  for (i = 0; i < job.n_nodes; i++)
+    {
+      g_list_free (job.nodes[i].sources);
+      g_list_free (job.nodes[i].targets);
+    }
+  g_free (job.nodes);
+  g_hash_table_unref (job.by_context);
+  g_mutex_clear (&job.mutex);
+
+  return job.result;
+}
+
 /**
  * gegl_graph_process:
  * @path: The traversal path
  * 
  * Process the prepared request. This will return the
  * resulting buffer from the final node, or NULL if
- * that node is a sink.
+ * that node is a sink. With more than one thread
+ * configured, independent branches of the graph are
+ * processed concurrently.
  *
  * If gegl_graph_prepare_request has not been called
  * the behavior of this function is undefined.
@@ -389,6 +770,9 @@ gegl_graph_process (GeglGraphTraversal *path,
   GeglOperationContext *last_context = NULL;
   GeglBuffer *operation_result = NULL;
 
+  if (gegl_config_threads () > 1 && gegl_graph_has_branches (path))
+    return gegl_graph_process_concurrent (path, level);
+
   for (list_iter = path->dfs_path; list_iter; list_iter = list_iter->next)
     {
       GeglNode *node = GEGL_NODE (list_iter->data);
@@ -398,73 +782,17 @@ gegl_graph_process (GeglGraphTraversal *path,
       
       GEGL_INSTRUMENT_START();
 
-      operation_result = NULL;
-
-      if (last_context)
+      if (last_context &&
+          !gegl_graph_is_chained (path, last_context->operation->node))
         gegl_operation_context_purge (last_context);
       
       context = g_hash_table_lookup (path->contexts, node);
       g_return_val_if_fail (context, NULL);
 
-      GEGL_NOTE (GEGL_DEBUG_PROCESS,
-                 "Will process %s result_rect = %d, %d %d×%d",
-                 gegl_node_get_debug_name (node),
-                 context->result_rect.x, context->result_rect.y, context->result_rect.width, context->result_rect.height);
-      
-      if (context->need_rect.width > 0 && context->need_rect.height > 0)
-        {
-          if (context->cached)
-            {
-              GEGL_NOTE (GEGL_DEBUG_PROCESS,
-                         "Using cached result for %s",
-                         gegl_node_get_debug_name (node));
-              operation_result = GEGL_BUFFER (node->cache);
-            }
-          else
-            {
-              /* Guarantee input pad */
-              if (gegl_node_has_pad (node, "input") &&
-                  !gegl_operation_context_get_object (context, "input"))
-                {
-                  gegl_operation_context_set_object (context, "input", G_OBJECT (gegl_graph_get_shared_empty(path)));
-                }
-
-              context->level = level;
-              gegl_operation_process (operation, context, "output", &context->need_rect, context->level);
-              operation_result = GEGL_BUFFER (gegl_operation_context_get_object (context, "output"));
-
-              if (operation_result && operation_result == (GeglBuffer *)operation->node->cache)
-                gegl_cache_computed (operation->node->cache, &context->need_rect, level);
-            }
-        }
-      else
-        {
-          operation_result = NULL;
-        }
+      operation_result = gegl_graph_process_node (path, node, context, level);
 
       if (operation_result)
-        {
-          GeglPad *output_pad = gegl_node_get_pad (node, "output");
-          GList   *targets = gegl_graph_get_connected_output_contexts (path, output_pad);
-          GList   *targets_iter;
-
-          GEGL_NOTE (GEGL_DEBUG_PROCESS,
-                     "Will deliver the results of %s:%s to %d targets",
-                     gegl_node_get_debug_name (node),
-                     "output",
-                     g_list_length (targets));
-          
-          if (g_list_length (targets) > 1)
-            gegl_object_set_has_forked (G_OBJECT (operation_result));
-
-          for (targets_iter = targets; targets_iter; targets_iter = g_list_next (targets_iter))
-            {
-              ContextConnection *target_con = targets_iter->data;
-              gegl_operation_context_set_object (target_con->context, target_con->name, G_OBJECT (operation_result));
-            }
-          
-          g_list_free_full (targets, free_context_connection);
-        }
+        gegl_graph_deliver (path, node, operation_result);
       
       last_context = context;
 
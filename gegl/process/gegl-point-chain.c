@@ -0,0 +1,476 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Single pass processing of chains of point operations.
+ *
+ * Processed one node at a time, a chain of point filters and point
+ * composers writes a buffer the size of the request for every node, each
+ * read again by the next one. A chain is instead processed by its last
+ * node alone: for every block of CHAIN_PIXELS pixels of the request, each
+ * operation of the chain is called in turn, the block passing from one to
+ * the next in scratch memory that stays in the cache. Only the input of
+ * the first node, the aux inputs of the composers and the output of the
+ * last node are buffers.
+ *
+ * Operations replacing the process function of the base classes, for a
+ * fast path of their own, are not part of chains.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl-types-internal.h"
+#include "gegl.h"
+#include "gegl-debug.h"
+
+#include "graph/gegl-node-private.h"
+#include "graph/gegl-pad.h"
+#include "graph/gegl-connection.h"
+
+#include "process/gegl-graph-traversal-private.h"
+#include "process/gegl-point-chain.h"
+
+#include "operation/gegl-operation.h"
+#include "operation/gegl-operation-context.h"
+#include "operation/gegl-operation-context-private.h"
+#include "operation/gegl-operation-point-filter.h"
+#include "operation/gegl-operation-point-composer.h"
+#include "operation/gegl-operation-chunks.h"
+
+#define CHAIN_PIXELS    1024 /* processed by all the operations in turn */
+#define CHAIN_MAX_AUX   (GEGL_BUFFER_MAX_ITERATORS - 2)
+
+typedef struct ChainLink
+{
+  GeglNode             *node;
+  GeglOperationContext *context;
+  gboolean              composer;
+  const Babl           *in_format;
+  const Babl           *aux_format;
+  const Babl           *out_format;
+  const Babl           *fish;  /* from the output of the link before, if
+                                * its format is not the input format */
+} ChainLink;
+
+struct _GeglPointChain
+{
+  GArray   *links;
+  gint      n_aux;
+  gint      max_bpp;
+  gboolean  threaded;
+};
+
+typedef struct ChainJob
+{
+  GeglPointChain *chain;
+  GeglBuffer     *input;
+  GeglBuffer     *output;
+  GeglBuffer     *aux[CHAIN_MAX_AUX];
+  gint            level;
+} ChainJob;
+
+static gint chains_run;
+static gint links_run;
+
+static gboolean
+chain_member (GeglGraphTraversal *path,
+              GeglNode           *node)
+{
+  GeglOperation        *operation = node->operation;
+  GeglOperationContext *context   = g_hash_table_lookup (path->contexts, node);
+  GeglOperationClass   *klass;
+  GeglOperationClass   *base;
+
+  if (!context || context->cached ||
+      context->need_rect.width <= 0 || context->need_rect.height <= 0 ||
+      !gegl_rectangle_equal (&context->need_rect, &context->result_rect))
+    return FALSE;
+
+  if (!gegl_operation_get_format (operation, "input") ||
+      !gegl_operation_get_format (operation, "output"))
+    return FALSE;
+
+  klass = GEGL_OPERATION_GET_CLASS (operation);
+
+  if (GEGL_IS_OPERATION_POINT_FILTER (operation))
+    {
+      base = g_type_class_peek (GEGL_TYPE_OPERATION_POINT_FILTER);
+
+      return klass->process == base->process &&
+             GEGL_OPERATION_FILTER_CLASS (klass)->process ==
+             GEGL_OPERATION_FILTER_CLASS (base)->process;
+    }
+  else if (GEGL_IS_OPERATION_POINT_COMPOSER (operation))
+    {
+      base = g_type_class_peek (GEGL_TYPE_OPERATION_POINT_COMPOSER);
+
+      return gegl_operation_get_format (operation, "aux") &&
+             klass->process == base->process &&
+             GEGL_OPERATION_COMPOSER_CLASS (klass)->process ==
+             GEGL_OPERATION_COMPOSER_CLASS (base)->process;
+    }
+
+  return FALSE;
+}
+
+/* whether the output of node is never cached, the nodes of a chain but the
+ * last not producing any. node caches are only created once a node is
+ * first processed, so node->cache says nothing on the first render
+ */
+static gboolean
+chain_uncached (GeglNode *node)
+{
+  return node->dont_cache ||
+         GEGL_OPERATION_GET_CLASS (node->operation)->no_cache;
+}
+
+/* whether node is the only user of the output of source in path, through
+ * its input pad, and needs the same area of it
+ */
+static gboolean
+chain_can_link (GeglGraphTraversal *path,
+                GeglNode           *source,
+                GeglNode           *node)
+{
+  GeglOperationContext *source_context = g_hash_table_lookup (path->contexts, source);
+  GeglOperationContext *context        = g_hash_table_lookup (path->contexts, node);
+  GSList               *iter;
+  gint                  users = 0;
+
+  for (iter = gegl_pad_get_connections (gegl_node_get_pad (source, "output"));
+       iter; iter = iter->next)
+    {
+      if (g_hash_table_contains (path->contexts,
+                                 gegl_connection_get_sink_node (iter->data)))
+        users++;
+    }
+
+  return users == 1 &&
+         gegl_rectangle_equal (&source_context->need_rect, &context->need_rect);
+}
+
+static void
+chain_free (GeglPointChain *chain)
+{
+  g_array_free (chain->links, TRUE);
+  g_slice_free (GeglPointChain, chain);
+}
+
+GHashTable *
+gegl_point_chains_find (GeglGraphTraversal *path)
+{
+  GHashTable *chains = g_hash_table_new (NULL, NULL);
+  GList      *found  = NULL;
+  GList      *iter;
+
+  for (iter = path->dfs_path; iter; iter = iter->next)
+    {
+      GeglNode       *node   = GEGL_NODE (iter->data);
+      GeglOperation  *operation;
+      GeglPad        *pad;
+      GeglNode       *source = NULL;
+      GeglPointChain *chain  = NULL;
+      ChainLink       link   = {NULL, };
+
+      if (!chain_member (path, node))
+        continue;
+
+      operation       = node->operation;
+      link.node       = node;
+      link.context    = g_hash_table_lookup (path->contexts, node);
+      link.composer   = GEGL_IS_OPERATION_POINT_COMPOSER (operation);
+      link.in_format  = gegl_operation_get_format (operation, "input");
+      link.out_format = gegl_operation_get_format (operation, "output");
+      if (link.composer)
+        link.aux_format = gegl_operation_get_format (operation, "aux");
+
+      pad = gegl_node_get_pad (node, "input");
+      if (pad && gegl_pad_get_connected_to (pad))
+        source = gegl_pad_get_node (gegl_pad_get_connected_to (pad));
+
+      /* the source is a member, and the last of its chain if it has a
+       * single user
+       */
+      if (source)
+        chain = g_hash_table_lookup (chains, source);
+
+      if (chain &&
+          chain_uncached (source) &&
+          chain_can_link (path, source, node) &&
+          chain->n_aux + link.composer <= CHAIN_MAX_AUX)
+        {
+          const Babl *source_format =
+            g_array_index (chain->links, ChainLink, chain->links->len - 1).out_format;
+
+          if (source_format != link.in_format)
+            link.fish = babl_fish (source_format, link.in_format);
+        }
+      else
+        {
+          chain = g_slice_new0 (GeglPointChain);
+          chain->links    = g_array_new (FALSE, FALSE, sizeof (ChainLink));
+          chain->threaded = TRUE;
+          found = g_list_prepend (found, chain);
+        }
+
+      g_array_append_val (chain->links, link);
+      chain->n_aux   += link.composer;
+      chain->max_bpp  = MAX (chain->max_bpp,
+                             MAX (babl_format_get_bytes_per_pixel (link.in_format),
+                                  babl_format_get_bytes_per_pixel (link.out_format)));
+      chain->threaded = chain->threaded &&
+                        GEGL_OPERATION_GET_CLASS (operation)->threaded;
+
+      g_hash_table_insert (chains, node, chain);
+    }
+
+  /* a single operation is processed as it is */
+  for (iter = found; iter; iter = iter->next)
+    {
+      GeglPointChain *chain = iter->data;
+
+      if (chain->links->len == 1)
+        {
+          g_hash_table_remove (chains,
+                               g_array_index (chain->links, ChainLink, 0).node);
+          chain_free (chain);
+        }
+      else
+        {
+          GEGL_NOTE (GEGL_DEBUG_PROCESS,
+                     "Chained %d point operations into %s",
+                     chain->links->len,
+                     gegl_node_get_debug_name (gegl_point_chain_get_last (chain)));
+        }
+    }
+  g_list_free (found);
+
+  if (g_hash_table_size (chains) == 0)
+    {
+      g_hash_table_unref (chains);
+      return NULL;
+    }
+
+  return chains;
+}
+
+void
+gegl_point_chains_free (GHashTable *chains)
+{
+  GHashTableIter  iter;
+  gpointer        key;
+  gpointer        value;
+
+  g_hash_table_iter_init (&iter, chains);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      /* each chain is freed once, with its last node */
+      if (gegl_point_chain_get_last (value) == key)
+        chain_free (value);
+    }
+
+  g_hash_table_unref (chains);
+}
+
+GeglNode *
+gegl_point_chain_get_last (GeglPointChain *chain)
+{
+  return g_array_index (chain->links, ChainLink, chain->links->len - 1).node;
+}
+
+static gboolean
+chain_process (GeglOperation       *operation,
+               const GeglRectangle *chunk,
+               gpointer             data)
+{
+  ChainJob           *job      = data;
+  GeglPointChain     *chain    = job->chain;
+  ChainLink          *links    = (ChainLink *) chain->links->data;
+  gint                n_links  = chain->links->len;
+  ChainLink          *first    = &links[0];
+  ChainLink          *last     = &links[n_links - 1];
+  gint               *aux      = g_newa (gint, n_links);
+  gint                in_bpp   = babl_format_get_bytes_per_pixel (first->in_format);
+  gint                out_bpp  = babl_format_get_bytes_per_pixel (last->out_format);
+  guchar             *scratch  = NULL;
+  gint                block    = 0;
+  gboolean            success  = TRUE;
+  GeglBufferIterator *i;
+  gint                read;
+  gint                l, n_aux;
+
+  i = gegl_buffer_iterator_new (job->output, chunk, job->level, last->out_format,
+                                GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  read = gegl_buffer_iterator_add (i, job->input, chunk, job->level, first->in_format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  for (l = 0, n_aux = 0; l < n_links; l++)
+    {
+      aux[l] = -1;
+
+      if (links[l].composer)
+        {
+          if (job->aux[n_aux])
+            aux[l] = gegl_buffer_iterator_add (i, job->aux[n_aux], chunk, job->level,
+                                               links[l].aux_format,
+                                               GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+          n_aux++;
+        }
+    }
+
+  while (gegl_buffer_iterator_next (i))
+    {
+      const GeglRectangle *roi  = &i->roi[0];
+      gint                 rows = MAX (CHAIN_PIXELS / roi->width, 1);
+      gint                 y;
+
+      /* the output of two links and a conversion */
+      if (roi->width * rows > block)
+        {
+          block = roi->width * rows;
+          gegl_free (scratch);
+          scratch = gegl_malloc (3 * block * chain->max_bpp);
+        }
+
+      for (y = 0; y < roi->height; y += rows)
+        {
+          GeglRectangle  part;
+          glong          offset;
+          guchar        *in;
+
+          part.x      = roi->x;
+          part.y      = roi->y + y;
+          part.width  = roi->width;
+          part.height = MIN (rows, roi->height - y);
+          offset      = (glong) y * roi->width;
+          in          = (guchar *) i->data[read] + offset * in_bpp;
+
+          for (l = 0; l < n_links; l++)
+            {
+              ChainLink *link    = &links[l];
+              glong      samples = (glong) part.width * part.height;
+              guchar    *out;
+
+              if (link->fish)
+                {
+                  guchar *converted = scratch + 2 * block * chain->max_bpp;
+
+                  babl_process (link->fish, in, converted, samples);
+                  in = converted;
+                }
+
+              if (l == n_links - 1)
+                out = (guchar *) i->data[0] + offset * out_bpp;
+              else
+                out = scratch + (l % 2) * block * chain->max_bpp;
+
+              if (link->composer)
+                {
+                  GeglOperationPointComposerClass *klass =
+                    GEGL_OPERATION_POINT_COMPOSER_GET_CLASS (link->node->operation);
+                  guchar *aux_data = NULL;
+
+                  if (aux[l] >= 0)
+                    aux_data = (guchar *) i->data[aux[l]] +
+                               offset * babl_format_get_bytes_per_pixel (link->aux_format);
+
+                  if (!klass->process (link->node->operation, in, aux_data, out,
+                                       samples, &part, job->level))
+                    success = FALSE;
+                }
+              else
+                {
+                  GeglOperationPointFilterClass *klass =
+                    GEGL_OPERATION_POINT_FILTER_GET_CLASS (link->node->operation);
+
+                  if (!klass->process (link->node->operation, in, out,
+                                       samples, &part, job->level))
+                    success = FALSE;
+                }
+
+              in = out;
+            }
+        }
+    }
+
+  gegl_free (scratch);
+
+  return success;
+}
+
+GeglBuffer *
+gegl_point_chain_process (GeglPointChain *chain,
+                          GeglBuffer     *empty,
+                          gint            level)
+{
+  ChainLink            *links     = (ChainLink *) chain->links->data;
+  gint                  n_links   = chain->links->len;
+  ChainLink            *last      = &links[n_links - 1];
+  GeglOperation        *operation = last->node->operation;
+  const GeglRectangle  *result    = &last->context->need_rect;
+  ChainJob              job       = {NULL, };
+  gint                  l, n_aux;
+
+  job.chain = chain;
+  job.level = level;
+  job.input = GEGL_BUFFER (gegl_operation_context_get_object (links[0].context, "input"));
+  if (!job.input)
+    job.input = empty;
+
+  for (l = 0, n_aux = 0; l < n_links; l++)
+    {
+      links[l].context->level = level;
+
+      if (links[l].composer)
+        job.aux[n_aux++] = GEGL_BUFFER (gegl_operation_context_get_object (links[l].context, "aux"));
+    }
+
+  job.output = gegl_operation_context_get_output_maybe_in_place (operation,
+                                                                 last->context,
+                                                                 job.input,
+                                                                 result);
+
+  if (chain->threaded &&
+      gegl_operation_use_threading (operation, result) && result->height > 1)
+    gegl_operation_process_chunks (operation, job.output, result, level,
+                                   chain_process, &job);
+  else
+    chain_process (operation, result, &job);
+
+  /* the inputs of the chain are done with */
+  for (l = 0; l < n_links - 1; l++)
+    gegl_operation_context_purge (links[l].context);
+
+  g_atomic_int_inc (&chains_run);
+  g_atomic_int_add (&links_run, n_links);
+
+  return job.output;
+}
+
+gint
+gegl_point_chains_get_runs (void)
+{
+  return g_atomic_int_get (&chains_run);
+}
+
+void
+gegl_point_chains_stats (void)
+{
+  g_warning ("Point chains: runs:%i operations:%i",
+             g_atomic_int_get (&chains_run),
+             g_atomic_int_get (&links_run));
+}
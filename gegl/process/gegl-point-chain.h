@@ -0,0 +1,47 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __GEGL_POINT_CHAIN_H__
+#define __GEGL_POINT_CHAIN_H__
+
+#include "process/gegl-graph-traversal.h"
+
+typedef struct _GeglPointChain GeglPointChain;
+
+/* finds the runs of point filters and point composers in path, each
+ * taking the output of the one before as its only user, that can be
+ * processed in a single pass over the request. returns a table of the
+ * nodes in the runs to their chain, or NULL if there are none.
+ */
+GHashTable *gegl_point_chains_find    (GeglGraphTraversal *path);
+void        gegl_point_chains_free    (GHashTable         *chains);
+
+/* the node processing the whole chain, the others doing nothing */
+GeglNode   *gegl_point_chain_get_last (GeglPointChain     *chain);
+
+/* processes the chain into the output of its last node, returning that
+ * output, which is not referenced. empty is the input to use if the first
+ * node has none.
+ */
+GeglBuffer *gegl_point_chain_process  (GeglPointChain     *chain,
+                                       GeglBuffer         *empty,
+                                       gint                level);
+
+/* the number of chains processed so far */
+gint        gegl_point_chains_get_runs (void);
+
+void        gegl_point_chains_stats   (void);
+
+#endif /* __GEGL_POINT_CHAIN_H__ */
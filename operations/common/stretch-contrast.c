@@ -33,34 +33,73 @@ property_boolean (keep_colors, _("Keep colors"), TRUE)
 #include "gegl-op.h"
 #include <math.h>
 
+typedef struct
+{
+  gfloat min[3];
+  gfloat max[3];
+} MinMax;
+
+static void
+min_max_chunk (GeglBufferIterator *gi,
+               gpointer            scratch,
+               gpointer            user_data)
+{
+  MinMax *mm  = scratch;
+  gfloat *buf = gi->data[0];
+  gint    i, c;
+
+  for (i = 0; i < gi->length; i++)
+    {
+      for (c = 0; c < 3; c++)
+        {
+          mm->min[c] = MIN (buf [i * 3 + c], mm->min[c]);
+          mm->max[c] = MAX (buf [i * 3 + c], mm->max[c]);
+        }
+    }
+}
+
+static void
+min_max_merge (gpointer scratch,
+               gpointer user_data)
+{
+  MinMax *mm     = scratch;
+  MinMax *result = user_data;
+  gint    c;
+
+  for (c = 0; c < 3; c++)
+    {
+      result->min[c] = MIN (mm->min[c], result->min[c]);
+      result->max[c] = MAX (mm->max[c], result->max[c]);
+    }
+}
+
 static void
 buffer_get_min_max (GeglBuffer *buffer,
                     gfloat     *min,
                     gfloat     *max)
 {
   GeglBufferIterator *gi;
-  gint c;
+  MinMax              init;
+  MinMax              result;
+  gint                c;
+
   gi = gegl_buffer_iterator_new (buffer, NULL, 0, babl_format ("R'G'B' float"),
                                  GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
   for (c = 0; c < 3; c++)
     {
-      min[c] =  G_MAXFLOAT;
-      max[c] = -G_MAXFLOAT;
+      init.min[c] =  G_MAXFLOAT;
+      init.max[c] = -G_MAXFLOAT;
     }
+  result = init;
 
-  while (gegl_buffer_iterator_next (gi))
-    {
-      gfloat *buf = gi->data[0];
+  gegl_buffer_iterator_foreach_parallel (gi, min_max_chunk,
+                                         &init, sizeof (init),
+                                         min_max_merge, &result);
 
-      gint i;
-      for (i = 0; i < gi->length; i++)
-        {
-          for (c = 0; c < 3; c++)
-            {
-              min[c] = MIN (buf [i * 3 + c], min[c]);
-              max[c] = MAX (buf [i * 3 + c], max[c]);
-            }
-        }
+  for (c = 0; c < 3; c++)
+    {
+      min[c] = result.min[c];
+      max[c] = result.max[c];
     }
 }
 
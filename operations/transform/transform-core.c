@@ -34,6 +34,7 @@
 #include <gegl-plugin.h>
 
 #include "gegl-config.h"
+#include "gegl-operation-chunks.h"
 
 #include "transform-core.h"
 #include "module.h"
@@ -700,41 +701,28 @@ gegl_transform_get_invalidated_by_change (GeglOperation       *op,
 
 typedef struct ThreadData
 {
-  void (*func) (GeglOperation *operation,
-                GeglBuffer  *dest,
-                GeglBuffer  *src,
-                GeglMatrix3 *matrix,
-                gint         level);
+  void (*func) (GeglOperation       *operation,
+                GeglBuffer          *dest,
+                GeglBuffer          *src,
+                GeglMatrix3         *matrix,
+                const GeglRectangle *roi,
+                gint                 level);
 
 
-  GeglOperation            *operation;
   GeglBuffer               *input;
   GeglBuffer               *output;
-  gint                     *pending;
   GeglMatrix3              *matrix;
   gint                      level;
-  gboolean                  success;
-  GeglRectangle             roi;
 } ThreadData;
 
-static void thread_process (gpointer thread_data, gpointer unused)
+static gboolean thread_process (GeglOperation       *operation,
+                                const GeglRectangle *chunk,
+                                gpointer             thread_data)
 {
   ThreadData *data = thread_data;
-  data->func (data->operation,
-                   data->output, data->input, data->matrix, data->level);
-    data->success = FALSE;
-  g_atomic_int_add (data->pending, -1);
-}
-
-static GThreadPool *thread_pool (void)
-{
-  static GThreadPool *pool = NULL;
-  if (!pool)
-    {
-      pool =  g_thread_pool_new (thread_process, NULL, gegl_config_threads(),
-                                 FALSE, NULL);
-    }
-  return pool;
+  data->func (operation,
+              data->output, data->input, data->matrix, chunk, data->level);
+  return TRUE;
 }
 
 
@@ -743,6 +731,7 @@ transform_affine (GeglOperation *operation,
                   GeglBuffer  *dest,
                   GeglBuffer  *src,
                   GeglMatrix3 *matrix,
+                  const GeglRectangle *roi,
                   gint         level)
 {
   gint         factor = 1 << level;
@@ -751,10 +740,13 @@ transform_affine (GeglOperation *operation,
   GeglMatrix3  inverse;
   GeglMatrix2  inverse_jacobian;
   gint         dest_pixels;
+  /* the inverse transform below maps to level 0 coordinates, which the
+   * sampler reads when it is not set to a level of its own
+   */
   GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src,
                                          babl_format("RaGaBaA float"),
                                          level?GEGL_SAMPLER_NEAREST:transform->sampler,
-                                         level);
+                                         0);
   GeglSamplerGetFun sampler_get_fun = gegl_sampler_get_fun (sampler);
 
 
@@ -788,9 +780,8 @@ transform_affine (GeglOperation *operation,
   g_object_get (dest, "pixels", &dest_pixels, NULL);
 
   {
-    const GeglRectangle *dest_extent = gegl_buffer_get_extent (dest);
     GeglBufferIterator *i = gegl_buffer_iterator_new (dest,
-                                                      dest_extent,
+                                                      roi,
                                                       level,
                                                       format,
                                                       GEGL_ACCESS_WRITE,
@@ -938,17 +929,34 @@ transform_affine (GeglOperation *operation,
           gdouble v_float = v_start;
 
           gint x = roi->width;
-          do {
-            sampler_get_fun (sampler,
-                             u_float, v_float,
-                             &inverse_jacobian,
-                             dest_ptr,
-                             GEGL_ABYSS_NONE);
-            dest_ptr += (gint) 4 - (gint) 8 * flip_x;
-
-            u_float += inverse_jacobian.coeff [0][0];
-            v_float += inverse_jacobian.coeff [1][0];
-          } while (--x);
+
+          if (! flip_x)
+            {
+              /* a scanline at once */
+              gegl_sampler_get_n (sampler,
+                                  u_float, v_float,
+                                  inverse_jacobian.coeff [0][0],
+                                  inverse_jacobian.coeff [1][0],
+                                  x,
+                                  &inverse_jacobian,
+                                  dest_ptr,
+                                  GEGL_ABYSS_NONE);
+              dest_ptr += (gint) 4 * x;
+            }
+          else
+            {
+              do {
+                sampler_get_fun (sampler,
+                                 u_float, v_float,
+                                 &inverse_jacobian,
+                                 dest_ptr,
+                                 GEGL_ABYSS_NONE);
+                dest_ptr += (gint) 4 - (gint) 8 * flip_x;
+
+                u_float += inverse_jacobian.coeff [0][0];
+                v_float += inverse_jacobian.coeff [1][0];
+              } while (--x);
+            }
 
           dest_ptr += (gint) 8 * (flip_x - flip_y) * roi->width;
 
@@ -966,13 +974,13 @@ transform_generic (GeglOperation *operation,
                    GeglBuffer  *dest,
                    GeglBuffer  *src,
                    GeglMatrix3 *matrix,
+                   const GeglRectangle *roi,
                    gint         level)
 {
   OpTransform *transform = (OpTransform *) operation;
   const Babl          *format = babl_format ("RaGaBaA float");
   gint                 factor = 1 << level;
   GeglBufferIterator  *i;
-  const GeglRectangle *dest_extent;
   GeglMatrix3          inverse;
   gint                 dest_pixels;
   GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src,
@@ -983,13 +991,12 @@ transform_generic (GeglOperation *operation,
   GeglSamplerGetFun sampler_get_fun = gegl_sampler_get_fun (sampler);
 
   g_object_get (dest, "pixels", &dest_pixels, NULL);
-  dest_extent = gegl_buffer_get_extent (dest);
 
   /*
    * Construct an output tile iterator.
    */
   i = gegl_buffer_iterator_new (dest,
-                                dest_extent,
+                                roi,
                                 level,
                                 format,
                                 GEGL_ACCESS_WRITE,
@@ -1251,11 +1258,12 @@ gegl_transform_process (GeglOperation        *operation,
     }
   else
     {
-      void (*func) (GeglOperation *operation,
-                    GeglBuffer  *dest,
-                    GeglBuffer  *src,
-                    GeglMatrix3 *matrix,
-                    gint         level) = transform_generic;
+      void (*func) (GeglOperation       *operation,
+                    GeglBuffer          *dest,
+                    GeglBuffer          *src,
+                    GeglMatrix3         *matrix,
+                    const GeglRectangle *roi,
+                    gint                 level) = transform_generic;
 
       if (gegl_matrix3_is_affine (&matrix))
         func = transform_affine;
@@ -1268,57 +1276,22 @@ gegl_transform_process (GeglOperation        *operation,
 
       if (gegl_operation_use_threading (operation, result))
       {
-        gint threads = gegl_config_threads ();
-        GThreadPool *pool = thread_pool ();
-        ThreadData thread_data[GEGL_MAX_THREADS];
-        gint pending = threads;
-
-        if (result->width > result->height)
-        {
-          gint bit = result->width / threads;
-          for (gint j = 0; j < threads; j++)
-          {
-            thread_data[j].roi.y = result->y;
-            thread_data[j].roi.height = result->height;
-            thread_data[j].roi.x = result->x + bit * j;
-            thread_data[j].roi.width = bit;
-          }
-          thread_data[threads-1].roi.width = result->width - (bit * (threads-1));
-        }
-        else
-        {
-          gint bit = result->height / threads;
-          for (gint j = 0; j < threads; j++)
-          {
-            thread_data[j].roi.x = result->x;
-            thread_data[j].roi.width = result->width;
-            thread_data[j].roi.y = result->y + bit * j;
-            thread_data[j].roi.height = bit;
-          }
-          thread_data[threads-1].roi.height = result->height - (bit * (threads-1));
-        }
-
-        for (gint i = 0; i < threads; i++)
-        {
-          thread_data[i].func = func;
-          thread_data[i].matrix = &matrix;
-          thread_data[i].operation = operation;
-          thread_data[i].input = input;
-          thread_data[i].output = output;
-          thread_data[i].pending = &pending;
-          thread_data[i].level = level;
-          thread_data[i].success = TRUE;
-        }
+        ThreadData data;
 
-        for (gint i = 1; i < threads; i++)
-          g_thread_pool_push (pool, &thread_data[i], NULL);
-        thread_process (&thread_data[0], NULL);
+        data.func   = func;
+        data.matrix = &matrix;
+        data.input  = input;
+        data.output = output;
+        data.level  = level;
 
-        while (g_atomic_int_get (&pending)) {};
+        gegl_operation_process_chunks (operation, output,
+                                       gegl_buffer_get_extent (output), level,
+                                       thread_process, &data);
       }
       else
       {
-        func (operation, output, input, &matrix, level);
+        func (operation, output, input, &matrix,
+              gegl_buffer_get_extent (output), level);
       }
 
       if (input != NULL)
@@ -0,0 +1,145 @@
+#include "test-common.h"
+
+#include <glib/gstdio.h>
+
+#define BUFFER_SIZE 2048
+#define ITERATIONS  4
+
+/* a buffer like the intermediates we archive: mostly empty or flat, with
+ * some noisy content
+ */
+static GeglBuffer *
+flat_buffer (const Babl *format)
+{
+  GeglRectangle  bound = {0, 0, BUFFER_SIZE, BUFFER_SIZE};
+  GeglRectangle  flat  = {0, 0, BUFFER_SIZE, BUFFER_SIZE * 4 / 10};
+  GeglRectangle  noisy = {0, BUFFER_SIZE * 7 / 10,
+                          BUFFER_SIZE, BUFFER_SIZE * 3 / 10};
+  GeglBuffer    *buffer;
+  GeglColor     *color;
+  gfloat        *buf;
+  gint           i;
+
+  buffer = gegl_buffer_new (&bound, format);
+
+  color = gegl_color_new ("rgb(0.2, 0.4, 0.6)");
+  gegl_buffer_set_color (buffer, &flat, color);
+  g_object_unref (color);
+
+  buf = g_malloc (noisy.width * noisy.height * 4 * sizeof (gfloat));
+  for (i = 0; i < noisy.width * noisy.height * 4; i++)
+    buf[i] = g_random_double_range (0.0, 1.0);
+  gegl_buffer_set (buffer, &noisy, 0, babl_format ("RGBA float"), buf, 0);
+  g_free (buf);
+
+  return buffer;
+}
+
+static void
+run (const gchar *codec,
+     GeglBuffer  *buffer,
+     const gchar *path)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  const Babl          *format = gegl_buffer_get_format (buffer);
+  glong                bytes;
+  guchar              *data;
+  gchar               *id;
+  GStatBuf             st;
+  gint                 i;
+
+  bytes = (glong) extent->width * extent->height *
+          babl_format_get_bytes_per_pixel (format);
+  data  = g_malloc (bytes);
+
+  g_object_set (gegl_config (), "save-compression", codec, NULL);
+
+  id = g_strdup_printf ("save, %s", codec);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    gegl_buffer_save (buffer, path, NULL);
+  test_end (id, bytes * ITERATIONS);
+  g_free (id);
+
+  /* only the snapshot is taken on the calling thread */
+  id = g_strdup_printf ("save in background, %s", codec);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    g_thread_join (gegl_buffer_save_in_background (buffer, path, NULL));
+  test_end (id, bytes * ITERATIONS);
+  g_free (id);
+
+  if (g_stat (path, &st) == 0)
+    g_print ("@ file size, %s: %.2f megabytes\n",
+             codec, st.st_size / 1024.0 / 1024.0);
+
+  id = g_strdup_printf ("load, %s", codec);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      GeglBuffer *loaded = gegl_buffer_load (path);
+      g_object_unref (loaded);
+    }
+  test_end (id, bytes * ITERATIONS);
+  g_free (id);
+
+  /* tiles of an opened buffer are read and decoded on demand */
+  id = g_strdup_printf ("open and read, %s", codec);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      GeglBuffer *opened = gegl_buffer_open (path);
+      gegl_buffer_get (opened, extent, 1.0, format, data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      g_object_unref (opened);
+    }
+  test_end (id, bytes * ITERATIONS);
+  g_free (id);
+
+  /* uncompressed tiles of a mapped buffer are not copied until written to */
+  id = g_strdup_printf ("open mapped and read, %s", codec);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      GeglBuffer *opened = gegl_buffer_open_mapped (path);
+      gegl_buffer_get (opened, extent, 1.0, format, data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      g_object_unref (opened);
+    }
+  test_end (id, bytes * ITERATIONS);
+  g_free (id);
+
+  g_free (data);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+  gchar      *tmpdir;
+  gchar      *path;
+
+  gegl_init (&argc, &argv);
+
+  tmpdir = g_dir_make_tmp ("test-buffer-save-XXXXXX", NULL);
+  path   = g_build_filename (tmpdir, "buffer.gegl", NULL);
+
+  buffer = flat_buffer (babl_format ("R'G'B'A u8"));
+
+  run ("nop", buffer, path);
+  run ("rle", buffer, path);
+  run ("delta", buffer, path);
+  run ("lz", buffer, path);
+
+  g_object_unref (buffer);
+
+  g_unlink (path);
+  g_remove (tmpdir);
+  g_free (path);
+  g_free (tmpdir);
+
+  gegl_exit ();
+
+  return 0;
+}
@@ -10,6 +10,8 @@ long babl_ticks (void); /* using babl_ticks instead of gegl_ticks
 void test_start (void);
 void test_end (const gchar *id,
                glong        bytes);
+void test_end_pixels (const gchar *id,
+                      glong        pixels);
 GeglBuffer *test_buffer (gint width,
                          gint height,
                          const Babl *format);
@@ -26,6 +28,14 @@ void test_end (const gchar *id,
        id, (bytes / 1024.0 / 1024.0)  / (ticks / 1000000.0));
 }
 
+void test_end_pixels (const gchar *id,
+                      glong        pixels)
+{
+  long ticks = babl_ticks ()-ticks_start;
+  g_print ("@ %s: %.2f megapixels/second\n",
+       id, (pixels / 1000000.0)  / (ticks / 1000000.0));
+}
+
 /* create a test buffer of random data in -0.5 to 2.0 range 
  */
 GeglBuffer *test_buffer (gint width,
@@ -0,0 +1,126 @@
+#include "test-common.h"
+
+#include "gegl-algorithms.h"
+
+#define SIZE       1024
+#define ITERATIONS 32
+
+typedef void (*DownscaleFunc) (gint    bpp,
+                               gint    src_width,
+                               gint    src_height,
+                               guchar *src_data,
+                               gint    src_rowstride,
+                               guchar *dst_data,
+                               gint    dst_rowstride);
+
+typedef void (*BoxfilterFunc) (guchar              *dest_buf,
+                               const guchar        *source_buf,
+                               const GeglRectangle *dst_rect,
+                               const GeglRectangle *src_rect,
+                               gint                 s_rowstride,
+                               gdouble              scale,
+                               gint                 bpp,
+                               gint                 d_rowstride);
+
+static guchar *
+random_pixels (const Babl *format,
+               gint        width,
+               gint        height)
+{
+  GeglBuffer    *buffer = test_buffer (width, height, format);
+  GeglRectangle  roi    = {0, 0, width, height};
+  guchar        *data;
+
+  data = g_malloc (width * height * babl_format_get_bytes_per_pixel (format));
+  gegl_buffer_get (buffer, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  g_object_unref (buffer);
+
+  return data;
+}
+
+/* the scalar kernel against the one gegl_downscale_2x2 () picks for the CPU */
+static void
+test_downscale (const gchar   *format_name,
+                DownscaleFunc  scalar)
+{
+  const Babl *format = babl_format (format_name);
+  const gint  bpp    = babl_format_get_bytes_per_pixel (format);
+  guchar     *src    = random_pixels (format, SIZE, SIZE);
+  guchar     *dst    = g_malloc (SIZE / 2 * SIZE / 2 * bpp);
+  gchar      *id;
+  gint        i;
+
+  id = g_strdup_printf ("downscale 2x2 scalar, %s", format_name);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    scalar (bpp, SIZE, SIZE, src, SIZE * bpp, dst, SIZE / 2 * bpp);
+  test_end (id, (glong) SIZE * SIZE * bpp * ITERATIONS);
+  g_free (id);
+
+  id = g_strdup_printf ("downscale 2x2, %s", format_name);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    gegl_downscale_2x2 (format, SIZE, SIZE, src, SIZE * bpp,
+                        dst, SIZE / 2 * bpp);
+  test_end (id, (glong) SIZE * SIZE * bpp * ITERATIONS);
+  g_free (id);
+
+  g_free (src);
+  g_free (dst);
+}
+
+static void
+test_boxfilter (const gchar   *format_name,
+                BoxfilterFunc  scalar,
+                gdouble        scale)
+{
+  const Babl    *format   = babl_format (format_name);
+  const gint     bpp      = babl_format_get_bytes_per_pixel (format);
+  GeglRectangle  src_rect = {-1, -1, SIZE + 2, SIZE + 2};
+  GeglRectangle  dst_rect = {0, 0, (SIZE - 1) * scale, (SIZE - 1) * scale};
+  guchar        *src      = random_pixels (format, src_rect.width,
+                                           src_rect.height);
+  guchar        *dst      = g_malloc (dst_rect.width * dst_rect.height * bpp);
+  const gint     s_stride = src_rect.width * bpp;
+  const gint     d_stride = dst_rect.width * bpp;
+  gchar         *id;
+  gint           i;
+
+  id = g_strdup_printf ("boxfilter %.2f scalar, %s", scale, format_name);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    scalar (dst, src, &dst_rect, &src_rect, s_stride, scale, bpp, d_stride);
+  test_end (id, (glong) dst_rect.width * dst_rect.height * bpp * ITERATIONS);
+  g_free (id);
+
+  id = g_strdup_printf ("boxfilter %.2f, %s", scale, format_name);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    gegl_resample_boxfilter (dst, src, &dst_rect, &src_rect,
+                             s_stride, scale, format, d_stride);
+  test_end (id, (glong) dst_rect.width * dst_rect.height * bpp * ITERATIONS);
+  g_free (id);
+
+  g_free (src);
+  g_free (dst);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  gegl_init (&argc, &argv);
+
+  test_downscale ("R'G'B'A u8", gegl_downscale_2x2_u8);
+  test_downscale ("RGBA u16", gegl_downscale_2x2_u16);
+  test_downscale ("RGBA float", gegl_downscale_2x2_float);
+
+  test_boxfilter ("R'G'B'A u8", gegl_resample_boxfilter_u8, 0.75);
+  test_boxfilter ("RGBA u16", gegl_resample_boxfilter_u16, 0.75);
+  test_boxfilter ("RGBA float", gegl_resample_boxfilter_float, 0.75);
+
+  gegl_exit ();
+
+  return 0;
+}
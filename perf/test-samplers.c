@@ -1,7 +1,72 @@
+#include "config.h"
+
+#include <string.h>
+
 #include "test-common.h"
 
+#include "gegl-cpuaccel-private.h"
+
 #define BPP 16
 #define ITERATIONS 12
+#define SAMPLES 150000
+
+/* the instruction set the linear and cubic samplers pick */
+static const gchar *
+accel_name (void)
+{
+  GeglCpuAccelFlags accel = gegl_cpu_accel_get_support ();
+
+#ifdef USE_AVX2
+  if (accel & GEGL_CPU_ACCEL_X86_AVX2)
+    return "avx2";
+#endif
+#ifdef USE_SSE2
+  if (accel & GEGL_CPU_ACCEL_X86_SSE2)
+    return "sse2";
+#endif
+
+  (void) accel;
+  return "scalar";
+}
+
+/* scanlines of a slight rotation, as sampled by an affine transform, with
+ * the CPU acceleration off or on; the samplers pick their kernels when
+ * they are created
+ */
+static void
+test_sampler_get_n (GeglBuffer      *buffer,
+                    const Babl      *format,
+                    GeglSamplerType  type,
+                    const gchar     *name,
+                    gboolean         accelerated)
+{
+  gchar *id;
+  gint   i;
+
+  gegl_cpu_accel_set_use (accelerated);
+
+  id = g_strdup_printf ("gegl_sampler_get_n %s, %s",
+                        name, accelerated ? accel_name () : "scalar");
+
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+  {
+    int j;
+    float px[4 * 1000];
+    GeglSampler *sampler = gegl_buffer_sampler_new (buffer, format, type);
+
+    for (j = 0; j < SAMPLES / 1000; j ++)
+      gegl_sampler_get_n (sampler, 10.5, 10.5 + j, 0.99, 0.1, 1000,
+                          NULL, (void*)&px[0], GEGL_ABYSS_NONE);
+
+    g_object_unref (sampler);
+  }
+  test_end_pixels (id, SAMPLES * ITERATIONS);
+
+  g_free (id);
+
+  gegl_cpu_accel_set_use (TRUE);
+}
 
 gint
 main (gint    argc,
@@ -25,7 +90,6 @@ main (gint    argc,
   format = babl_format ("RGBA float");
 
   {
-#define SAMPLES 150000
     gint rands[SAMPLES*2];
 
   for (i = 0; i < SAMPLES; i ++)
@@ -251,6 +315,19 @@ main (gint    argc,
   }
   test_end ("sampler_get_fun cubic", SAMPLES * ITERATIONS * BPP);
 
+  test_sampler_get_n (buffer, format, GEGL_SAMPLER_NEAREST, "nearest", FALSE);
+
+  test_sampler_get_n (buffer, format, GEGL_SAMPLER_LINEAR, "linear", FALSE);
+  if (strcmp (accel_name (), "scalar"))
+    test_sampler_get_n (buffer, format, GEGL_SAMPLER_LINEAR, "linear", TRUE);
+
+  test_sampler_get_n (buffer, format, GEGL_SAMPLER_CUBIC, "cubic", FALSE);
+  if (strcmp (accel_name (), "scalar"))
+    test_sampler_get_n (buffer, format, GEGL_SAMPLER_CUBIC, "cubic", TRUE);
+
+  test_sampler_get_n (buffer, format, GEGL_SAMPLER_NOHALO, "nohalo", FALSE);
+  test_sampler_get_n (buffer, format, GEGL_SAMPLER_LOHALO, "lohalo", FALSE);
+
   test_start ();
   for (i = 0; i < ITERATIONS; i++)
   {
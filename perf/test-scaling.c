@@ -0,0 +1,111 @@
+#include "test-common.h"
+
+#define SIZE       2048
+#define ITERATIONS 4
+
+typedef struct
+{
+  const gchar *operation;
+  const gchar *property;  /* one to set, if not NULL */
+  gdouble      value;
+} ScalingTest;
+
+static const ScalingTest tests[] =
+{
+  {"gegl:brightness-contrast", NULL,      0.0},
+  {"gegl:gaussian-blur",       NULL,      0.0},
+  {"gegl:rotate",              "degrees", 30.0},
+};
+
+/* the time of ITERATIONS renders of the operation on buffer, with threads
+ * threads
+ */
+static long
+test_scaling_run (GeglBuffer        *buffer,
+                  const ScalingTest *test,
+                  gint               threads)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *node, *sink;
+  gchar      *id;
+  long        ticks;
+  gint        i;
+
+  g_object_set (gegl_config (), "threads", threads, NULL);
+
+  id = g_strdup_printf ("%s, %i threads", test->operation, threads);
+  test_start ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      gegl = gegl_node_new ();
+      source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+      node = gegl_node_new_child (gegl, "operation", test->operation, NULL);
+      if (test->property)
+        gegl_node_set (node, test->property, test->value, NULL);
+      sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+      gegl_node_link_many (source, node, sink, NULL);
+      gegl_node_process (sink);
+      g_object_unref (gegl);
+      g_object_unref (buffer2);
+    }
+  ticks = babl_ticks () - ticks_start;
+  test_end_pixels (id, gegl_buffer_get_pixel_count (buffer) * ITERATIONS);
+  g_free (id);
+
+  return ticks;
+}
+
+/* the throughput from one thread up to as many as there are processors,
+ * doubling them, and where adding threads stops paying off
+ */
+static void
+test_scaling (GeglBuffer        *buffer,
+              const ScalingTest *test)
+{
+  gint    processors = g_get_num_processors ();
+  long    single     = test_scaling_run (buffer, test, 1);
+  gdouble last       = 1.0;
+  gint    last_n     = 1;
+  gint    plateau    = 0;
+  gint    threads;
+
+  for (threads = 2; threads / 2 < processors; threads *= 2)
+    {
+      gint    n       = MIN (threads, processors);
+      gdouble speedup = (gdouble) single / test_scaling_run (buffer, test, n);
+
+      g_print ("  %s: %.2fx with %i threads\n", test->operation, speedup, n);
+
+      /* less than a tenth more for doubling the threads */
+      if (!plateau && speedup < last * 1.1)
+        plateau = last_n;
+      last   = speedup;
+      last_n = n;
+    }
+
+  if (plateau)
+    g_print ("  %s: no longer scales beyond %i threads\n",
+             test->operation, plateau);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+  guint       i;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    test_scaling (buffer, &tests[i]);
+
+  g_object_unref (buffer);
+
+  gegl_exit ();
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "test-common.h"
+#include "gegl-buffer-backend.h"
+
+#define BUFFER_SIZE 1024
+#define LOOKUPS     400000
+#define MAX_THREADS 64
+
+typedef struct
+{
+  GeglBuffer *buffer;
+  gint        tiles_x;
+  gint        tiles_y;
+  gint        lookups;
+} ThreadData;
+
+static gpointer
+lookup_thread (gpointer data)
+{
+  ThreadData *td = data;
+  gint        i;
+
+  for (i = 0; i < td->lookups; i++)
+    {
+      GeglTile *tile;
+
+      tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (td->buffer),
+                                        i % td->tiles_x,
+                                        (i / td->tiles_x) % td->tiles_y,
+                                        0);
+      gegl_tile_unref (tile);
+    }
+
+  return NULL;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  const Babl    *format;
+  GeglBuffer    *buffers[MAX_THREADS];
+  GThread       *threads[MAX_THREADS];
+  ThreadData     data[MAX_THREADS];
+  gint           max_threads;
+  gint           n_threads;
+  gint           tile_width;
+  gint           tile_height;
+  gint           i;
+
+  gegl_init (&argc, &argv);
+  format = babl_format ("RGBA u8");
+
+  max_threads = MIN (g_get_num_processors (), MAX_THREADS);
+
+  for (i = 0; i < max_threads; i++)
+    {
+      buffers[i] = test_buffer (BUFFER_SIZE, BUFFER_SIZE, format);
+      g_object_get (buffers[i],
+                    "tile-width",  &tile_width,
+                    "tile-height", &tile_height,
+                    NULL);
+      data[i].buffer  = buffers[i];
+      data[i].tiles_x = BUFFER_SIZE / tile_width;
+      data[i].tiles_y = BUFFER_SIZE / tile_height;
+      data[i].lookups = LOOKUPS;
+      /* warm up the cache so that only lookups are measured */
+      lookup_thread (&data[i]);
+    }
+
+  for (n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+    {
+      gchar *id = g_strdup_printf ("tile cache lookup, %i threads", n_threads);
+
+      test_start ();
+      for (i = 0; i < n_threads; i++)
+        threads[i] = g_thread_new (NULL, lookup_thread, &data[i]);
+      for (i = 0; i < n_threads; i++)
+        g_thread_join (threads[i]);
+      test_end (id, (glong) n_threads * LOOKUPS *
+                    tile_width * tile_height * babl_format_get_bytes_per_pixel (format));
+
+      g_free (id);
+    }
+
+  for (i = 0; i < max_threads; i++)
+    g_object_unref (buffers[i]);
+
+  gegl_exit ();
+
+  return 0;
+}
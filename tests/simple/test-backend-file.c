@@ -409,6 +409,303 @@ test_buffer_change_extent (void)
   return result;
 }
 
+static gboolean
+test_buffer_save_contents (void)
+{
+  gboolean         result = TRUE;
+  gchar           *tmpdir = NULL;
+  gchar           *buf_a_path = NULL;
+  GeglBuffer      *buf_a = NULL;
+  const Babl      *format = babl_format ("R'G'B'A u8");
+  GeglRectangle    roi = {0, 0, 300, 200};
+  guchar          *pattern;
+  guchar          *data;
+  gint             i;
+
+  tmpdir = g_dir_make_tmp ("test-backend-file-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  buf_a_path = g_build_filename (tmpdir, "buf_a.gegl", NULL);
+
+  pattern = g_malloc (roi.width * roi.height * 4);
+  data    = g_malloc0 (roi.width * roi.height * 4);
+  for (i = 0; i < roi.width * roi.height * 4; i++)
+    pattern[i] = (i * 7) & 0xff;
+
+  buf_a = gegl_buffer_new (&roi, format);
+  gegl_buffer_set (buf_a, &roi, 0, format, pattern, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_save (buf_a, buf_a_path, &roi);
+  g_object_unref (buf_a);
+
+  /* the tiles are found through the index table */
+  buf_a = gegl_buffer_load (buf_a_path);
+  gegl_buffer_get (buf_a, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Loaded contents do not match.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  /* the file backend decodes compressed tiles as they are read */
+  memset (data, 0, roi.width * roi.height * 4);
+  buf_a = gegl_buffer_open (buf_a_path);
+  gegl_buffer_get (buf_a, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Opened contents do not match.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  g_unlink (buf_a_path);
+  g_remove (tmpdir);
+
+  g_free (pattern);
+  g_free (data);
+  g_free (tmpdir);
+  g_free (buf_a_path);
+
+  return result;
+}
+
+static gboolean
+test_buffer_load_rev0 (void)
+{
+  gboolean          result = TRUE;
+  gchar            *tmpdir = NULL;
+  gchar            *buf_a_path = NULL;
+  GeglBuffer       *buf_a = NULL;
+  const Babl       *format = babl_format ("R'G'B'A u8");
+  GeglRectangle     roi = {0, 0, 64, 64};
+  GeglBufferHeader  header = { { 0, }, };
+  GeglBufferTile   *entry;
+  guchar           *pattern;
+  guchar           *data;
+  FILE             *file;
+  gint              i;
+
+  tmpdir = g_dir_make_tmp ("test-backend-file-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  buf_a_path = g_build_filename (tmpdir, "buf_a.gegl", NULL);
+
+  pattern = g_malloc (roi.width * roi.height * 4);
+  data    = g_malloc0 (roi.width * roi.height * 4);
+  for (i = 0; i < roi.width * roi.height * 4; i++)
+    pattern[i] = (i * 7) & 0xff;
+
+  /* a single tile file using the linked list index of revision 0 */
+  header.width  = roi.width;
+  header.height = roi.height;
+  gegl_buffer_header_init (&header, roi.width, roi.height, 4, format);
+  header.flags = GEGL_FLAG_FLUSHED | GEGL_FLAG_IS_HEADER;
+  header.next  = sizeof (GeglBufferHeader);
+
+  /* entries of revision 0 end before the codec */
+  entry = gegl_tile_entry_new (0, 0, 0);
+  entry->block.length = G_STRUCT_OFFSET (GeglBufferTile, codec);
+  entry->offset = sizeof (GeglBufferHeader) + entry->block.length;
+
+  file = g_fopen (buf_a_path, "wb");
+  fwrite (&header, sizeof (GeglBufferHeader), 1, file);
+  fwrite (entry, entry->block.length, 1, file);
+  fwrite (pattern, roi.width * roi.height * 4, 1, file);
+  fclose (file);
+
+  gegl_tile_entry_destroy (entry);
+
+  buf_a = gegl_buffer_load (buf_a_path);
+  gegl_buffer_get (buf_a, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Loaded contents do not match.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  g_unlink (buf_a_path);
+  g_remove (tmpdir);
+
+  g_free (pattern);
+  g_free (data);
+  g_free (tmpdir);
+  g_free (buf_a_path);
+
+  return result;
+}
+
+static gboolean
+test_buffer_open_mapped (void)
+{
+  gboolean         result = TRUE;
+  gchar           *tmpdir = NULL;
+  gchar           *buf_a_path = NULL;
+  GeglBuffer      *buf_a = NULL;
+  GeglBuffer      *buf_b = NULL;
+  const Babl      *format = babl_format ("R'G'B'A u8");
+  GeglRectangle    roi = {0, 0, 300, 200};
+  GeglRectangle    rect = {10, 10, 100, 100};
+  GeglColor       *color;
+  guchar          *pattern;
+  guchar          *data;
+  gint             i;
+
+  tmpdir = g_dir_make_tmp ("test-backend-file-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  buf_a_path = g_build_filename (tmpdir, "buf_a.gegl", NULL);
+
+  pattern = g_malloc (roi.width * roi.height * 4);
+  data    = g_malloc0 (roi.width * roi.height * 4);
+  for (i = 0; i < roi.width * roi.height * 4; i++)
+    pattern[i] = (i * 7) & 0xff;
+
+  /* only uncompressed tiles are served from the mapping */
+  g_object_set (gegl_config (), "save-compression", "nop", NULL);
+
+  buf_a = gegl_buffer_new (&roi, format);
+  gegl_buffer_set (buf_a, &roi, 0, format, pattern, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_save (buf_a, buf_a_path, &roi);
+  g_object_unref (buf_a);
+
+  buf_a = gegl_buffer_open_mapped (buf_a_path);
+  gegl_buffer_get (buf_a, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Mapped contents do not match.\n");
+      result = FALSE;
+    }
+
+  /* shares the mapped tiles of buf_a */
+  buf_b = gegl_buffer_dup (buf_a);
+
+  color = gegl_color_new ("black");
+  gegl_buffer_set_color (buf_a, &rect, color);
+  g_object_unref (color);
+  gegl_buffer_flush (buf_a);
+
+  memset (data, 0, roi.width * roi.height * 4);
+  gegl_buffer_get (buf_b, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Writing to a mapped buffer changed its copy.\n");
+      result = FALSE;
+    }
+
+  /* the copy is the last user of the mapped tiles, and must still not
+   * write to the mapping
+   */
+  g_object_unref (buf_a);
+
+  memset (data, 0, roi.width * roi.height * 4);
+  gegl_buffer_set (buf_b, &rect, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+
+  for (i = 0; i < rect.height; i++)
+    memset (pattern + ((rect.y + i) * roi.width + rect.x) * 4, 0,
+            rect.width * 4);
+
+  gegl_buffer_get (buf_b, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Writing to the copy of a released mapped buffer failed.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_b);
+
+  g_unlink (buf_a_path);
+  g_remove (tmpdir);
+
+  g_free (pattern);
+  g_free (data);
+  g_free (tmpdir);
+  g_free (buf_a_path);
+
+  return result;
+}
+
+static gboolean
+test_buffer_save_in_background (void)
+{
+  gboolean         result = TRUE;
+  gchar           *tmpdir = NULL;
+  gchar           *buf_a_path = NULL;
+  GeglBuffer      *buf_a = NULL;
+  const Babl      *format = babl_format ("R'G'B'A u8");
+  GeglRectangle    roi = {0, 0, 300, 200};
+  GeglColor       *color;
+  GThread         *thread;
+  guchar          *pattern;
+  guchar          *data;
+  gint             i;
+
+  tmpdir = g_dir_make_tmp ("test-backend-file-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  buf_a_path = g_build_filename (tmpdir, "buf_a.gegl", NULL);
+
+  pattern = g_malloc (roi.width * roi.height * 4);
+  data    = g_malloc0 (roi.width * roi.height * 4);
+  for (i = 0; i < roi.width * roi.height * 4; i++)
+    pattern[i] = (i * 7) & 0xff;
+
+  buf_a = gegl_buffer_new (&roi, format);
+  gegl_buffer_set (buf_a, &roi, 0, format, pattern, GEGL_AUTO_ROWSTRIDE);
+
+  thread = gegl_buffer_save_in_background (buf_a, buf_a_path, &roi);
+
+  /* changes made while saving do not end up in the file */
+  color = gegl_color_new ("black");
+  gegl_buffer_set_color (buf_a, &roi, color);
+  g_object_unref (color);
+
+  if (! g_thread_join (thread))
+    {
+      printf ("Saving in the background failed.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  buf_a = gegl_buffer_load (buf_a_path);
+  gegl_buffer_get (buf_a, &roi, 1.0, format, data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data, pattern, roi.width * roi.height * 4))
+    {
+      printf ("Saved contents do not match.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  g_unlink (buf_a_path);
+  g_remove (tmpdir);
+
+  g_free (pattern);
+  g_free (data);
+  g_free (tmpdir);
+  g_free (buf_a_path);
+
+  return result;
+}
+
 #define RUN_TEST(test_name) \
 { \
   if (test_name()) \
@@ -442,6 +739,10 @@ int main(int argc, char **argv)
   RUN_TEST (test_buffer_same_path)
   RUN_TEST (test_buffer_open)
   RUN_TEST (test_buffer_change_extent)
+  RUN_TEST (test_buffer_save_contents)
+  RUN_TEST (test_buffer_load_rev0)
+  RUN_TEST (test_buffer_open_mapped)
+  RUN_TEST (test_buffer_save_in_background)
 
   gegl_exit();
 
@@ -0,0 +1,231 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-buffer-backend.h"
+#include "gegl-tile-backend-mmap.h"
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH  300
+#define HEIGHT 200
+
+static guchar *
+make_pattern (gint seed)
+{
+  guchar *data = g_malloc (WIDTH * HEIGHT * 4);
+  gint    i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    data[i] = (i * 7 + seed) & 0xff;
+
+  return data;
+}
+
+static gboolean
+check_contents (GeglBuffer   *buffer,
+                const guchar *expected)
+{
+  GeglRectangle  roi  = {0, 0, WIDTH, HEIGHT};
+  guchar        *data = g_malloc (WIDTH * HEIGHT * 4);
+  gboolean       result;
+
+  gegl_buffer_get (buffer, &roi, 1.0, babl_format ("R'G'B'A u8"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  result = memcmp (data, expected, WIDTH * HEIGHT * 4) == 0;
+
+  g_free (data);
+
+  return result;
+}
+
+static GeglBuffer *
+new_buffer (const gchar *path)
+{
+  return g_object_new (GEGL_TYPE_BUFFER,
+                       "format", babl_format ("R'G'B'A u8"),
+                       "path", path,
+                       "x", 0,
+                       "y", 0,
+                       "width", WIDTH,
+                       "height", HEIGHT,
+                       NULL);
+}
+
+static gboolean
+test_buffer_backend (void)
+{
+  gboolean         result = TRUE;
+  GeglBuffer      *buf_a;
+  GeglTileBackend *backend_a = NULL;
+
+  buf_a = new_buffer ("mmap");
+
+  g_object_get (buf_a, "backend", &backend_a, NULL);
+
+  if (!GEGL_IS_TILE_BACKEND_MMAP (backend_a))
+    {
+      printf ("Buffer did not use the mmap backend.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (backend_a);
+  g_object_unref (buf_a);
+
+  return result;
+}
+
+static gboolean
+test_buffer_contents (void)
+{
+  gboolean       result = TRUE;
+  GeglRectangle  roi    = {0, 0, WIDTH, HEIGHT};
+  gchar         *tmpdir;
+  gchar         *path;
+  guchar        *pattern;
+  GeglBuffer    *buf_a;
+  GDir          *dir;
+
+  tmpdir = g_dir_make_tmp ("test-backend-mmap-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  path    = g_strconcat ("mmap:", tmpdir, NULL);
+  pattern = make_pattern (0);
+
+  buf_a = new_buffer (path);
+  gegl_buffer_set (buf_a, &roi, 0, babl_format ("R'G'B'A u8"), pattern,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  /* push the tiles out of the cache and into the mapping */
+  gegl_buffer_flush (buf_a);
+  gegl_tile_source_reinit (GEGL_TILE_SOURCE (buf_a));
+
+  if (!check_contents (buf_a, pattern))
+    {
+      printf ("Buffer contents do not match.\n");
+      result = FALSE;
+    }
+
+  /* the backing file is unlinked as soon as it is mapped */
+  dir = g_dir_open (tmpdir, 0, NULL);
+  if (dir && g_dir_read_name (dir))
+    {
+      printf ("The tile file was left in the directory.\n");
+      result = FALSE;
+    }
+  if (dir)
+    g_dir_close (dir);
+
+  g_object_unref (buf_a);
+  g_remove (tmpdir);
+
+  g_free (pattern);
+  g_free (path);
+  g_free (tmpdir);
+
+  return result;
+}
+
+static gboolean
+test_buffer_copy_on_write (void)
+{
+  gboolean       result = TRUE;
+  GeglRectangle  roi    = {0, 0, WIDTH, HEIGHT};
+  guchar        *pattern_a;
+  guchar        *pattern_b;
+  GeglBuffer    *buf_a;
+  GeglBuffer    *buf_b;
+
+  pattern_a = make_pattern (0);
+  pattern_b = make_pattern (100);
+
+  buf_a = new_buffer ("mmap");
+  gegl_buffer_set (buf_a, &roi, 0, babl_format ("R'G'B'A u8"), pattern_a,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buf_a);
+  gegl_tile_source_reinit (GEGL_TILE_SOURCE (buf_a));
+
+  /* shares the tiles pointing into the mapping of buf_a */
+  buf_b = gegl_buffer_dup (buf_a);
+
+  gegl_buffer_set (buf_a, &roi, 0, babl_format ("R'G'B'A u8"), pattern_b,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buf_a);
+  gegl_tile_source_reinit (GEGL_TILE_SOURCE (buf_a));
+
+  if (!check_contents (buf_a, pattern_b))
+    {
+      printf ("Modified buffer contents do not match.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+
+  /* the mapping outlives the buffer while buf_b uses it */
+  if (!check_contents (buf_b, pattern_a))
+    {
+      printf ("Copied buffer changed with the original.\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_b);
+
+  g_free (pattern_a);
+  g_free (pattern_b);
+
+  return result;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_buffer_backend)
+  RUN_TEST (test_buffer_contents)
+  RUN_TEST (test_buffer_copy_on_write)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
@@ -0,0 +1,313 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIDTH  700
+#define HEIGHT 500
+
+static guchar
+pattern (gint x,
+         gint y,
+         gint c)
+{
+  return (x * 3 + y * 7 + c) & 0xff;
+}
+
+static void
+write_pattern (GeglBufferIterator *iter,
+               gpointer            scratch,
+               gpointer            user_data)
+{
+  guchar *data = iter->data[0];
+  gint    x, y, c;
+
+  for (y = 0; y < iter->roi[0].height; y++)
+    for (x = 0; x < iter->roi[0].width; x++)
+      for (c = 0; c < 4; c++)
+        *data++ = pattern (iter->roi[0].x + x, iter->roi[0].y + y, c);
+}
+
+static void
+sum_chunk (GeglBufferIterator *iter,
+           gpointer            scratch,
+           gpointer            user_data)
+{
+  guint64 *sum  = scratch;
+  guchar  *data = iter->data[0];
+  gint     i;
+
+  for (i = 0; i < iter->length * 4; i++)
+    *sum += data[i];
+
+  sum[1] += iter->length;
+}
+
+static void
+sum_merge (gpointer scratch,
+           gpointer user_data)
+{
+  guint64 *sum    = scratch;
+  guint64 *result = user_data;
+
+  result[0] += sum[0];
+  result[1] += sum[1];
+}
+
+static gboolean
+check_pattern (GeglBuffer          *buffer,
+               const GeglRectangle *roi)
+{
+  guchar   *data = g_malloc (roi->width * roi->height * 4);
+  gboolean  result = TRUE;
+  gint      x, y, c;
+
+  gegl_buffer_get (buffer, roi, 1.0, babl_format ("R'G'B'A u8"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (y = 0; y < roi->height && result; y++)
+    for (x = 0; x < roi->width && result; x++)
+      for (c = 0; c < 4; c++)
+        if (data[((y * roi->width) + x) * 4 + c] !=
+            pattern (roi->x + x, roi->y + y, c))
+          {
+            printf ("Wrong pixel at %d,%d.\n", roi->x + x, roi->y + y);
+            result = FALSE;
+            break;
+          }
+
+  g_free (data);
+
+  return result;
+}
+
+static gboolean
+test_parallel_write (void)
+{
+  /* an area not aligned with the tiles */
+  GeglRectangle       extent = {-30, -20, WIDTH, HEIGHT};
+  GeglRectangle       roi    = {-13, 5, WIDTH - 40, HEIGHT - 50};
+  GeglBuffer         *buffer;
+  GeglBufferIterator *iter;
+  gboolean            result;
+
+  buffer = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+
+  iter = gegl_buffer_iterator_new (buffer, &roi, 0, babl_format ("R'G'B'A u8"),
+                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, write_pattern,
+                                         NULL, 0, NULL, NULL);
+
+  result = check_pattern (buffer, &roi);
+
+  g_object_unref (buffer);
+
+  return result;
+}
+
+static gboolean
+test_parallel_reduce (void)
+{
+  GeglRectangle       extent = {0, 0, WIDTH, HEIGHT};
+  GeglBuffer         *buffer;
+  GeglBufferIterator *iter;
+  guint64             expected = 0;
+  guint64             result[2] = {0, 0};
+  gint                x, y, c;
+
+  buffer = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+
+  iter = gegl_buffer_iterator_new (buffer, NULL, 0, NULL,
+                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, write_pattern,
+                                         NULL, 0, NULL, NULL);
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      for (c = 0; c < 4; c++)
+        expected += pattern (x, y, c);
+
+  /* the reads are converted, and so not done on the tiles directly */
+  iter = gegl_buffer_iterator_new (buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, sum_chunk,
+                                         NULL, 2 * sizeof (guint64),
+                                         sum_merge, result);
+
+  g_object_unref (buffer);
+
+  if (result[0] != expected || result[1] != WIDTH * HEIGHT)
+    {
+      printf ("The parallel sum does not match.\n");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+copy_chunk (GeglBufferIterator *iter,
+            gpointer            scratch,
+            gpointer            user_data)
+{
+  memcpy (iter->data[1], iter->data[0], iter->length * 4);
+}
+
+static gboolean
+test_parallel_unaligned (void)
+{
+  GeglRectangle       extent = {0, 0, WIDTH, HEIGHT};
+  GeglRectangle       src    = {0, 0, WIDTH - 17, HEIGHT - 9};
+  GeglRectangle       dst    = {17, 9, WIDTH - 17, HEIGHT - 9};
+  GeglBuffer         *source;
+  GeglBuffer         *dest;
+  GeglBufferIterator *iter;
+  gboolean            result = TRUE;
+  guchar             *data_a;
+  guchar             *data_b;
+
+  source = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+  dest   = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+
+  iter = gegl_buffer_iterator_new (source, NULL, 0, NULL,
+                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, write_pattern,
+                                         NULL, 0, NULL, NULL);
+
+  /* the tiles of dest do not line up with those of source */
+  iter = gegl_buffer_iterator_new (source, &src, 0, NULL,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_add (iter, dest, &dst, 0, NULL,
+                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, copy_chunk,
+                                         NULL, 0, NULL, NULL);
+
+  data_a = g_malloc (src.width * src.height * 4);
+  data_b = g_malloc (src.width * src.height * 4);
+
+  gegl_buffer_get (source, &src, 1.0, NULL, data_a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (dest, &dst, 1.0, NULL, data_b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (memcmp (data_a, data_b, src.width * src.height * 4))
+    {
+      printf ("The copy does not match.\n");
+      result = FALSE;
+    }
+
+  g_free (data_a);
+  g_free (data_b);
+  g_object_unref (source);
+  g_object_unref (dest);
+
+  return result;
+}
+
+static void
+nested_chunk (GeglBufferIterator *iter,
+              gpointer            scratch,
+              gpointer            user_data)
+{
+  GeglBuffer         *other  = user_data;
+  GeglBufferIterator *inner;
+  guint64            *count  = scratch;
+  guint64             sum[2] = {0, 0};
+
+  /* a parallel iteration from within one, which the threads already busy
+   * with the outer one have to complete
+   */
+  inner = gegl_buffer_iterator_new (other, NULL, 0, babl_format ("R'G'B'A u8"),
+                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (inner, sum_chunk,
+                                         NULL, 2 * sizeof (guint64),
+                                         sum_merge, sum);
+
+  count[0] += sum[1];
+  count[1] += 1;
+}
+
+static gboolean
+test_parallel_nested (void)
+{
+  GeglRectangle       extent = {0, 0, WIDTH, HEIGHT};
+  GeglRectangle       small  = {0, 0, 300, 200};
+  GeglBuffer         *buffer;
+  GeglBuffer         *other;
+  GeglBufferIterator *iter;
+  guint64             count[2] = {0, 0};
+
+  buffer = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+  other  = gegl_buffer_new (&small, babl_format ("R'G'B'A u8"));
+
+  iter = gegl_buffer_iterator_new (buffer, NULL, 0, NULL,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_foreach_parallel (iter, nested_chunk,
+                                         NULL, 2 * sizeof (guint64),
+                                         sum_merge, count);
+
+  g_object_unref (buffer);
+  g_object_unref (other);
+
+  if (count[1] == 0 || count[0] != count[1] * small.width * small.height)
+    {
+      printf ("The nested iterations do not add up.\n");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               "threads", 4,
+               NULL);
+
+  RUN_TEST (test_parallel_write)
+  RUN_TEST (test_parallel_reduce)
+  RUN_TEST (test_parallel_unaligned)
+  RUN_TEST (test_parallel_nested)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
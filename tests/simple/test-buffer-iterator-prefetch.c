@@ -0,0 +1,148 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-buffer-iterator-private.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIDTH  512
+#define HEIGHT 512
+
+static GeglBuffer *
+pattern_buffer (void)
+{
+  GeglRectangle  extent = {0, 0, WIDTH, HEIGHT};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("R'G'B'A u8"));
+  guchar        *data   = g_malloc (WIDTH * HEIGHT * 4);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    data[i] = (i * 7 + i / (WIDTH * 4)) & 0xff;
+
+  gegl_buffer_set (buffer, &extent, 0, NULL, data, GEGL_AUTO_ROWSTRIDE);
+  g_free (data);
+
+  return buffer;
+}
+
+/* reads the first zoom level of buffer through an iterator */
+static guchar *
+read_level (GeglBuffer *buffer,
+            gint        prefetch)
+{
+  const gint          width = WIDTH / 2;
+  guchar             *out   = g_malloc0 (width * (HEIGHT / 2) * 4);
+  GeglBufferIterator *iter;
+
+  g_object_set (gegl_config (), "iterator-prefetch", prefetch, NULL);
+
+  iter = gegl_buffer_iterator_new (buffer, NULL, 1, NULL,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const GeglRectangle *roi  = &iter->roi[0];
+      const guchar        *data = iter->data[0];
+      gint                 row;
+
+      for (row = 0; row < roi->height; row++)
+        memcpy (out + ((roi->y + row) * width + roi->x) * 4,
+                data + row * roi->width * 4,
+                roi->width * 4);
+    }
+
+  return out;
+}
+
+static gboolean
+test_prefetch_zoom (void)
+{
+  GeglBuffer *plain    = pattern_buffer ();
+  GeglBuffer *prefetch = pattern_buffer ();
+  guchar     *expected;
+  guchar     *result;
+  gint        issued, hidden, late;
+  gint        issued0, hidden0, late0;
+  gboolean    success  = TRUE;
+
+  expected = read_level (plain, 0);
+
+  gegl_buffer_iterator_get_prefetch_stats (&issued0, &hidden0, &late0);
+  result = read_level (prefetch, 2);
+  gegl_buffer_iterator_get_prefetch_stats (&issued, &hidden, &late);
+
+  issued -= issued0;
+  hidden -= hidden0;
+  late   -= late0;
+
+  if (memcmp (expected, result, (WIDTH / 2) * (HEIGHT / 2) * 4))
+    {
+      printf ("The prefetched level differs.\n");
+      success = FALSE;
+    }
+
+  /* every tile but the first is computed ahead of its use */
+  if (issued < 1 || hidden + late != issued)
+    {
+      printf ("Prefetched %d tiles, %d were ready and %d late.\n",
+              issued, hidden, late);
+      success = FALSE;
+    }
+
+  g_free (expected);
+  g_free (result);
+  g_object_unref (plain);
+  g_object_unref (prefetch);
+
+  return success;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               "threads", 4,
+               NULL);
+
+  RUN_TEST (test_prefetch_zoom)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
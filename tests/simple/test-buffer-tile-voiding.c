@@ -142,6 +142,97 @@ test_buffer_copy (void)
   return result;
 }
 
+static gboolean
+test_buffer_build_pyramid (void)
+{
+  gboolean result = TRUE;
+
+  GeglBuffer *bufferA, *bufferB;
+  const Babl *format = babl_format ("Y u8");
+  GeglColor *black = gegl_color_new("black");
+  GeglRectangle full_extent = {0, 0, 0, 0};
+  GeglRectangle scaled_extent = {0, 0, 0, 0};
+  GeglRectangle edit = {0, 0, 0, 0};
+
+  guchar *pattern;
+  guchar *output_buffer_a, *output_buffer_b;
+  gint    output_buffer_size;
+  gint    i;
+
+  bufferA = gegl_buffer_new (NULL, format);
+  bufferB = gegl_buffer_new (NULL, format);
+
+  g_object_get (bufferA,
+                "tile-width", &full_extent.width,
+                "tile-height", &full_extent.height,
+                NULL);
+
+  full_extent.width *= 4;
+  full_extent.height *= 4;
+
+  scaled_extent.width = full_extent.width / 4;
+  scaled_extent.height = full_extent.height / 4;
+
+  edit.x = full_extent.width / 3;
+  edit.y = full_extent.height / 3;
+  edit.width = full_extent.width / 5;
+  edit.height = full_extent.height / 5;
+
+  output_buffer_size = scaled_extent.width * scaled_extent.height;
+
+  pattern = gegl_malloc (full_extent.width * full_extent.height);
+  output_buffer_a = gegl_malloc (output_buffer_size);
+  output_buffer_b = gegl_malloc (output_buffer_size);
+
+  for (i = 0; i < full_extent.width * full_extent.height; i++)
+    pattern[i] = (i * 7) & 0xff;
+
+  gegl_buffer_set_extent (bufferA, &full_extent);
+  gegl_buffer_set_extent (bufferB, &full_extent);
+
+  gegl_buffer_set (bufferA, NULL, 0, format, pattern, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (bufferB, NULL, 0, format, pattern, GEGL_AUTO_ROWSTRIDE);
+
+  /* the levels built ahead of time match the ones built on demand */
+  gegl_buffer_build_pyramid (bufferA, NULL, 0);
+
+  gegl_buffer_get (bufferA, &scaled_extent, 0.25, format, output_buffer_a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (bufferB, &scaled_extent, 0.25, format, output_buffer_b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (0 != memcmp (output_buffer_a, output_buffer_b, output_buffer_size))
+    {
+      printf ("%s: built levels don't match!\n", G_STRFUNC);
+      result = FALSE;
+    }
+
+  /* and so do they once the base level was changed */
+  gegl_buffer_set_color (bufferA, &edit, black);
+  gegl_buffer_set_color (bufferB, &edit, black);
+
+  gegl_buffer_get (bufferA, &scaled_extent, 0.25, format, output_buffer_a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (bufferB, &scaled_extent, 0.25, format, output_buffer_b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (0 != memcmp (output_buffer_a, output_buffer_b, output_buffer_size))
+    {
+      printf ("%s: rebuilt levels don't match!\n", G_STRFUNC);
+      result = FALSE;
+    }
+
+  gegl_free (pattern);
+  gegl_free (output_buffer_a);
+  gegl_free (output_buffer_b);
+
+  g_object_unref (bufferA);
+  g_object_unref (bufferB);
+  g_object_unref (black);
+
+  return result;
+}
+
 #define RUN_TEST(test_name) \
 { \
   if (test_name()) \
@@ -170,6 +261,7 @@ int main(int argc, char **argv)
                NULL);
 
   RUN_TEST (test_buffer_copy)
+  RUN_TEST (test_buffer_build_pyramid)
 
   gegl_exit();
 
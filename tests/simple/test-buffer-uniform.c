@@ -0,0 +1,253 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define SIZE 512
+
+static const gfloat color_a[4] = {0.25, 0.5, 0.75, 1.0};
+static const gfloat color_b[4] = {0.9, 0.1, 0.3, 0.5};
+
+static GeglBuffer *
+new_filled (const GeglRectangle *rect,
+            const gfloat        *value)
+{
+  GeglRectangle  extent = {0, 0, SIZE, SIZE};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  GeglColor     *color  = gegl_color_new (NULL);
+
+  gegl_color_set_pixel (color, babl_format ("RGBA float"), value);
+  gegl_buffer_set_color (buffer, rect ? rect : &extent, color);
+
+  g_object_unref (color);
+
+  return buffer;
+}
+
+static gboolean
+check_rect (GeglBuffer          *buffer,
+            const GeglRectangle *rect,
+            gdouble              scale,
+            const gfloat        *value)
+{
+  gfloat   *data    = g_new (gfloat, rect->width * rect->height * 4);
+  gboolean  success = TRUE;
+  gint      i;
+
+  gegl_buffer_get (buffer, rect, scale, babl_format ("RGBA float"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < rect->width * rect->height * 4; i++)
+    if (fabsf (data[i] - value[i % 4]) > 1e-6)
+      {
+        printf ("Wrong pixel at %d,%d at scale %g: %g instead of %g.\n",
+                rect->x + i / 4 % rect->width, rect->y + i / 4 / rect->width,
+                scale, data[i], value[i % 4]);
+        success = FALSE;
+        break;
+      }
+
+  g_free (data);
+
+  return success;
+}
+
+static void
+changed (GeglBuffer          *buffer,
+         const GeglRectangle *rect,
+         gpointer             user_data)
+{
+  GeglRectangle *bounds = user_data;
+
+  gegl_rectangle_bounding_box (bounds, bounds, rect);
+}
+
+static gboolean
+test_uniform_set_color (void)
+{
+  GeglRectangle  extent  = {0, 0, SIZE, SIZE};
+  GeglRectangle  rect    = {0, 0, SIZE / 2, SIZE};
+  GeglRectangle  bounds  = {0, 0, 0, 0};
+  GeglBuffer    *buffer  = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  GeglColor     *color   = gegl_color_new (NULL);
+  gboolean       success = TRUE;
+
+  gegl_buffer_signal_connect (buffer, "changed", G_CALLBACK (changed), &bounds);
+
+  /* a tile aligned fill, made of uniform tiles only */
+  gegl_color_set_pixel (color, babl_format ("RGBA float"), color_a);
+  gegl_buffer_set_color (buffer, &rect, color);
+
+  if (! gegl_rectangle_equal (&bounds, &rect))
+    {
+      printf ("The changed signal covered %d,%d %dx%d.\n",
+              bounds.x, bounds.y, bounds.width, bounds.height);
+      success = FALSE;
+    }
+
+  success &= check_rect (buffer, &rect, 1.0, color_a);
+
+  g_object_unref (color);
+  g_object_unref (buffer);
+
+  return success;
+}
+
+static gboolean
+test_uniform_unaligned (void)
+{
+  GeglRectangle  rect    = {13, 7, SIZE - 40, SIZE - 30};
+  GeglRectangle  left    = {0, 0, 13, SIZE};
+  GeglBuffer    *buffer  = new_filled (&rect, color_a);
+  gfloat         none[4] = {0.0, 0.0, 0.0, 0.0};
+  gboolean       success = TRUE;
+
+  success &= check_rect (buffer, &rect, 1.0, color_a);
+  success &= check_rect (buffer, &left, 1.0, none);
+
+  g_object_unref (buffer);
+
+  return success;
+}
+
+static gboolean
+test_uniform_write (void)
+{
+  GeglRectangle  pixel   = {10, 10, 1, 1};
+  GeglRectangle  rest    = {SIZE / 2, 0, SIZE / 2, SIZE};
+  GeglBuffer    *a       = new_filled (NULL, color_a);
+  GeglBuffer    *b       = new_filled (NULL, color_a);
+  gboolean       success = TRUE;
+
+  /* uniform tiles of the same value share their data, writing to one of
+   * them must leave the others alone
+   */
+  gegl_buffer_set (a, &pixel, 0, babl_format ("RGBA float"), color_b,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  success &= check_rect (a, &pixel, 1.0, color_b);
+  success &= check_rect (a, &rest, 1.0, color_a);
+  success &= check_rect (b, &pixel, 1.0, color_a);
+
+  g_object_unref (a);
+  g_object_unref (b);
+
+  return success;
+}
+
+static gboolean
+test_uniform_converted (void)
+{
+  GeglRectangle  rect     = {0, 0, SIZE, SIZE};
+  GeglBuffer    *buffer   = new_filled (NULL, color_a);
+  guchar        *data     = g_malloc (SIZE * SIZE * 4);
+  guchar         expected[4];
+  gboolean       success  = TRUE;
+  gint           i;
+
+  /* reads of uniform tiles convert a single pixel and replicate it */
+  babl_process (babl_fish (babl_format ("RGBA float"),
+                           babl_format ("R'G'B'A u8")),
+                color_a, expected, 1);
+
+  gegl_buffer_get (buffer, &rect, 1.0, babl_format ("R'G'B'A u8"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    if (data[i] != expected[i % 4])
+      {
+        printf ("Wrong converted pixel at %d,%d.\n", i / 4 % SIZE, i / 4 / SIZE);
+        success = FALSE;
+        break;
+      }
+
+  g_free (data);
+  g_object_unref (buffer);
+
+  return success;
+}
+
+static gboolean
+test_uniform_zoom (void)
+{
+  GeglRectangle  half    = {0, 0, SIZE / 4, SIZE};
+  GeglRectangle  whole   = {0, 0, SIZE / 2, SIZE / 2};
+  GeglRectangle  left    = {0, 0, SIZE / 8, SIZE / 2};
+  GeglRectangle  right   = {SIZE / 8, 0, SIZE / 2 - SIZE / 8, SIZE / 2};
+  GeglBuffer    *a       = new_filled (NULL, color_a);
+  GeglBuffer    *b       = new_filled (NULL, color_b);
+  GeglColor     *color   = gegl_color_new (NULL);
+  gboolean       success = TRUE;
+
+  /* mipmap tiles of uniform tiles of the same value */
+  success &= check_rect (a, &whole, 0.5, color_a);
+
+  /* and of uniform tiles of different values, a quarter of a quarter of
+   * the buffer being of another value
+   */
+  gegl_color_set_pixel (color, babl_format ("RGBA float"), color_a);
+  gegl_buffer_set_color (b, &half, color);
+
+  success &= check_rect (b, &left, 0.5, color_a);
+  success &= check_rect (b, &right, 0.5, color_b);
+
+  g_object_unref (color);
+  g_object_unref (a);
+  g_object_unref (b);
+
+  return success;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_uniform_set_color)
+  RUN_TEST (test_uniform_unaligned)
+  RUN_TEST (test_uniform_write)
+  RUN_TEST (test_uniform_converted)
+  RUN_TEST (test_uniform_zoom)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
@@ -0,0 +1,210 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-compression.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define N_PIXELS (128 * 64)
+
+typedef enum
+{
+  PATTERN_FLAT,
+  PATTERN_GRADIENT,
+  PATTERN_RUNS,
+  PATTERN_NOISE,
+  N_PATTERNS
+} Pattern;
+
+static const gchar *codecs[]  = {"nop", "rle", "delta", "lz"};
+static const gchar *formats[] = {"Y u8", "R'G'B'A u8", "RGBA u16", "RGBA float"};
+static const gchar *patterns[] = {"flat", "gradient", "runs", "noise"};
+
+static void
+fill (guchar  *data,
+      gint     size,
+      gint     bpp,
+      Pattern  pattern)
+{
+  GRand *rand = g_rand_new_with_seed (size);
+  gint   i;
+
+  for (i = 0; i < size; i++)
+    {
+      gint pixel = i / bpp;
+
+      switch (pattern)
+        {
+          case PATTERN_FLAT:
+            data[i] = 0x5a;
+            break;
+          case PATTERN_GRADIENT:
+            data[i] = pixel + i % bpp;
+            break;
+          case PATTERN_RUNS:
+            data[i] = (pixel / 37) * 13 + (i % bpp) * 71;
+            break;
+          default:
+            data[i] = g_rand_int (rand);
+            break;
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+static gboolean
+round_trip (const gchar *codec,
+            const gchar *format_name,
+            Pattern      pattern)
+{
+  const GeglCompression *compression = gegl_compression (codec);
+  const Babl            *format      = babl_format (format_name);
+  gint                   bpp         = babl_format_get_bytes_per_pixel (format);
+  gint                   size        = N_PIXELS * bpp;
+  guchar                *data        = g_malloc (size);
+  guchar                *compressed  = g_malloc (2 * size);
+  guchar                *result      = g_malloc (size);
+  gboolean               success     = TRUE;
+  gint                   compressed_size;
+
+  fill (data, size, bpp, pattern);
+
+  if (! gegl_compression_compress (compression, format, data, N_PIXELS,
+                                   compressed, &compressed_size, 2 * size))
+    {
+      printf ("%s failed to compress %s %s data.\n",
+              codec, patterns[pattern], format_name);
+      success = FALSE;
+    }
+  else if (! gegl_compression_decompress (compression, format, result, N_PIXELS,
+                                          compressed, compressed_size) ||
+           memcmp (data, result, size))
+    {
+      printf ("%s does not round-trip %s %s data.\n",
+              codec, patterns[pattern], format_name);
+      success = FALSE;
+    }
+  else if (pattern == PATTERN_FLAT && strcmp (codec, "nop") &&
+           compressed_size >= size / 4)
+    {
+      printf ("%s does not shrink flat %s data.\n", codec, format_name);
+      success = FALSE;
+    }
+
+  /* data not fitting is reported, without writing past the limit */
+  if (success && compressed_size > 16)
+    {
+      memset (compressed, 0xa5, 2 * size);
+
+      if (gegl_compression_compress (compression, format, data, N_PIXELS,
+                                     compressed, &compressed_size, 16) ||
+          compressed[16] != 0xa5)
+        {
+          printf ("%s overflows the size limit on %s %s data.\n",
+                  codec, patterns[pattern], format_name);
+          success = FALSE;
+        }
+    }
+
+  g_free (data);
+  g_free (compressed);
+  g_free (result);
+
+  return success;
+}
+
+static gboolean
+test_compression_round_trip (void)
+{
+  gboolean success = TRUE;
+  gint     c, f, p;
+
+  for (c = 0; c < G_N_ELEMENTS (codecs); c++)
+    for (f = 0; f < G_N_ELEMENTS (formats); f++)
+      for (p = 0; p < N_PATTERNS; p++)
+        success &= round_trip (codecs[c], formats[f], p);
+
+  return success;
+}
+
+static gboolean
+test_compression_short (void)
+{
+  const Babl *format  = babl_format ("R'G'B'A u8");
+  gboolean    success = TRUE;
+  gint        c;
+
+  /* runs and matches must not reach past the end of a single pixel */
+  for (c = 0; c < G_N_ELEMENTS (codecs); c++)
+    {
+      const GeglCompression *compression = gegl_compression (codecs[c]);
+      guchar                 data[4]     = {1, 2, 3, 4};
+      guchar                 result[4]   = {0, };
+      guchar                 compressed[64];
+      gint                   compressed_size;
+
+      if (! gegl_compression_compress (compression, format, data, 1,
+                                       compressed, &compressed_size,
+                                       sizeof (compressed)) ||
+          ! gegl_compression_decompress (compression, format, result, 1,
+                                         compressed, compressed_size) ||
+          memcmp (data, result, sizeof (data)))
+        {
+          printf ("%s does not round-trip a single pixel.\n", codecs[c]);
+          success = FALSE;
+        }
+    }
+
+  return success;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_compression_round_trip)
+  RUN_TEST (test_compression_short)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
@@ -16,6 +16,8 @@
  */
 
 
+#include <string.h>
+
 #include <gegl.h>
 #include <gegl-buffer-backend.h>
 
@@ -76,6 +78,36 @@ set_data_full (void)
   g_assert (callback_called);
 }
 
+/**
+ * Tests that data from gegl_malloc() set with gegl_tile_set_data() on a
+ * bare tile is freed with the tile, also when shared with a clone.
+ **/
+static void
+set_data_malloced (void)
+{
+  GeglTile *tile  = gegl_tile_new_bare ();
+  GeglTile *clone;
+  guchar   *data  = gegl_malloc (64);
+
+  memset (data, 42, 64);
+  gegl_tile_set_data (tile, data, 64);
+
+  /* the clone gets data of its own when written to */
+  clone = gegl_tile_dup (tile);
+  gegl_tile_lock (clone);
+  gegl_tile_get_data (clone)[0] = 7;
+  gegl_tile_unlock (clone);
+
+  g_assert_cmpint (gegl_tile_get_data (tile)[0], ==, 42);
+
+  gegl_tile_unref (clone);
+  gegl_tile_unref (tile);
+
+  tile = gegl_tile_new_bare ();
+  gegl_tile_set_data (tile, gegl_malloc (64), 64);
+  gegl_tile_unref (tile);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -85,6 +117,7 @@ main (int    argc,
 
   ADD_TEST (set_unlock_notify);
   ADD_TEST (set_data_full);
+  ADD_TEST (set_data_malloced);
 
   return g_test_run ();
 }
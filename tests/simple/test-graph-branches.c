@@ -0,0 +1,264 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-plugin.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define WIDTH  400
+#define HEIGHT 300
+
+/* a copy that is not threaded, counting how many of its instances run
+ * at once
+ */
+
+typedef struct
+{
+  GeglOperationFilter  parent_instance;
+} GeglTestOperationSerial;
+
+typedef struct
+{
+  GeglOperationFilterClass  parent_class;
+} GeglTestOperationSerialClass;
+
+GType   gegl_test_operation_serial_get_type (void) G_GNUC_CONST;
+
+G_DEFINE_TYPE (GeglTestOperationSerial, gegl_test_operation_serial,
+               GEGL_TYPE_OPERATION_FILTER);
+
+static gint serial_running     = 0;
+static gint serial_max_running = 0;
+
+static gboolean
+serial_process (GeglOperation       *operation,
+                GeglBuffer          *input,
+                GeglBuffer          *output,
+                const GeglRectangle *roi,
+                gint                 level)
+{
+  gint running = g_atomic_int_add (&serial_running, 1) + 1;
+  gint max;
+
+  do
+    max = g_atomic_int_get (&serial_max_running);
+  while (running > max &&
+         ! g_atomic_int_compare_and_exchange (&serial_max_running, max, running));
+
+  /* long enough for the other branches to catch up */
+  g_usleep (20000);
+
+  gegl_buffer_copy (input, roi, output, roi);
+
+  g_atomic_int_add (&serial_running, -1);
+
+  return TRUE;
+}
+
+static void
+gegl_test_operation_serial_init (GeglTestOperationSerial *self)
+{
+}
+
+static void
+gegl_test_operation_serial_class_init (GeglTestOperationSerialClass *klass)
+{
+  GeglOperationClass       *operation_class = GEGL_OPERATION_CLASS (klass);
+  GeglOperationFilterClass *filter_class    = GEGL_OPERATION_FILTER_CLASS (klass);
+
+  filter_class->process     = serial_process;
+  operation_class->threaded = FALSE;
+
+  gegl_operation_class_set_keys (operation_class,
+                                 "name",        "gegl-test:serial",
+                                 "description", "",
+                                 NULL);
+}
+
+static GeglBuffer *
+noise_buffer (guint32 seed)
+{
+  GeglRectangle  extent = {0, 0, WIDTH, HEIGHT};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *data   = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (seed);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    data[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &extent, 0, NULL, data, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (data);
+
+  return buffer;
+}
+
+/* two sources, one of them forking into two blurs, joined again by overs,
+ * with an operation that is not threaded on each branch:
+ *
+ *   a ---- blur -- serial ----------- over -- over
+ *   b --+- blur -- serial -- opacity -'      |
+ *       '- blur -- serial -----------------'
+ */
+static void
+render (GeglBuffer *a,
+        GeglBuffer *b,
+        gint        threads,
+        gfloat     *data)
+{
+  GeglRectangle  roi = {10, 10, WIDTH - 20, HEIGHT - 20};
+  GeglNode      *graph;
+  GeglNode      *source_a, *source_b;
+  GeglNode      *blur_a, *blur_b, *blur_c;
+  GeglNode      *serial_a, *serial_b, *serial_c;
+  GeglNode      *opacity, *over, *over2;
+
+  g_object_set (G_OBJECT (gegl_config ()), "threads", threads, NULL);
+
+  graph    = gegl_node_new ();
+  source_a = gegl_node_new_child (graph, "operation", "gegl:buffer-source",
+                                  "buffer", a, NULL);
+  source_b = gegl_node_new_child (graph, "operation", "gegl:buffer-source",
+                                  "buffer", b, NULL);
+  blur_a   = gegl_node_new_child (graph, "operation", "gegl:gaussian-blur",
+                                  "std-dev-x", 3.0, "std-dev-y", 3.0, NULL);
+  blur_b   = gegl_node_new_child (graph, "operation", "gegl:gaussian-blur",
+                                  "std-dev-x", 2.0, "std-dev-y", 2.0, NULL);
+  blur_c   = gegl_node_new_child (graph, "operation", "gegl:gaussian-blur",
+                                  "std-dev-x", 5.0, "std-dev-y", 1.0, NULL);
+  serial_a = gegl_node_new_child (graph, "operation", "gegl-test:serial", NULL);
+  serial_b = gegl_node_new_child (graph, "operation", "gegl-test:serial", NULL);
+  serial_c = gegl_node_new_child (graph, "operation", "gegl-test:serial", NULL);
+  opacity  = gegl_node_new_child (graph, "operation", "gegl:opacity",
+                                  "value", 0.5, NULL);
+  over     = gegl_node_new_child (graph, "operation", "gegl:over", NULL);
+  over2    = gegl_node_new_child (graph, "operation", "gegl:over", NULL);
+
+  gegl_node_link_many (source_a, blur_a, serial_a, over, over2, NULL);
+  gegl_node_link_many (source_b, blur_b, serial_b, opacity, NULL);
+  gegl_node_link_many (source_b, blur_c, serial_c, NULL);
+  gegl_node_connect_to (opacity, "output", over, "aux");
+  gegl_node_connect_to (serial_c, "output", over2, "aux");
+
+  gegl_node_blit (over2, 1.0, &roi, babl_format ("RGBA float"), data,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+}
+
+static gboolean
+compare_branches (void)
+{
+  const gint  n        = (WIDTH - 20) * (HEIGHT - 20) * 4;
+  GeglBuffer *a        = noise_buffer (1);
+  GeglBuffer *b        = noise_buffer (2);
+  gfloat     *expected = g_new (gfloat, n);
+  gfloat     *result   = g_new (gfloat, n);
+  gboolean    success  = TRUE;
+  gint        i;
+
+  render (a, b, 1, expected);
+
+  g_atomic_int_set (&serial_max_running, 0);
+  render (a, b, 4, result);
+
+  if (g_atomic_int_get (&serial_max_running) > 1)
+    {
+      printf ("%d operations that are not threaded ran at once.\n",
+              g_atomic_int_get (&serial_max_running));
+      success = FALSE;
+    }
+
+  for (i = 0; i < n; i++)
+    if (fabsf (expected[i] - result[i]) > 1e-4)
+      {
+        printf ("The branches differ at %d: %g, %g.\n",
+                i / 4, expected[i], result[i]);
+        success = FALSE;
+        break;
+      }
+
+  g_free (expected);
+  g_free (result);
+  g_object_unref (a);
+  g_object_unref (b);
+
+  return success;
+}
+
+static gboolean
+test_branches (void)
+{
+  return compare_branches ();
+}
+
+/* a budget too small for any two outputs, one node running at a time */
+static gboolean
+test_branches_budget (void)
+{
+  guint64  cache_size;
+  gboolean success;
+
+  g_object_get (G_OBJECT (gegl_config ()), "tile-cache-size", &cache_size, NULL);
+  g_object_set (G_OBJECT (gegl_config ()), "tile-cache-size", (guint64) 1, NULL);
+
+  success = compare_branches ();
+
+  g_object_set (G_OBJECT (gegl_config ()), "tile-cache-size", cache_size, NULL);
+
+  return success;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  g_type_class_peek (gegl_test_operation_serial_get_type ());
+
+  RUN_TEST (test_branches)
+  RUN_TEST (test_branches_budget)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
@@ -0,0 +1,157 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/* an area not aligned with the tiles */
+#define X      -37
+#define Y       13
+#define WIDTH  900
+#define HEIGHT 500
+
+static GeglBuffer *
+noise_buffer (void)
+{
+  GeglRectangle  extent = {X, Y, WIDTH, HEIGHT};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *data   = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (42);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    data[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &extent, 0, NULL, data, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (data);
+
+  return buffer;
+}
+
+static void
+render (GeglBuffer          *buffer,
+        const gchar         *operation,
+        gint                 threads,
+        const GeglRectangle *roi,
+        gfloat              *data)
+{
+  GeglNode *graph;
+  GeglNode *source;
+  GeglNode *node;
+
+  g_object_set (G_OBJECT (gegl_config ()), "threads", threads, NULL);
+
+  /* a new graph each time, not to hit the cache of the last one */
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  node   = gegl_node_new_child (graph,
+                                "operation", operation,
+                                NULL);
+  gegl_node_link (source, node);
+
+  gegl_node_blit (node, 1.0, roi, babl_format ("RGBA float"), data,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+}
+
+/* the chunks processed by several threads against the whole area processed
+ * at once
+ */
+static gboolean
+compare_threads (const gchar *operation)
+{
+  GeglRectangle  roi      = {X + 17, Y + 7, WIDTH - 40, HEIGHT - 30};
+  GeglBuffer    *buffer   = noise_buffer ();
+  gfloat        *expected = g_new (gfloat, roi.width * roi.height * 4);
+  gfloat        *result   = g_new (gfloat, roi.width * roi.height * 4);
+  gboolean       success  = TRUE;
+  gint           i;
+
+  render (buffer, operation, 4, &roi, result);
+  render (buffer, operation, 1, &roi, expected);
+
+  /* sliding sums depend on where the area starts */
+  for (i = 0; i < roi.width * roi.height * 4; i++)
+    if (fabsf (expected[i] - result[i]) > 1e-4)
+      {
+        printf ("%s differs at %d,%d: %g, %g.\n", operation,
+                roi.x + i / 4 % roi.width, roi.y + i / 4 / roi.width,
+                expected[i], result[i]);
+        success = FALSE;
+        break;
+      }
+
+  g_free (expected);
+  g_free (result);
+  g_object_unref (buffer);
+
+  return success;
+}
+
+static gboolean
+test_point_filter_chunks (void)
+{
+  return compare_threads ("gegl:value-invert");
+}
+
+static gboolean
+test_filter_chunks (void)
+{
+  return compare_threads ("gegl:box-blur");
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_point_filter_chunks)
+  RUN_TEST (test_filter_chunks)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
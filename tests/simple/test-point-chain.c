@@ -0,0 +1,221 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-point-chain.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WIDTH  500
+#define HEIGHT 300
+
+static GeglBuffer *
+noise_buffer (guint32 seed)
+{
+  GeglRectangle  extent = {0, 0, WIDTH, HEIGHT};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *data   = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (seed);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    data[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &extent, 0, NULL, data, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (data);
+
+  return buffer;
+}
+
+static GeglNode *
+add_chain (GeglNode *graph,
+           GeglNode *input,
+           GeglNode *aux)
+{
+  GeglNode *brightness = gegl_node_new_child (graph,
+                                              "operation", "gegl:brightness-contrast",
+                                              "contrast", 1.3,
+                                              "brightness", 0.1,
+                                              NULL);
+  GeglNode *gamma      = gegl_node_new_child (graph,
+                                              "operation", "gegl:invert-gamma",
+                                              NULL);
+  GeglNode *multiply   = gegl_node_new_child (graph,
+                                              "operation", "gegl:multiply",
+                                              NULL);
+  GeglNode *invert     = gegl_node_new_child (graph,
+                                              "operation", "gegl:value-invert",
+                                              NULL);
+
+  gegl_node_link_many (input, brightness, gamma, multiply, invert, NULL);
+  gegl_node_connect_to (aux, "output", multiply, "aux");
+
+  return invert;
+}
+
+/* the operations of the chain one graph each, with buffers in between */
+static GeglBuffer *
+apply (GeglBuffer  *input,
+       GeglBuffer  *aux,
+       const gchar *operation)
+{
+  GeglNode   *graph  = gegl_node_new ();
+  GeglBuffer *output = NULL;
+  GeglNode   *source;
+  GeglNode   *node;
+  GeglNode   *sink;
+
+  source = gegl_node_new_child (graph, "operation", "gegl:buffer-source",
+                                "buffer", input, NULL);
+  node   = gegl_node_new_child (graph, "operation", operation, NULL);
+  sink   = gegl_node_new_child (graph, "operation", "gegl:buffer-sink",
+                                "buffer", &output, NULL);
+
+  if (!strcmp (operation, "gegl:brightness-contrast"))
+    gegl_node_set (node, "contrast", 1.3, "brightness", 0.1, NULL);
+
+  if (aux)
+    {
+      GeglNode *aux_source = gegl_node_new_child (graph,
+                                                  "operation", "gegl:buffer-source",
+                                                  "buffer", aux, NULL);
+      gegl_node_connect_to (aux_source, "output", node, "aux");
+    }
+
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+
+  g_object_unref (graph);
+
+  return output;
+}
+
+static gboolean
+compare_chain (gint threads)
+{
+  GeglRectangle  roi      = {7, 3, WIDTH - 20, HEIGHT - 10};
+  const gint     n        = roi.width * roi.height * 4;
+  GeglBuffer    *a        = noise_buffer (1);
+  GeglBuffer    *b        = noise_buffer (2);
+  gfloat        *expected = g_new (gfloat, n);
+  gfloat        *result   = g_new (gfloat, n);
+  gboolean       success  = TRUE;
+  GeglBuffer    *stage[4];
+  GeglNode      *graph;
+  GeglNode      *source_a, *source_b;
+  gint           runs;
+  gint           i;
+
+  g_object_set (G_OBJECT (gegl_config ()), "threads", threads, NULL);
+
+  stage[0] = apply (a,        NULL, "gegl:brightness-contrast");
+  stage[1] = apply (stage[0], NULL, "gegl:invert-gamma");
+  stage[2] = apply (stage[1], b,    "gegl:multiply");
+  stage[3] = apply (stage[2], NULL, "gegl:value-invert");
+
+  gegl_buffer_get (stage[3], &roi, 1.0, babl_format ("RGBA float"), expected,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  graph    = gegl_node_new ();
+  source_a = gegl_node_new_child (graph, "operation", "gegl:buffer-source",
+                                  "buffer", a, NULL);
+  source_b = gegl_node_new_child (graph, "operation", "gegl:buffer-source",
+                                  "buffer", b, NULL);
+
+  runs = gegl_point_chains_get_runs ();
+
+  gegl_node_blit (add_chain (graph, source_a, source_b), 1.0, &roi,
+                  babl_format ("RGBA float"), result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  /* the operations are rendered one by one if they are not chained */
+  if (gegl_point_chains_get_runs () == runs)
+    {
+      printf ("The point operations were not chained.\n");
+      success = FALSE;
+    }
+
+  for (i = 0; i < n; i++)
+    if (fabsf (expected[i] - result[i]) > 1e-4)
+      {
+        printf ("The chain differs at %d,%d: %g, %g.\n",
+                roi.x + i / 4 % roi.width, roi.y + i / 4 / roi.width,
+                expected[i], result[i]);
+        success = FALSE;
+        break;
+      }
+
+  for (i = 0; i < 4; i++)
+    g_object_unref (stage[i]);
+  g_object_unref (graph);
+  g_free (expected);
+  g_free (result);
+  g_object_unref (a);
+  g_object_unref (b);
+
+  return success;
+}
+
+static gboolean
+test_point_chain (void)
+{
+  return compare_chain (1);
+}
+
+static gboolean
+test_point_chain_threaded (void)
+{
+  return compare_chain (4);
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_point_chain)
+  RUN_TEST (test_point_chain_threaded)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}
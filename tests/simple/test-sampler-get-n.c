@@ -0,0 +1,215 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gegl.h"
+#include "gegl-cpuaccel-private.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIZE    200
+#define SAMPLES 300
+
+static GeglBuffer *
+noise_buffer (void)
+{
+  GeglRectangle  extent = {0, 0, SIZE, SIZE};
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *data   = g_new (gfloat, SIZE * SIZE * 4);
+  GRand         *rand   = g_rand_new_with_seed (42);
+  gint           i;
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    data[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &extent, 0, NULL, data, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (data);
+
+  return buffer;
+}
+
+/* samples a line, in both directions and with steps larger than the area a
+ * sampler holds, and compares with sampling one pixel at a time
+ */
+static gboolean
+compare_line (GeglBuffer      *buffer,
+              GeglSamplerType  type,
+              gdouble          x,
+              gdouble          y,
+              gdouble          dx,
+              gdouble          dy)
+{
+  const Babl  *format = babl_format ("R'G'B'A u8");
+  GeglSampler *sampler;
+  guchar       expected[SAMPLES * 4];
+  guchar       result[SAMPLES * 4];
+  gdouble      coordinates[SAMPLES * 2];
+  gdouble      u = x;
+  gdouble      v = y;
+  gint         i;
+
+  sampler = gegl_buffer_sampler_new (buffer, format, type);
+
+  for (i = 0; i < SAMPLES; i++)
+    {
+      gegl_sampler_get (sampler, u, v, NULL, expected + i * 4,
+                        GEGL_ABYSS_CLAMP);
+
+      coordinates[i * 2]     = u;
+      coordinates[i * 2 + 1] = v;
+
+      u += dx;
+      v += dy;
+    }
+
+  g_object_unref (sampler);
+
+  /* a fresh sampler, not holding the area of the last samples */
+  sampler = gegl_buffer_sampler_new (buffer, format, type);
+  gegl_sampler_get_n (sampler, x, y, dx, dy, SAMPLES, NULL, result,
+                      GEGL_ABYSS_CLAMP);
+  g_object_unref (sampler);
+
+  if (memcmp (expected, result, sizeof (result)))
+    {
+      printf ("gegl_sampler_get_n () differs for %d along %g,%g.\n",
+              type, dx, dy);
+      return FALSE;
+    }
+
+  sampler = gegl_buffer_sampler_new (buffer, format, type);
+  gegl_sampler_get_array (sampler, coordinates, SAMPLES, NULL, result,
+                          GEGL_ABYSS_CLAMP);
+  g_object_unref (sampler);
+
+  if (memcmp (expected, result, sizeof (result)))
+    {
+      printf ("gegl_sampler_get_array () differs for %d along %g,%g.\n",
+              type, dx, dy);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+test_sampler_get_n (void)
+{
+  const GeglSamplerType types[] = {GEGL_SAMPLER_NEAREST,
+                                   GEGL_SAMPLER_LINEAR,
+                                   GEGL_SAMPLER_CUBIC,
+                                   GEGL_SAMPLER_NOHALO,
+                                   GEGL_SAMPLER_LOHALO};
+  GeglBuffer *buffer  = noise_buffer ();
+  gboolean    success = TRUE;
+  gint        i;
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++)
+    {
+      success &= compare_line (buffer, types[i], 3.3, 7.7, 0.61, 0.07);
+      success &= compare_line (buffer, types[i], 190.2, 150.6, -0.53, -0.21);
+      success &= compare_line (buffer, types[i], 20.4, 10.1, 0.05, 0.57);
+      success &= compare_line (buffer, types[i], -5.5, 100.5, 3.7, -0.3);
+    }
+
+  g_object_unref (buffer);
+
+  return success;
+}
+
+/* the SIMD versions of the samplers against the scalar ones, within the
+ * tolerance documented in gegl-sampler-sse2.c
+ */
+static gboolean
+test_sampler_simd (void)
+{
+  const GeglSamplerType types[] = {GEGL_SAMPLER_LINEAR,
+                                   GEGL_SAMPLER_CUBIC};
+  const Babl *format  = babl_format ("RaGaBaA float");
+  GeglBuffer *buffer  = noise_buffer ();
+  gboolean    success = TRUE;
+  gint        i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++)
+    {
+      GeglSampler *sampler;
+      gfloat       expected[SAMPLES * 4];
+      gfloat       result[SAMPLES * 4];
+
+      gegl_cpu_accel_set_use (FALSE);
+      sampler = gegl_buffer_sampler_new (buffer, format, types[i]);
+      gegl_sampler_get_n (sampler, 3.3, 7.7, 0.61, 0.07, SAMPLES, NULL,
+                          expected, GEGL_ABYSS_CLAMP);
+      g_object_unref (sampler);
+
+      gegl_cpu_accel_set_use (TRUE);
+      sampler = gegl_buffer_sampler_new (buffer, format, types[i]);
+      gegl_sampler_get_n (sampler, 3.3, 7.7, 0.61, 0.07, SAMPLES, NULL,
+                          result, GEGL_ABYSS_CLAMP);
+      g_object_unref (sampler);
+
+      for (j = 0; j < SAMPLES * 4; j++)
+        if (fabsf (expected[j] - result[j]) > 1e-6)
+          {
+            printf ("The accelerated sampler %d differs at %d: %g, %g.\n",
+                    types[i], j / 4, expected[j], result[j]);
+            success = FALSE;
+            break;
+          }
+    }
+
+  g_object_unref (buffer);
+
+  return success;
+}
+
+#define RUN_TEST(test_name) \
+{ \
+  if (test_name()) \
+    { \
+      printf ("" #test_name " ... PASS\n"); \
+      tests_passed++; \
+    } \
+  else \
+    { \
+      printf ("" #test_name " ... FAIL\n"); \
+      tests_failed++; \
+    } \
+  tests_run++; \
+}
+
+int main(int argc, char **argv)
+{
+  gint tests_run    = 0;
+  gint tests_passed = 0;
+  gint tests_failed = 0;
+
+  gegl_init(0, NULL);
+  g_object_set(G_OBJECT(gegl_config()),
+               "swap", "RAM",
+               "use-opencl", FALSE,
+               NULL);
+
+  RUN_TEST (test_sampler_get_n)
+  RUN_TEST (test_sampler_simd)
+
+  gegl_exit();
+
+  if (tests_passed == tests_run)
+    return 0;
+  return -1;
+}